@@ -12,6 +12,14 @@ uniform vec4 colDiffuse;
 
 // NOTE: Add here your custom variables
 
+// LOD crossfade set by DrawScene: > 0 draws that share of the pixels of the
+// level fading in, < 0 the rest of them for the level fading out, so the two
+// levels never cover the same pixel
+uniform float lodFade;
+
+const float bayer[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0,
+                                  3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+
 #define     MAX_LIGHTS              4
 #define     LIGHT_DIRECTIONAL       0
 #define     LIGHT_POINT             1
@@ -34,6 +42,13 @@ out vec4 finalColor;
 
 void main()
 {
+    if (lodFade != 0.0)
+    {
+        ivec2 p = ivec2(gl_FragCoord.xy) % 4;
+        float threshold = (bayer[p.y*4 + p.x] + 0.5)/16.0;
+        if ((lodFade > 0.0) ? (threshold > lodFade) : (threshold <= -lodFade)) discard;
+    }
+
     // Texel color fetching from texture sampler
     vec4 texelColor = texture(texture0, fragTexCoord);
     vec3 lightDot = vec3(0.0);
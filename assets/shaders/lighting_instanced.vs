@@ -0,0 +1,34 @@
+#version 330
+
+// Input vertex attributes
+in vec3 vertexPosition;
+in vec2 vertexTexCoord;
+in vec3 vertexNormal;
+in vec4 vertexColor;
+
+// Per-instance model matrix, bound to SHADER_LOC_MATRIX_MODEL
+in mat4 instanceTransform;
+
+// Input uniform values
+uniform mat4 mvp;
+
+// Output vertex attributes (to fragment shader)
+out vec3 fragPosition;
+out vec2 fragTexCoord;
+out vec4 fragColor;
+out vec3 fragNormal;
+
+void main()
+{
+    // matNormal is not per instance, derive it from the instance transform
+    mat3 normalMatrix = transpose(inverse(mat3(instanceTransform)));
+
+    // Send vertex attributes to fragment shader
+    fragPosition = vec3(instanceTransform*vec4(vertexPosition, 1.0));
+    fragTexCoord = vertexTexCoord;
+    fragColor = vertexColor;
+    fragNormal = normalize(normalMatrix*vertexNormal);
+
+    // Calculate final vertex position, mvp holds view and projection only
+    gl_Position = mvp*vec4(fragPosition, 1.0);
+}
@@ -1,93 +1,1423 @@
 #include "collision.h"
+#include "gltf.h"
 #include <raylib.h>
 #include <raymath.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define COLLISION_MODEL_PATH "./assets/colliders.glb"
+// cooked from the model by tools/colcook.c
+#define COLLISION_COOKED_PATH "./assets/colliders.colbin"
 
 // Global debug flag
 static bool collision_debug_enabled = false;
 
-void collision_init(CollisionSystem *collisionSystem) {
-  // Load the colliders model
-  collisionSystem->colliderModel = LoadModel("./assets/colliders.glb");
+// Triangle BVH, built once per collision mesh with binned SAH splits so a
+// raycast only tests the triangles along its path
+#define COLLISION_BVH_BINS 12
+#define COLLISION_BVH_MAX_LEAF_SIZE 8
+#define COLLISION_BVH_MAX_DEPTH 48
+// cost of visiting a node relative to testing a triangle
+#define COLLISION_BVH_TRAVERSAL_COST 1.0f
+
+typedef struct CollisionBVHBuilder {
+  CollisionMesh *mesh;
+  BoundingBox *triangleBounds;
+  Vector3 *centroids;
+  int *triangles; // triangle order, partitioned in place
+} CollisionBVHBuilder;
+
+typedef struct CollisionBVHBin {
+  BoundingBox bounds;
+  int count;
+} CollisionBVHBin;
+
+static BoundingBox collision_empty_bounds(void) {
+  return (BoundingBox){{INFINITY, INFINITY, INFINITY},
+                       {-INFINITY, -INFINITY, -INFINITY}};
+}
+
+static BoundingBox collision_merge_bounds(BoundingBox a, BoundingBox b) {
+  return (BoundingBox){Vector3Min(a.min, b.min), Vector3Max(a.max, b.max)};
+}
+
+static float collision_bounds_area(BoundingBox bounds) {
+  Vector3 size = Vector3Subtract(bounds.max, bounds.min);
+  if (size.x < 0.0f || size.y < 0.0f || size.z < 0.0f) {
+    return 0.0f;
+  }
+  return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+// Copies the world-space corners of the mesh's triangle
+static void collision_get_triangle(const CollisionMesh *mesh, int triangle,
+                                   Vector3 corners[3]) {
+  const unsigned short *indices = &mesh->triangles[triangle * 3];
+  corners[0] = mesh->worldVertices[indices[0]];
+  corners[1] = mesh->worldVertices[indices[1]];
+  corners[2] = mesh->worldVertices[indices[2]];
+}
+
+static float collision_axis(Vector3 v, int axis) {
+  return axis == 0 ? v.x : axis == 1 ? v.y : v.z;
+}
+
+// Finds the cheapest binned SAH split of the range. Returns false if keeping
+// it as a leaf is cheaper or the centroids can't be told apart.
+static bool collision_bvh_find_split(const CollisionBVHBuilder *builder,
+                                     int first, int count,
+                                     BoundingBox centroidBounds, float area,
+                                     int *splitAxis, float *splitPosition) {
+  float bestCost = count * area;
+  bool found = false;
+  for (int axis = 0; axis < 3; axis++) {
+    float min = collision_axis(centroidBounds.min, axis);
+    float extent = collision_axis(centroidBounds.max, axis) - min;
+    if (extent <= 0.0f) {
+      continue;
+    }
+
+    CollisionBVHBin bins[COLLISION_BVH_BINS];
+    for (int b = 0; b < COLLISION_BVH_BINS; b++) {
+      bins[b] = (CollisionBVHBin){collision_empty_bounds(), 0};
+    }
+    float scale = COLLISION_BVH_BINS / extent;
+    for (int i = first; i < first + count; i++) {
+      int triangle = builder->triangles[i];
+      float centroid = collision_axis(builder->centroids[triangle], axis);
+      int b = (int)((centroid - min) * scale);
+      b = b < COLLISION_BVH_BINS ? b : COLLISION_BVH_BINS - 1;
+      bins[b].bounds =
+          collision_merge_bounds(bins[b].bounds,
+                                 builder->triangleBounds[triangle]);
+      bins[b].count++;
+    }
+
+    // sweep from the right, then evaluate each plane sweeping from the left
+    float rightArea[COLLISION_BVH_BINS];
+    int rightCount[COLLISION_BVH_BINS];
+    BoundingBox bounds = collision_empty_bounds();
+    int sum = 0;
+    for (int b = COLLISION_BVH_BINS - 1; b > 0; b--) {
+      bounds = collision_merge_bounds(bounds, bins[b].bounds);
+      sum += bins[b].count;
+      rightArea[b] = collision_bounds_area(bounds);
+      rightCount[b] = sum;
+    }
+    bounds = collision_empty_bounds();
+    sum = 0;
+    for (int b = 0; b < COLLISION_BVH_BINS - 1; b++) {
+      bounds = collision_merge_bounds(bounds, bins[b].bounds);
+      sum += bins[b].count;
+      if (sum == 0 || rightCount[b + 1] == 0) {
+        continue;
+      }
+      float cost = COLLISION_BVH_TRAVERSAL_COST * area +
+                   collision_bounds_area(bounds) * sum +
+                   rightArea[b + 1] * rightCount[b + 1];
+      if (cost < bestCost) {
+        bestCost = cost;
+        *splitAxis = axis;
+        *splitPosition = min + (b + 1) / scale;
+        found = true;
+      }
+    }
+  }
+  return found;
+}
+
+static void collision_bvh_build_node(CollisionBVHBuilder *builder, int node,
+                                     int first, int count, int depth) {
+  CollisionMesh *mesh = builder->mesh;
+  BoundingBox bounds = collision_empty_bounds();
+  BoundingBox centroidBounds = collision_empty_bounds();
+  for (int i = first; i < first + count; i++) {
+    int triangle = builder->triangles[i];
+    bounds = collision_merge_bounds(bounds, builder->triangleBounds[triangle]);
+    centroidBounds.min =
+        Vector3Min(centroidBounds.min, builder->centroids[triangle]);
+    centroidBounds.max =
+        Vector3Max(centroidBounds.max, builder->centroids[triangle]);
+  }
+  mesh->bvhNodes[node] = (CollisionBVHNode){bounds, first, count};
+  if (count <= 1 || depth >= COLLISION_BVH_MAX_DEPTH) {
+    return;
+  }
 
-  if (collisionSystem->colliderModel.meshCount == 0) {
-    TraceLog(LOG_ERROR, "Failed to load colliders.glb!");
-    collisionSystem->meshCount = 0;
+  int axis = 0;
+  float position = 0.0f;
+  int middle = first;
+  if (collision_bvh_find_split(builder, first, count, centroidBounds,
+                               collision_bounds_area(bounds), &axis,
+                               &position)) {
+    int last = first + count - 1;
+    while (middle <= last) {
+      int triangle = builder->triangles[middle];
+      if (collision_axis(builder->centroids[triangle], axis) < position) {
+        middle++;
+      } else {
+        builder->triangles[middle] = builder->triangles[last];
+        builder->triangles[last--] = triangle;
+      }
+    }
+  }
+  if (middle == first || middle == first + count) {
+    if (count <= COLLISION_BVH_MAX_LEAF_SIZE) {
+      return;
+    }
+    // too many triangles to keep, split them in order
+    middle = first + count / 2;
+  }
+
+  int children = mesh->bvhNodeCount;
+  mesh->bvhNodeCount += 2;
+  mesh->bvhNodes[node].first = children;
+  mesh->bvhNodes[node].count = 0;
+  collision_bvh_build_node(builder, children, first, middle - first,
+                           depth + 1);
+  collision_bvh_build_node(builder, children + 1, middle,
+                           first + count - middle, depth + 1);
+}
+
+// Builds the BVH over the mesh's world-space triangles and brings them into
+// leaf order
+static void collision_build_bvh(CollisionMesh *mesh) {
+  int triangleCount = mesh->triangleCount;
+  MemFree(mesh->bvhNodes);
+  mesh->bvhNodes = NULL;
+  mesh->bvhNodeCount = 0;
+  if (triangleCount == 0) {
     return;
   }
 
-  TraceLog(LOG_INFO, "Loaded colliders.glb with %d meshes",
-           collisionSystem->colliderModel.meshCount);
+  CollisionBVHBuilder builder = {
+      .mesh = mesh,
+      .triangleBounds = MemAlloc(sizeof(BoundingBox) * triangleCount),
+      .centroids = MemAlloc(sizeof(Vector3) * triangleCount),
+      .triangles = MemAlloc(sizeof(int) * triangleCount)};
+  for (int t = 0; t < triangleCount; t++) {
+    Vector3 triangle[3];
+    collision_get_triangle(mesh, t, triangle);
+    Vector3 a = triangle[0], b = triangle[1], c = triangle[2];
+    builder.triangleBounds[t] = (BoundingBox){Vector3Min(Vector3Min(a, b), c),
+                                              Vector3Max(Vector3Max(a, b), c)};
+    builder.centroids[t] = Vector3Scale(Vector3Add(Vector3Add(a, b), c),
+                                        1.0f / 3.0f);
+    builder.triangles[t] = t;
+  }
 
-  // Allocate memory for collision meshes
-  collisionSystem->meshCount = collisionSystem->colliderModel.meshCount;
-  collisionSystem->meshes = (CollisionMesh *)MemAlloc(
-      sizeof(CollisionMesh) * collisionSystem->meshCount);
+  mesh->bvhNodes = MemAlloc(sizeof(CollisionBVHNode) * 2 * triangleCount);
+  mesh->bvhNodeCount = 1;
+  collision_bvh_build_node(&builder, 0, 0, triangleCount, 0);
 
-  // Process each mesh in the collider model
-  for (int i = 0; i < collisionSystem->meshCount; i++) {
-    Mesh mesh = collisionSystem->colliderModel.meshes[i];
-    CollisionMesh *collMesh = &collisionSystem->meshes[i];
+  unsigned short *triangles =
+      MemAlloc(sizeof(unsigned short) * 3 * triangleCount);
+  for (int t = 0; t < triangleCount; t++) {
+    memcpy(&triangles[t * 3], &mesh->triangles[builder.triangles[t] * 3],
+           sizeof(unsigned short) * 3);
+  }
+  MemFree(mesh->triangles);
+  mesh->triangles = triangles;
+
+  MemFree(builder.triangleBounds);
+  MemFree(builder.centroids);
+  MemFree(builder.triangles);
+}
+
+// Distance along the ray to the box, INFINITY if it misses or the box starts
+// beyond maxDistance
+static float collision_ray_box(Vector3 origin, Vector3 inverseDirection,
+                               BoundingBox box, float maxDistance) {
+  float t1 = (box.min.x - origin.x) * inverseDirection.x;
+  float t2 = (box.max.x - origin.x) * inverseDirection.x;
+  float tMin = fminf(t1, t2), tMax = fmaxf(t1, t2);
+  t1 = (box.min.y - origin.y) * inverseDirection.y;
+  t2 = (box.max.y - origin.y) * inverseDirection.y;
+  tMin = fmaxf(tMin, fminf(t1, t2));
+  tMax = fminf(tMax, fmaxf(t1, t2));
+  t1 = (box.min.z - origin.z) * inverseDirection.z;
+  t2 = (box.max.z - origin.z) * inverseDirection.z;
+  tMin = fmaxf(tMin, fminf(t1, t2));
+  tMax = fminf(tMax, fmaxf(t1, t2));
+  return tMax >= fmaxf(tMin, 0.0f) && tMin <= maxDistance ? tMin : INFINITY;
+}
+
+// Moller-Trumbore, two sided like GetRayCollisionTriangle. Returns the
+// distance along the ray or INFINITY.
+static float collision_ray_triangle(Ray ray, Vector3 a, Vector3 b,
+                                    Vector3 c) {
+  Vector3 edge1 = Vector3Subtract(b, a);
+  Vector3 edge2 = Vector3Subtract(c, a);
+  Vector3 p = Vector3CrossProduct(ray.direction, edge2);
+  float determinant = Vector3DotProduct(edge1, p);
+  if (fabsf(determinant) < EPSILON) {
+    return INFINITY;
+  }
+
+  float inverse = 1.0f / determinant;
+  Vector3 toOrigin = Vector3Subtract(ray.position, a);
+  float u = Vector3DotProduct(toOrigin, p) * inverse;
+  if (u < 0.0f || u > 1.0f) {
+    return INFINITY;
+  }
+  Vector3 q = Vector3CrossProduct(toOrigin, edge1);
+  float v = Vector3DotProduct(ray.direction, q) * inverse;
+  if (v < 0.0f || u + v > 1.0f) {
+    return INFINITY;
+  }
+  float t = Vector3DotProduct(edge2, q) * inverse;
+  return t > EPSILON ? t : INFINITY;
+}
+
+// Closest hit of a ray up to maxDistance, nearest child first
+static bool collision_raycast_bvh(const CollisionMesh *mesh, Ray ray,
+                                  float maxDistance, RayCollision *hit) {
+  if (mesh->bvhNodeCount == 0) {
+    return false;
+  }
+
+  Vector3 inverseDirection = {1.0f / ray.direction.x, 1.0f / ray.direction.y,
+                              1.0f / ray.direction.z};
+  float closest = maxDistance;
+  int closestTriangle = -1;
+  int stack[COLLISION_BVH_MAX_DEPTH + 2];
+  int stackSize = 0;
+  if (collision_ray_box(ray.position, inverseDirection,
+                        mesh->bvhNodes[0].bounds, closest) < INFINITY) {
+    stack[stackSize++] = 0;
+  }
+
+  while (stackSize > 0) {
+    const CollisionBVHNode *node = &mesh->bvhNodes[stack[--stackSize]];
+    if (node->count > 0) {
+      for (int t = node->first; t < node->first + node->count; t++) {
+        Vector3 triangle[3];
+        collision_get_triangle(mesh, t, triangle);
+        float distance =
+            collision_ray_triangle(ray, triangle[0], triangle[1], triangle[2]);
+        if (distance <= closest) {
+          closest = distance;
+          closestTriangle = t;
+        }
+      }
+      continue;
+    }
+
+    int nearChild = node->first, farChild = node->first + 1;
+    float nearDistance =
+        collision_ray_box(ray.position, inverseDirection,
+                          mesh->bvhNodes[nearChild].bounds, closest);
+    float farDistance =
+        collision_ray_box(ray.position, inverseDirection,
+                          mesh->bvhNodes[farChild].bounds, closest);
+    if (farDistance < nearDistance) {
+      float distance = nearDistance;
+      nearDistance = farDistance;
+      farDistance = distance;
+      int child = nearChild;
+      nearChild = farChild;
+      farChild = child;
+    }
+    // entries further down are only looked at once the near child is done
+    if (farDistance < INFINITY) {
+      stack[stackSize++] = farChild;
+    }
+    if (nearDistance < INFINITY) {
+      stack[stackSize++] = nearChild;
+    }
+  }
+
+  if (closestTriangle < 0) {
+    return false;
+  }
+
+  Vector3 triangle[3];
+  collision_get_triangle(mesh, closestTriangle, triangle);
+  Vector3 edge1 = Vector3Subtract(triangle[1], triangle[0]);
+  Vector3 edge2 = Vector3Subtract(triangle[2], triangle[0]);
+  *hit = (RayCollision){
+      .hit = true,
+      .distance = closest,
+      .point = Vector3Add(ray.position, Vector3Scale(ray.direction, closest)),
+      .normal = Vector3Normalize(Vector3CrossProduct(edge1, edge2))};
+  return true;
+}
+
+// Ray packets trace several rays through the BVH together: every node is
+// fetched and tested once for all of them, and each triangle is set up once
+// and intersected with PACKET_LANES rays per instruction. The vector width
+// is picked at compile time; define COLLISION_NO_SIMD for the scalar path.
+#if !defined(COLLISION_NO_SIMD) && defined(__AVX__)
+#include <immintrin.h>
+#define PACKET_LANES 8
+typedef __m256 PacketFloat;
+typedef __m256 PacketMask;
+#define PacketLoad(p) _mm256_loadu_ps(p)
+#define PacketStore(p, v) _mm256_storeu_ps(p, v)
+#define PacketSet(x) _mm256_set1_ps(x)
+#define PacketAdd(a, b) _mm256_add_ps(a, b)
+#define PacketSub(a, b) _mm256_sub_ps(a, b)
+#define PacketMul(a, b) _mm256_mul_ps(a, b)
+#define PacketDiv(a, b) _mm256_div_ps(a, b)
+#define PacketMin(a, b) _mm256_min_ps(a, b)
+#define PacketMax(a, b) _mm256_max_ps(a, b)
+#define PacketLess(a, b) _mm256_cmp_ps(a, b, _CMP_LT_OQ)
+#define PacketLessEqual(a, b) _mm256_cmp_ps(a, b, _CMP_LE_OQ)
+#define PacketAnd(a, b) _mm256_and_ps(a, b)
+#define PacketMaskBits(m) _mm256_movemask_ps(m)
+#define PacketSelect(m, a, b) _mm256_blendv_ps(b, a, m)
+#elif !defined(COLLISION_NO_SIMD) && defined(__SSE__)
+#include <xmmintrin.h>
+#define PACKET_LANES 4
+typedef __m128 PacketFloat;
+typedef __m128 PacketMask;
+#define PacketLoad(p) _mm_loadu_ps(p)
+#define PacketStore(p, v) _mm_storeu_ps(p, v)
+#define PacketSet(x) _mm_set1_ps(x)
+#define PacketAdd(a, b) _mm_add_ps(a, b)
+#define PacketSub(a, b) _mm_sub_ps(a, b)
+#define PacketMul(a, b) _mm_mul_ps(a, b)
+#define PacketDiv(a, b) _mm_div_ps(a, b)
+#define PacketMin(a, b) _mm_min_ps(a, b)
+#define PacketMax(a, b) _mm_max_ps(a, b)
+#define PacketLess(a, b) _mm_cmplt_ps(a, b)
+#define PacketLessEqual(a, b) _mm_cmple_ps(a, b)
+#define PacketAnd(a, b) _mm_and_ps(a, b)
+#define PacketMaskBits(m) _mm_movemask_ps(m)
+#define PacketSelect(m, a, b) _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b))
+#elif !defined(COLLISION_NO_SIMD) && defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define PACKET_LANES 4
+typedef float32x4_t PacketFloat;
+typedef uint32x4_t PacketMask;
+#define PacketLoad(p) vld1q_f32(p)
+#define PacketStore(p, v) vst1q_f32(p, v)
+#define PacketSet(x) vdupq_n_f32(x)
+#define PacketAdd(a, b) vaddq_f32(a, b)
+#define PacketSub(a, b) vsubq_f32(a, b)
+#define PacketMul(a, b) vmulq_f32(a, b)
+#define PacketDiv(a, b) vdivq_f32(a, b)
+#define PacketMin(a, b) vminq_f32(a, b)
+#define PacketMax(a, b) vmaxq_f32(a, b)
+#define PacketLess(a, b) vcltq_f32(a, b)
+#define PacketLessEqual(a, b) vcleq_f32(a, b)
+#define PacketAnd(a, b) vandq_u32(a, b)
+#define PacketSelect(m, a, b) vbslq_f32(m, a, b)
+static inline int PacketMaskBits(uint32x4_t mask) {
+  const uint32x4_t bits = {1, 2, 4, 8};
+  return (int)vaddvq_u32(vandq_u32(mask, bits));
+}
+#else
+#define PACKET_LANES 1
+typedef float PacketFloat;
+typedef int PacketMask;
+#define PacketLoad(p) (*(p))
+#define PacketStore(p, v) (*(p) = (v))
+#define PacketSet(x) (x)
+#define PacketAdd(a, b) ((a) + (b))
+#define PacketSub(a, b) ((a) - (b))
+#define PacketMul(a, b) ((a) * (b))
+#define PacketDiv(a, b) ((a) / (b))
+#define PacketMin(a, b) fminf(a, b)
+#define PacketMax(a, b) fmaxf(a, b)
+#define PacketLess(a, b) ((a) < (b))
+#define PacketLessEqual(a, b) ((a) <= (b))
+#define PacketAnd(a, b) ((a) && (b))
+#define PacketMaskBits(m) (m)
+#define PacketSelect(m, a, b) ((m) ? (a) : (b))
+#endif
+
+// Rays in SoA, padded to whole groups of lanes. Padding lanes have a
+// negative closest distance, so their slabs are empty and they never hit
+// anything.
+typedef struct CollisionPacket {
+  float originX[COLLISION_PACKET_SIZE];
+  float originY[COLLISION_PACKET_SIZE];
+  float originZ[COLLISION_PACKET_SIZE];
+  float directionX[COLLISION_PACKET_SIZE];
+  float directionY[COLLISION_PACKET_SIZE];
+  float directionZ[COLLISION_PACKET_SIZE];
+  float inverseX[COLLISION_PACKET_SIZE];
+  float inverseY[COLLISION_PACKET_SIZE];
+  float inverseZ[COLLISION_PACKET_SIZE];
+  float closest[COLLISION_PACKET_SIZE];
+  float triangle[COLLISION_PACKET_SIZE]; // hit in the current mesh, or -1
+  int laneCount;
+} CollisionPacket;
+
+// Checks if any ray of the packet enters the box before its closest hit. The
+// exit is clamped to the closest hit, so the slab is empty for padding lanes
+// however far behind their origins the box lies.
+static bool collision_packet_hits_box(const CollisionPacket *packet,
+                                      BoundingBox box) {
+  PacketFloat minX = PacketSet(box.min.x), maxX = PacketSet(box.max.x);
+  PacketFloat minY = PacketSet(box.min.y), maxY = PacketSet(box.max.y);
+  PacketFloat minZ = PacketSet(box.min.z), maxZ = PacketSet(box.max.z);
+  PacketFloat zero = PacketSet(0.0f);
+  for (int i = 0; i < packet->laneCount; i += PACKET_LANES) {
+    PacketFloat origin = PacketLoad(&packet->originX[i]);
+    PacketFloat inverse = PacketLoad(&packet->inverseX[i]);
+    PacketFloat t1 = PacketMul(PacketSub(minX, origin), inverse);
+    PacketFloat t2 = PacketMul(PacketSub(maxX, origin), inverse);
+    PacketFloat tMin = PacketMin(t1, t2), tMax = PacketMax(t1, t2);
+    origin = PacketLoad(&packet->originY[i]);
+    inverse = PacketLoad(&packet->inverseY[i]);
+    t1 = PacketMul(PacketSub(minY, origin), inverse);
+    t2 = PacketMul(PacketSub(maxY, origin), inverse);
+    tMin = PacketMax(tMin, PacketMin(t1, t2));
+    tMax = PacketMin(tMax, PacketMax(t1, t2));
+    origin = PacketLoad(&packet->originZ[i]);
+    inverse = PacketLoad(&packet->inverseZ[i]);
+    t1 = PacketMul(PacketSub(minZ, origin), inverse);
+    t2 = PacketMul(PacketSub(maxZ, origin), inverse);
+    tMin = PacketMax(tMin, PacketMin(t1, t2));
+    tMax = PacketMin(tMax, PacketMax(t1, t2));
+
+    PacketFloat closest = PacketLoad(&packet->closest[i]);
+    PacketMask hit =
+        PacketLessEqual(PacketMax(tMin, zero), PacketMin(tMax, closest));
+    if (PacketMaskBits(hit)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Moller-Trumbore like collision_ray_triangle, for every ray of the packet
+static void collision_packet_triangle(CollisionPacket *packet, Vector3 a,
+                                      Vector3 b, Vector3 c, int triangle) {
+  PacketFloat ax = PacketSet(a.x), ay = PacketSet(a.y), az = PacketSet(a.z);
+  PacketFloat e1x = PacketSet(b.x - a.x), e1y = PacketSet(b.y - a.y);
+  PacketFloat e1z = PacketSet(b.z - a.z);
+  PacketFloat e2x = PacketSet(c.x - a.x), e2y = PacketSet(c.y - a.y);
+  PacketFloat e2z = PacketSet(c.z - a.z);
+  PacketFloat zero = PacketSet(0.0f), one = PacketSet(1.0f);
+  PacketFloat epsilon = PacketSet(EPSILON);
+  PacketFloat index = PacketSet((float)triangle);
+  for (int i = 0; i < packet->laneCount; i += PACKET_LANES) {
+    PacketFloat dx = PacketLoad(&packet->directionX[i]);
+    PacketFloat dy = PacketLoad(&packet->directionY[i]);
+    PacketFloat dz = PacketLoad(&packet->directionZ[i]);
+    PacketFloat px = PacketSub(PacketMul(dy, e2z), PacketMul(dz, e2y));
+    PacketFloat py = PacketSub(PacketMul(dz, e2x), PacketMul(dx, e2z));
+    PacketFloat pz = PacketSub(PacketMul(dx, e2y), PacketMul(dy, e2x));
+    PacketFloat determinant = PacketAdd(
+        PacketAdd(PacketMul(e1x, px), PacketMul(e1y, py)), PacketMul(e1z, pz));
+    PacketFloat inverse = PacketDiv(one, determinant);
+
+    PacketFloat sx = PacketSub(PacketLoad(&packet->originX[i]), ax);
+    PacketFloat sy = PacketSub(PacketLoad(&packet->originY[i]), ay);
+    PacketFloat sz = PacketSub(PacketLoad(&packet->originZ[i]), az);
+    PacketFloat u = PacketMul(
+        PacketAdd(PacketAdd(PacketMul(sx, px), PacketMul(sy, py)),
+                  PacketMul(sz, pz)),
+        inverse);
+    PacketFloat qx = PacketSub(PacketMul(sy, e1z), PacketMul(sz, e1y));
+    PacketFloat qy = PacketSub(PacketMul(sz, e1x), PacketMul(sx, e1z));
+    PacketFloat qz = PacketSub(PacketMul(sx, e1y), PacketMul(sy, e1x));
+    PacketFloat v = PacketMul(
+        PacketAdd(PacketAdd(PacketMul(dx, qx), PacketMul(dy, qy)),
+                  PacketMul(dz, qz)),
+        inverse);
+    PacketFloat t = PacketMul(
+        PacketAdd(PacketAdd(PacketMul(e2x, qx), PacketMul(e2y, qy)),
+                  PacketMul(e2z, qz)),
+        inverse);
+
+    PacketFloat closest = PacketLoad(&packet->closest[i]);
+    PacketFloat absDeterminant =
+        PacketMax(determinant, PacketSub(zero, determinant));
+    PacketMask hit = PacketAnd(PacketLessEqual(epsilon, absDeterminant),
+                               PacketLessEqual(zero, u));
+    hit = PacketAnd(hit, PacketLessEqual(zero, v));
+    hit = PacketAnd(hit, PacketLessEqual(PacketAdd(u, v), one));
+    hit = PacketAnd(hit, PacketLess(epsilon, t));
+    hit = PacketAnd(hit, PacketLessEqual(t, closest));
+    if (PacketMaskBits(hit)) {
+      PacketStore(&packet->closest[i], PacketSelect(hit, t, closest));
+      PacketStore(&packet->triangle[i],
+                  PacketSelect(hit, index,
+                               PacketLoad(&packet->triangle[i])));
+    }
+  }
+}
+
+// Traces the packet through a mesh's BVH, the nearer child first as seen
+// along the first ray
+static void collision_packet_traverse(CollisionPacket *packet,
+                                      const CollisionMesh *mesh) {
+  if (mesh->bvhNodeCount == 0) {
+    return;
+  }
+
+  Vector3 direction = {packet->directionX[0], packet->directionY[0],
+                       packet->directionZ[0]};
+  int stack[COLLISION_BVH_MAX_DEPTH + 2];
+  int stackSize = 0;
+  stack[stackSize++] = 0;
+  while (stackSize > 0) {
+    const CollisionBVHNode *node = &mesh->bvhNodes[stack[--stackSize]];
+    if (!collision_packet_hits_box(packet, node->bounds)) {
+      continue;
+    }
+
+    if (node->count > 0) {
+      for (int t = node->first; t < node->first + node->count; t++) {
+        Vector3 triangle[3];
+        collision_get_triangle(mesh, t, triangle);
+        collision_packet_triangle(packet, triangle[0], triangle[1],
+                                  triangle[2], t);
+      }
+      continue;
+    }
+
+    const CollisionBVHNode *left = &mesh->bvhNodes[node->first];
+    const CollisionBVHNode *right = &mesh->bvhNodes[node->first + 1];
+    Vector3 between = Vector3Subtract(
+        Vector3Add(right->bounds.min, right->bounds.max),
+        Vector3Add(left->bounds.min, left->bounds.max));
+    bool rightFirst = Vector3DotProduct(between, direction) < 0.0f;
+    stack[stackSize++] = node->first + !rightFirst;
+    stack[stackSize++] = node->first + rightFirst;
+  }
+}
+
+// Capsule sweeps keep this gap between a moved capsule and the geometry, so
+// the next sweep doesn't start in contact
+#define COLLISION_SKIN 0.01f
+// a sweep stops when the capsule is this close to a triangle
+#define COLLISION_SWEEP_TOLERANCE 0.001f
+#define COLLISION_SWEEP_STEPS 16
+#define COLLISION_MOVE_ITERATIONS 4
+#define COLLISION_DEPENETRATION_ITERATIONS 4
+
+typedef void (*CollisionTriangleVisitor)(Vector3 a, Vector3 b, Vector3 c,
+                                         void *data);
+
+// Calls visitor for the triangles of every BVH leaf that overlaps box
+static void collision_bvh_visit_box(const CollisionMesh *mesh,
+                                    BoundingBox box,
+                                    CollisionTriangleVisitor visitor,
+                                    void *data) {
+  if (mesh->bvhNodeCount == 0) {
+    return;
+  }
+
+  int stack[COLLISION_BVH_MAX_DEPTH + 2];
+  int stackSize = 0;
+  stack[stackSize++] = 0;
+  while (stackSize > 0) {
+    const CollisionBVHNode *node = &mesh->bvhNodes[stack[--stackSize]];
+    if (!CheckCollisionBoxes(node->bounds, box)) {
+      continue;
+    }
+
+    if (node->count > 0) {
+      for (int t = node->first; t < node->first + node->count; t++) {
+        Vector3 triangle[3];
+        collision_get_triangle(mesh, t, triangle);
+        visitor(triangle[0], triangle[1], triangle[2], data);
+      }
+      continue;
+    }
+    stack[stackSize++] = node->first;
+    stack[stackSize++] = node->first + 1;
+  }
+}
+
+// Closest point of the triangle to p, by the Voronoi region p falls in
+static Vector3 collision_closest_point_triangle(Vector3 p, Vector3 a,
+                                                Vector3 b, Vector3 c) {
+  Vector3 ab = Vector3Subtract(b, a);
+  Vector3 ac = Vector3Subtract(c, a);
+  Vector3 ap = Vector3Subtract(p, a);
+  float d1 = Vector3DotProduct(ab, ap), d2 = Vector3DotProduct(ac, ap);
+  if (d1 <= 0.0f && d2 <= 0.0f) {
+    return a;
+  }
+
+  Vector3 bp = Vector3Subtract(p, b);
+  float d3 = Vector3DotProduct(ab, bp), d4 = Vector3DotProduct(ac, bp);
+  if (d3 >= 0.0f && d4 <= d3) {
+    return b;
+  }
+  float vc = d1 * d4 - d3 * d2;
+  if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+    return Vector3Add(a, Vector3Scale(ab, d1 / (d1 - d3)));
+  }
+
+  Vector3 cp = Vector3Subtract(p, c);
+  float d5 = Vector3DotProduct(ab, cp), d6 = Vector3DotProduct(ac, cp);
+  if (d6 >= 0.0f && d5 <= d6) {
+    return c;
+  }
+  float vb = d5 * d2 - d1 * d6;
+  if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+    return Vector3Add(a, Vector3Scale(ac, d2 / (d2 - d6)));
+  }
+  float va = d3 * d6 - d5 * d4;
+  if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f) {
+    float w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+    return Vector3Add(b, Vector3Scale(Vector3Subtract(c, b), w));
+  }
+
+  float denominator = 1.0f / (va + vb + vc);
+  return Vector3Add(a, Vector3Add(Vector3Scale(ab, vb * denominator),
+                                  Vector3Scale(ac, vc * denominator)));
+}
+
+// Closest points of the segments p1-q1 and p2-q2
+static void collision_closest_points_segments(Vector3 p1, Vector3 q1,
+                                              Vector3 p2, Vector3 q2,
+                                              Vector3 *c1, Vector3 *c2) {
+  Vector3 d1 = Vector3Subtract(q1, p1);
+  Vector3 d2 = Vector3Subtract(q2, p2);
+  Vector3 r = Vector3Subtract(p1, p2);
+  float a = Vector3DotProduct(d1, d1), e = Vector3DotProduct(d2, d2);
+  float f = Vector3DotProduct(d2, r);
+  float s = 0.0f, t = 0.0f;
+  if (a <= EPSILON && e > EPSILON) {
+    t = Clamp(f / e, 0.0f, 1.0f);
+  } else if (a > EPSILON) {
+    float c = Vector3DotProduct(d1, r);
+    if (e <= EPSILON) {
+      s = Clamp(-c / a, 0.0f, 1.0f);
+    } else {
+      float b = Vector3DotProduct(d1, d2);
+      float denominator = a * e - b * b;
+      s = denominator > 0.0f ? Clamp((b * f - c * e) / denominator, 0.0f, 1.0f)
+                             : 0.0f;
+      t = (b * s + f) / e;
+      if (t < 0.0f) {
+        t = 0.0f;
+        s = Clamp(-c / a, 0.0f, 1.0f);
+      } else if (t > 1.0f) {
+        t = 1.0f;
+        s = Clamp((b - c) / a, 0.0f, 1.0f);
+      }
+    }
+  }
+  *c1 = Vector3Add(p1, Vector3Scale(d1, s));
+  *c2 = Vector3Add(p2, Vector3Scale(d2, t));
+}
+
+// Distance between the segment p-q and the triangle, with the closest points
+static float collision_segment_triangle(Vector3 p, Vector3 q, Vector3 a,
+                                        Vector3 b, Vector3 c,
+                                        Vector3 *onSegment,
+                                        Vector3 *onTriangle) {
+  Vector3 segment = Vector3Subtract(q, p);
+  float crossing = collision_ray_triangle((Ray){p, segment}, a, b, c);
+  if (crossing <= 1.0f) {
+    *onSegment = *onTriangle = Vector3Add(p, Vector3Scale(segment, crossing));
+    return 0.0f;
+  }
+
+  // otherwise the closest points involve an end of the segment or an edge
+  Vector3 ends[2] = {p, q};
+  float best = INFINITY;
+  for (int i = 0; i < 2; i++) {
+    Vector3 point = collision_closest_point_triangle(ends[i], a, b, c);
+    float distance = Vector3Distance(ends[i], point);
+    if (distance < best) {
+      best = distance;
+      *onSegment = ends[i];
+      *onTriangle = point;
+    }
+  }
+  Vector3 edges[3][2] = {{a, b}, {b, c}, {c, a}};
+  for (int i = 0; i < 3; i++) {
+    Vector3 segmentPoint, edgePoint;
+    collision_closest_points_segments(p, q, edges[i][0], edges[i][1],
+                                      &segmentPoint, &edgePoint);
+    float distance = Vector3Distance(segmentPoint, edgePoint);
+    if (distance < best) {
+      best = distance;
+      *onSegment = segmentPoint;
+      *onTriangle = edgePoint;
+    }
+  }
+  return best;
+}
+
+// Direction from the triangle towards the capsule at their closest points.
+// Touching or crossing capsules use the face normal, turned to the capsule.
+static Vector3 collision_contact_normal(Vector3 onSegment, Vector3 onTriangle,
+                                        Vector3 center, Vector3 a, Vector3 b,
+                                        Vector3 c) {
+  Vector3 normal = Vector3Subtract(onSegment, onTriangle);
+  float length = Vector3Length(normal);
+  if (length > EPSILON) {
+    return Vector3Scale(normal, 1.0f / length);
+  }
+
+  normal = Vector3CrossProduct(Vector3Subtract(b, a), Vector3Subtract(c, a));
+  length = Vector3Length(normal);
+  if (length <= EPSILON) {
+    return (Vector3){0.0f, 1.0f, 0.0f};
+  }
+  normal = Vector3Scale(normal, 1.0f / length);
+  return Vector3DotProduct(normal, Vector3Subtract(center, a)) < 0.0f
+             ? Vector3Negate(normal)
+             : normal;
+}
+
+// A capsule swept through the meshes; result.time starts at 1 and only
+// earlier hits replace it
+typedef struct CollisionSweepQuery {
+  CollisionCapsule capsule;
+  Vector3 motion;
+  float motionLength;
+  CollisionSweep result;
+} CollisionSweepQuery;
+
+// Conservative advancement: the capsule can't get closer to the triangle
+// than by the length it moves, so moving it by its gap never tunnels. The
+// gap only shrinks towards the first contact, as the distance between two
+// convex shapes moving apart linearly is convex in time.
+static void collision_sweep_triangle(Vector3 a, Vector3 b, Vector3 c,
+                                     void *data) {
+  CollisionSweepQuery *query = data;
+  CollisionCapsule capsule = query->capsule;
+  float time = 0.0f;
+  for (int step = 0; step < COLLISION_SWEEP_STEPS; step++) {
+    Vector3 offset = Vector3Scale(query->motion, time);
+    Vector3 start = Vector3Add(capsule.start, offset);
+    Vector3 end = Vector3Add(capsule.end, offset);
+    Vector3 onSegment, onTriangle;
+    float gap = collision_segment_triangle(start, end, a, b, c, &onSegment,
+                                           &onTriangle) -
+                capsule.radius;
+    if (gap <= COLLISION_SWEEP_TOLERANCE || step == COLLISION_SWEEP_STEPS - 1) {
+      Vector3 center = Vector3Scale(Vector3Add(start, end), 0.5f);
+      Vector3 normal = collision_contact_normal(onSegment, onTriangle, center,
+                                                a, b, c);
+      // surfaces the capsule moves along or away from don't stop it
+      if (Vector3DotProduct(normal, query->motion) < 0.0f) {
+        query->result = (CollisionSweep){.hit = true,
+                                         .time = time,
+                                         .point = onTriangle,
+                                         .normal = normal};
+      }
+      return;
+    }
+
+    time += gap / query->motionLength;
+    if (time >= query->result.time) {
+      return;
+    }
+  }
+}
+
+// The deepest overlap of a capsule with the triangles it is tested against
+typedef struct CollisionPenetration {
+  CollisionCapsule capsule;
+  float depth;
+  Vector3 normal;
+} CollisionPenetration;
+
+static void collision_penetrate_triangle(Vector3 a, Vector3 b, Vector3 c,
+                                         void *data) {
+  CollisionPenetration *penetration = data;
+  CollisionCapsule capsule = penetration->capsule;
+  Vector3 onSegment, onTriangle;
+  float depth = capsule.radius - collision_segment_triangle(
+                                     capsule.start, capsule.end, a, b, c,
+                                     &onSegment, &onTriangle);
+  if (depth > penetration->depth) {
+    Vector3 center = Vector3Scale(Vector3Add(capsule.start, capsule.end), 0.5f);
+    penetration->depth = depth;
+    penetration->normal =
+        collision_contact_normal(onSegment, onTriangle, center, a, b, c);
+  }
+}
+
+static BoundingBox collision_capsule_bounds(CollisionCapsule capsule,
+                                            float margin) {
+  float extent = capsule.radius + margin;
+  Vector3 extents = {extent, extent, extent};
+  return (BoundingBox){
+      Vector3Subtract(Vector3Min(capsule.start, capsule.end), extents),
+      Vector3Add(Vector3Max(capsule.start, capsule.end), extents)};
+}
+
+static CollisionCapsule collision_character_capsule(
+    const CollisionCharacter *character, Vector3 position) {
+  float half = fmaxf(character->height * 0.5f - character->radius, 0.0f);
+  return (CollisionCapsule){{position.x, position.y - half, position.z},
+                            {position.x, position.y + half, position.z},
+                            character->radius};
+}
+
+// Merges the vertices of the mesh at the same position, placed by transform,
+// and keeps its triangles that still have three distinct corners. Returns
+// false if more vertices are left than unsigned short indices reach.
+static bool collision_weld_mesh(CollisionMesh *collMesh, Mesh mesh,
+                                Matrix transform) {
+  int capacity = 1;
+  while (capacity < mesh.vertexCount * 2) {
+    capacity <<= 1;
+  }
+  // welded vertex + 1 by position hash, 0 for empty slots
+  int *table = MemAlloc(sizeof(int) * capacity);
+  int *welded = MemAlloc(sizeof(int) * (mesh.vertexCount + 1));
+  Vector3 *vertices = MemAlloc(sizeof(Vector3) * (mesh.vertexCount + 1));
+  int vertexCount = 0;
+  for (int v = 0; v < mesh.vertexCount; v++) {
+    Vector3 vertex = Vector3Transform(
+        (Vector3){mesh.vertices[v * 3], mesh.vertices[v * 3 + 1],
+                  mesh.vertices[v * 3 + 2]},
+        transform);
+    unsigned int bits[3];
+    memcpy(bits, &vertex, sizeof(bits));
+    unsigned int slot =
+        (bits[0] * 73856093u ^ bits[1] * 19349663u ^ bits[2] * 83492791u) &
+        (capacity - 1);
+    while (table[slot] &&
+           memcmp(&vertices[table[slot] - 1], &vertex, sizeof(Vector3)) != 0) {
+      slot = (slot + 1) & (capacity - 1);
+    }
+    if (!table[slot]) {
+      vertices[vertexCount] = vertex;
+      table[slot] = ++vertexCount;
+    }
+    welded[v] = table[slot] - 1;
+  }
+  MemFree(table);
+
+  if (vertexCount > 65536) {
+    MemFree(welded);
+    MemFree(vertices);
+    return false;
+  }
+
+  int cornerCount =
+      mesh.indices ? mesh.triangleCount * 3 : mesh.vertexCount / 3 * 3;
+  unsigned short *triangles =
+      MemAlloc(sizeof(unsigned short) * (cornerCount + 1));
+  int triangleCount = 0;
+  for (int c = 0; c < cornerCount; c += 3) {
+    int corners[3];
+    bool valid = true;
+    for (int k = 0; k < 3; k++) {
+      int vertex = mesh.indices ? mesh.indices[c + k] : c + k;
+      valid = valid && vertex < mesh.vertexCount;
+      corners[k] = valid ? welded[vertex] : 0;
+    }
+    if (!valid || corners[0] == corners[1] || corners[1] == corners[2] ||
+        corners[2] == corners[0]) {
+      continue;
+    }
+    for (int k = 0; k < 3; k++) {
+      triangles[triangleCount * 3 + k] = (unsigned short)corners[k];
+    }
+    triangleCount++;
+  }
+  MemFree(welded);
+
+  collMesh->vertices = vertices;
+  collMesh->vertexCount = vertexCount;
+  collMesh->triangles = triangles;
+  collMesh->triangleCount = triangleCount;
+  return true;
+}
+
+// Transforms the mesh's vertices into world space and rebuilds its bounds
+// and BVH around them
+static void collision_bake_mesh(CollisionMesh *mesh) {
+  MemFree(mesh->worldVertices);
+  mesh->worldVertices = MemAlloc(sizeof(Vector3) * (mesh->vertexCount + 1));
+  mesh->bbox = collision_empty_bounds();
+  for (int v = 0; v < mesh->vertexCount; v++) {
+    Vector3 vertex = Vector3Transform(mesh->vertices[v], mesh->transform);
+    mesh->worldVertices[v] = vertex;
+    mesh->bbox.min = Vector3Min(mesh->bbox.min, vertex);
+    mesh->bbox.max = Vector3Max(mesh->bbox.max, vertex);
+  }
+  collision_build_bvh(mesh);
+}
+
+// Gives a mesh that points into a cooked file arrays of its own, so it can be
+// baked again
+static void collision_uncook_mesh(CollisionMesh *mesh) {
+  Vector3 *vertices = MemAlloc(sizeof(Vector3) * (mesh->vertexCount + 1));
+  memcpy(vertices, mesh->vertices, sizeof(Vector3) * mesh->vertexCount);
+  unsigned short *triangles =
+      MemAlloc(sizeof(unsigned short) * (mesh->triangleCount * 3 + 1));
+  memcpy(triangles, mesh->triangles,
+         sizeof(unsigned short) * mesh->triangleCount * 3);
+  mesh->vertices = vertices;
+  mesh->triangles = triangles;
+  mesh->worldVertices = NULL;
+  mesh->bvhNodes = NULL;
+  mesh->bvhNodeCount = 0;
+  mesh->cooked = false;
+}
+
+// World transform of a glTF node, the way raylib's model loader bakes it
+// into the node's meshes
+static Matrix collision_gltf_node_transform(const GLTFDocument *document,
+                                            int node) {
+  Matrix transform = MatrixIdentity();
+  for (int depth = 0; node >= 0 && depth < document->nodeCount; depth++) {
+    const GLTFNode *gltfNode = &document->nodes[node];
+    Matrix local = MatrixMultiply(
+        MatrixMultiply(MatrixScale(gltfNode->scale.x, gltfNode->scale.y,
+                                   gltfNode->scale.z),
+                       QuaternionToMatrix(gltfNode->rotation)),
+        MatrixTranslate(gltfNode->translation.x, gltfNode->translation.y,
+                        gltfNode->translation.z));
+    transform = MatrixMultiply(transform, local);
+    node = gltfNode->parent;
+  }
+  return transform;
+}
+
+bool collision_init_gltf(CollisionSystem *collisionSystem,
+                         const char *fileName, Matrix transform) {
+  collisionSystem->meshes = NULL;
+  collisionSystem->meshCount = 0;
+  GLTFDocument document;
+  if (!LoadGLTFDocument(fileName, &document)) {
+    TraceLog(LOG_ERROR, "Failed to load %s!", fileName);
+    return false;
+  }
+
+  // one collision mesh for every primitive of every node, like LoadModel
+  int primitiveCount = 0;
+  for (int n = 0; n < document.nodeCount; n++) {
+    if (document.nodes[n].mesh >= 0) {
+      primitiveCount += document.meshes[document.nodes[n].mesh].primitiveCount;
+    }
+  }
+  collisionSystem->meshes =
+      (CollisionMesh *)MemAlloc(sizeof(CollisionMesh) * (primitiveCount + 1));
+
+  for (int n = 0; n < document.nodeCount; n++) {
+    const GLTFNode *node = &document.nodes[n];
+    if (node->mesh < 0) {
+      continue;
+    }
+
+    Matrix nodeTransform = collision_gltf_node_transform(&document, n);
+    const GLTFMesh *gltfMesh = &document.meshes[node->mesh];
+    for (int p = 0; p < gltfMesh->primitiveCount; p++) {
+      CollisionMesh *collMesh =
+          &collisionSystem->meshes[collisionSystem->meshCount];
+      if (!collision_weld_mesh(collMesh, gltfMesh->primitives[p],
+                               nodeTransform)) {
+        TraceLog(LOG_WARNING, "Collision mesh %s has too many vertices",
+                 node->name ? node->name : "");
+        continue;
+      }
+
+      // Place the mesh in the world (can be moved later for dynamic objects)
+      collMesh->transform = transform;
+      collision_bake_mesh(collMesh);
+
+      // Set name
+      if (node->name) {
+        snprintf(collMesh->name, sizeof(collMesh->name), "%s", node->name);
+      } else {
+        snprintf(collMesh->name, sizeof(collMesh->name), "Collider_%d",
+                 collisionSystem->meshCount);
+      }
+
+      TraceLog(LOG_INFO,
+               "Collision mesh %s: %d vertices, %d triangles, %d BVH nodes, "
+               "bbox: (%.2f,%.2f,%.2f) to (%.2f,%.2f,%.2f)",
+               collMesh->name, collMesh->vertexCount, collMesh->triangleCount,
+               collMesh->bvhNodeCount, collMesh->bbox.min.x,
+               collMesh->bbox.min.y, collMesh->bbox.min.z,
+               collMesh->bbox.max.x, collMesh->bbox.max.y,
+               collMesh->bbox.max.z);
+      collisionSystem->meshCount++;
+    }
+  }
+  UnloadGLTFDocument(&document);
+
+  TraceLog(LOG_INFO, "Loaded %s with %d collision meshes", fileName,
+           collisionSystem->meshCount);
+  return true;
+}
+
+// Cooked collision files hold the meshes as they are after welding, baking
+// and the BVH build, as flat arrays referenced by offsets from the start of
+// the file: collision_load maps the file and points the meshes into the
+// mapping, nothing is copied or parsed. The layout is native endian; the
+// version is bumped whenever it changes.
+#define COLLISION_COOKED_MAGIC 0x424c4f43u // "COLB"
+#define COLLISION_COOKED_VERSION 1u
+#define COLLISION_COOKED_ALIGNMENT 16
+
+typedef struct CollisionCookedHeader {
+  unsigned int magic;
+  unsigned int version;
+  unsigned long long fileSize;
+  unsigned long long meshes; // offset of the CollisionCookedMesh array
+  unsigned int meshCount;
+} CollisionCookedHeader;
+
+// a CollisionMesh with its arrays as offsets
+typedef struct CollisionCookedMesh {
+  unsigned long long vertices, worldVertices, triangles, bvhNodes;
+  int vertexCount, triangleCount, bvhNodeCount;
+  Matrix transform;
+  BoundingBox bbox;
+  char name[64];
+} CollisionCookedMesh;
+
+typedef struct CollisionCookedWriter {
+  unsigned char *data;
+  unsigned long size;
+  unsigned long capacity;
+} CollisionCookedWriter;
+
+// appends an aligned copy of data, returns its offset
+static unsigned long long collision_write(CollisionCookedWriter *writer,
+                                          const void *data,
+                                          unsigned long size) {
+  unsigned long offset = (writer->size + COLLISION_COOKED_ALIGNMENT - 1) &
+                         ~(unsigned long)(COLLISION_COOKED_ALIGNMENT - 1);
+  if (offset + size > writer->capacity) {
+    while (offset + size > writer->capacity) {
+      writer->capacity = writer->capacity == 0 ? 4096 : writer->capacity * 2;
+    }
+    writer->data = MemRealloc(writer->data, writer->capacity);
+  }
+
+  memset(writer->data + writer->size, 0, offset - writer->size);
+  if (size > 0) {
+    memcpy(writer->data + offset, data, size);
+  }
+  writer->size = offset + size;
+  return offset;
+}
+
+// Maps the file read only; falls back to reading it where mmap isn't there
+static unsigned char *collision_map_file(const char *fileName,
+                                         unsigned long *size) {
+#if defined(_WIN32)
+  int dataSize = 0;
+  unsigned char *data = LoadFileData(fileName, &dataSize);
+  *size = dataSize;
+  return data;
+#else
+  int file = open(fileName, O_RDONLY);
+  if (file < 0) {
+    return 0;
+  }
 
-    // Calculate bounding box
-    collMesh->bbox = GetMeshBoundingBox(mesh);
+  struct stat info;
+  void *data = MAP_FAILED;
+  if (fstat(file, &info) == 0 && info.st_size > 0) {
+    *size = info.st_size;
+    data = mmap(0, *size, PROT_READ, MAP_PRIVATE, file, 0);
+  }
+  close(file);
+  return data == MAP_FAILED ? 0 : data;
+#endif
+}
+
+static void collision_unmap_file(unsigned char *data, unsigned long size) {
+#if defined(_WIN32)
+  (void)size;
+  UnloadFileData(data);
+#else
+  munmap(data, size);
+#endif
+}
 
-    // Copy vertex data
-    collMesh->vertexCount = mesh.vertexCount;
-    collMesh->vertices =
-        (Vector3 *)MemAlloc(sizeof(Vector3) * mesh.vertexCount);
+// Relocates a section offset against the mapping. Returns 0 if the range
+// isn't inside the file or misaligned.
+static void *collision_get_section(unsigned char *data, unsigned long size,
+                                   unsigned long long offset,
+                                   unsigned long long count,
+                                   unsigned long long elementSize) {
+  if (offset == 0 || offset % COLLISION_COOKED_ALIGNMENT != 0 ||
+      offset > size || count > (size - offset) / elementSize) {
+    return 0;
+  }
+  return data + offset;
+}
 
-    for (int v = 0; v < mesh.vertexCount; v++) {
-      collMesh->vertices[v] =
-          (Vector3){mesh.vertices[v * 3], mesh.vertices[v * 3 + 1],
-                    mesh.vertices[v * 3 + 2]};
+// Points the mesh into the mapping and checks that every index stays inside
+// its arrays and the BVH is no deeper than the traversal stacks allow
+static bool collision_load_cooked_mesh(unsigned char *data, unsigned long size,
+                                       const CollisionCookedMesh *cooked,
+                                       CollisionMesh *mesh) {
+  if (cooked->vertexCount < 0 || cooked->vertexCount > 65536 ||
+      cooked->triangleCount < 0 || cooked->bvhNodeCount < 0 ||
+      cooked->bvhNodeCount > 2 * cooked->triangleCount ||
+      (cooked->triangleCount > 0) != (cooked->bvhNodeCount > 0)) {
+    return false;
+  }
+
+  *mesh = (CollisionMesh){.vertexCount = cooked->vertexCount,
+                          .triangleCount = cooked->triangleCount,
+                          .bvhNodeCount = cooked->bvhNodeCount,
+                          .transform = cooked->transform,
+                          .bbox = cooked->bbox,
+                          .cooked = true};
+  memcpy(mesh->name, cooked->name, sizeof(mesh->name) - 1);
+  mesh->vertices = collision_get_section(data, size, cooked->vertices,
+                                         cooked->vertexCount, sizeof(Vector3));
+  mesh->worldVertices =
+      collision_get_section(data, size, cooked->worldVertices,
+                            cooked->vertexCount, sizeof(Vector3));
+  mesh->triangles =
+      collision_get_section(data, size, cooked->triangles,
+                            cooked->triangleCount * 3ull,
+                            sizeof(unsigned short));
+  mesh->bvhNodes =
+      collision_get_section(data, size, cooked->bvhNodes,
+                            cooked->bvhNodeCount, sizeof(CollisionBVHNode));
+  if (!mesh->vertices || !mesh->worldVertices || !mesh->triangles ||
+      !mesh->bvhNodes) {
+    return false;
+  }
+
+  for (int i = 0; i < mesh->triangleCount * 3; i++) {
+    if (mesh->triangles[i] >= mesh->vertexCount) {
+      return false;
     }
+  }
 
-    // Copy index data if available
-    if (mesh.indices) {
-      collMesh->indexCount = mesh.triangleCount * 3;
-      collMesh->indices = (unsigned short *)MemAlloc(sizeof(unsigned short) *
-                                                     collMesh->indexCount);
-      memcpy(collMesh->indices, mesh.indices,
-             sizeof(unsigned short) * collMesh->indexCount);
+  // children come after their parents, so depths are known in node order
+  bool valid = true;
+  int *depths = MemAlloc(sizeof(int) * (mesh->bvhNodeCount + 1));
+  for (int i = 0; i < mesh->bvhNodeCount && valid; i++) {
+    const CollisionBVHNode *node = &mesh->bvhNodes[i];
+    if (node->count > 0) {
+      valid = node->first >= 0 &&
+              node->first <= mesh->triangleCount - node->count;
     } else {
-      collMesh->indexCount = 0;
-      collMesh->indices = NULL;
+      valid = node->count == 0 && node->first > i &&
+              node->first < mesh->bvhNodeCount - 1 &&
+              depths[i] < COLLISION_BVH_MAX_DEPTH;
+      for (int child = node->first; valid && child <= node->first + 1;
+           child++) {
+        depths[child] =
+            depths[child] > depths[i] + 1 ? depths[child] : depths[i] + 1;
+      }
+    }
+  }
+  MemFree(depths);
+  return valid;
+}
+
+bool collision_load(CollisionSystem *collisionSystem, const char *fileName) {
+  unsigned long size = 0;
+  unsigned char *data = collision_map_file(fileName, &size);
+  if (!data) {
+    return false;
+  }
+
+  const CollisionCookedHeader *header = (const CollisionCookedHeader *)data;
+  const CollisionCookedMesh *cookedMeshes =
+      size >= sizeof(CollisionCookedHeader)
+          ? collision_get_section(data, size, header->meshes,
+                                  header->meshCount,
+                                  sizeof(CollisionCookedMesh))
+          : 0;
+  if (!cookedMeshes || header->magic != COLLISION_COOKED_MAGIC ||
+      header->version != COLLISION_COOKED_VERSION ||
+      header->fileSize != size) {
+    TraceLog(LOG_WARNING, "%s isn't a cooked collision file of version %u",
+             fileName, COLLISION_COOKED_VERSION);
+    collision_unmap_file(data, size);
+    return false;
+  }
+
+  int meshCount = header->meshCount;
+  CollisionMesh *meshes =
+      (CollisionMesh *)MemAlloc(sizeof(CollisionMesh) * (meshCount + 1));
+  for (int i = 0; i < meshCount; i++) {
+    if (!collision_load_cooked_mesh(data, size, &cookedMeshes[i],
+                                    &meshes[i])) {
+      TraceLog(LOG_WARNING, "%s: collision mesh %d is corrupt", fileName, i);
+      MemFree(meshes);
+      collision_unmap_file(data, size);
+      return false;
     }
+  }
+
+  collisionSystem->meshes = meshes;
+  collisionSystem->meshCount = meshCount;
+  collisionSystem->cookedData = data;
+  collisionSystem->cookedSize = size;
+  TraceLog(LOG_INFO, "Mapped %s with %d collision meshes, %lu bytes",
+           fileName, meshCount, size);
+  return true;
+}
+
+bool collision_save(const CollisionSystem *collisionSystem,
+                    const char *fileName) {
+  CollisionCookedWriter writer = {0};
+  CollisionCookedHeader header = {.magic = COLLISION_COOKED_MAGIC,
+                                  .version = COLLISION_COOKED_VERSION};
+  collision_write(&writer, &header, sizeof(header));
+
+  int meshCount = collisionSystem->meshCount;
+  CollisionCookedMesh *cookedMeshes =
+      MemAlloc(sizeof(CollisionCookedMesh) * (meshCount + 1));
+  for (int i = 0; i < meshCount; i++) {
+    const CollisionMesh *mesh = &collisionSystem->meshes[i];
+    CollisionCookedMesh *cooked = &cookedMeshes[i];
+    cooked->vertexCount = mesh->vertexCount;
+    cooked->triangleCount = mesh->triangleCount;
+    cooked->bvhNodeCount = mesh->bvhNodeCount;
+    cooked->transform = mesh->transform;
+    cooked->bbox = mesh->bbox;
+    memcpy(cooked->name, mesh->name, sizeof(cooked->name));
+    cooked->vertices = collision_write(&writer, mesh->vertices,
+                                       sizeof(Vector3) * mesh->vertexCount);
+    cooked->worldVertices = collision_write(
+        &writer, mesh->worldVertices, sizeof(Vector3) * mesh->vertexCount);
+    cooked->triangles =
+        collision_write(&writer, mesh->triangles,
+                        sizeof(unsigned short) * mesh->triangleCount * 3);
+    cooked->bvhNodes =
+        collision_write(&writer, mesh->bvhNodes,
+                        sizeof(CollisionBVHNode) * mesh->bvhNodeCount);
+  }
+  header.meshCount = meshCount;
+  header.meshes = collision_write(&writer, cookedMeshes,
+                                  sizeof(CollisionCookedMesh) * meshCount);
+  header.fileSize = writer.size;
+  memcpy(writer.data, &header, sizeof(header));
+
+  bool saved = SaveFileData(fileName, writer.data, (int)writer.size);
+  TraceLog(LOG_INFO, "collision_save: %s, %d meshes, %lu bytes", fileName,
+           meshCount, writer.size);
+  MemFree(cookedMeshes);
+  MemFree(writer.data);
+  return saved;
+}
 
-    // Set identity transform (can be modified later for dynamic objects)
-    collMesh->transform = MatrixIdentity();
+// The debug view draws GPU copies of the world-space triangles, uploaded
+// when it is turned on and released when it is turned off again
+static void collision_upload_debug_meshes(CollisionSystem *collisionSystem) {
+  collisionSystem->debugMeshes =
+      MemAlloc(sizeof(Mesh) * (collisionSystem->meshCount + 1));
+  for (int i = 0; i < collisionSystem->meshCount; i++) {
+    const CollisionMesh *mesh = &collisionSystem->meshes[i];
+    if (mesh->triangleCount == 0) {
+      continue;
+    }
+
+    Mesh *debugMesh = &collisionSystem->debugMeshes[i];
+    debugMesh->vertexCount = mesh->vertexCount;
+    debugMesh->triangleCount = mesh->triangleCount;
+    debugMesh->vertices = MemAlloc(sizeof(Vector3) * mesh->vertexCount);
+    memcpy(debugMesh->vertices, mesh->worldVertices,
+           sizeof(Vector3) * mesh->vertexCount);
+    debugMesh->indices =
+        MemAlloc(sizeof(unsigned short) * mesh->triangleCount * 3);
+    memcpy(debugMesh->indices, mesh->triangles,
+           sizeof(unsigned short) * mesh->triangleCount * 3);
+    UploadMesh(debugMesh, false);
+  }
+  collisionSystem->debugMaterial = LoadMaterialDefault();
+}
+
+static void collision_unload_debug_meshes(CollisionSystem *collisionSystem) {
+  if (!collisionSystem->debugMeshes) {
+    return;
+  }
+
+  for (int i = 0; i < collisionSystem->meshCount; i++) {
+    if (collisionSystem->debugMeshes[i].triangleCount > 0) {
+      UnloadMesh(collisionSystem->debugMeshes[i]);
+    }
+  }
+  MemFree(collisionSystem->debugMeshes);
+  collisionSystem->debugMeshes = NULL;
+  UnloadMaterial(collisionSystem->debugMaterial);
+}
 
-    // Set name
-    snprintf(collMesh->name, sizeof(collMesh->name), "Collider_%d", i);
+void collision_init(CollisionSystem *collisionSystem, Matrix transform) {
+  // Map the cooked colliders, unless the model was changed since they were
+  // cooked
+  if (FileExists(COLLISION_COOKED_PATH) &&
+      GetFileModTime(COLLISION_COOKED_PATH) >=
+          GetFileModTime(COLLISION_MODEL_PATH) &&
+      collision_load(collisionSystem, COLLISION_COOKED_PATH)) {
+    // meshes cooked with another placement are baked again
+    for (int i = 0; i < collisionSystem->meshCount; i++) {
+      collision_set_mesh_transform(collisionSystem, i, transform);
+    }
+    return;
+  }
 
-    TraceLog(LOG_INFO,
-             "Collision mesh %d: %d vertices, %d indices, bbox: "
-             "(%.2f,%.2f,%.2f) to (%.2f,%.2f,%.2f)",
-             i, collMesh->vertexCount, collMesh->indexCount,
-             collMesh->bbox.min.x, collMesh->bbox.min.y, collMesh->bbox.min.z,
-             collMesh->bbox.max.x, collMesh->bbox.max.y, collMesh->bbox.max.z);
+  TraceLog(LOG_WARNING,
+           "%s is missing or out of date, building the colliders from %s",
+           COLLISION_COOKED_PATH, COLLISION_MODEL_PATH);
+  if (collision_init_gltf(collisionSystem, COLLISION_MODEL_PATH, transform) &&
+      collision_save(collisionSystem, COLLISION_COOKED_PATH)) {
+    // the next start maps these instead of building them again
+    TraceLog(LOG_INFO, "Cooked the colliders into %s", COLLISION_COOKED_PATH);
   }
 }
 
 void collision_cleanup(CollisionSystem *collisionSystem) {
+  collision_unload_debug_meshes(collisionSystem);
   if (collisionSystem->meshes) {
     for (int i = 0; i < collisionSystem->meshCount; i++) {
       CollisionMesh *mesh = &collisionSystem->meshes[i];
+      if (mesh->cooked) {
+        continue;
+      }
       if (mesh->vertices) {
         MemFree(mesh->vertices);
       }
-      if (mesh->indices) {
-        MemFree(mesh->indices);
+      if (mesh->worldVertices) {
+        MemFree(mesh->worldVertices);
+      }
+      if (mesh->triangles) {
+        MemFree(mesh->triangles);
+      }
+      if (mesh->bvhNodes) {
+        MemFree(mesh->bvhNodes);
       }
     }
     MemFree(collisionSystem->meshes);
   }
 
-  UnloadModel(collisionSystem->colliderModel);
+  if (collisionSystem->cookedData) {
+    collision_unmap_file(collisionSystem->cookedData,
+                         collisionSystem->cookedSize);
+  }
+  collisionSystem->meshes = NULL;
   collisionSystem->meshCount = 0;
+  collisionSystem->cookedData = NULL;
+}
+
+void collision_set_mesh_transform(CollisionSystem *collisionSystem,
+                                  int meshIndex, Matrix transform) {
+  if (meshIndex < 0 || meshIndex >= collisionSystem->meshCount) {
+    return;
+  }
+
+  CollisionMesh *mesh = &collisionSystem->meshes[meshIndex];
+  if (memcmp(&mesh->transform, &transform, sizeof(Matrix)) == 0) {
+    return;
+  }
+  if (mesh->cooked) {
+    collision_uncook_mesh(mesh);
+  }
+  mesh->transform = transform;
+  collision_bake_mesh(mesh);
+
+  // the debug view is uploaded again with the moved triangles
+  collision_unload_debug_meshes(collisionSystem);
 }
 
 bool collision_check_point(CollisionSystem *collisionSystem, Vector3 point) {
@@ -174,37 +1504,36 @@ bool collision_raycast(CollisionSystem *collisionSystem, Ray ray,
 }
 
 void collision_debug_draw(CollisionSystem *collisionSystem) {
-  // Only draw if debug is enabled
+  // Only draw if debug is enabled, the GPU copies are only kept meanwhile
   if (!collision_debug_enabled) {
+    collision_unload_debug_meshes(collisionSystem);
     return;
   }
-
-  // Create transform matrix to match house position (10, 0, 10)
-  Matrix houseTransform = MatrixTranslate(10.0f, 0.0f, 10.0f);
+  if (!collisionSystem->debugMeshes) {
+    collision_upload_debug_meshes(collisionSystem);
+  }
 
   for (int i = 0; i < collisionSystem->meshCount; i++) {
     CollisionMesh *mesh = &collisionSystem->meshes[i];
 
-    // Draw actual mesh with house transform
-    Mesh rayMesh = collisionSystem->colliderModel.meshes[i];
-    DrawMesh(rayMesh, LoadMaterialDefault(), houseTransform);
-
-    // Draw wireframe with transformed vertices
-    if (mesh->indices && mesh->indexCount > 0) {
-      for (int j = 0; j < mesh->indexCount; j += 3) {
-        // Get triangle vertices and transform them
-        Vector3 v1 =
-            Vector3Transform(mesh->vertices[mesh->indices[j]], houseTransform);
-        Vector3 v2 = Vector3Transform(mesh->vertices[mesh->indices[j + 1]],
-                                      houseTransform);
-        Vector3 v3 = Vector3Transform(mesh->vertices[mesh->indices[j + 2]],
-                                      houseTransform);
-
-        // Draw triangle edges
-        DrawLine3D(v1, v2, RED);
-        DrawLine3D(v2, v3, RED);
-        DrawLine3D(v3, v1, RED);
-      }
+    // Draw actual mesh, already in world space
+    if (collisionSystem->debugMeshes[i].triangleCount > 0) {
+      DrawMesh(collisionSystem->debugMeshes[i],
+               collisionSystem->debugMaterial, MatrixIdentity());
+    }
+
+    // Draw wireframe of the world-space triangles
+    for (int j = 0; j < mesh->triangleCount; j++) {
+      Vector3 triangle[3];
+      collision_get_triangle(mesh, j, triangle);
+      Vector3 v1 = triangle[0];
+      Vector3 v2 = triangle[1];
+      Vector3 v3 = triangle[2];
+
+      // Draw triangle edges
+      DrawLine3D(v1, v2, RED);
+      DrawLine3D(v2, v3, RED);
+      DrawLine3D(v3, v1, RED);
     }
   }
 }
@@ -221,23 +1550,18 @@ bool collision_is_debug_enabled() { return collision_debug_enabled; }
 bool collision_check_mesh_raycast(CollisionSystem *collisionSystem,
                                   Vector3 position, Vector3 direction,
                                   float distance, RayCollision *hitInfo) {
-  Ray ray = {position, direction};
   RayCollision closest = {0};
   closest.distance = INFINITY;
   bool hit = false;
 
-  // Create transform matrix to match house position (10, 0, 10)
-  Matrix houseTransform = MatrixTranslate(10.0f, 0.0f, 10.0f);
-
+  Ray ray = {position, direction};
   for (int i = 0; i < collisionSystem->meshCount; i++) {
     CollisionMesh *collMesh = &collisionSystem->meshes[i];
-    Mesh mesh = collisionSystem->colliderModel.meshes[i];
-
-    // Use GetRayCollisionMesh for precise triangle intersection
-    RayCollision meshHit = GetRayCollisionMesh(ray, mesh, houseTransform);
 
-    if (meshHit.hit && meshHit.distance <= distance &&
-        meshHit.distance < closest.distance) {
+    // Walk the mesh's BVH, only hits closer than the best so far count
+    RayCollision meshHit;
+    float maxDistance = hit ? closest.distance : distance;
+    if (collision_raycast_bvh(collMesh, ray, maxDistance, &meshHit)) {
       closest = meshHit;
       hit = true;
     }
@@ -250,65 +1574,274 @@ bool collision_check_mesh_raycast(CollisionSystem *collisionSystem,
   return hit;
 }
 
-// NEW: Check if player can move to a position using multiple raycasts
-bool collision_can_move_to_position(CollisionSystem *collisionSystem,
-                                    Vector3 currentPos, Vector3 targetPos,
-                                    float playerRadius) {
-  Vector3 movement = Vector3Subtract(targetPos, currentPos);
-  float moveDistance = Vector3Length(movement);
-
-  if (moveDistance < 0.001f)
-    return true; // No movement
+int collision_raycast_packet(CollisionSystem *collisionSystem,
+                             const Ray *rays, int rayCount, float distance,
+                             RayCollision *hits) {
+  if (rayCount > COLLISION_PACKET_SIZE) {
+    rayCount = COLLISION_PACKET_SIZE;
+  }
 
-  Vector3 moveDirection = Vector3Normalize(movement);
+  CollisionPacket packet;
+  packet.laneCount =
+      (rayCount + PACKET_LANES - 1) / PACKET_LANES * PACKET_LANES;
+  for (int i = 0; i < packet.laneCount; i++) {
+    Ray ray = i < rayCount ? rays[i]
+                           : (Ray){rays[0].position, (Vector3){1, 0, 0}};
+    Vector3 origin = ray.position;
+    Vector3 direction = ray.direction;
+    packet.originX[i] = origin.x;
+    packet.originY[i] = origin.y;
+    packet.originZ[i] = origin.z;
+    packet.directionX[i] = direction.x;
+    packet.directionY[i] = direction.y;
+    packet.directionZ[i] = direction.z;
+    packet.inverseX[i] = 1.0f / direction.x;
+    packet.inverseY[i] = 1.0f / direction.y;
+    packet.inverseZ[i] = 1.0f / direction.z;
+    packet.closest[i] = i < rayCount ? distance : -1.0f;
+    packet.triangle[i] = -1.0f;
+  }
 
-  // Cast multiple rays around the player's cylinder
-  const int rayCount = 8;
-  const float angleStep = 2.0f * PI / rayCount;
+  int hitMesh[COLLISION_PACKET_SIZE];
+  int hitTriangle[COLLISION_PACKET_SIZE];
+  for (int i = 0; i < rayCount; i++) {
+    hitMesh[i] = -1;
+  }
+  for (int m = 0; m < collisionSystem->meshCount; m++) {
+    collision_packet_traverse(&packet, &collisionSystem->meshes[m]);
+    for (int i = 0; i < rayCount; i++) {
+      if (packet.triangle[i] >= 0.0f) {
+        hitMesh[i] = m;
+        hitTriangle[i] = (int)packet.triangle[i];
+        packet.triangle[i] = -1.0f;
+      }
+    }
+  }
 
+  int hitCount = 0;
   for (int i = 0; i < rayCount; i++) {
-    float angle = i * angleStep;
-    Vector3 offset = {cosf(angle) * playerRadius, 0.0f,
-                      sinf(angle) * playerRadius};
+    hits[i] = (RayCollision){.distance = INFINITY};
+    if (hitMesh[i] < 0) {
+      continue;
+    }
+
+    const CollisionMesh *mesh = &collisionSystem->meshes[hitMesh[i]];
+    Vector3 triangle[3];
+    collision_get_triangle(mesh, hitTriangle[i], triangle);
+    Vector3 normal =
+        Vector3CrossProduct(Vector3Subtract(triangle[1], triangle[0]),
+                            Vector3Subtract(triangle[2], triangle[0]));
+    hits[i] = (RayCollision){
+        .hit = true,
+        .distance = packet.closest[i],
+        .point = Vector3Add(rays[i].position,
+                            Vector3Scale(rays[i].direction,
+                                         packet.closest[i])),
+        .normal = Vector3Normalize(normal)};
+    hitCount++;
+  }
+  return hitCount;
+}
 
-    Vector3 rayStart = Vector3Add(currentPos, offset);
-    RayCollision hitInfo;
+bool collision_sweep_capsule(CollisionSystem *collisionSystem,
+                             CollisionCapsule capsule, Vector3 motion,
+                             CollisionSweep *sweep) {
+  CollisionSweepQuery query = {0};
+  query.result.time = 1.0f;
+  query.motionLength = Vector3Length(motion);
+  if (query.motionLength <= EPSILON) {
+    if (sweep) {
+      *sweep = query.result;
+    }
+    return false;
+  }
+
+  query.capsule = capsule;
+  query.motion = motion;
+
+  // Only triangles within the box the capsule sweeps through can be hit
+  BoundingBox from =
+      collision_capsule_bounds(query.capsule, COLLISION_SWEEP_TOLERANCE);
+  BoundingBox to = {Vector3Add(from.min, query.motion),
+                    Vector3Add(from.max, query.motion)};
+  BoundingBox swept = {Vector3Min(from.min, to.min),
+                       Vector3Max(from.max, to.max)};
+
+  for (int i = 0; i < collisionSystem->meshCount; i++) {
+    CollisionMesh *collMesh = &collisionSystem->meshes[i];
+    if (CheckCollisionBoxes(collMesh->bbox, swept)) {
+      collision_bvh_visit_box(collMesh, swept, collision_sweep_triangle,
+                              &query);
+    }
+  }
+
+  if (sweep) {
+    *sweep = query.result;
+  }
+  return query.result.hit;
+}
+
+// Finds how deep the capsule overlaps the meshes, and the direction to push
+// it out of the deepest overlap
+static float collision_capsule_penetration(CollisionSystem *collisionSystem,
+                                           CollisionCapsule capsule,
+                                           Vector3 *normal) {
+  CollisionPenetration penetration = {0};
+  penetration.capsule = capsule;
+  BoundingBox bounds = collision_capsule_bounds(penetration.capsule, 0.0f);
+  for (int i = 0; i < collisionSystem->meshCount; i++) {
+    CollisionMesh *collMesh = &collisionSystem->meshes[i];
+    if (CheckCollisionBoxes(collMesh->bbox, bounds)) {
+      collision_bvh_visit_box(collMesh, bounds, collision_penetrate_triangle,
+                              &penetration);
+    }
+  }
+
+  *normal = penetration.normal;
+  return penetration.depth;
+}
+
+// Pushes a character that starts inside geometry back out, deepest overlap
+// first
+static Vector3 collision_depenetrate(CollisionSystem *collisionSystem,
+                                     const CollisionCharacter *character,
+                                     Vector3 position) {
+  for (int i = 0; i < COLLISION_DEPENETRATION_ITERATIONS; i++) {
+    Vector3 normal;
+    float depth = collision_capsule_penetration(
+        collisionSystem, collision_character_capsule(character, position),
+        &normal);
+    if (depth <= 0.0f) {
+      break;
+    }
+    position =
+        Vector3Add(position, Vector3Scale(normal, depth + COLLISION_SKIN));
+  }
+  return position;
+}
 
-    // Cast ray in movement direction
-    if (collision_check_mesh_raycast(collisionSystem, rayStart, moveDirection,
-                                     moveDistance + 0.1f, &hitInfo)) {
-      return false; // Collision detected
+// Sweeps the character along motion, sliding along what it hits. Walls and
+// slopes steeper than walkable are slid along horizontally only, so they
+// can't be climbed, and set blocked.
+static Vector3 collision_slide(CollisionSystem *collisionSystem,
+                               const CollisionCharacter *character,
+                               Vector3 position, Vector3 motion,
+                               float walkable, bool *blocked) {
+  for (int i = 0; i < COLLISION_MOVE_ITERATIONS; i++) {
+    if (Vector3Length(motion) <= EPSILON) {
+      break;
+    }
+
+    CollisionSweep sweep;
+    if (!collision_sweep_capsule(
+            collisionSystem, collision_character_capsule(character, position),
+            motion, &sweep)) {
+      position = Vector3Add(position, motion);
+      break;
+    }
+
+    // stop short of the contact by the skin width
+    position = Vector3Add(position, Vector3Scale(motion, sweep.time));
+    position = Vector3Add(position, Vector3Scale(sweep.normal, COLLISION_SKIN));
+
+    Vector3 normal = sweep.normal;
+    if (normal.y < walkable) {
+      if (blocked) {
+        *blocked = true;
+      }
+      if (normal.y > 0.0f) {
+        Vector3 horizontal = {normal.x, 0.0f, normal.z};
+        if (Vector3Length(horizontal) > EPSILON) {
+          normal = Vector3Normalize(horizontal);
+        }
+      }
     }
+
+    // what's left of the motion continues along the surface
+    Vector3 remaining = Vector3Scale(motion, 1.0f - sweep.time);
+    motion = Vector3Subtract(
+        remaining, Vector3Scale(normal, Vector3DotProduct(remaining, normal)));
   }
+  return position;
+}
 
-  // Also check center ray
-  RayCollision centerHit;
-  if (collision_check_mesh_raycast(collisionSystem, currentPos, moveDirection,
-                                   moveDistance + 0.1f, &centerHit)) {
+// Sweeps the character down by distance and returns where it lands on
+// walkable ground, if it does
+static bool collision_find_ground(CollisionSystem *collisionSystem,
+                                  const CollisionCharacter *character,
+                                  Vector3 position, float distance,
+                                  float walkable, Vector3 *ground) {
+  CollisionSweep sweep;
+  if (!collision_sweep_capsule(
+          collisionSystem, collision_character_capsule(character, position),
+          (Vector3){0.0f, -distance, 0.0f}, &sweep) ||
+      sweep.normal.y < walkable) {
     return false;
   }
 
-  return true; // No collision, movement is safe
+  *ground = (Vector3){position.x,
+                      position.y - distance * sweep.time + COLLISION_SKIN,
+                      position.z};
+  return true;
 }
 
-// NEW: Get collision normal for sliding movement
-Vector3 collision_get_slide_vector(CollisionSystem *collisionSystem,
-                                   Vector3 position, Vector3 movement,
-                                   float playerRadius) {
-  Vector3 moveDirection = Vector3Normalize(movement);
-  float moveDistance = Vector3Length(movement);
+Vector3 collision_move_character(CollisionSystem *collisionSystem,
+                                 const CollisionCharacter *character,
+                                 Vector3 position, Vector3 motion) {
+  float walkable = cosf(character->maxSlope * DEG2RAD);
+  position = collision_depenetrate(collisionSystem, character, position);
+
+  Vector3 ground;
+  bool grounded =
+      collision_find_ground(collisionSystem, character, position,
+                            2.0f * COLLISION_SKIN + COLLISION_SWEEP_TOLERANCE,
+                            walkable, &ground);
+
+  bool blocked = false;
+  Vector3 moved = collision_slide(collisionSystem, character, position, motion,
+                                  walkable, &blocked);
+
+  // Blocked by something low: try to step up onto it, across, and back down
+  // onto walkable ground, and keep that if it gets further
+  bool stepped = false;
+  if (blocked && character->stepHeight > 0.0f) {
+    Vector3 up = {0.0f, character->stepHeight, 0.0f};
+    CollisionSweep sweep;
+    float climbed = character->stepHeight;
+    if (collision_sweep_capsule(
+            collisionSystem, collision_character_capsule(character, position),
+            up, &sweep)) {
+      climbed = fmaxf(climbed * sweep.time - COLLISION_SKIN, 0.0f);
+    }
+
+    Vector3 raised = {position.x, position.y + climbed, position.z};
+    Vector3 horizontal = {motion.x, 0.0f, motion.z};
+    Vector3 across = collision_slide(collisionSystem, character, raised,
+                                     horizontal, walkable, NULL);
+    Vector3 landed;
+    if (climbed > 0.0f &&
+        collision_find_ground(collisionSystem, character, across,
+                              climbed + COLLISION_SKIN, walkable, &landed)) {
+      float steppedDistance = Vector2Distance(
+          (Vector2){position.x, position.z}, (Vector2){landed.x, landed.z});
+      float slidDistance = Vector2Distance((Vector2){position.x, position.z},
+                                           (Vector2){moved.x, moved.z});
+      if (steppedDistance > slidDistance + EPSILON) {
+        moved = landed;
+        stepped = true;
+      }
+    }
+  }
 
-  RayCollision hitInfo;
-  if (collision_check_mesh_raycast(collisionSystem, position, moveDirection,
-                                   moveDistance + playerRadius, &hitInfo)) {
-    // Calculate slide vector along the collision surface
-    Vector3 normal = hitInfo.normal;
-    Vector3 slideDirection = Vector3Subtract(
-        movement, Vector3Scale(normal, Vector3DotProduct(movement, normal)));
-    return slideDirection;
+  // Keep a character that was on the ground on it when walking down slopes
+  // and steps; there is no gravity to pull it down otherwise
+  if (grounded && !stepped &&
+      collision_find_ground(collisionSystem, character, moved,
+                            character->stepHeight, walkable, &ground)) {
+    moved = ground;
   }
 
-  return movement; // No collision, return original movement
+  return moved;
 }
 
 // Add these functions to collision.c
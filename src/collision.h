@@ -4,8 +4,27 @@
 #include "game_types.h"
 #include <raylib.h>
 
-// Initialize collision system by loading colliders.glb
-void collision_init(CollisionSystem *collisionSystem);
+// Initialize collision system by mapping the cooked colliders.colbin, or by
+// loading colliders.glb if it is missing or older, placed in the world by
+// transform
+void collision_init(CollisionSystem *collisionSystem, Matrix transform);
+
+// Initialize collision system from the meshes of a glTF file: their vertices
+// are welded, placed in the world by transform and get a BVH each
+bool collision_init_gltf(CollisionSystem *collisionSystem,
+                         const char *fileName, Matrix transform);
+
+// Maps a cooked collision file written by collision_save and uses it in place
+bool collision_load(CollisionSystem *collisionSystem, const char *fileName);
+
+// Writes the collision meshes with their BVHs as a cooked collision file
+bool collision_save(const CollisionSystem *collisionSystem,
+                    const char *fileName);
+
+// Moves a collision mesh, baking its triangles into world space again if the
+// transform changed
+void collision_set_mesh_transform(CollisionSystem *collisionSystem,
+                                  int meshIndex, Matrix transform);
 
 // Cleanup collision system
 void collision_cleanup(CollisionSystem *collisionSystem);
@@ -33,15 +52,54 @@ bool collision_check_mesh_raycast(CollisionSystem *collisionSystem,
                                   Vector3 position, Vector3 direction,
                                   float distance, RayCollision *hitInfo);
 
-// NEW: Check if player can move to a position using multiple raycasts
-bool collision_can_move_to_position(CollisionSystem *collisionSystem,
-                                    Vector3 currentPos, Vector3 targetPos,
-                                    float playerRadius);
-
-// NEW: Get collision normal for sliding movement
-Vector3 collision_get_slide_vector(CollisionSystem *collisionSystem,
-                                   Vector3 position, Vector3 movement,
-                                   float playerRadius);
+// Maximum number of rays per collision_raycast_packet call
+#define COLLISION_PACKET_SIZE 16
+
+// Casts up to COLLISION_PACKET_SIZE rays together, sharing the BVH walk and
+// testing triangles against several rays per SIMD instruction. Works best
+// for coherent rays, such as parallel rays from nearby origins. Stores the
+// closest hit of each ray within distance in hits and returns how many rays
+// hit something.
+int collision_raycast_packet(CollisionSystem *collisionSystem,
+                             const Ray *rays, int rayCount, float distance,
+                             RayCollision *hits);
+
+// A capsule: the points within radius of the segment from start to end
+typedef struct CollisionCapsule {
+  Vector3 start;
+  Vector3 end;
+  float radius;
+} CollisionCapsule;
+
+// The shape and limits of a character moved by collision_move_character
+typedef struct CollisionCharacter {
+  float radius;
+  float height;     // of the whole capsule, centered on the position
+  float stepHeight; // ledges up to this high are stepped onto
+  float maxSlope;   // steepest walkable slope, in degrees
+} CollisionCharacter;
+
+typedef struct CollisionSweep {
+  bool hit;
+  float time; // fraction of the motion done before the contact
+  Vector3 point;
+  Vector3 normal; // of the surface hit, facing the capsule
+} CollisionSweep;
+
+// Sweeps the capsule along motion and finds the first contact with the
+// collision meshes. Surfaces the capsule moves along or away from are
+// ignored, so a capsule resting on one can still leave it.
+bool collision_sweep_capsule(CollisionSystem *collisionSystem,
+                             CollisionCapsule capsule, Vector3 motion,
+                             CollisionSweep *sweep);
+
+// Moves a character from position by motion and returns where it ends up:
+// pushed out of anything it started in, sliding along walls, climbing
+// walkable slopes and low steps, and following the ground down when it
+// started on it
+Vector3 collision_move_character(CollisionSystem *collisionSystem,
+                                 const CollisionCharacter *character,
+                                 Vector3 position, Vector3 motion);
 
 // Debug: Draw collision bounding boxes
 void collision_debug_draw(CollisionSystem *collisionSystem);
@@ -5,45 +5,93 @@
 #include "lighting.h"
 #include "player.h"
 #include "scene.h"
+#include "world.h"
 #include <math.h>
 
+#define HOUSE_MODEL_PATH "./assets/house.glb"
+#define HOUSE_POSITION ((Vector3){10.0f, 0.0f, 10.0f})
+// world cell snapshots, see world.h
+#define WORLD_CELL_DIRECTORY "./assets/cells"
+// the cell the house stands in, rebuilt when the house file changes
+#define HOUSE_CELL_PATH "./assets/cells/cell_0_0.scene"
+
+// Newest modification time of the house and the LOD levels tools/lodgen
+// writes next to it, which AddGLTFScene picks up as well
+static long get_house_mod_time(void) {
+  long modTime = GetFileModTime(HOUSE_MODEL_PATH);
+  for (int level = 1; level <= SCENE_MAX_LOD_COUNT; level++) {
+    const char *lodPath = TextFormat("./assets/house.lod%d.glb", level);
+    if (!FileExists(lodPath))
+      break;
+    long lodModTime = GetFileModTime(lodPath);
+    if (lodModTime > modTime)
+      modTime = lodModTime;
+  }
+  return modTime;
+}
+
+// Writes the house cell snapshot from the house file
+static void build_house_cell(void) {
+  SceneId sceneId = LoadScene();
+
+  // Load the house with its node hierarchy, placed at a reasonable distance
+  // from spawn
+  SceneNodeId houseNodeId = AddGLTFScene(sceneId, HOUSE_MODEL_PATH,
+                                         MatrixTranslate(HOUSE_POSITION.x,
+                                                         HOUSE_POSITION.y,
+                                                         HOUSE_POSITION.z));
+  if (houseNodeId.generation) {
+    SetSceneNodeName(houseNodeId, "MainHouse");
+    MakeDirectory(WORLD_CELL_DIRECTORY);
+    if (SaveSceneBinary(sceneId, HOUSE_CELL_PATH)) {
+      TraceLog(LOG_INFO, "Created house scene");
+    }
+  } else {
+    TraceLog(LOG_ERROR, "Failed to load house.glb model!");
+  }
+  UnloadScene(sceneId);
+}
+
+// The house colliders are simplified walls, good enough to hide what is
+// behind them. Occluders aren't part of the snapshot, so they are added
+// whenever the house cell streams in, placed like the house.
+static void game_on_cell_loaded(world_cell_t *cell, void *data) {
+  game_context *gc = data;
+  if (!world_cell_contains(cell, HOUSE_POSITION)) {
+    return;
+  }
+
+  // the colliders are already placed with the house
+  for (int i = 0; i < gc->collisionSystem.meshCount; i++) {
+    CollisionMesh *collider = &gc->collisionSystem.meshes[i];
+    Mesh mesh = {.vertexCount = collider->vertexCount,
+                 .triangleCount = collider->triangleCount,
+                 .vertices = (float *)collider->worldVertices,
+                 .indices = collider->triangles};
+    AddSceneOccluder(cell->sceneId, mesh, MatrixIdentity());
+  }
+}
+
 // In game_init function, after collision_init:
 void game_init(game_context *gc) {
   // Initialize game state
   gc->paused = false;
   gc->running = true;
 
-  // Initialize scene
-  gc->sceneId = LoadScene();
-
-  // Initialize collision system
-  collision_init(&gc->collisionSystem);
-
-  // Load and place a single house model
-  Model houseModel = LoadModel("./assets/house.glb");
-  if (houseModel.meshCount > 0) {
-    TraceLog(LOG_INFO, "Loaded house.glb with %d meshes", houseModel.meshCount);
-
-    // Add house model to scene
-    SceneModelId houseModelId =
-        AddModelToScene(gc->sceneId, houseModel, "house_model", 1);
-
-    // Create a single house node
-    SceneNodeId houseNodeId = AcquireSceneNode(gc->sceneId);
-    SetSceneNodeModel(houseNodeId, houseModelId);
-
-    // Position the house at a reasonable distance from spawn
-    SetSceneNodePosition(houseNodeId, 10.0f, 0.0f, 10.0f);
+  // Initialize collision system, its colliders placed with the house
+  collision_init(&gc->collisionSystem,
+                 MatrixTranslate(HOUSE_POSITION.x, HOUSE_POSITION.y,
+                                 HOUSE_POSITION.z));
 
-    // Keep normal scale and no rotation for clarity
-    SetSceneNodeScale(houseNodeId, 1.0f, 1.0f, 1.0f);
-    SetSceneNodeRotation(houseNodeId, 0.0f, 0.0f, 0.0f);
-    SetSceneNodeName(houseNodeId, "MainHouse");
-
-    TraceLog(LOG_INFO, "Created simple house scene");
-  } else {
-    TraceLog(LOG_ERROR, "Failed to load house.glb model!");
+  // Initialize the world, rebuilding the house cell if the house files are
+  // newer than its snapshot
+  if (!FileExists(HOUSE_CELL_PATH) ||
+      GetFileModTime(HOUSE_CELL_PATH) < get_house_mod_time()) {
+    build_house_cell();
   }
+  world_init(&gc->world, WORLD_CELL_DIRECTORY);
+  gc->world.onCellLoaded = game_on_cell_loaded;
+  gc->world.onCellLoadedData = gc;
 
   // Initialize camera (now includes mode setup)
   camera_init(gc);
@@ -52,6 +100,9 @@ void game_init(game_context *gc) {
   player_init(&gc->player);
   player_load_model(&gc->player, "./assets/greenman.glb");
 
+  // Load the cells around spawn before the first frame, the rest streams in
+  world_prime(&gc->world, gc->player.position);
+
   // Initialize enemies
   enemies_init(gc);
 
@@ -116,13 +167,15 @@ void game_update(game_context *gc) {
     camera_update(gc);
     enemies_update(gc);
   }
+
+  world_update(&gc->world, gc->player.position, gc->camera);
 }
 
 void game_cleanup(game_context *gc) {
   lighting_cleanup(gc);
   player_cleanup(&gc->player);
   collision_cleanup(&gc->collisionSystem);
-  UnloadScene(gc->sceneId);
+  world_cleanup(&gc->world);
 }
 
 // In your game drawing/rendering function, add:
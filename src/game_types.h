@@ -32,22 +32,86 @@ typedef struct player_t player_t;
 typedef struct game_context game_context;
 
 // Collision system structures
+
+// Node of a collision mesh's triangle BVH. Inner nodes have their children at
+// first and first + 1; leaves hold count triangles of the mesh from triangle
+// first on.
+typedef struct CollisionBVHNode {
+  BoundingBox bounds;
+  int first;
+  int count; // 0 for inner nodes
+} CollisionBVHNode;
+
+// A collision mesh keeps its welded vertices as loaded and baked into world
+// space by its transform; every query works on the baked vertices, which are
+// only baked again when the transform changes
 typedef struct CollisionMesh {
-  BoundingBox bbox;
-  Vector3 *vertices;
+  BoundingBox bbox; // world space
+  Vector3 *vertices; // model space
+  Vector3 *worldVertices;
   int vertexCount;
-  unsigned short *indices;
-  int indexCount;
-  Matrix transform;
+  unsigned short *triangles; // three vertices each, in BVH leaf order
+  int triangleCount;
+  Matrix transform; // model to world
+  CollisionBVHNode *bvhNodes; // root first
+  int bvhNodeCount;
+  bool cooked; // the arrays point into the mapped cooked file
   char name[64];
 } CollisionMesh;
 
 typedef struct CollisionSystem {
   CollisionMesh *meshes;
   int meshCount;
-  Model colliderModel;
+  unsigned char *cookedData; // mapped cooked file, if loaded from one
+  unsigned long cookedSize;
+  // GPU copies of the meshes, only while the debug view is on
+  Mesh *debugMeshes;
+  Material debugMaterial;
 } CollisionSystem;
 
+// World streaming structures, see world.h
+typedef enum {
+  WORLD_CELL_UNLOADED = 0,
+  WORLD_CELL_LOADING,   // queued for or being read by the loader thread
+  WORLD_CELL_UPLOADING, // read, uploaded a slice per frame
+  WORLD_CELL_RESIDENT,
+  WORLD_CELL_FAILED // the snapshot is missing or corrupt, never retried
+} WorldCellState;
+
+typedef struct world_cell_t {
+  int x, z; // grid coordinates
+  char fileName[256];
+  BoundingBox bounds;
+  unsigned long size; // snapshot size, charged against the memory budget
+  WorldCellState state;
+  unsigned int generation;    // bumped when a load in flight is abandoned
+  SceneBinaryData *data;      // while uploading
+  SceneId sceneId;            // once resident
+  float distance;             // to the player on the XZ plane
+  float priority;             // distance, plus a penalty behind the camera
+} world_cell_t;
+
+typedef struct world_loader_t world_loader_t;
+
+typedef struct world_t {
+  world_cell_t *cells;
+  int cellCount;
+  float cellSize;
+  // cells closer than loadRadius are streamed in, cells farther than
+  // unloadRadius are dropped; the gap keeps cells at the edge from
+  // reloading every time the player turns around
+  float loadRadius;
+  float unloadRadius;
+  unsigned long memoryBudget; // bytes of snapshots loaded or in flight
+  unsigned long memoryUsed;
+  double uploadBudget; // seconds of GPU upload per frame
+  world_loader_t *loader;
+
+  // called once a cell is resident, to add what isn't in its snapshot
+  void (*onCellLoaded)(world_cell_t *cell, void *data);
+  void *onCellLoadedData;
+} world_t;
+
 // Enemy structure
 struct enemy_t {
   Vector3 position;
@@ -82,6 +146,12 @@ struct player_t {
   Model equipModels[BONE_SOCKETS];   // Hat, Sword, Shield
   bool showEquip[BONE_SOCKETS];      // Toggle visibility
   int boneSocketIndex[BONE_SOCKETS]; // Bone indices for sockets
+
+  // Copies of the model's and accessories' materials with the shader they
+  // are drawn with, rebuilt by player_draw when the shader changes
+  Material *drawMaterials;
+  Material *equipDrawMaterials[BONE_SOCKETS];
+  Shader drawShader;
 };
 
 // Add these includes at the top
@@ -142,8 +212,8 @@ struct game_context {
   Vector3 thirdPersonOffset;
   float transitionSpeed;
 
-  // Scene system
-  SceneId sceneId;
+  // Scene system, streamed in cells
+  world_t world;
   SceneNodeId doorNodeId;
   SceneModelId doorModelId;
 
@@ -153,7 +223,9 @@ struct game_context {
 
   // Lighting system
   Shader lightingShader;
+  Shader lightingInstancedShader;
   Light lights[MAX_LIGHTS];
+  Light instancedLights[MAX_LIGHTS]; // uniform locations in the instanced shader
   int lightCount;
 
   // Collision system
@@ -0,0 +1,1049 @@
+#include "gltf.h"
+#include <raylib.h>
+#include <raymath.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// # JSON Functions
+// The JSON text is tokenized into a flat array in document order; every token
+// knows where its subtree ends, so lookups skip whole values without
+// recursion.
+#define GLTF_JSON_MAX_DEPTH 64
+
+typedef enum JsonType {
+  JSON_NULL,
+  JSON_BOOL,
+  JSON_NUMBER,
+  JSON_STRING,
+  JSON_ARRAY,
+  JSON_OBJECT
+} JsonType;
+
+typedef struct JsonToken {
+  JsonType type;
+  // byte range in the text; strings exclude the quotes
+  int start;
+  int end;
+  // elements of arrays, key/value pairs of objects
+  int size;
+  // index of the first token after this subtree
+  int next;
+} JsonToken;
+
+typedef struct GLTFParser {
+  const char *fileName;
+  char *json;
+  int jsonLength;
+  JsonToken *tokens;
+  int tokensCount;
+  int tokensCapacity;
+
+  unsigned char **buffers;
+  int *bufferSizes;
+  char *bufferOwned;
+  int buffersCount;
+
+  // element tokens of the top level arrays other objects index into
+  int *accessors;
+  int accessorsCount;
+  int *bufferViews;
+  int bufferViewsCount;
+} GLTFParser;
+
+static int PushJsonToken(GLTFParser *p, JsonType type, int start) {
+  if (p->tokensCount >= p->tokensCapacity) {
+    p->tokensCapacity = p->tokensCapacity == 0 ? 256 : p->tokensCapacity * 2;
+    p->tokens = MemRealloc(p->tokens, sizeof(JsonToken) * p->tokensCapacity);
+  }
+
+  p->tokens[p->tokensCount] =
+      (JsonToken){.type = type, .start = start, .end = start};
+  return p->tokensCount++;
+}
+
+static void SkipJsonWhitespace(const GLTFParser *p, int *pos) {
+  while (*pos < p->jsonLength &&
+         (p->json[*pos] == ' ' || p->json[*pos] == '\t' ||
+          p->json[*pos] == '\n' || p->json[*pos] == '\r')) {
+    (*pos)++;
+  }
+}
+
+// Parses the value at pos and returns its token, or -1 on malformed input
+static int ParseJsonValue(GLTFParser *p, int *pos, int depth) {
+  SkipJsonWhitespace(p, pos);
+  if (*pos >= p->jsonLength || depth > GLTF_JSON_MAX_DEPTH) {
+    return -1;
+  }
+
+  const char *json = p->json;
+  char c = json[*pos];
+  int token;
+  if (c == '{' || c == '[') {
+    char close = c == '{' ? '}' : ']';
+    token = PushJsonToken(p, c == '{' ? JSON_OBJECT : JSON_ARRAY, *pos);
+    (*pos)++;
+    SkipJsonWhitespace(p, pos);
+    if (*pos < p->jsonLength && json[*pos] == close) {
+      (*pos)++;
+    } else {
+      for (;;) {
+        if (c == '{') {
+          int key = ParseJsonValue(p, pos, depth + 1);
+          if (key < 0 || p->tokens[key].type != JSON_STRING) {
+            return -1;
+          }
+          SkipJsonWhitespace(p, pos);
+          if (*pos >= p->jsonLength || json[*pos] != ':') {
+            return -1;
+          }
+          (*pos)++;
+        }
+        if (ParseJsonValue(p, pos, depth + 1) < 0) {
+          return -1;
+        }
+        p->tokens[token].size++;
+
+        SkipJsonWhitespace(p, pos);
+        if (*pos >= p->jsonLength) {
+          return -1;
+        }
+        if (json[(*pos)++] == close) {
+          break;
+        }
+        if (json[*pos - 1] != ',') {
+          return -1;
+        }
+      }
+    }
+  } else if (c == '"') {
+    token = PushJsonToken(p, JSON_STRING, ++(*pos));
+    while (*pos < p->jsonLength && json[*pos] != '"') {
+      *pos += json[*pos] == '\\' ? 2 : 1;
+    }
+    if (*pos >= p->jsonLength) {
+      return -1;
+    }
+    p->tokens[token].end = (*pos)++;
+    p->tokens[token].next = p->tokensCount;
+    return token;
+  } else if (c == 't' || c == 'f' || c == 'n') {
+    const char *literal = c == 't' ? "true" : c == 'f' ? "false" : "null";
+    int length = strlen(literal);
+    if (*pos + length > p->jsonLength ||
+        strncmp(json + *pos, literal, length) != 0) {
+      return -1;
+    }
+    token = PushJsonToken(p, c == 'n' ? JSON_NULL : JSON_BOOL, *pos);
+    *pos += length;
+  } else {
+    char *end;
+    strtod(json + *pos, &end);
+    if (end == json + *pos) {
+      return -1;
+    }
+    token = PushJsonToken(p, JSON_NUMBER, *pos);
+    *pos = end - json;
+  }
+
+  p->tokens[token].end = *pos;
+  p->tokens[token].next = p->tokensCount;
+  return token;
+}
+
+// value of the key in the object, or -1
+static int JsonFind(const GLTFParser *p, int object, const char *key) {
+  if (object < 0 || p->tokens[object].type != JSON_OBJECT) {
+    return -1;
+  }
+
+  int length = strlen(key);
+  int i = object + 1;
+  for (int n = 0; n < p->tokens[object].size; n++) {
+    const JsonToken *keyToken = &p->tokens[i];
+    if (keyToken->end - keyToken->start == length &&
+        memcmp(p->json + keyToken->start, key, length) == 0) {
+      return i + 1;
+    }
+    i = p->tokens[i + 1].next;
+  }
+
+  return -1;
+}
+
+static int JsonSize(const GLTFParser *p, int token) {
+  return token < 0 ? 0 : p->tokens[token].size;
+}
+
+// element of the array, or -1. Walks the elements before it, so it is meant
+// for short arrays like vectors; loop over long ones with JsonFirst and
+// JsonNext, or index them through JsonElements.
+static int JsonAt(const GLTFParser *p, int array, int index) {
+  if (array < 0 || p->tokens[array].type != JSON_ARRAY || index < 0 ||
+      index >= p->tokens[array].size) {
+    return -1;
+  }
+
+  int i = array + 1;
+  for (int n = 0; n < index; n++) {
+    i = p->tokens[i].next;
+  }
+
+  return i;
+}
+
+// first element of the array, or -1 if it is empty or not an array
+static int JsonFirst(const GLTFParser *p, int array) {
+  if (array < 0 || p->tokens[array].type != JSON_ARRAY ||
+      p->tokens[array].size == 0) {
+    return -1;
+  }
+
+  return array + 1;
+}
+
+// element after the given one; only valid while elements are left
+static int JsonNext(const GLTFParser *p, int element) {
+  return p->tokens[element].next;
+}
+
+// tokens of all elements of the array, walked once, for arrays that are
+// indexed at random. count is set to the number of elements.
+static int *JsonElements(const GLTFParser *p, int array, int *count) {
+  *count = JsonSize(p, array);
+  int *elements = MemAlloc(sizeof(int) * (*count + 1));
+  int element = JsonFirst(p, array);
+  for (int i = 0; i < *count; i++) {
+    elements[i] = element;
+    element = JsonNext(p, element);
+  }
+
+  return elements;
+}
+
+// element of an array of JsonElements, or -1
+static int JsonElementAt(const int *elements, int count, int index) {
+  return index >= 0 && index < count ? elements[index] : -1;
+}
+
+static double JsonNumber(const GLTFParser *p, int token, double fallback) {
+  if (token < 0 || p->tokens[token].type != JSON_NUMBER) {
+    return fallback;
+  }
+
+  return strtod(p->json + p->tokens[token].start, 0);
+}
+
+static int JsonInt(const GLTFParser *p, int token, int fallback) {
+  return (int)JsonNumber(p, token, fallback);
+}
+
+static int JsonBool(const GLTFParser *p, int token, int fallback) {
+  if (token < 0 || p->tokens[token].type != JSON_BOOL) {
+    return fallback;
+  }
+
+  return p->json[p->tokens[token].start] == 't';
+}
+
+static int JsonStringEquals(const GLTFParser *p, int token, const char *str) {
+  if (token < 0 || p->tokens[token].type != JSON_STRING) {
+    return 0;
+  }
+
+  int length = strlen(str);
+  return p->tokens[token].end - p->tokens[token].start == length &&
+         memcmp(p->json + p->tokens[token].start, str, length) == 0;
+}
+
+static int ParseHexDigits(const char *str, int count) {
+  int value = 0;
+  for (int i = 0; i < count; i++) {
+    char c = str[i];
+    int digit = c >= '0' && c <= '9'   ? c - '0'
+                : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                : c >= 'A' && c <= 'F' ? c - 'A' + 10
+                                       : -1;
+    if (digit < 0) {
+      return -1;
+    }
+    value = value * 16 + digit;
+  }
+
+  return value;
+}
+
+// unescaped copy of a string token, or 0; free with MemFree
+static char *JsonString(const GLTFParser *p, int token) {
+  if (token < 0 || p->tokens[token].type != JSON_STRING) {
+    return 0;
+  }
+
+  const char *src = p->json + p->tokens[token].start;
+  int length = p->tokens[token].end - p->tokens[token].start;
+  // escapes never expand: \uXXXX takes 6 bytes and yields at most 3
+  char *str = MemAlloc(length + 1);
+  int out = 0;
+  for (int i = 0; i < length; i++) {
+    if (src[i] != '\\' || i + 1 >= length) {
+      str[out++] = src[i];
+      continue;
+    }
+
+    char e = src[++i];
+    switch (e) {
+    case 'b':
+      str[out++] = '\b';
+      break;
+    case 'f':
+      str[out++] = '\f';
+      break;
+    case 'n':
+      str[out++] = '\n';
+      break;
+    case 'r':
+      str[out++] = '\r';
+      break;
+    case 't':
+      str[out++] = '\t';
+      break;
+    case 'u': {
+      int code = i + 4 < length ? ParseHexDigits(src + i + 1, 4) : -1;
+      if (code < 0) {
+        str[out++] = '?';
+        break;
+      }
+      i += 4;
+      // surrogate pairs are not combined
+      if (code < 0x80) {
+        str[out++] = code;
+      } else if (code < 0x800) {
+        str[out++] = 0xc0 | (code >> 6);
+        str[out++] = 0x80 | (code & 0x3f);
+      } else {
+        str[out++] = 0xe0 | (code >> 12);
+        str[out++] = 0x80 | ((code >> 6) & 0x3f);
+        str[out++] = 0x80 | (code & 0x3f);
+      }
+    } break;
+    default:
+      str[out++] = e;
+      break;
+    }
+  }
+  str[out] = 0;
+
+  return str;
+}
+
+// # Buffer Functions
+static unsigned char *DecodeBase64(const char *text, int length,
+                                   int *outputSize) {
+  unsigned char *data = MemAlloc(length / 4 * 3 + 3);
+  unsigned int bits = 0;
+  int bitCount = 0;
+  int size = 0;
+  for (int i = 0; i < length && text[i] != '='; i++) {
+    char c = text[i];
+    int value = c >= 'A' && c <= 'Z'   ? c - 'A'
+                : c >= 'a' && c <= 'z' ? c - 'a' + 26
+                : c >= '0' && c <= '9' ? c - '0' + 52
+                : c == '+'             ? 62
+                : c == '/'             ? 63
+                                       : -1;
+    if (value < 0) {
+      continue;
+    }
+    bits = bits << 6 | value;
+    bitCount += 6;
+    if (bitCount >= 8) {
+      bitCount -= 8;
+      data[size++] = (bits >> bitCount) & 0xff;
+    }
+  }
+
+  *outputSize = size;
+  return data;
+}
+
+// Resolves a uri relative to the file: base64 data uris are decoded, anything
+// else is read from disk. Returns 0 on failure; the caller owns the data.
+static unsigned char *LoadGLTFUri(const GLTFParser *p, const char *uri,
+                                  int *size, char *mimeType, int mimeSize) {
+  if (strncmp(uri, "data:", 5) == 0) {
+    const char *comma = strchr(uri, ',');
+    const char *base64 = strstr(uri, ";base64,");
+    if (!comma || base64 != comma - 7) {
+      return 0;
+    }
+    if (mimeType) {
+      int length = base64 - uri - 5;
+      length = length < mimeSize - 1 ? length : mimeSize - 1;
+      memcpy(mimeType, uri + 5, length);
+      mimeType[length] = 0;
+    }
+    return DecodeBase64(comma + 1, strlen(comma + 1), size);
+  }
+
+  const char *path = TextFormat("%s/%s", GetDirectoryPath(p->fileName), uri);
+  if (mimeType) {
+    mimeType[0] = 0;
+  }
+  unsigned char *fileData = LoadFileData(path, size);
+  if (!fileData) {
+    return 0;
+  }
+
+  // copy, so all owned data is released with MemFree
+  unsigned char *data = MemAlloc(*size);
+  memcpy(data, fileData, *size);
+  UnloadFileData(fileData);
+  return data;
+}
+
+static int LoadGLTFBuffers(GLTFParser *p, unsigned char *binChunk,
+                           int binChunkSize) {
+  int buffers = JsonFind(p, 0, "buffers");
+  p->buffersCount = JsonSize(p, buffers);
+  p->buffers = MemAlloc(sizeof(unsigned char *) * (p->buffersCount + 1));
+  p->bufferSizes = MemAlloc(sizeof(int) * (p->buffersCount + 1));
+  p->bufferOwned = MemAlloc(p->buffersCount + 1);
+  int buffer = JsonFirst(p, buffers);
+  for (int i = 0; i < p->buffersCount; i++, buffer = JsonNext(p, buffer)) {
+    int byteLength = JsonInt(p, JsonFind(p, buffer, "byteLength"), 0);
+    char *uri = JsonString(p, JsonFind(p, buffer, "uri"));
+    if (!uri) {
+      // the binary chunk of a .glb file
+      if (i != 0 || !binChunk) {
+        TraceLog(LOG_WARNING, "GLTF: [%s] buffer %d has no data", p->fileName,
+                 i);
+        return 0;
+      }
+      p->buffers[i] = binChunk;
+      p->bufferSizes[i] = binChunkSize;
+    } else {
+      p->buffers[i] = LoadGLTFUri(p, uri, &p->bufferSizes[i], 0, 0);
+      p->bufferOwned[i] = 1;
+      MemFree(uri);
+      if (!p->buffers[i]) {
+        TraceLog(LOG_WARNING, "GLTF: [%s] failed to load buffer %d",
+                 p->fileName, i);
+        return 0;
+      }
+    }
+
+    if (p->bufferSizes[i] < byteLength) {
+      TraceLog(LOG_WARNING, "GLTF: [%s] buffer %d is truncated", p->fileName,
+               i);
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+// byte range of a buffer view, or 0 if it is out of bounds
+static const unsigned char *GetGLTFBufferView(const GLTFParser *p, int index,
+                                              int *length, int *stride) {
+  int view = JsonElementAt(p->bufferViews, p->bufferViewsCount, index);
+  int buffer = JsonInt(p, JsonFind(p, view, "buffer"), -1);
+  int offset = JsonInt(p, JsonFind(p, view, "byteOffset"), 0);
+  *length = JsonInt(p, JsonFind(p, view, "byteLength"), 0);
+  *stride = JsonInt(p, JsonFind(p, view, "byteStride"), 0);
+  if (view < 0 || buffer < 0 || buffer >= p->buffersCount || offset < 0 ||
+      *length < 0 || offset + *length > p->bufferSizes[buffer]) {
+    return 0;
+  }
+
+  return p->buffers[buffer] + offset;
+}
+
+// # Accessor Functions
+typedef struct GLTFAccessor {
+  // 0 for accessors without a buffer view, which read as zeros
+  const unsigned char *data;
+  int count;
+  int components;
+  int componentType;
+  int stride;
+  int normalized;
+} GLTFAccessor;
+
+static int GetGLTFComponentSize(int componentType) {
+  switch (componentType) {
+  case 5120: // BYTE
+  case 5121: // UNSIGNED_BYTE
+    return 1;
+  case 5122: // SHORT
+  case 5123: // UNSIGNED_SHORT
+    return 2;
+  case 5125: // UNSIGNED_INT
+  case 5126: // FLOAT
+    return 4;
+  }
+
+  return 0;
+}
+
+static int GetGLTFAccessor(const GLTFParser *p, int index,
+                           GLTFAccessor *accessor) {
+  int token = JsonElementAt(p->accessors, p->accessorsCount, index);
+  if (token < 0) {
+    return 0;
+  }
+
+  int type = JsonFind(p, token, "type");
+  *accessor = (GLTFAccessor){
+      .count = JsonInt(p, JsonFind(p, token, "count"), 0),
+      .componentType = JsonInt(p, JsonFind(p, token, "componentType"), 0),
+      .normalized = JsonBool(p, JsonFind(p, token, "normalized"), 0),
+      .components = JsonStringEquals(p, type, "SCALAR") ? 1
+                    : JsonStringEquals(p, type, "VEC2") ? 2
+                    : JsonStringEquals(p, type, "VEC3") ? 3
+                    : JsonStringEquals(p, type, "VEC4") ? 4
+                    : JsonStringEquals(p, type, "MAT4") ? 16
+                                                        : 0};
+
+  int componentSize = GetGLTFComponentSize(accessor->componentType);
+  if (accessor->count <= 0 || accessor->components == 0 || !componentSize) {
+    return 0;
+  }
+
+  int view = JsonInt(p, JsonFind(p, token, "bufferView"), -1);
+  if (view < 0) {
+    return 1;
+  }
+
+  int viewLength, viewStride;
+  const unsigned char *viewData =
+      GetGLTFBufferView(p, view, &viewLength, &viewStride);
+  int offset = JsonInt(p, JsonFind(p, token, "byteOffset"), 0);
+  int elementSize = accessor->components * componentSize;
+  accessor->stride = viewStride > 0 ? viewStride : elementSize;
+  if (!viewData || offset < 0 ||
+      (long)offset + (long)accessor->stride * (accessor->count - 1) +
+              elementSize >
+          viewLength) {
+    TraceLog(LOG_WARNING, "GLTF: [%s] accessor %d is out of bounds",
+             p->fileName, index);
+    return 0;
+  }
+
+  accessor->data = viewData + offset;
+  return 1;
+}
+
+static float ReadGLTFAccessorFloat(const GLTFAccessor *accessor, int element,
+                                   int component) {
+  if (!accessor->data) {
+    return 0;
+  }
+
+  const unsigned char *src = accessor->data + accessor->stride * element +
+                             GetGLTFComponentSize(accessor->componentType) *
+                                 component;
+  float value = 0;
+  switch (accessor->componentType) {
+  case 5120: {
+    signed char v = *(const signed char *)src;
+    value = accessor->normalized ? fmaxf(v / 127.0f, -1.0f) : v;
+  } break;
+  case 5121:
+    value = accessor->normalized ? *src / 255.0f : *src;
+    break;
+  case 5122: {
+    short v;
+    memcpy(&v, src, sizeof(v));
+    value = accessor->normalized ? fmaxf(v / 32767.0f, -1.0f) : v;
+  } break;
+  case 5123: {
+    unsigned short v;
+    memcpy(&v, src, sizeof(v));
+    value = accessor->normalized ? v / 65535.0f : v;
+  } break;
+  case 5125: {
+    unsigned int v;
+    memcpy(&v, src, sizeof(v));
+    value = v;
+  } break;
+  case 5126:
+    memcpy(&value, src, sizeof(value));
+    break;
+  }
+
+  return value;
+}
+
+static unsigned int ReadGLTFAccessorIndex(const GLTFAccessor *accessor,
+                                          int element) {
+  if (!accessor->data) {
+    return 0;
+  }
+
+  const unsigned char *src = accessor->data + accessor->stride * element;
+  switch (accessor->componentType) {
+  case 5121:
+    return *src;
+  case 5123: {
+    unsigned short v;
+    memcpy(&v, src, sizeof(v));
+    return v;
+  }
+  case 5125: {
+    unsigned int v;
+    memcpy(&v, src, sizeof(v));
+    return v;
+  }
+  }
+
+  return 0;
+}
+
+// # Mesh Functions
+static void FreeGLTFMesh(Mesh mesh) {
+  MemFree(mesh.vertices);
+  MemFree(mesh.texcoords);
+  MemFree(mesh.normals);
+  MemFree(mesh.colors);
+  MemFree(mesh.indices);
+}
+
+// optional attribute accessor with the expected component count
+static int GetGLTFAttribute(const GLTFParser *p, int attributes,
+                            const char *name, int minComponents,
+                            int maxComponents, GLTFAccessor *accessor) {
+  int index = JsonInt(p, JsonFind(p, attributes, name), -1);
+  return index >= 0 && GetGLTFAccessor(p, index, accessor) &&
+         accessor->components >= minComponents &&
+         accessor->components <= maxComponents;
+}
+
+// Reads a triangle primitive into a CPU side mesh. Primitives with more
+// vertices than 16 bit indices can address are expanded to unindexed
+// triangles, since raylib meshes use 16 bit indices.
+static int LoadGLTFPrimitive(const GLTFParser *p, int primitive, Mesh *mesh) {
+  int mode = JsonInt(p, JsonFind(p, primitive, "mode"), 4);
+  if (mode != 4) {
+    TraceLog(LOG_WARNING, "GLTF: [%s] skipping non-triangle primitive",
+             p->fileName);
+    return 0;
+  }
+
+  int attributes = JsonFind(p, primitive, "attributes");
+  GLTFAccessor position, normal, texcoord, color, indices;
+  if (!GetGLTFAttribute(p, attributes, "POSITION", 3, 3, &position)) {
+    return 0;
+  }
+  int hasNormals = GetGLTFAttribute(p, attributes, "NORMAL", 3, 3, &normal) &&
+                   normal.count == position.count;
+  int hasTexcoords =
+      GetGLTFAttribute(p, attributes, "TEXCOORD_0", 2, 2, &texcoord) &&
+      texcoord.count == position.count;
+  int hasColors = GetGLTFAttribute(p, attributes, "COLOR_0", 3, 4, &color) &&
+                  color.count == position.count;
+
+  int indicesIndex = JsonInt(p, JsonFind(p, primitive, "indices"), -1);
+  int hasIndices = indicesIndex >= 0;
+  if (hasIndices && (!GetGLTFAccessor(p, indicesIndex, &indices) ||
+                     indices.components != 1)) {
+    return 0;
+  }
+
+  int indexed = hasIndices && position.count <= 65536;
+  int vertexCount = hasIndices && !indexed ? indices.count : position.count;
+  *mesh = (Mesh){0};
+  mesh->vertexCount = vertexCount;
+  mesh->triangleCount = (indexed ? indices.count : vertexCount) / 3;
+  mesh->vertices = MemAlloc(sizeof(float) * 3 * vertexCount);
+  if (hasNormals) {
+    mesh->normals = MemAlloc(sizeof(float) * 3 * vertexCount);
+  }
+  if (hasTexcoords) {
+    mesh->texcoords = MemAlloc(sizeof(float) * 2 * vertexCount);
+  }
+  if (hasColors) {
+    mesh->colors = MemAlloc(4 * vertexCount);
+  }
+
+  for (int v = 0; v < vertexCount; v++) {
+    unsigned int src =
+        hasIndices && !indexed ? ReadGLTFAccessorIndex(&indices, v)
+                               : (unsigned int)v;
+    if (src >= (unsigned int)position.count) {
+      TraceLog(LOG_WARNING, "GLTF: [%s] vertex index out of range",
+               p->fileName);
+      FreeGLTFMesh(*mesh);
+      return 0;
+    }
+
+    for (int c = 0; c < 3; c++) {
+      mesh->vertices[v * 3 + c] = ReadGLTFAccessorFloat(&position, src, c);
+      if (hasNormals) {
+        mesh->normals[v * 3 + c] = ReadGLTFAccessorFloat(&normal, src, c);
+      }
+    }
+    if (hasTexcoords) {
+      mesh->texcoords[v * 2] = ReadGLTFAccessorFloat(&texcoord, src, 0);
+      mesh->texcoords[v * 2 + 1] = ReadGLTFAccessorFloat(&texcoord, src, 1);
+    }
+    if (hasColors) {
+      for (int c = 0; c < 4; c++) {
+        float value = c < color.components
+                          ? ReadGLTFAccessorFloat(&color, src, c)
+                          : 1.0f;
+        mesh->colors[v * 4 + c] =
+            (unsigned char)(Clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+      }
+    }
+  }
+
+  if (indexed) {
+    mesh->indices = MemAlloc(sizeof(unsigned short) * indices.count);
+    for (int i = 0; i < indices.count; i++) {
+      unsigned int index = ReadGLTFAccessorIndex(&indices, i);
+      if (index >= (unsigned int)position.count) {
+        TraceLog(LOG_WARNING, "GLTF: [%s] vertex index out of range",
+                 p->fileName);
+        FreeGLTFMesh(*mesh);
+        return 0;
+      }
+      mesh->indices[i] = index;
+    }
+  }
+
+  return 1;
+}
+
+static void LoadGLTFMeshes(const GLTFParser *p, GLTFDocument *document) {
+  int meshes = JsonFind(p, 0, "meshes");
+  document->meshCount = JsonSize(p, meshes);
+  document->meshes = MemAlloc(sizeof(GLTFMesh) * (document->meshCount + 1));
+  int meshToken = JsonFirst(p, meshes);
+  for (int m = 0; m < document->meshCount;
+       m++, meshToken = JsonNext(p, meshToken)) {
+    int primitives = JsonFind(p, meshToken, "primitives");
+    GLTFMesh *mesh = &document->meshes[m];
+    mesh->name = JsonString(p, JsonFind(p, meshToken, "name"));
+    mesh->primitives = MemAlloc(sizeof(Mesh) * (JsonSize(p, primitives) + 1));
+    mesh->primitiveMaterials =
+        MemAlloc(sizeof(int) * (JsonSize(p, primitives) + 1));
+    int primitive = JsonFirst(p, primitives);
+    for (int i = 0; i < JsonSize(p, primitives);
+         i++, primitive = JsonNext(p, primitive)) {
+      Mesh *primitiveMesh = &mesh->primitives[mesh->primitiveCount];
+      if (!LoadGLTFPrimitive(p, primitive, primitiveMesh)) {
+        continue;
+      }
+
+      int material = JsonInt(p, JsonFind(p, primitive, "material"), -1);
+      mesh->primitiveMaterials[mesh->primitiveCount++] =
+          material < JsonSize(p, JsonFind(p, 0, "materials")) ? material : -1;
+    }
+  }
+}
+
+// # Material Functions
+static Image LoadGLTFImage(const GLTFParser *p, int image) {
+  char mimeType[32] = {0};
+  char *mimeTypeString = JsonString(p, JsonFind(p, image, "mimeType"));
+  if (mimeTypeString) {
+    strncpy(mimeType, mimeTypeString, sizeof(mimeType) - 1);
+    MemFree(mimeTypeString);
+  }
+
+  int size = 0;
+  unsigned char *data = 0;
+  int owned = 0;
+  int view = JsonInt(p, JsonFind(p, image, "bufferView"), -1);
+  char *uri = JsonString(p, JsonFind(p, image, "uri"));
+  if (view >= 0) {
+    int stride;
+    data = (unsigned char *)GetGLTFBufferView(p, view, &size, &stride);
+  } else if (uri) {
+    char uriMimeType[32];
+    data = LoadGLTFUri(p, uri, &size, uriMimeType, sizeof(uriMimeType));
+    owned = 1;
+    if (uriMimeType[0]) {
+      strcpy(mimeType, uriMimeType);
+    } else if (!mimeType[0]) {
+      // file on disk: let raylib pick the loader from the extension
+      snprintf(mimeType, sizeof(mimeType), "image/%s",
+               GetFileExtension(uri) ? GetFileExtension(uri) + 1 : "png");
+    }
+  }
+  MemFree(uri);
+
+  Image result = {0};
+  if (data) {
+    // "image/png" -> ".png"
+    const char *subtype = strchr(mimeType, '/');
+    const char *fileType = TextFormat(".%s", subtype ? subtype + 1 : "png");
+    if (strcmp(fileType, ".jpeg") == 0) {
+      fileType = ".jpg";
+    }
+    result = LoadImageFromMemory(fileType, data, size);
+  }
+  if (owned) {
+    MemFree(data);
+  }
+  if (!result.data) {
+    TraceLog(LOG_WARNING, "GLTF: [%s] failed to load image", p->fileName);
+  }
+
+  return result;
+}
+
+static void LoadGLTFMaterials(const GLTFParser *p, GLTFDocument *document) {
+  int images = JsonFind(p, 0, "images");
+  document->imageCount = JsonSize(p, images);
+  document->images = MemAlloc(sizeof(Image) * (document->imageCount + 1));
+  int image = JsonFirst(p, images);
+  for (int i = 0; i < document->imageCount; i++, image = JsonNext(p, image)) {
+    document->images[i] = LoadGLTFImage(p, image);
+  }
+
+  int texturesCount;
+  int *textures = JsonElements(p, JsonFind(p, 0, "textures"), &texturesCount);
+  int materials = JsonFind(p, 0, "materials");
+  document->materialCount = JsonSize(p, materials);
+  document->materials =
+      MemAlloc(sizeof(GLTFMaterial) * (document->materialCount + 1));
+  int materialToken = JsonFirst(p, materials);
+  for (int m = 0; m < document->materialCount;
+       m++, materialToken = JsonNext(p, materialToken)) {
+    int pbr = JsonFind(p, materialToken, "pbrMetallicRoughness");
+    int factor = JsonFind(p, pbr, "baseColorFactor");
+    int texture = JsonInt(
+        p, JsonFind(p, JsonFind(p, pbr, "baseColorTexture"), "index"), -1);
+    int image = JsonInt(
+        p,
+        JsonFind(p, JsonElementAt(textures, texturesCount, texture), "source"),
+        -1);
+
+    GLTFMaterial *material = &document->materials[m];
+    material->name = JsonString(p, JsonFind(p, materialToken, "name"));
+    unsigned char rgba[4];
+    for (int c = 0; c < 4; c++) {
+      float value = JsonNumber(p, JsonAt(p, factor, c), 1);
+      rgba[c] = (unsigned char)(Clamp(value, 0, 1) * 255.0f + 0.5f);
+    }
+    material->baseColor = (Color){rgba[0], rgba[1], rgba[2], rgba[3]};
+    material->baseColorImage =
+        image >= 0 && image < document->imageCount ? image : -1;
+  }
+
+  MemFree(textures);
+}
+
+// # Node Functions
+static void LoadGLTFNodes(const GLTFParser *p, GLTFDocument *document) {
+  int nodes = JsonFind(p, 0, "nodes");
+  document->nodeCount = JsonSize(p, nodes);
+  document->nodes = MemAlloc(sizeof(GLTFNode) * (document->nodeCount + 1));
+  for (int n = 0; n < document->nodeCount; n++) {
+    document->nodes[n].parent = -1;
+  }
+
+  int nodeToken = JsonFirst(p, nodes);
+  for (int n = 0; n < document->nodeCount;
+       n++, nodeToken = JsonNext(p, nodeToken)) {
+    GLTFNode *node = &document->nodes[n];
+    node->name = JsonString(p, JsonFind(p, nodeToken, "name"));
+    node->mesh = JsonInt(p, JsonFind(p, nodeToken, "mesh"), -1);
+    if (node->mesh >= document->meshCount) {
+      node->mesh = -1;
+    }
+
+    int matrix = JsonFind(p, nodeToken, "matrix");
+    if (JsonSize(p, matrix) == 16) {
+      // column major, like the memory layout of raylib's Matrix
+      float m[16];
+      int element = JsonFirst(p, matrix);
+      for (int i = 0; i < 16; i++, element = JsonNext(p, element)) {
+        m[i] = JsonNumber(p, element, 0);
+      }
+      Matrix local = {m[0], m[4], m[8],  m[12], m[1], m[5], m[9],  m[13],
+                      m[2], m[6], m[10], m[14], m[3], m[7], m[11], m[15]};
+      MatrixDecompose(local, &node->translation, &node->rotation,
+                      &node->scale);
+    } else {
+      int t = JsonFind(p, nodeToken, "translation");
+      int r = JsonFind(p, nodeToken, "rotation");
+      int s = JsonFind(p, nodeToken, "scale");
+      node->translation = (Vector3){JsonNumber(p, JsonAt(p, t, 0), 0),
+                                    JsonNumber(p, JsonAt(p, t, 1), 0),
+                                    JsonNumber(p, JsonAt(p, t, 2), 0)};
+      node->rotation = (Quaternion){
+          JsonNumber(p, JsonAt(p, r, 0), 0), JsonNumber(p, JsonAt(p, r, 1), 0),
+          JsonNumber(p, JsonAt(p, r, 2), 0), JsonNumber(p, JsonAt(p, r, 3), 1)};
+      node->scale = (Vector3){JsonNumber(p, JsonAt(p, s, 0), 1),
+                              JsonNumber(p, JsonAt(p, s, 1), 1),
+                              JsonNumber(p, JsonAt(p, s, 2), 1)};
+    }
+
+    int children = JsonFind(p, nodeToken, "children");
+    int element = JsonFirst(p, children);
+    for (int c = 0; c < JsonSize(p, children);
+         c++, element = JsonNext(p, element)) {
+      int child = JsonInt(p, element, -1);
+      if (child >= 0 && child < document->nodeCount && child != n &&
+          document->nodes[child].parent < 0) {
+        document->nodes[child].parent = n;
+      }
+    }
+  }
+
+  // a child listed as its own ancestor would form a cycle; cut it loose
+  for (int n = 0; n < document->nodeCount; n++) {
+    int ancestor = document->nodes[n].parent;
+    for (int depth = 0; ancestor >= 0; depth++) {
+      if (ancestor == n || depth > document->nodeCount) {
+        document->nodes[n].parent = -1;
+        break;
+      }
+      ancestor = document->nodes[ancestor].parent;
+    }
+  }
+
+  // roots of the default scene, or every parentless node without scenes
+  int scenes = JsonFind(p, 0, "scenes");
+  int scene = JsonAt(p, scenes, JsonInt(p, JsonFind(p, 0, "scene"), 0));
+  int sceneNodes = JsonFind(p, scene, "nodes");
+  document->rootNodes = MemAlloc(sizeof(int) * (document->nodeCount + 1));
+  if (scene >= 0) {
+    int element = JsonFirst(p, sceneNodes);
+    for (int i = 0; i < JsonSize(p, sceneNodes);
+         i++, element = JsonNext(p, element)) {
+      int root = JsonInt(p, element, -1);
+      if (root >= 0 && root < document->nodeCount &&
+          document->nodes[root].parent < 0 &&
+          document->rootNodeCount < document->nodeCount) {
+        document->rootNodes[document->rootNodeCount++] = root;
+      }
+    }
+  } else {
+    for (int n = 0; n < document->nodeCount; n++) {
+      if (document->nodes[n].parent < 0) {
+        document->rootNodes[document->rootNodeCount++] = n;
+      }
+    }
+  }
+}
+
+// # Document Functions
+#define GLTF_GLB_MAGIC 0x46546c67
+#define GLTF_GLB_CHUNK_JSON 0x4e4f534a
+#define GLTF_GLB_CHUNK_BIN 0x004e4942
+
+static unsigned int ReadUInt32(const unsigned char *data) {
+  return data[0] | data[1] << 8 | data[2] << 16 | (unsigned int)data[3] << 24;
+}
+
+int LoadGLTFDocument(const char *fileName, GLTFDocument *document) {
+  *document = (GLTFDocument){0};
+  int fileSize = 0;
+  unsigned char *fileData = LoadFileData(fileName, &fileSize);
+  if (!fileData) {
+    return 0;
+  }
+
+  GLTFParser parser = {.fileName = fileName};
+  GLTFParser *p = &parser;
+  const char *jsonText = (const char *)fileData;
+  int jsonLength = fileSize;
+  unsigned char *binChunk = 0;
+  int binChunkSize = 0;
+  if (fileSize >= 12 && ReadUInt32(fileData) == GLTF_GLB_MAGIC) {
+    // .glb: header, then a JSON chunk and an optional binary chunk
+    unsigned int length = ReadUInt32(fileData + 8);
+    if (length > (unsigned int)fileSize || fileSize < 20 ||
+        ReadUInt32(fileData + 16) != GLTF_GLB_CHUNK_JSON) {
+      TraceLog(LOG_WARNING, "GLTF: [%s] invalid glb header", fileName);
+      UnloadFileData(fileData);
+      return 0;
+    }
+
+    jsonText = (const char *)fileData + 20;
+    jsonLength = ReadUInt32(fileData + 12);
+    unsigned int binOffset = 20 + ((jsonLength + 3) & ~3u);
+    if ((unsigned int)jsonLength > length - 20) {
+      jsonLength = length - 20;
+    } else if (binOffset + 8 <= length &&
+               ReadUInt32(fileData + binOffset + 4) == GLTF_GLB_CHUNK_BIN) {
+      binChunkSize = ReadUInt32(fileData + binOffset);
+      binChunk = fileData + binOffset + 8;
+      if (binChunkSize > (int)(length - binOffset - 8) || binChunkSize < 0) {
+        binChunkSize = length - binOffset - 8;
+      }
+    }
+  }
+
+  // terminated copy, strtod must not run past the end of the chunk
+  p->json = MemAlloc(jsonLength + 1);
+  memcpy(p->json, jsonText, jsonLength);
+  p->jsonLength = jsonLength;
+
+  int pos = 0;
+  int ok = ParseJsonValue(p, &pos, 0) == 0 && p->tokens[0].type == JSON_OBJECT;
+  if (!ok) {
+    TraceLog(LOG_WARNING, "GLTF: [%s] invalid json", fileName);
+  } else {
+    p->accessors =
+        JsonElements(p, JsonFind(p, 0, "accessors"), &p->accessorsCount);
+    p->bufferViews =
+        JsonElements(p, JsonFind(p, 0, "bufferViews"), &p->bufferViewsCount);
+    ok = LoadGLTFBuffers(p, binChunk, binChunkSize);
+  }
+
+  if (ok) {
+    LoadGLTFMeshes(p, document);
+    LoadGLTFMaterials(p, document);
+    LoadGLTFNodes(p, document);
+  }
+
+  for (int i = 0; i < p->buffersCount; i++) {
+    if (p->bufferOwned[i]) {
+      MemFree(p->buffers[i]);
+    }
+  }
+  MemFree(p->buffers);
+  MemFree(p->bufferSizes);
+  MemFree(p->bufferOwned);
+  MemFree(p->accessors);
+  MemFree(p->bufferViews);
+  MemFree(p->tokens);
+  MemFree(p->json);
+  UnloadFileData(fileData);
+
+  return ok;
+}
+
+void UnloadGLTFDocument(GLTFDocument *document) {
+  for (int n = 0; n < document->nodeCount; n++) {
+    MemFree(document->nodes[n].name);
+  }
+  for (int m = 0; m < document->meshCount; m++) {
+    GLTFMesh *mesh = &document->meshes[m];
+    for (int i = 0; i < mesh->primitiveCount; i++) {
+      FreeGLTFMesh(mesh->primitives[i]);
+    }
+    MemFree(mesh->primitives);
+    MemFree(mesh->primitiveMaterials);
+    MemFree(mesh->name);
+  }
+  for (int m = 0; m < document->materialCount; m++) {
+    MemFree(document->materials[m].name);
+  }
+  for (int i = 0; i < document->imageCount; i++) {
+    if (document->images[i].data) {
+      UnloadImage(document->images[i]);
+    }
+  }
+  MemFree(document->nodes);
+  MemFree(document->meshes);
+  MemFree(document->materials);
+  MemFree(document->images);
+  MemFree(document->rootNodes);
+  *document = (GLTFDocument){0};
+}
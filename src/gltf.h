@@ -0,0 +1,59 @@
+#ifndef GLTF_H
+#define GLTF_H
+
+#include "raylib.h"
+/*
+Minimal glTF 2.0 reader for static scenes, used by AddGLTFScene.
+
+Reads .glb and .gltf files (external and base64 embedded buffers) into a flat
+document: the node hierarchy with names and TRS, meshes as CPU side raylib
+meshes (one per primitive, not uploaded), materials with their base color and
+the decoded images. Skins, animations, morph targets and cameras are ignored.
+
+Every mesh is read once no matter how many nodes reference it, so callers can
+upload it once and share it between all its instances.
+*/
+
+typedef struct GLTFNode {
+  char *name;
+  int parent; // -1 for root nodes
+  int mesh;   // -1 if the node has no mesh
+  Vector3 translation;
+  Quaternion rotation;
+  Vector3 scale;
+} GLTFNode;
+
+typedef struct GLTFMesh {
+  char *name;
+  int primitiveCount;
+  Mesh *primitives;
+  int *primitiveMaterials; // -1 for the default material
+} GLTFMesh;
+
+typedef struct GLTFMaterial {
+  char *name;
+  Color baseColor;
+  int baseColorImage; // -1 if untextured
+} GLTFMaterial;
+
+typedef struct GLTFDocument {
+  GLTFNode *nodes;
+  int nodeCount;
+  GLTFMesh *meshes;
+  int meshCount;
+  GLTFMaterial *materials;
+  int materialCount;
+  Image *images;
+  int imageCount;
+  // root nodes of the default scene
+  int *rootNodes;
+  int rootNodeCount;
+} GLTFDocument;
+
+// Returns 0 and an empty document if the file can't be read or parsed
+int LoadGLTFDocument(const char *fileName, GLTFDocument *document);
+// Frees everything still owned by the document; callers that take over a
+// mesh or image clear its slot first
+void UnloadGLTFDocument(GLTFDocument *document);
+
+#endif
@@ -43,6 +43,32 @@ void lighting_init(game_context *gc) {
 
   gc->lightCount = 3;
 
+  // Instanced variant used by the scene for meshes shared by many nodes; it
+  // takes the model matrix from a per-instance attribute
+  gc->lightingInstancedShader = LoadShader(
+      "assets/shaders/lighting_instanced.vs", "assets/shaders/lighting.fs");
+  if (gc->lightingInstancedShader.id == 0) {
+    TraceLog(LOG_WARNING, "Failed to load instanced lighting shader, "
+                          "scene instancing disabled");
+  } else {
+    gc->lightingInstancedShader.locs[SHADER_LOC_MATRIX_MODEL] =
+        GetShaderLocationAttrib(gc->lightingInstancedShader,
+                                "instanceTransform");
+    gc->lightingInstancedShader.locs[SHADER_LOC_VECTOR_VIEW] =
+        GetShaderLocation(gc->lightingInstancedShader, "viewPos");
+    SetShaderValue(gc->lightingInstancedShader,
+                   GetShaderLocation(gc->lightingInstancedShader, "ambient"),
+                   (float[4]){0.15f, 0.15f, 0.18f, 1.0f}, SHADER_UNIFORM_VEC4);
+
+    // Same lights, but uniform locations are per shader program
+    for (int i = 0; i < gc->lightCount; i++) {
+      Light light = gc->lights[i];
+      gc->instancedLights[i] =
+          CreateLight(light.type, light.position, light.target, light.color,
+                      gc->lightingInstancedShader, i);
+    }
+  }
+
   TraceLog(LOG_INFO, "Soft texture-preserving lighting system initialized with %d lights",
            gc->lightCount);
 }
@@ -112,7 +138,42 @@ void UpdateLightValues(Shader shader, Light light, int index) {
   debugCounter++;
 }
 
+void lighting_update(game_context *gc) {
+  float cameraPos[3] = {gc->camera.position.x, gc->camera.position.y,
+                        gc->camera.position.z};
+  SetShaderValue(gc->lightingShader,
+                 gc->lightingShader.locs[SHADER_LOC_VECTOR_VIEW], cameraPos,
+                 SHADER_UNIFORM_VEC3);
+
+  for (int i = 0; i < gc->lightCount; i++) {
+    UpdateLightValues(gc->lightingShader, gc->lights[i], i);
+  }
+
+  if (gc->lightingInstancedShader.id == 0) {
+    return;
+  }
+
+  SetShaderValue(gc->lightingInstancedShader,
+                 gc->lightingInstancedShader.locs[SHADER_LOC_VECTOR_VIEW],
+                 cameraPos, SHADER_UNIFORM_VEC3);
+
+  for (int i = 0; i < gc->lightCount; i++) {
+    // State of the light, uniform locations of the instanced shader
+    Light light = gc->lights[i];
+    Light locations = gc->instancedLights[i];
+    light.enabledLoc = locations.enabledLoc;
+    light.typeLoc = locations.typeLoc;
+    light.positionLoc = locations.positionLoc;
+    light.targetLoc = locations.targetLoc;
+    light.colorLoc = locations.colorLoc;
+    UpdateLightValues(gc->lightingInstancedShader, light, i);
+  }
+}
+
 void lighting_cleanup(game_context *gc) {
   TraceLog(LOG_INFO, "Cleaning up lighting system");
   UnloadShader(gc->lightingShader);
+  if (gc->lightingInstancedShader.id > 0) {
+    UnloadShader(gc->lightingInstancedShader);
+  }
 }
\ No newline at end of file
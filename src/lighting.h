@@ -13,6 +13,9 @@ Light CreateLight(int type, Vector3 position, Vector3 target, Color color,
 // Update light values in shader
 void UpdateLightValues(Shader shader, Light light, int index);
 
+// Upload camera position and light state to the lighting shaders
+void lighting_update(game_context *gc);
+
 // Cleanup lighting
 void lighting_cleanup(game_context *gc);
 
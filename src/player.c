@@ -2,6 +2,11 @@
 #include "collision.h"
 #include "enemy.h"
 
+// Collision capsule of the player
+#define PLAYER_COLLISION_RADIUS 0.3f
+#define PLAYER_STEP_HEIGHT 0.3f
+#define PLAYER_MAX_SLOPE 45.0f // degrees
+
 void player_init(player_t *player) {
   player->position =
       (Vector3){10.0f, 1.0f, 10.0f}; // Spawn inside the house at (10, 1, 10)
@@ -18,7 +23,10 @@ void player_init(player_t *player) {
   for (int i = 0; i < BONE_SOCKETS; i++) {
     player->showEquip[i] = true;
     player->boneSocketIndex[i] = -1;
+    player->equipDrawMaterials[i] = NULL;
   }
+  player->drawMaterials = NULL;
+  player->drawShader = (Shader){0};
 }
 
 void player_load_model(player_t *player, const char *model_path) {
@@ -154,38 +162,13 @@ void player_handle_animation(player_t *player, bool moved) {
 void player_handle_collision(game_context *gc, Vector3 old_position) {
   gc->player.bbox = player_get_bbox(&gc->player);
 
-  // Use mesh-based collision detection instead of bounding box
-  float playerRadius = 0.3f; // Adjust based on your player size
-
-  // Check if the new position is valid using raycasting
-  bool canMove = collision_can_move_to_position(
-      &gc->collisionSystem, old_position, gc->player.position, playerRadius);
-
-  if (!canMove) {
-    // Try sliding movement
-    Vector3 movement = Vector3Subtract(gc->player.position, old_position);
-    Vector3 slideMovement = collision_get_slide_vector(
-        &gc->collisionSystem, old_position, movement, playerRadius);
-
-    // Apply slide movement if it's significant
-    if (Vector3Length(slideMovement) > 0.01f) {
-      Vector3 newPos = Vector3Add(old_position, slideMovement);
-
-      // Check if slide movement is valid
-      if (collision_can_move_to_position(&gc->collisionSystem, old_position,
-                                         newPos, playerRadius)) {
-        gc->player.position = newPos;
-      } else {
-        // Revert to old position if sliding also fails
-        gc->player.position = old_position;
-      }
-    } else {
-      // Revert to old position
-      gc->player.position = old_position;
-    }
-
-    TraceLog(LOG_INFO, "Player collision detected - movement blocked/adjusted");
-  }
+  // Move from the old position as a capsule the size of the player, sliding
+  // along walls and following steps and slopes
+  CollisionCharacter character = {PLAYER_COLLISION_RADIUS, gc->player.size.y,
+                                  PLAYER_STEP_HEIGHT, PLAYER_MAX_SLOPE};
+  Vector3 movement = Vector3Subtract(gc->player.position, old_position);
+  gc->player.position = collision_move_character(
+      &gc->collisionSystem, &character, old_position, movement);
 
   // Update bounding box after position adjustment
   gc->player.bbox = player_get_bbox(&gc->player);
@@ -234,7 +217,44 @@ void player_update(game_context *gc) {
   player_handle_collision(gc, old_position);
 }
 
-void player_draw(const player_t *player, Shader lightingShader) {
+// Copies the model's materials with the shader swapped in. Every copy gets
+// maps of its own, so tinting it leaves the model's materials alone.
+static Material *player_build_materials(Model model, Shader shader) {
+  Material *materials = MemAlloc(sizeof(Material) * model.materialCount);
+  for (int i = 0; i < model.materialCount; i++) {
+    materials[i] = model.materials[i];
+    materials[i].maps =
+        MemAlloc(sizeof(MaterialMap) * SCENE_MATERIAL_MAP_COUNT);
+    memcpy(materials[i].maps, model.materials[i].maps,
+           sizeof(MaterialMap) * SCENE_MATERIAL_MAP_COUNT);
+    if (shader.id > 0) {
+      materials[i].shader = shader;
+    }
+  }
+  return materials;
+}
+
+static void player_free_materials(Material *materials, int count) {
+  if (materials == NULL) {
+    return;
+  }
+  for (int i = 0; i < count; i++) {
+    MemFree(materials[i].maps);
+  }
+  MemFree(materials);
+}
+
+static void player_free_draw_materials(player_t *player) {
+  player_free_materials(player->drawMaterials, player->model.materialCount);
+  player->drawMaterials = NULL;
+  for (int i = 0; i < BONE_SOCKETS; i++) {
+    player_free_materials(player->equipDrawMaterials[i],
+                          player->equipModels[i].materialCount);
+    player->equipDrawMaterials[i] = NULL;
+  }
+}
+
+void player_draw(player_t *player, Shader lightingShader) {
   // Debug: Check if shader is valid
   static int debugCounter = 0;
   if (debugCounter % 300 == 0) { // Every 5 seconds
@@ -242,6 +262,23 @@ void player_draw(const player_t *player, Shader lightingShader) {
   }
   debugCounter++;
 
+  // Build the materials with the lighting shader once, not every draw
+  if (player->drawMaterials == NULL ||
+      player->drawShader.id != lightingShader.id ||
+      player->drawShader.locs != lightingShader.locs) {
+    if (lightingShader.id == 0) {
+      TraceLog(LOG_WARNING, "Invalid lighting shader, using default");
+    }
+    player_free_draw_materials(player);
+    player->drawMaterials =
+        player_build_materials(player->model, lightingShader);
+    for (int i = 0; i < BONE_SOCKETS; i++) {
+      player->equipDrawMaterials[i] =
+          player_build_materials(player->equipModels[i], lightingShader);
+    }
+    player->drawShader = lightingShader;
+  }
+
   // Create transformation matrices - reduced scale for smaller player
   Matrix directionRotation = MatrixRotateY(player->rotation_y * DEG2RAD);
   Matrix scaleMatrix =
@@ -253,25 +290,16 @@ void player_draw(const player_t *player, Shader lightingShader) {
   Matrix transform = MatrixMultiply(scaleMatrix, directionRotation);
   transform = MatrixMultiply(transform, translationMatrix);
 
-  // Draw main character model
+  // Apply player color to the materials
   Model model = player->model;
-  for (int i = 0; i < model.meshCount; i++) {
-    if (lightingShader.id > 0) {
-      // Create a temporary material with the lighting shader
-      Material tempMaterial = model.materials[model.meshMaterial[i]];
-      tempMaterial.shader = lightingShader;
-
-      // Apply player color to the material
-      tempMaterial.maps[MATERIAL_MAP_DIFFUSE].color = player->color;
+  for (int i = 0; i < model.materialCount; i++) {
+    player->drawMaterials[i].maps[MATERIAL_MAP_DIFFUSE].color = player->color;
+  }
 
-      DrawMesh(model.meshes[i], tempMaterial, transform);
-    } else {
-      TraceLog(LOG_WARNING, "Invalid lighting shader, using default");
-      // Fallback to default material
-      Material tempMaterial = model.materials[model.meshMaterial[i]];
-      tempMaterial.maps[MATERIAL_MAP_DIFFUSE].color = player->color;
-      DrawMesh(model.meshes[i], tempMaterial, transform);
-    }
+  // Draw main character model
+  for (int i = 0; i < model.meshCount; i++) {
+    DrawMesh(model.meshes[i], player->drawMaterials[model.meshMaterial[i]],
+             transform);
   }
 
   // Draw accessories at bone socket positions
@@ -300,19 +328,11 @@ void player_draw(const player_t *player, Shader lightingShader) {
 
         // Draw accessory model
         Model accessoryModel = player->equipModels[i];
+        Material *accessoryMaterials = player->equipDrawMaterials[i];
         for (int j = 0; j < accessoryModel.meshCount; j++) {
-          if (lightingShader.id > 0) {
-            Material tempMaterial =
-                accessoryModel.materials[accessoryModel.meshMaterial[j]];
-            tempMaterial.shader = lightingShader;
-            DrawMesh(accessoryModel.meshes[j], tempMaterial,
-                     accessoryTransform);
-          } else {
-            Material tempMaterial =
-                accessoryModel.materials[accessoryModel.meshMaterial[j]];
-            DrawMesh(accessoryModel.meshes[j], tempMaterial,
-                     accessoryTransform);
-          }
+          DrawMesh(accessoryModel.meshes[j],
+                   accessoryMaterials[accessoryModel.meshMaterial[j]],
+                   accessoryTransform);
         }
       }
     }
@@ -320,6 +340,7 @@ void player_draw(const player_t *player, Shader lightingShader) {
 }
 
 void player_cleanup(player_t *player) {
+  player_free_draw_materials(player);
   if (player->anims != NULL) {
     UnloadModelAnimations(player->anims, player->animsCount);
     player->anims = NULL;
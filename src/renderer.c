@@ -4,34 +4,30 @@
 #include "lighting.h"
 #include "player.h"
 #include "scene.h"
+#include "world.h"
 
 // In renderer_draw_game function:
 // In your UI drawing section, add:
 void renderer_draw_game(game_context *gc) {
-  // Update camera position in shader
-  float cameraPos[3] = {gc->camera.position.x, gc->camera.position.y,
-                        gc->camera.position.z};
-  SetShaderValue(gc->lightingShader,
-                 gc->lightingShader.locs[SHADER_LOC_VECTOR_VIEW], cameraPos,
-                 SHADER_UNIFORM_VEC3);
-
-  // Update light values
-  for (int i = 0; i < gc->lightCount; i++) {
-    UpdateLightValues(gc->lightingShader, gc->lights[i], i);
-  }
+  // Update camera position and light values in the shaders
+  lighting_update(gc);
 
   BeginMode3D(gc->camera);
 
-  // Draw scene with lighting shader
+  // Draw the resident world cells with lighting shader
   SceneDrawConfig config = {.camera = gc->camera,
                             .transform = MatrixIdentity(),
                             .layerMask = 0xFFFFFFFF,
                             .sortMode = SCENE_DRAW_SORT_FRONT_TO_BACK,
                             .drawBoundingBoxes = 0,
                             .drawCameraFrustum = 0,
-                            .shader = gc->lightingShader};
+                            .occlusionCulling = 1,
+                            .lodCrossfadeTime = 0.25f,
+                            .workerCount = -1,
+                            .shader = gc->lightingShader,
+                            .instancingShader = gc->lightingInstancedShader};
 
-  SceneDrawStats stats = DrawScene(gc->sceneId, config);
+  SceneDrawStats stats = world_draw(&gc->world, config);
 
   // Draw player with lighting
   player_draw(&gc->player, gc->lightingShader);
@@ -71,8 +67,10 @@ void renderer_draw_game(game_context *gc) {
   }
 
   // Enhanced debug info
-  DrawText(TextFormat("Meshes: %lu, Triangles: %lu", stats.meshDrawCount,
-                      stats.trianglesDrawCount),
+  DrawText(TextFormat("Meshes: %lu, Culled: %lu, Draw calls: %lu, "
+                      "Triangles: %lu",
+                      stats.meshDrawCount, stats.culledMeshCount,
+                      stats.drawCallCount, stats.trianglesDrawCount),
            10, 10, 20, WHITE);
   DrawText("Press Y/R/G/B to toggle lights", 10, 30, 20, WHITE);
   DrawText("Press C to toggle collision debug", 10, 50, 20, WHITE);
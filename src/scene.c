@@ -1,10 +1,20 @@
 #include <raylib.h>
 #include <raymath.h>
+#include <math.h>
+#include <pthread.h>
 #include <rlgl.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #include "scene.h" // Changed from <scene.h> to "scene.h"
-#include <string.h>
+#include "gltf.h"
 
 static void *ListAlloc(void **list, unsigned long *count,
                        unsigned long *capacity, unsigned long size) {
@@ -22,13 +32,29 @@ static void *ListAlloc(void **list, unsigned long *count,
   return (void *)ptr;
 }
 
+// A coarser version of a model: one mesh per mesh of the model, drawn with the
+// model's materials below screenSize
+typedef struct SceneModelLOD {
+  Mesh *meshes;
+  float screenSize;
+} SceneModelLOD;
+
 typedef struct SceneModel {
   long generation;
   Model model;
-  const char *name;
+  unsigned long nameId; // interned in the owning scene's names
   char isManaged;
   BoundingBox *meshBounds;
   Vector4 *meshBoundingSpheres;
+  // levels of detail, ordered by decreasing screen size; level 0 is model
+  SceneModelLOD *lods;
+  int lodCount;
+  // local bounds of all meshes, used to pick the level
+  Vector4 boundingSphere;
+  // index of the model's first material in the scene's material tables
+  unsigned long firstMaterial;
+  // scene wide index of the model's first mesh, which keys its draws
+  unsigned long firstMesh;
 } SceneModel;
 
 typedef struct SceneNode {
@@ -37,46 +63,329 @@ typedef struct SceneNode {
   SceneNodeId nextSiblingId;
   SceneNodeId firstChildId;
 
-  // the generation of the transform data; is increased when TRS is modified
-  unsigned long modTRSGeneration;
-  // if modTRSMarker != modTRSGeneration, the TRS matrix is dirty
-  unsigned long modTRSMarker;
+  // index of the node's TRS data in Scene.transforms
+  unsigned long transformIndex;
+  // range of the node's mesh bounds in Scene.cullBounds
+  unsigned long cullBoundsIndex;
+  unsigned long cullBoundsCount;
+  // leaf of the node in Scene.bvh; -1 if the node has no meshes
+  long bvhLeaf;
 
-  Vector3 position;
-  Vector3 rotation;
-  Vector3 scale;
-  char *name;
-  Matrix localToWorld;
-  Matrix worldToLocal;
+  // interned name, 0 if unnamed; nodes sharing a name form a list
+  unsigned long nameId;
+  long previousNamed, nextNamed;
 
   // SceneNode metadata
   int userIdentifier;
   SceneModelId model;
+  // bitmask of the SCENE_LAYER_COUNT layers the node belongs to
+  unsigned long layers;
+
+  // level of detail of the model drawn last, the level it is fading out from
+  // and when the fade started
+  unsigned char lod, lodPrevious;
+  double lodFadeStart;
 
 } SceneNode;
 
+// Interned strings of a scene, referenced by id (entry index + 1, 0 is no
+// name). The characters are packed into blocks, so interning doesn't allocate
+// per string. Entries count the nodes and models using them; a name nobody
+// uses any more is dropped and its id reused, and once dropped names take up
+// more than half of the blocks, the live ones are packed into new blocks.
+#define SCENE_NAME_BLOCK_SIZE 4096
+
+typedef struct SceneName {
+  const char *chars; // 0 for a dropped name
+  unsigned long length;
+  unsigned long hash;
+  unsigned long references;
+  long firstNode; // index of a node with this name, -1 if none
+} SceneName;
+
+typedef struct SceneNames {
+  SceneName *entries;
+  unsigned long count;
+  unsigned long capacity;
+  // open addressing table of name ids, a power of two at most half full
+  unsigned long *slots;
+  unsigned long slotsCapacity;
+
+  // ids of dropped entries, reused first
+  unsigned long *freeIds;
+  unsigned long freeIdsCount;
+  unsigned long freeIdsCapacity;
+
+  char **blocks;
+  unsigned long blocksCount;
+  unsigned long blocksCapacity;
+  unsigned long blockUsed;
+  unsigned long blockSize; // of the last block
+  // characters of all names in the blocks, and of the dropped ones among them
+  unsigned long usedChars;
+  unsigned long freeChars;
+} SceneNames;
+
+// Transform data of all live nodes in SoA layout. The arrays are kept in
+// parent-before-child order, so world matrices can be resolved front to back
+// without recursion or parent chain walks.
+typedef struct SceneTransforms {
+  unsigned long count;
+  unsigned long capacity;
+
+  unsigned long *nodeIndex; // index into Scene.nodes
+  long *parent;             // transform index of the parent; -1 for roots
+  // world matrix is stale; a dirty node always has a dirty subtree
+  unsigned char *dirty;
+
+  Vector3 *position;
+  Vector3 *rotation;
+  Vector3 *scale;
+  Matrix *localToWorld;
+} SceneTransforms;
+
+// World space bounds of every mesh of every node that has a model, in
+// center/extent SoA layout so the culling kernel can test a batch of boxes per
+// instruction. The arrays are padded to a multiple of SCENE_CULL_BATCH. Every
+// mesh also has a bounding sphere around the box center, which decides most
+// meshes before the box is tested.
+typedef struct SceneCullBounds {
+  unsigned long count;
+  unsigned long capacity;
+
+  unsigned long *nodeIndex;
+  int *meshIndex;
+  float *centerX;
+  float *centerY;
+  float *centerZ;
+  float *extentX;
+  float *extentY;
+  float *extentZ;
+  float *radius;
+
+  // the frustum plane that rejected the mesh last, tested first next time
+  unsigned char *rejectPlane;
+  // output of the culling kernel; 1 if the box intersects the frustum
+  unsigned char *visible;
+} SceneCullBounds;
+
+// A node of the dynamic bounding volume hierarchy. Leaves reference a scene
+// node and store its world bounds enlarged by SCENE_BVH_MARGIN, so small
+// movements don't touch the tree at all.
+typedef struct SceneBVHNode {
+  BoundingBox box;
+  long parent; // next free node while on the free list
+  long child1; // -1 for leaves
+  long child2;
+  long height; // 0 for leaves, -1 for free nodes
+  unsigned long nodeIndex;
+} SceneBVHNode;
+
+typedef struct SceneBVH {
+  SceneBVHNode *nodes;
+  long count;
+  long capacity;
+  long root;
+  long freeList;
+} SceneBVH;
+
+// A visible mesh queued for drawing. The sort key is filled in before the
+// queue is sorted; see BuildSceneDrawKeys for its layout.
+typedef struct SceneDrawItem {
+  unsigned long nodeIndex;
+  int meshIndex;
+  unsigned long long sortKey;
+  // level of detail of the mesh, and its share of the pixels while the node
+  // crossfades between levels (see SelectSceneDrawItemLODs); 0 when opaque
+  int lod;
+  float fade;
+} SceneDrawItem;
+
+// The materials of all models as DrawScene draws them for one pair of shader
+// overrides: with a white diffuse tint and the shader swapped in, two variants
+// per material, plain and instanced. The variants of a material share one
+// copy of its maps, so the models' own materials are never touched.
+typedef struct SceneMaterialTable {
+  Shader shader;
+  Shader instancingShader;
+  Material *materials; // 2 per scene material
+  MaterialMap *maps;   // SCENE_MATERIAL_MAP_COUNT per scene material
+  unsigned long count; // scene materials in the table
+} SceneMaterialTable;
+
+// A range of the gathered meshes culled on a worker into a draw list of its
+// own, see SplitSceneDrawJobs
+typedef struct SceneDrawJob {
+  unsigned long first, last; // range of the gathered meshes
+  // room for twice the range, for the crossfade duplicates
+  SceneDrawItem *items;
+  unsigned long itemsCapacity;
+  unsigned long visibleCount; // items that passed culling
+  unsigned long itemsCount;   // and their crossfade duplicates after them
+} SceneDrawJob;
+
+// Pool of the components of one definition. Component data and the owning
+// nodes are packed and kept packed by swap-remove, so systems iterate them
+// linearly; a sparse array maps node indices to pool entries.
 typedef struct SceneComponentData {
   unsigned char *componentData;
+  SceneNodeId *nodeIds;
+  unsigned long count;
+  unsigned long capacity;
+  // node index -> pool index + 1, 0 if the node has no such component
+  unsigned long *nodeEntries;
+  // per node index, bumped whenever the node gets a component of this type
+  unsigned short *nodeGenerations;
+  unsigned long nodeEntriesCapacity;
 } SceneComponentData;
 
+// node indices of the members of one layer
+typedef struct SceneLayer {
+  unsigned long *nodeIndices;
+  unsigned long count;
+  unsigned long capacity;
+} SceneLayer;
+
+// Storage that grows one fixed size page at a time. Elements never move, so
+// pointers to them stay valid while the list grows, and growing only copies
+// the page table.
+#define SCENE_PAGE_SHIFT 8
+#define SCENE_PAGE_SIZE (1ul << SCENE_PAGE_SHIFT)
+
+typedef struct ScenePagedList {
+  char **pages;
+  unsigned long count;
+  unsigned long pagesCount;
+  unsigned long pagesCapacity;
+} ScenePagedList;
+
 typedef struct Scene {
   long generation;
 
   SceneComponentData sceneComponentData[256];
+  SceneNames names;
 
   SceneNodeId firstRoot, firstFree;
-  SceneNode *nodes;
-  unsigned long nodesCount;
-  unsigned long nodesCapacity;
+  ScenePagedList nodes;  // of SceneNode
+  ScenePagedList models; // of SceneModel
+  // generations handed out before DefragmentScene trimmed the node storage;
+  // new node slots start above it so old handles can't match them
+  long nodeGenerationFloor;
+
+  SceneTransforms transforms;
+  // node indices whose world matrix is stale; only these are visited by the
+  // transform sweep
+  unsigned long *dirtyNodes;
+  unsigned long dirtyNodesCount;
+  unsigned long dirtyNodesCapacity;
+  // set when the parent-before-child order of transforms is broken
+  char transformOrderDirty;
+  // set when the order is still valid but some subtree is no longer
+  // contiguous; only the traversals need it to be depth first
+  char transformSubtreesSplit;
+
+  SceneCullBounds cullBounds;
+  // set when nodes gained or lost meshes; the bounds are rebuilt before use
+  char cullBoundsDirty;
 
-  SceneModel *models;
-  unsigned long modelsCount;
-  unsigned long modelsCapacity;
+  SceneBVH bvh;
+  // meshes of BVH leaves that straddle a frustum plane; tested in batches
+  SceneCullBounds cullCandidates;
+  SceneDrawItem *drawItems;
+  SceneDrawItem *drawItemsScratch;
+  Matrix *instanceTransforms;
+  unsigned long instanceTransformsCapacity;
+  unsigned long drawItemsCount;
+  unsigned long drawItemsCapacity;
+  // per job draw lists of the last parallel DrawScene, see SplitSceneDrawJobs
+  SceneDrawJob *drawJobs;
+  unsigned long drawJobsCapacity;
+
+  // materials and meshes of all models added so far, see
+  // SceneModel.firstMaterial and SceneModel.firstMesh
+  unsigned long materialCount;
+  unsigned long meshCount;
+  SceneMaterialTable *materialTables;
+  unsigned long materialTablesCount;
+  unsigned long materialTablesCapacity;
+
+  // textures loaded by AddGLTFScene; models share them, the scene owns them
+  Texture2D *textures;
+  unsigned long texturesCount;
+  unsigned long texturesCapacity;
+
+  SceneLayer layers[SCENE_LAYER_COUNT];
+  // union of the layers that have members
+  unsigned long usedLayers;
+  // set when nodes were added, removed or changed layers
+  char layersDirty;
+
+  // world space occluder triangles, three vertices each
+  Vector3 *occluderVertices;
+  unsigned long occluderVerticesCount;
+  unsigned long occluderVerticesCapacity;
+  // coarse depth buffer the occluders are rasterized into, see
+  // RasterizeSceneOccluders; allocated on first use
+  float *occlusionDepth;
 
 } Scene;
 
-static Scene *scenes = 0;
+// scenes are allocated one by one, so Scene pointers survive LoadScene
+static Scene **scenes = 0;
 static unsigned long scenesCount = 0;
+static unsigned long scenesCapacity = 0;
+
+static void *PagedListAt(ScenePagedList *list, unsigned long index,
+                         unsigned long size) {
+  return list->pages[index >> SCENE_PAGE_SHIFT] +
+         (index & (SCENE_PAGE_SIZE - 1)) * size;
+}
+
+// appends a zeroed element
+static void *PagedListAlloc(ScenePagedList *list, unsigned long size) {
+  if (list->count >= list->pagesCount * SCENE_PAGE_SIZE) {
+    if (list->pagesCount >= list->pagesCapacity) {
+      list->pagesCapacity =
+          list->pagesCapacity == 0 ? 8 : list->pagesCapacity * 2;
+      list->pages =
+          list->pages
+              ? MemRealloc(list->pages, sizeof(char *) * list->pagesCapacity)
+              : MemAlloc(sizeof(char *) * list->pagesCapacity);
+    }
+    list->pages[list->pagesCount++] = MemAlloc(SCENE_PAGE_SIZE * size);
+  }
+
+  void *element = PagedListAt(list, list->count++, size);
+  memset(element, 0, size);
+  return element;
+}
+
+// frees the pages past the last element
+static void TrimPagedList(ScenePagedList *list) {
+  unsigned long pagesNeeded =
+      (list->count + SCENE_PAGE_SIZE - 1) >> SCENE_PAGE_SHIFT;
+  while (list->pagesCount > pagesNeeded) {
+    MemFree(list->pages[--list->pagesCount]);
+  }
+}
+
+static void FreePagedList(ScenePagedList *list) {
+  for (unsigned long i = 0; i < list->pagesCount; i++) {
+    MemFree(list->pages[i]);
+  }
+  if (list->pages) {
+    MemFree(list->pages);
+  }
+  *list = (ScenePagedList){0};
+}
+
+static SceneNode *GetSceneNodeAt(Scene *scene, unsigned long index) {
+  return PagedListAt(&scene->nodes, index, sizeof(SceneNode));
+}
+
+static SceneModel *GetSceneModelAt(Scene *scene, unsigned long index) {
+  return PagedListAt(&scene->models, index, sizeof(SceneModel));
+}
 
 static SceneNodeComponentDefinition sceneNodeComponentDefinitions[256] = {0};
 
@@ -93,49 +402,101 @@ void RegisterSceneNodeComponent(SceneNodeComponentDefinition definition) {
 }
 
 static SceneNode *GetSceneNode(SceneNodeId sceneNodeId, Scene **sceneOut);
+static void FreeSceneTransforms(SceneTransforms *transforms);
+static void UpdateTransforms(Scene *scene);
+static void FreeSceneCullBounds(SceneCullBounds *bounds);
+static void UpdateSceneNodeCullBounds(Scene *scene, SceneNode *node);
+static void RemoveSceneBVHLeaf(Scene *scene, SceneNode *node);
+static void UpdateSceneBVHLeaf(Scene *scene, SceneNode *node);
+static Scene *GetScene(SceneId sceneId);
+static unsigned long InternSceneName(SceneNames *names, const char *str);
+static void ReleaseSceneName(SceneNames *names, unsigned long id);
+static const char *GetSceneNameChars(SceneNames *names, unsigned long id);
+static void FreeSceneNames(SceneNames *names);
+static void UnlinkSceneNodeName(Scene *scene, unsigned long nodeIndex);
+static void RemoveSceneComponentEntry(Scene *scene, int definitionId,
+                                      unsigned long nodeIndex);
+static Matrix *ReserveSceneInstanceTransforms(Scene *scene,
+                                              unsigned long count);
+static void StopSceneWorkers(void);
 
 // # Scene Management Functions
 SceneId LoadScene() {
   int useIndex = -1;
   for (unsigned long i = 0; i < scenesCount; i++) {
-    if (scenes[i].generation < 0) {
+    if (scenes[i]->generation < 0) {
       useIndex = i;
       break;
     }
   }
 
   if (useIndex == -1) {
-    scenes = scenes ? MemRealloc(scenes, sizeof(Scene) * (scenesCount + 1))
-                    : MemAlloc(sizeof(Scene));
+    if (scenesCount >= scenesCapacity) {
+      scenesCapacity = scenesCapacity == 0 ? 4 : scenesCapacity * 2;
+      scenes = scenes ? MemRealloc(scenes, sizeof(Scene *) * scenesCapacity)
+                      : MemAlloc(sizeof(Scene *) * scenesCapacity);
+    }
+    scenes[scenesCount] = MemAlloc(sizeof(Scene));
+    scenes[scenesCount]->generation = 0;
     useIndex = scenesCount;
     scenesCount++;
   }
 
-  SceneId sceneId = {useIndex, scenes[useIndex].generation};
+  SceneId sceneId = {useIndex, scenes[useIndex]->generation};
   sceneId.generation = -sceneId.generation + 1;
 
-  scenes[useIndex] = (Scene){.generation = sceneId.generation};
+  *scenes[useIndex] = (Scene){.generation = sceneId.generation,
+                              .bvh = {.root = -1, .freeList = -1}};
 
   return sceneId;
 }
 
 void UnloadScene(SceneId sceneId) {
-  if (sceneId.id >= scenesCount ||
-      scenes[sceneId.id].generation != sceneId.generation) {
+  if (!IsSceneValid(sceneId)) {
     return;
   }
 
-  scenes[sceneId.id].generation = -scenes[sceneId.id].generation;
+  // components are removed while the scene is still valid, so onRemove can
+  // query their nodes
+  for (int d = 0; d < 256; d++) {
+    SceneComponentData *pool = &scenes[sceneId.id]->sceneComponentData[d];
+    while (pool->count > 0) {
+      RemoveSceneComponentEntry(scenes[sceneId.id], d,
+                                pool->nodeIds[pool->count - 1].id);
+    }
+  }
 
-  Scene *scene = &scenes[sceneId.id];
+  scenes[sceneId.id]->generation = -scenes[sceneId.id]->generation;
+
+  Scene *scene = scenes[sceneId.id];
+  for (int d = 0; d < 256; d++) {
+    SceneComponentData *pool = &scene->sceneComponentData[d];
+    MemFree(pool->componentData);
+    MemFree(pool->nodeIds);
+    MemFree(pool->nodeEntries);
+    MemFree(pool->nodeGenerations);
+    *pool = (SceneComponentData){0};
+  }
   // Unload all scene resources
-  for (int i = 0; i < scene->modelsCount; i++) {
-    SceneModel *sceneModel = &scene->models[i];
+  for (int i = 0; i < scene->models.count; i++) {
+    SceneModel *sceneModel = GetSceneModelAt(scene, i);
     MemFree(sceneModel->meshBounds);
     MemFree(sceneModel->meshBoundingSpheres);
     sceneModel->meshBounds = 0;
     sceneModel->meshBoundingSpheres = 0;
 
+    for (int l = 0; l < sceneModel->lodCount; l++) {
+      SceneModelLOD *lod = &sceneModel->lods[l];
+      for (int k = 0; sceneModel->isManaged && k < sceneModel->model.meshCount;
+           k++) {
+        UnloadMesh(lod->meshes[k]);
+      }
+      MemFree(lod->meshes);
+    }
+    MemFree(sceneModel->lods);
+    sceneModel->lods = 0;
+    sceneModel->lodCount = 0;
+
     if (sceneModel->generation < 0 || !sceneModel->isManaged) {
       continue;
     }
@@ -143,126 +504,172 @@ void UnloadScene(SceneId sceneId) {
     UnloadModel(sceneModel->model);
   }
 
-  if (scene->models) {
-    MemFree(scene->models);
-    scene->models = 0;
-  }
+  FreePagedList(&scene->models);
+  FreeSceneNames(&scene->names);
+  FreePagedList(&scene->nodes);
 
-  for (int i = 0; i < scene->nodesCount; i++) {
-    SceneNode *node = &scene->nodes[i];
-    if (node->generation < 0) {
-      continue;
+  FreeSceneTransforms(&scene->transforms);
+  FreeSceneCullBounds(&scene->cullBounds);
+  FreeSceneCullBounds(&scene->cullCandidates);
+  if (scene->bvh.nodes) {
+    MemFree(scene->bvh.nodes);
+  }
+  scene->bvh = (SceneBVH){0};
+  for (unsigned long i = 0; i < scene->texturesCount; i++) {
+    UnloadTexture(scene->textures[i]);
+  }
+  if (scene->textures) {
+    MemFree(scene->textures);
+    scene->textures = 0;
+  }
+  for (int l = 0; l < SCENE_LAYER_COUNT; l++) {
+    if (scene->layers[l].nodeIndices) {
+      MemFree(scene->layers[l].nodeIndices);
+      scene->layers[l].nodeIndices = 0;
     }
-
-    if (node->name) {
-      MemFree(node->name);
-      node->name = 0;
+  }
+  if (scene->instanceTransforms) {
+    MemFree(scene->instanceTransforms);
+    scene->instanceTransforms = 0;
+  }
+  if (scene->drawItemsScratch) {
+    MemFree(scene->drawItemsScratch);
+    scene->drawItemsScratch = 0;
+  }
+  if (scene->drawItems) {
+    MemFree(scene->drawItems);
+    scene->drawItems = 0;
+  }
+  for (unsigned long j = 0; j < scene->drawJobsCapacity; j++) {
+    if (scene->drawJobs[j].items) {
+      MemFree(scene->drawJobs[j].items);
     }
   }
+  if (scene->drawJobs) {
+    MemFree(scene->drawJobs);
+    scene->drawJobs = 0;
+    scene->drawJobsCapacity = 0;
+  }
+  for (unsigned long t = 0; t < scene->materialTablesCount; t++) {
+    MemFree(scene->materialTables[t].materials);
+    MemFree(scene->materialTables[t].maps);
+  }
+  if (scene->materialTables) {
+    MemFree(scene->materialTables);
+    scene->materialTables = 0;
+    scene->materialTablesCount = 0;
+    scene->materialTablesCapacity = 0;
+  }
+  if (scene->dirtyNodes) {
+    MemFree(scene->dirtyNodes);
+    scene->dirtyNodes = 0;
+  }
+  if (scene->occluderVertices) {
+    MemFree(scene->occluderVertices);
+    scene->occluderVertices = 0;
+  }
+  if (scene->occlusionDepth) {
+    MemFree(scene->occlusionDepth);
+    scene->occlusionDepth = 0;
+  }
 
   // clean up all when last scene is unloaded
   for (unsigned long i = 0; i < scenesCount; i++) {
-    if (scenes[i].generation > 0) {
+    if (scenes[i]->generation > 0) {
       // still have a loaded scene, don't free anything
       return;
     }
   }
 
+  StopSceneWorkers();
+  for (unsigned long i = 0; i < scenesCount; i++) {
+    MemFree(scenes[i]);
+  }
   MemFree(scenes);
   scenes = 0;
   scenesCount = 0;
+  scenesCapacity = 0;
 }
 
 int IsSceneValid(SceneId sceneId) {
   return sceneId.id < scenesCount &&
-         scenes[sceneId.id].generation == sceneId.generation;
+         scenes[sceneId.id]->generation == sceneId.generation;
 }
 
-static Vector3 Vector4Transform3(Vector4 v, Matrix m) {
-  Vector4 result = {0};
-  result.x = v.x * m.m0 + v.y * m.m4 + v.z * m.m8 + v.w * m.m12;
-  result.y = v.x * m.m1 + v.y * m.m5 + v.z * m.m9 + v.w * m.m13;
-  result.z = v.x * m.m2 + v.y * m.m6 + v.z * m.m10 + v.w * m.m14;
-  result.w = v.x * m.m3 + v.y * m.m7 + v.z * m.m11 + v.w * m.m15;
-  return (Vector3){result.x / result.w, result.y / result.w,
-                   result.z / result.w};
+// Extracts the frustum planes from a combined view-projection matrix
+// (Gribb/Hartmann). A point p is inside plane i if dot(normal, p) >= w. The
+// planes are ordered near, far, right, left, top, bottom.
+static void ExtractFrustumPlanes(Matrix viewProj, Vector4 *planes) {
+  // rows of the matrix that produce the clip space x, y, z and w coordinates
+  Vector4 rowX = {viewProj.m0, viewProj.m4, viewProj.m8, viewProj.m12};
+  Vector4 rowY = {viewProj.m1, viewProj.m5, viewProj.m9, viewProj.m13};
+  Vector4 rowZ = {viewProj.m2, viewProj.m6, viewProj.m10, viewProj.m14};
+  Vector4 rowW = {viewProj.m3, viewProj.m7, viewProj.m11, viewProj.m15};
+
+  // -w <= x, y, z <= w in OpenGL clip space
+  Vector4 clip[6] = {
+      {rowW.x + rowZ.x, rowW.y + rowZ.y, rowW.z + rowZ.z, rowW.w + rowZ.w},
+      {rowW.x - rowZ.x, rowW.y - rowZ.y, rowW.z - rowZ.z, rowW.w - rowZ.w},
+      {rowW.x - rowX.x, rowW.y - rowX.y, rowW.z - rowX.z, rowW.w - rowX.w},
+      {rowW.x + rowX.x, rowW.y + rowX.y, rowW.z + rowX.z, rowW.w + rowX.w},
+      {rowW.x - rowY.x, rowW.y - rowY.y, rowW.z - rowY.z, rowW.w - rowY.w},
+      {rowW.x + rowY.x, rowW.y + rowY.y, rowW.z + rowY.z, rowW.w + rowY.w},
+  };
+
+  for (int i = 0; i < 6; i++) {
+    float length = sqrtf(clip[i].x * clip[i].x + clip[i].y * clip[i].y +
+                         clip[i].z * clip[i].z);
+    float invLength = length > 0.0f ? 1.0f / length : 0.0f;
+    planes[i] = (Vector4){clip[i].x * invLength, clip[i].y * invLength,
+                          clip[i].z * invLength, -clip[i].w * invLength};
+  }
 }
 
-static void CalcFrustumCorners(Camera3D camera, Vector3 *corners) {
-  Matrix view = GetCameraMatrix(camera);
-  Matrix proj = MatrixIdentity();
-  
-  // Use the correct projection matrix based on camera type
-  if (camera.projection == CAMERA_ORTHOGRAPHIC) {
-    // For orthographic projection, use the fovy as the orthographic size
-    float orthoSize = camera.fovy;
-    float aspect = (double)GetScreenWidth() / (double)GetScreenHeight();
-    proj = MatrixOrtho(-orthoSize * aspect, orthoSize * aspect, 
-                       -orthoSize, orthoSize, 
-                       0.1f, 120.0f); // Reduced from 200.0f to 120.0f for better performance
-  } else {
-    proj = MatrixPerspective(
-        camera.fovy * DEG2RAD,
-        (double)GetScreenWidth() / (double)GetScreenHeight(), 1.0f,
-        80.0f); // Keep perspective far plane at 80.0f
-  }
-  
-  Matrix viewProj = MatrixMultiply(view, proj);
-  viewProj = MatrixInvert(viewProj);
-  corners[0] = Vector4Transform3((Vector4){-1, -1, -1, 1}, viewProj);
-  corners[1] = Vector4Transform3((Vector4){1, -1, -1, 1}, viewProj);
-  corners[2] = Vector4Transform3((Vector4){1, 1, -1, 1}, viewProj);
-  corners[3] = Vector4Transform3((Vector4){-1, 1, -1, 1}, viewProj);
-  corners[4] = Vector4Transform3((Vector4){-1, -1, 1, 1}, viewProj);
-  corners[5] = Vector4Transform3((Vector4){1, -1, 1, 1}, viewProj);
-  corners[6] = Vector4Transform3((Vector4){1, 1, 1, 1}, viewProj);
-  corners[7] = Vector4Transform3((Vector4){-1, 1, 1, 1}, viewProj);
-}
-
-static void GetCameraFrustumPlanes(Camera3D camera, Vector4 *planes) {
-  // this algorithm is absolutely nowhere near optimal, but I am able
-  // to understand it and it works; it can be optimized later
-  Vector3 corners[8];
-  CalcFrustumCorners(camera, corners);
-  Vector3 nearCenter = Vector3Scale(Vector3Add(corners[0], corners[2]), 0.5f);
-  Vector3 farCenter = Vector3Scale(Vector3Add(corners[4], corners[6]), 0.5f);
-  Vector3 rightCenter = Vector3Scale(Vector3Add(corners[1], corners[6]), 0.5f);
-  Vector3 leftCenter = Vector3Scale(Vector3Add(corners[0], corners[7]), 0.5f);
-  Vector3 topCenter = Vector3Scale(Vector3Add(corners[2], corners[7]), 0.5f);
-  Vector3 bottomCenter = Vector3Scale(Vector3Add(corners[0], corners[5]), 0.5f);
-
-  Vector3 nearCenterNormal =
-      Vector3Normalize(Vector3Subtract(nearCenter, camera.position));
-  Vector3 farCenterNormal = Vector3Scale(nearCenterNormal, -1.0f);
-  Vector3 rightCenterNormal = Vector3Normalize(
-      Vector3CrossProduct(Vector3Subtract(corners[2], corners[1]),
-                          Vector3Subtract(corners[6], corners[2])));
-  Vector3 leftCenterNormal = Vector3Normalize(
-      Vector3CrossProduct(Vector3Subtract(corners[3], corners[0]),
-                          Vector3Subtract(corners[0], corners[4])));
-  Vector3 topCenterNormal = Vector3Normalize(
-      Vector3CrossProduct(Vector3Subtract(corners[3], corners[2]),
-                          Vector3Subtract(corners[7], corners[3])));
-  Vector3 bottomCenterNormal = Vector3Normalize(
-      Vector3CrossProduct(Vector3Subtract(corners[1], corners[0]),
-                          Vector3Subtract(corners[5], corners[1])));
-
-  planes[0] =
-      (Vector4){nearCenterNormal.x, nearCenterNormal.y, nearCenterNormal.z,
-                Vector3DotProduct(nearCenter, nearCenterNormal)};
-  planes[1] = (Vector4){farCenterNormal.x, farCenterNormal.y, farCenterNormal.z,
-                        Vector3DotProduct(farCenter, farCenterNormal)};
-  planes[2] =
-      (Vector4){rightCenterNormal.x, rightCenterNormal.y, rightCenterNormal.z,
-                Vector3DotProduct(rightCenter, rightCenterNormal)};
-  planes[3] =
-      (Vector4){leftCenterNormal.x, leftCenterNormal.y, leftCenterNormal.z,
-                Vector3DotProduct(leftCenter, leftCenterNormal)};
-  planes[4] = (Vector4){topCenterNormal.x, topCenterNormal.y, topCenterNormal.z,
-                        Vector3DotProduct(topCenter, topCenterNormal)};
-  planes[5] = (Vector4){bottomCenterNormal.x, bottomCenterNormal.y,
-                        bottomCenterNormal.z,
-                        Vector3DotProduct(bottomCenter, bottomCenterNormal)};
+// planes are cached per camera and projection, so multiple cameras (e.g. a
+// debug view) don't evict each other every frame
+#define SCENE_FRUSTUM_CACHE_SIZE 4
+
+typedef struct SceneFrustumCacheEntry {
+  Camera3D camera;
+  Matrix projection;
+  Matrix viewProjection;
+  Vector4 planes[6];
+  char valid;
+} SceneFrustumCacheEntry;
+
+static SceneFrustumCacheEntry frustumCache[SCENE_FRUSTUM_CACHE_SIZE] = {0};
+static int frustumCacheNext = 0;
+
+// Returns the frustum planes of the camera with the projection that is
+// currently active in rlgl; inside BeginMode3D this is exactly the projection
+// raylib renders with (aspect ratio, near and far cull distances included).
+// Also returns the view-projection matrix the planes come from.
+static void GetCameraFrustumPlanes(Camera3D camera, Vector4 *planes,
+                                   Matrix *viewProjection) {
+  Matrix projection = rlGetMatrixProjection();
+  for (int i = 0; i < SCENE_FRUSTUM_CACHE_SIZE; i++) {
+    SceneFrustumCacheEntry *entry = &frustumCache[i];
+    if (entry->valid &&
+        memcmp(&entry->camera, &camera, sizeof(Camera3D)) == 0 &&
+        memcmp(&entry->projection, &projection, sizeof(Matrix)) == 0) {
+      memcpy(planes, entry->planes, sizeof(entry->planes));
+      *viewProjection = entry->viewProjection;
+      return;
+    }
+  }
+
+  // same view matrix as BeginMode3D
+  Matrix view = MatrixLookAt(camera.position, camera.target, camera.up);
+  *viewProjection = MatrixMultiply(view, projection);
+  ExtractFrustumPlanes(*viewProjection, planes);
+
+  SceneFrustumCacheEntry *entry = &frustumCache[frustumCacheNext];
+  frustumCacheNext = (frustumCacheNext + 1) % SCENE_FRUSTUM_CACHE_SIZE;
+  *entry = (SceneFrustumCacheEntry){.camera = camera,
+                                    .projection = projection,
+                                    .viewProjection = *viewProjection,
+                                    .valid = 1};
+  memcpy(entry->planes, planes, sizeof(entry->planes));
 }
 
 static void DrawPlaneEq(Vector4 planeEq, Color color) {
@@ -317,268 +724,4103 @@ int CheckCollisionBoxFrustum(BoundingBox box, Vector4 *planes,
   return 1;
 }
 
-SceneDrawStats DrawScene(SceneId sceneId, SceneDrawConfig config) {
-  SceneDrawStats stats = {0};
-  if (!IsSceneValid(sceneId)) {
-    return stats;
-  }
+// # Worker Pool Functions
+// Threads are started on first use and kept until the last scene is
+// unloaded, so handing out jobs every frame only costs a wake up. One batch of
+// jobs runs at a time; a caller that finds the pool busy, like a job handing
+// out jobs of its own, runs its batch on the calling thread instead.
+#define SCENE_MAX_WORKER_COUNT 64
 
-  Camera3D camera = config.camera;
-  Matrix transform = config.transform;
-  unsigned long layerMask = config.layerMask;
-  int sortMode = config.sortMode;
-  char drawBoundingBoxes = config.drawBoundingBoxes;
-  Shader shader = config.shader; // Add this line
+typedef void (*SceneJobFunction)(void *data, unsigned long job);
 
-  Vector4 frustumPlanes[6];
-  GetCameraFrustumPlanes(camera, frustumPlanes);
+typedef struct SceneWorkerPool {
+  pthread_mutex_t lock;
+  pthread_cond_t wake;     // a batch was handed out or the pool stops
+  pthread_cond_t finished; // the last job of the batch is done
+  pthread_t threads[SCENE_MAX_WORKER_COUNT - 1];
+  int threadCount;
+  // threads with a lower index take part in the current batch
+  int activeCount;
+  char busy;
+  char stopping;
 
-  if (config.drawCameraFrustum) {
-    DrawPlaneEq(frustumPlanes[0], GREEN);
-    DrawPlaneEq(frustumPlanes[1], GREEN);
-    DrawPlaneEq(frustumPlanes[2], GREEN);
-    DrawPlaneEq(frustumPlanes[3], GREEN);
-    DrawPlaneEq(frustumPlanes[4], GREEN);
-    DrawPlaneEq(frustumPlanes[5], GREEN);
+  SceneJobFunction function;
+  void *data;
+  unsigned long jobCount;
+  unsigned long nextJob;
+  unsigned long doneCount;
+} SceneWorkerPool;
+
+static SceneWorkerPool sceneWorkerPool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+    .finished = PTHREAD_COND_INITIALIZER};
+
+// takes jobs of the current batch until none are left; called and returns
+// with the lock held
+static void RunSceneWorkerJobs(SceneWorkerPool *pool) {
+  while (pool->nextJob < pool->jobCount) {
+    unsigned long job = pool->nextJob++;
+    SceneJobFunction function = pool->function;
+    void *data = pool->data;
+    pthread_mutex_unlock(&pool->lock);
+    function(data, job);
+    pthread_mutex_lock(&pool->lock);
+    if (++pool->doneCount == pool->jobCount) {
+      pthread_cond_signal(&pool->finished);
+    }
   }
+}
 
-  Scene *scene = &scenes[sceneId.id];
-  for (int i = 0; i < scene->nodesCount; i++) {
-    SceneNode *node = &scene->nodes[i];
-    if (node->generation < 0) {
-      continue;
+static void *RunSceneWorker(void *arg) {
+  SceneWorkerPool *pool = &sceneWorkerPool;
+  int index = (int)(size_t)arg;
+  pthread_mutex_lock(&pool->lock);
+  for (;;) {
+    while (!pool->stopping &&
+           (index >= pool->activeCount || pool->nextJob >= pool->jobCount)) {
+      pthread_cond_wait(&pool->wake, &pool->lock);
+    }
+    if (pool->stopping) {
+      break;
     }
+    RunSceneWorkerJobs(pool);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return 0;
+}
 
-    SceneModel *sceneModel = &scene->models[node->model.id];
-    if (sceneModel->generation != node->model.generation) {
-      continue;
+// Calls function for every job in [0, jobCount) on up to workerCount threads,
+// including the calling one, and returns when all of them are done. Jobs are
+// taken in order but finish in any order.
+static void RunSceneJobs(SceneJobFunction function, void *data,
+                         unsigned long jobCount, int workerCount) {
+  SceneWorkerPool *pool = &sceneWorkerPool;
+  if (workerCount > SCENE_MAX_WORKER_COUNT) {
+    workerCount = SCENE_MAX_WORKER_COUNT;
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  if (workerCount <= 1 || jobCount <= 1 || pool->busy) {
+    pthread_mutex_unlock(&pool->lock);
+    for (unsigned long job = 0; job < jobCount; job++) {
+      function(data, job);
     }
+    return;
+  }
 
-    Matrix matrix =
-        GetSceneNodeLocalTransform((SceneNodeId){sceneId, i, node->generation});
-    Model model = sceneModel->model;
-    for (int i = 0; i < model.meshCount; i++) {
-      BoundingBox box = sceneModel->meshBounds[i];
-      if (!CheckCollisionBoxFrustum(box, frustumPlanes, matrix)) {
-        stats.culledMeshCount++;
-        continue;
-      }
+  while (pool->threadCount < workerCount - 1 &&
+         pthread_create(&pool->threads[pool->threadCount], 0, RunSceneWorker,
+                        (void *)(size_t)pool->threadCount) == 0) {
+    pool->threadCount++;
+  }
+
+  pool->busy = 1;
+  pool->activeCount = workerCount - 1;
+  pool->function = function;
+  pool->data = data;
+  pool->jobCount = jobCount;
+  pool->nextJob = 0;
+  pool->doneCount = 0;
+  pthread_cond_broadcast(&pool->wake);
+  // the calling thread works as well; it finishes the batch on its own if no
+  // thread could be started
+  RunSceneWorkerJobs(pool);
+  while (pool->doneCount < pool->jobCount) {
+    pthread_cond_wait(&pool->finished, &pool->lock);
+  }
+  pool->busy = 0;
+  pthread_mutex_unlock(&pool->lock);
+}
 
-      Color color = model.materials[model.meshMaterial[i]]
-                        .maps[MATERIAL_MAP_DIFFUSE]
-                        .color;
+// online processors, for worker counts asking for one thread per processor
+static int GetSceneProcessorCount(void) {
+#if defined(_SC_NPROCESSORS_ONLN)
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return count > 0 ? (int)count : 1;
+#else
+  return 1;
+#endif
+}
 
-      Color colorTint = WHITE;
-      model.materials[model.meshMaterial[i]].maps[MATERIAL_MAP_DIFFUSE].color =
-          colorTint;
+static void StopSceneWorkers(void) {
+  SceneWorkerPool *pool = &sceneWorkerPool;
+  pthread_mutex_lock(&pool->lock);
+  pool->stopping = 1;
+  pthread_cond_broadcast(&pool->wake);
+  pthread_mutex_unlock(&pool->lock);
+  for (int i = 0; i < pool->threadCount; i++) {
+    pthread_join(pool->threads[i], 0);
+  }
 
-      // Use the lighting shader instead of default material shader
-      if (shader.id > 0) {
-        Material tempMaterial = model.materials[model.meshMaterial[i]];
-        tempMaterial.shader = shader;
-        DrawMesh(model.meshes[i], tempMaterial, matrix);
-      } else {
-        DrawMesh(model.meshes[i], model.materials[model.meshMaterial[i]],
-                 matrix);
-      }
+  pool->threadCount = 0;
+  pool->stopping = 0;
+}
+
+// # Culling Functions
+// The culling kernel tests SCENE_CULL_BATCH boxes per instruction. The vector
+// width is picked at compile time; define SCENE_NO_SIMD to force the scalar
+// path and SCENE_CULL_VERIFY to cross-check both paths every frame; make
+// cullcheck compares them on random boxes.
+#if !defined(SCENE_NO_SIMD) && defined(__AVX__)
+#include <immintrin.h>
+#define SCENE_CULL_SIMD
+#define SCENE_CULL_BATCH 8
+typedef __m256 CullFloat;
+typedef __m256 CullMask;
+#define CullLoad(p) _mm256_loadu_ps(p)
+#define CullSet(x) _mm256_set1_ps(x)
+#define CullAdd(a, b) _mm256_add_ps(a, b)
+#define CullMul(a, b) _mm256_mul_ps(a, b)
+#define CullLess(a, b) _mm256_cmp_ps(a, b, _CMP_LT_OQ)
+#define CullOr(a, b) _mm256_or_ps(a, b)
+#define CullMaskBits(m) _mm256_movemask_ps(m)
+#define CullStore(p, v) _mm256_storeu_ps(p, v)
+#define CullMax(a, b) _mm256_max_ps(a, b)
+#define CullSelect(m, a, b) _mm256_blendv_ps(b, a, m)
+#elif !defined(SCENE_NO_SIMD) && defined(__SSE__)
+#include <xmmintrin.h>
+#define SCENE_CULL_SIMD
+#define SCENE_CULL_BATCH 4
+typedef __m128 CullFloat;
+typedef __m128 CullMask;
+#define CullLoad(p) _mm_loadu_ps(p)
+#define CullSet(x) _mm_set1_ps(x)
+#define CullAdd(a, b) _mm_add_ps(a, b)
+#define CullMul(a, b) _mm_mul_ps(a, b)
+#define CullLess(a, b) _mm_cmplt_ps(a, b)
+#define CullOr(a, b) _mm_or_ps(a, b)
+#define CullMaskBits(m) _mm_movemask_ps(m)
+#define CullStore(p, v) _mm_storeu_ps(p, v)
+#define CullMax(a, b) _mm_max_ps(a, b)
+#define CullSelect(m, a, b) _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b))
+#elif !defined(SCENE_NO_SIMD) && defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define SCENE_CULL_SIMD
+#define SCENE_CULL_BATCH 4
+typedef float32x4_t CullFloat;
+typedef uint32x4_t CullMask;
+#define CullLoad(p) vld1q_f32(p)
+#define CullSet(x) vdupq_n_f32(x)
+#define CullAdd(a, b) vaddq_f32(a, b)
+#define CullMul(a, b) vmulq_f32(a, b)
+#define CullLess(a, b) vcltq_f32(a, b)
+#define CullOr(a, b) vorrq_u32(a, b)
+#define CullStore(p, v) vst1q_f32(p, v)
+#define CullMax(a, b) vmaxq_f32(a, b)
+#define CullSelect(m, a, b) vbslq_f32(m, a, b)
+static inline int CullMaskBits(uint32x4_t mask) {
+  const uint32x4_t bits = {1, 2, 4, 8};
+  return (int)vaddvq_u32(vandq_u32(mask, bits));
+}
+#else
+#define SCENE_CULL_BATCH 4
+#endif
 
-      model.materials[model.meshMaterial[i]].maps[MATERIAL_MAP_DIFFUSE].color =
-          color;
+// Both kernels must round each product and sum on its own to agree bit for
+// bit. Clang contracts within a statement by default and GCC across
+// statements and intrinsics in its GNU modes, so contraction is off until
+// the end of the kernels.
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+#endif
 
-      stats.meshDrawCount++;
-      stats.trianglesDrawCount += model.meshes[i].vertexCount / 3;
+// The culling kernel decides in two tiers. The bounding sphere of a mesh is
+// outside if it is fully behind any plane, dot(n, c) + r < w, and inside if it
+// is fully in front of all of them, dot(n, c) >= w + r. Only meshes whose
+// sphere crosses a plane get the exact box test: outside if
+// dot(n, c) + dot(|n|, e) < w for any plane. Before all that, the plane that
+// rejected the mesh last time is tried on its own, since a mesh that was
+// outside usually still is, behind the same plane.
+//
+// This is the reference implementation. It rounds every product and sum the
+// way the SIMD kernel does, which keeps both bit-exact as long as neither is
+// contracted into FMAs; see the pragmas above. rejectPlane may be 0 to test
+// without the cache.
+#if !defined(SCENE_CULL_SIMD) || defined(SCENE_CULL_VERIFY)
+static void CullSceneBoundsScalar(const SceneCullBounds *bounds,
+                                  unsigned long first, unsigned long last,
+                                  const Vector4 *planes, unsigned char *visible,
+                                  unsigned char *rejectPlane) {
+  for (unsigned long i = first; i < last; i++) {
+    float distance[6];
+    for (int p = 0; p < 6; p++) {
+      float d = planes[p].x * bounds->centerX[i];
+      float t = planes[p].y * bounds->centerY[i];
+      d = d + t;
+      t = planes[p].z * bounds->centerZ[i];
+      distance[p] = d + t;
     }
-  }
-  if (drawBoundingBoxes) {
-    for (int i = 0; i < scene->nodesCount; i++) {
-      SceneNode *node = &scene->nodes[i];
-      if (node->generation < 0) {
+
+    float radius = bounds->radius[i];
+    if (rejectPlane) {
+      int p = rejectPlane[i];
+      float d = distance[p] + radius;
+      if (d < planes[p].w) {
+        visible[i] = 0;
         continue;
       }
+    }
 
-      SceneModel *sceneModel = &scene->models[node->model.id];
-      if (sceneModel->generation != node->model.generation) {
-        continue;
+    int plane = -1, crossing = 0;
+    for (int p = 0; p < 6; p++) {
+      float d = distance[p] + radius;
+      if (plane < 0 && d < planes[p].w) {
+        plane = p;
       }
+      float t = planes[p].w + radius;
+      crossing |= distance[p] < t;
+    }
 
-      Matrix matrix = GetSceneNodeLocalTransform(
-          (SceneNodeId){sceneId, i, node->generation});
-      Model model = sceneModel->model;
-      rlPushMatrix();
-      rlMultMatrixf(MatrixToFloat(matrix));
-      for (int i = 0; i < model.meshCount; i++) {
-        BoundingBox box = sceneModel->meshBounds[i];
-        DrawBoundingBox(box, RED);
+    for (int p = 0; plane < 0 && crossing && p < 6; p++) {
+      float r = fabsf(planes[p].x) * bounds->extentX[i];
+      float t = fabsf(planes[p].y) * bounds->extentY[i];
+      r = r + t;
+      t = fabsf(planes[p].z) * bounds->extentZ[i];
+      r = r + t;
+      float d = distance[p] + r;
+      if (d < planes[p].w) {
+        plane = p;
       }
-      rlPopMatrix();
+    }
+
+    visible[i] = plane < 0;
+    if (plane >= 0 && rejectPlane) {
+      rejectPlane[i] = plane;
     }
   }
+}
 
-  return stats;
+#endif
+
+#ifdef SCENE_CULL_SIMD
+static inline CullFloat CullPlaneDot(const CullFloat *terms, CullFloat x,
+                                     CullFloat y, CullFloat z) {
+  CullFloat d = CullMul(terms[0], x);
+  d = CullAdd(d, CullMul(terms[1], y));
+  return CullAdd(d, CullMul(terms[2], z));
 }
+#endif
 
-SceneModelId AddModelToScene(SceneId sceneId, Model model, const char *name,
-                             int manageModel) {
-  if (!IsSceneValid(sceneId)) {
-    return (SceneModelId){0};
+// Tests the meshes in [first, last) and sets their visible flags; flags
+// outside the range are left alone, so disjoint ranges can be culled
+// concurrently.
+static void CullSceneBounds(SceneCullBounds *bounds, unsigned long first,
+                            unsigned long last, const Vector4 *planes) {
+#ifdef SCENE_CULL_SIMD
+  // broadcast the plane terms once; [p][0..2] normal, [3..5] |normal|, [6] w
+  CullFloat terms[6][7];
+  for (int p = 0; p < 6; p++) {
+    terms[p][0] = CullSet(planes[p].x);
+    terms[p][1] = CullSet(planes[p].y);
+    terms[p][2] = CullSet(planes[p].z);
+    terms[p][3] = CullSet(fabsf(planes[p].x));
+    terms[p][4] = CullSet(fabsf(planes[p].y));
+    terms[p][5] = CullSet(fabsf(planes[p].z));
+    terms[p][6] = CullSet(planes[p].w);
   }
 
-  Scene *scene = &scenes[sceneId.id];
-  SceneModel *sceneModel =
-      ListAlloc((void **)&scene->models, &scene->modelsCount,
-                &scene->modelsCapacity, sizeof(SceneModel));
-  int index = scene->modelsCount - 1;
-  *sceneModel = (SceneModel){.generation = sceneModel->generation + 1,
-                             .model = model,
-                             .name = name,
-                             .isManaged = manageModel};
+  // batches start at multiples of the batch size and the padding past count
+  // is zeroed, so full batches are always safe to load
+  const int allLanes = (1 << SCENE_CULL_BATCH) - 1;
+  unsigned long start = first / SCENE_CULL_BATCH * SCENE_CULL_BATCH;
+  for (unsigned long i = start; i < last; i += SCENE_CULL_BATCH) {
+    CullFloat cx = CullLoad(&bounds->centerX[i]);
+    CullFloat cy = CullLoad(&bounds->centerY[i]);
+    CullFloat cz = CullLoad(&bounds->centerZ[i]);
+    CullFloat radius = CullLoad(&bounds->radius[i]);
+    unsigned long laneFirst = i < first ? first : i;
+    unsigned long laneLast =
+        i + SCENE_CULL_BATCH < last ? i + SCENE_CULL_BATCH : last;
 
-  sceneModel->meshBounds = MemAlloc(sizeof(BoundingBox) * model.meshCount);
-  sceneModel->meshBoundingSpheres = MemAlloc(sizeof(Vector4) * model.meshCount);
-  for (int i = 0; i < model.meshCount; i++) {
-    BoundingBox box = GetMeshBoundingBox(model.meshes[i]);
-    sceneModel->meshBounds[i] = box;
-    Vector3 center = Vector3Scale(Vector3Add(box.min, box.max), 0.5f);
-    float radius = Vector3Distance(center, box.max);
-    sceneModel->meshBoundingSpheres[i] =
-        (Vector4){center.x, center.y, center.z, radius};
-  }
+    // Neighbouring meshes belong to the same node or to nodes close to it,
+    // so the plane that rejected the first mesh of the batch mostly rejects
+    // all of them.
+    int cached = bounds->rejectPlane[laneFirst];
+    CullFloat d = CullPlaneDot(terms[cached], cx, cy, cz);
+    if (CullMaskBits(CullLess(CullAdd(d, radius), terms[cached][6])) ==
+        allLanes) {
+      memset(&bounds->visible[laneFirst], 0, laneLast - laneFirst);
+      continue;
+    }
 
-  return (SceneModelId){sceneId, index, sceneModel->generation};
+    CullFloat distance[6];
+    int sphereOut[6], sphereOutside = 0, crossing = 0;
+    for (int p = 0; p < 6; p++) {
+      distance[p] = CullPlaneDot(terms[p], cx, cy, cz);
+      sphereOut[p] =
+          CullMaskBits(CullLess(CullAdd(distance[p], radius), terms[p][6]));
+      sphereOutside |= sphereOut[p];
+      crossing |= CullMaskBits(
+          CullLess(distance[p], CullAdd(terms[p][6], radius)));
+    }
+
+    int inside = ~crossing & allLanes;
+    int boxOut[6] = {0}, boxOutside = 0;
+    if ((sphereOutside | inside) != allLanes) {
+      CullFloat ex = CullLoad(&bounds->extentX[i]);
+      CullFloat ey = CullLoad(&bounds->extentY[i]);
+      CullFloat ez = CullLoad(&bounds->extentZ[i]);
+      for (int p = 0; p < 6; p++) {
+        CullFloat r = CullMul(terms[p][3], ex);
+        r = CullAdd(r, CullMul(terms[p][4], ey));
+        r = CullAdd(r, CullMul(terms[p][5], ez));
+        boxOut[p] =
+            CullMaskBits(CullLess(CullAdd(distance[p], r), terms[p][6]));
+        boxOutside |= boxOut[p];
+      }
+    }
+
+    int outside = sphereOutside | (boxOutside & ~inside);
+    for (unsigned long m = laneFirst; m < laneLast; m++) {
+      int lane = m - i;
+      bounds->visible[m] = !((outside >> lane) & 1);
+      if ((outside >> lane) & 1) {
+        // the first plane that rejected it, preferring the sphere test
+        int *out = (sphereOutside >> lane) & 1 ? sphereOut : boxOut;
+        int p = 0;
+        while (!((out[p] >> lane) & 1)) {
+          p++;
+        }
+        bounds->rejectPlane[m] = p;
+      }
+    }
+  }
+#else
+  CullSceneBoundsScalar(bounds, first, last, planes, bounds->visible,
+                        bounds->rejectPlane);
+#endif
 }
 
-static Scene *GetScene(SceneId sceneId) {
-  if (!IsSceneValid(sceneId)) {
-    return 0;
+#ifdef SCENE_CULL_VERIFY
+static void VerifySceneCullBounds(const SceneCullBounds *bounds,
+                                  const Vector4 *planes) {
+  unsigned char *expected = MemAlloc(bounds->count + 1);
+  CullSceneBoundsScalar(bounds, 0, bounds->count, planes, expected, 0);
+  for (unsigned long i = 0; i < bounds->count; i++) {
+    if (expected[i] != bounds->visible[i]) {
+      TraceLog(LOG_WARNING,
+               "VerifySceneCullBounds: kernel mismatch at %lu: %d vs %d", i,
+               bounds->visible[i], expected[i]);
+    }
   }
+  MemFree(expected);
+}
+#endif
 
-  return &scenes[sceneId.id];
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT DEFAULT
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+static void *ArrayRealloc(void *array, unsigned long size) {
+  return array ? MemRealloc(array, size) : MemAlloc(size);
 }
 
-void AddGLTFScene(SceneId sceneId, const char *filename, Matrix transform) {
-  if (!IsSceneValid(sceneId)) {
-    return;
+static void FreeSceneCullBounds(SceneCullBounds *bounds) {
+  if (bounds->capacity > 0) {
+    MemFree(bounds->nodeIndex);
+    MemFree(bounds->meshIndex);
+    MemFree(bounds->centerX);
+    MemFree(bounds->centerY);
+    MemFree(bounds->centerZ);
+    MemFree(bounds->extentX);
+    MemFree(bounds->extentY);
+    MemFree(bounds->extentZ);
+    MemFree(bounds->radius);
+    MemFree(bounds->rejectPlane);
+    MemFree(bounds->visible);
   }
+
+  *bounds = (SceneCullBounds){0};
 }
 
-SceneNodeId AcquireSceneNode(SceneId sceneId) {
-  Scene *scene = GetScene(sceneId);
-  if (!scene) {
-    return (SceneNodeId){0};
+static void ReserveSceneCullBounds(SceneCullBounds *bounds,
+                                   unsigned long count) {
+  // round up so the kernel can always load full batches
+  unsigned long capacity =
+      (count + SCENE_CULL_BATCH - 1) / SCENE_CULL_BATCH * SCENE_CULL_BATCH;
+  if (capacity <= bounds->capacity) {
+    return;
   }
 
-  SceneNode *node = GetSceneNode(scene->firstFree, 0);
-  int index;
-  if (!node) {
-    node = ListAlloc((void **)&scene->nodes, &scene->nodesCount,
-                     &scene->nodesCapacity, sizeof(SceneNode));
-    index = scene->nodesCount - 1;
-  } else {
-    index = scene->firstFree.id;
-    scene->firstFree = node->nextSiblingId;
+  if (capacity < bounds->capacity * 2) {
+    capacity = bounds->capacity * 2;
   }
 
-  *node = (SceneNode){.generation = node->generation + 1,
-                      .position = (Vector3){0, 0, 0},
-                      .rotation = (Vector3){0, 0, 0},
-                      .scale = (Vector3){1, 1, 1},
-                      .name = 0,
-                      .modTRSMarker = 0,
-                      .modTRSGeneration = 1,
-                      .localToWorld = MatrixIdentity(),
-                      .worldToLocal = MatrixIdentity(),
-                      .userIdentifier = 0,
-                      .parent = (SceneNodeId){0},
-                      .model = (SceneModelId){0}};
-
-  return (SceneNodeId){sceneId, index, node->generation};
+  bounds->nodeIndex =
+      ArrayRealloc(bounds->nodeIndex, sizeof(unsigned long) * capacity);
+  bounds->meshIndex = ArrayRealloc(bounds->meshIndex, sizeof(int) * capacity);
+  bounds->centerX = ArrayRealloc(bounds->centerX, sizeof(float) * capacity);
+  bounds->centerY = ArrayRealloc(bounds->centerY, sizeof(float) * capacity);
+  bounds->centerZ = ArrayRealloc(bounds->centerZ, sizeof(float) * capacity);
+  bounds->extentX = ArrayRealloc(bounds->extentX, sizeof(float) * capacity);
+  bounds->extentY = ArrayRealloc(bounds->extentY, sizeof(float) * capacity);
+  bounds->extentZ = ArrayRealloc(bounds->extentZ, sizeof(float) * capacity);
+  bounds->radius = ArrayRealloc(bounds->radius, sizeof(float) * capacity);
+  bounds->rejectPlane = ArrayRealloc(bounds->rejectPlane, capacity);
+  bounds->visible = ArrayRealloc(bounds->visible, capacity);
+  bounds->capacity = capacity;
 }
 
-static unsigned long GetSceneNodeGenerationSum(SceneNode *node) {
-  unsigned long generationSum = node->modTRSGeneration;
-  SceneNode *parentNode = GetSceneNode(node->parent, 0);
-  while (parentNode) {
-    // TraceLog(LOG_INFO, "parentNode: %p", parentNode);
-    generationSum += parentNode->modTRSGeneration;
-    parentNode = GetSceneNode(parentNode->parent, 0);
+// zeroes the entries between count and the end of the last batch, so the
+// kernel can load full batches without reading stale boxes
+static void PadSceneCullBounds(SceneCullBounds *bounds) {
+  unsigned long end = (bounds->count + SCENE_CULL_BATCH - 1) /
+                      SCENE_CULL_BATCH * SCENE_CULL_BATCH;
+  for (unsigned long i = bounds->count; i < end; i++) {
+    bounds->centerX[i] = bounds->centerY[i] = bounds->centerZ[i] = 0;
+    bounds->extentX[i] = bounds->extentY[i] = bounds->extentZ[i] = 0;
+    bounds->radius[i] = 0;
+    bounds->rejectPlane[i] = 0;
   }
+}
 
-  return generationSum;
+#ifdef SCENE_CULL_VERIFY
+// xorshift, so a seed gives the same boxes on every platform
+static float CheckSceneRandom(unsigned int *state, float min, float max) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return min + (max - min) * (float)(*state >> 8) / (float)(1 << 24);
 }
 
-// returns the node if it is dirty, otherwise 0; saves pointer resolving for
-// callee
-static SceneNode *IsSceneNodeTRSDirty(SceneNodeId sceneNodeId) {
-  Scene *scene;
-  SceneNode *node = GetSceneNode(sceneNodeId, &scene);
-  if (!node) {
-    return 0;
+int CheckSceneCullKernel(unsigned long count, unsigned int seed) {
+  unsigned int state = seed ? seed : 1;
+  SceneCullBounds bounds = {0};
+  ReserveSceneCullBounds(&bounds, count);
+  bounds.count = count;
+  unsigned char *expected = MemAlloc(count + 1);
+
+  int mismatches = 0;
+  for (int round = 0; round < 64; round++) {
+    // Besides plain random rounds, some use axis aligned planes and whole
+    // numbers, which put many boxes exactly on a plane, and some move every
+    // sphere to touch a plane, so that the rounding of the distances decides.
+    int exact = round % 3 == 1, touching = round % 3 == 2;
+    Vector4 planes[6];
+    for (int p = 0; p < 6; p++) {
+      Vector3 normal = {CheckSceneRandom(&state, -1, 1),
+                        CheckSceneRandom(&state, -1, 1),
+                        CheckSceneRandom(&state, -1, 1)};
+      float w = CheckSceneRandom(&state, -20, 5);
+      if (exact) {
+        float sign = p & 1 ? -1.0f : 1.0f;
+        normal = (Vector3){p / 2 == 0 ? sign : 0, p / 2 == 1 ? sign : 0,
+                           p / 2 == 2 ? sign : 0};
+        w = floorf(w / 2);
+      }
+      normal = Vector3Normalize(normal);
+      planes[p] = (Vector4){normal.x, normal.y, normal.z, w};
+    }
+
+    for (unsigned long i = 0; i < count; i++) {
+      Vector3 center = {CheckSceneRandom(&state, -30, 30),
+                        CheckSceneRandom(&state, -30, 30),
+                        CheckSceneRandom(&state, -30, 30)};
+      Vector3 extent = {CheckSceneRandom(&state, 0, 5),
+                        CheckSceneRandom(&state, 0, 5),
+                        CheckSceneRandom(&state, 0, 5)};
+      if (exact) {
+        center = (Vector3){floorf(center.x / 3), floorf(center.y / 3),
+                           floorf(center.z / 3)};
+        extent = (Vector3){floorf(extent.x), floorf(extent.y),
+                           floorf(extent.z)};
+      }
+      if (touching) {
+        Vector4 plane = planes[(int)CheckSceneRandom(&state, 0, 6)];
+        Vector3 normal = {plane.x, plane.y, plane.z};
+        float offset = plane.w - Vector3Length(extent) -
+                       Vector3DotProduct(normal, center);
+        center = Vector3Add(center, Vector3Scale(normal, offset));
+      }
+      bounds.centerX[i] = center.x;
+      bounds.centerY[i] = center.y;
+      bounds.centerZ[i] = center.z;
+      bounds.extentX[i] = extent.x;
+      bounds.extentY[i] = extent.y;
+      bounds.extentZ[i] = extent.z;
+      bounds.radius[i] =
+          exact ? ceilf(Vector3Length(extent)) : Vector3Length(extent);
+      bounds.rejectPlane[i] = (unsigned char)CheckSceneRandom(&state, 0, 6);
+    }
+    PadSceneCullBounds(&bounds);
+
+    // in two ranges split anywhere, like the culling jobs, against the
+    // reference without the rejection cache
+    unsigned long split =
+        (unsigned long)CheckSceneRandom(&state, 0, (float)count);
+    CullSceneBounds(&bounds, 0, split, planes);
+    CullSceneBounds(&bounds, split, count, planes);
+    CullSceneBoundsScalar(&bounds, 0, count, planes, expected, 0);
+    for (unsigned long i = 0; i < count; i++) {
+      if (expected[i] != bounds.visible[i]) {
+        if (mismatches < 8) {
+          TraceLog(LOG_WARNING,
+                   "CheckSceneCullKernel: mismatch in round %d at %lu: %d vs "
+                   "%d",
+                   round, i, bounds.visible[i], expected[i]);
+        }
+        mismatches++;
+      }
+    }
   }
 
-  unsigned long generationSum = GetSceneNodeGenerationSum(node);
-  return node->modTRSMarker != generationSum ? node : 0;
+  MemFree(expected);
+  FreeSceneCullBounds(&bounds);
+  return mismatches;
 }
+#endif
 
-static SceneNode *GetSceneNode(SceneNodeId sceneNodeId, Scene **sceneOut) {
-  Scene *scene = GetScene(sceneNodeId.sceneId);
-  if (!scene) {
+// returns the node's model if the node has a valid one, otherwise 0
+static SceneModel *GetSceneNodeSceneModel(Scene *scene, SceneNode *node) {
+  if (node->model.id >= scene->models.count) {
     return 0;
   }
 
-  if (sceneNodeId.id >= scene->nodesCount ||
-      scene->nodes[sceneNodeId.id].generation != sceneNodeId.generation) {
+  SceneModel *sceneModel = GetSceneModelAt(scene, node->model.id);
+  if (sceneModel->generation != node->model.generation) {
     return 0;
   }
 
-  if (sceneOut)
-    *sceneOut = scene;
-
-  return &scene->nodes[sceneNodeId.id];
+  return sceneModel;
 }
 
-int IsSceneNodeValid(SceneNodeId sceneNodeId) {
-  Scene *scene;
-  return GetSceneNode(sceneNodeId, &scene) != 0;
+// length of the longest basis vector, which scales bounding spheres
+static float GetMatrixMaxScale(Matrix m) {
+  return sqrtf(fmaxf(m.m0 * m.m0 + m.m1 * m.m1 + m.m2 * m.m2,
+                     fmaxf(m.m4 * m.m4 + m.m5 * m.m5 + m.m6 * m.m6,
+                           m.m8 * m.m8 + m.m9 * m.m9 + m.m10 * m.m10)));
 }
 
-void SetSceneNodeParent(SceneNodeId sceneNodeId,
-                        SceneNodeId parentSceneNodeId) {
-  if (parentSceneNodeId.sceneId.id != sceneNodeId.sceneId.id) {
-    TraceLog(
-        LOG_WARNING,
-        "SetSceneNodeParent: scene node and parent must be in the same scene");
+// Transforms the local mesh boxes of the node into world space AABBs
+// (Arvo's method: the extent is transformed by the absolute 3x3 matrix). The
+// bounding spheres share the box centers and grow with the largest scale.
+static void UpdateSceneNodeCullBounds(Scene *scene, SceneNode *node) {
+  if (scene->cullBoundsDirty || node->cullBoundsCount == 0) {
     return;
   }
 
-  Scene *scene;
-  SceneNode *node = GetSceneNode(sceneNodeId, &scene);
-  if (!node) {
+  SceneModel *sceneModel = GetSceneNodeSceneModel(scene, node);
+  if (!sceneModel ||
+      node->cullBoundsCount != (unsigned long)sceneModel->model.meshCount) {
+    scene->cullBoundsDirty = 1;
     return;
   }
 
-  SceneNode *parentNode = GetSceneNode(parentSceneNodeId, 0);
-  if (!parentNode) {
-    return;
+  SceneCullBounds *bounds = &scene->cullBounds;
+  Matrix m = scene->transforms.localToWorld[node->transformIndex];
+  float scale = GetMatrixMaxScale(m);
+  for (unsigned long k = 0; k < node->cullBoundsCount; k++) {
+    BoundingBox box = sceneModel->meshBounds[k];
+    Vector3 c = Vector3Scale(Vector3Add(box.min, box.max), 0.5f);
+    Vector3 e = Vector3Scale(Vector3Subtract(box.max, box.min), 0.5f);
+    unsigned long i = node->cullBoundsIndex + k;
+    bounds->centerX[i] = m.m0 * c.x + m.m4 * c.y + m.m8 * c.z + m.m12;
+    bounds->centerY[i] = m.m1 * c.x + m.m5 * c.y + m.m9 * c.z + m.m13;
+    bounds->centerZ[i] = m.m2 * c.x + m.m6 * c.y + m.m10 * c.z + m.m14;
+    bounds->extentX[i] =
+        fabsf(m.m0) * e.x + fabsf(m.m4) * e.y + fabsf(m.m8) * e.z;
+    bounds->extentY[i] =
+        fabsf(m.m1) * e.x + fabsf(m.m5) * e.y + fabsf(m.m9) * e.z;
+    bounds->extentZ[i] =
+        fabsf(m.m2) * e.x + fabsf(m.m6) * e.y + fabsf(m.m10) * e.z;
+    bounds->radius[i] = sceneModel->meshBoundingSpheres[k].w * scale;
   }
 
-  node->parent = parentSceneNodeId;
-  node->nextSiblingId = parentNode->firstChildId;
-  parentNode->firstChildId = sceneNodeId;
-  node->modTRSGeneration = 0;
+  UpdateSceneBVHLeaf(scene, node);
 }
 
-// releases a scene node (destroy) and all its children
-void ReleaseSceneNode(SceneNodeId sceneNodeId) {
-  Scene *scene;
-  SceneNode *node = GetSceneNode(sceneNodeId, &scene);
-  if (!node) {
-    return;
+// Packs the mesh bounds of all nodes with a model in transform order. Only
+// needed when nodes gain or lose meshes; moving nodes updates their bounds in
+// place during the transform sweep.
+static void RebuildSceneCullBounds(Scene *scene) {
+  SceneTransforms *transforms = &scene->transforms;
+  SceneCullBounds *bounds = &scene->cullBounds;
+
+  unsigned long count = 0;
+  for (unsigned long t = 0; t < transforms->count; t++) {
+    SceneNode *node = GetSceneNodeAt(scene, transforms->nodeIndex[t]);
+    SceneModel *sceneModel = GetSceneNodeSceneModel(scene, node);
+    count += sceneModel ? sceneModel->model.meshCount : 0;
   }
 
-  SceneNode *parentNode = GetSceneNode(node->parent, 0);
-  if (parentNode) {
-    // remove from parent child list
-    SceneNodeId siblingId = parentNode->firstChildId;
+  ReserveSceneCullBounds(bounds, count);
+  bounds->count = 0;
+  scene->cullBoundsDirty = 0;
+  for (unsigned long t = 0; t < transforms->count; t++) {
+    SceneNode *node = GetSceneNodeAt(scene, transforms->nodeIndex[t]);
+    SceneModel *sceneModel = GetSceneNodeSceneModel(scene, node);
+    node->cullBoundsIndex = bounds->count;
+    node->cullBoundsCount = sceneModel ? sceneModel->model.meshCount : 0;
+    for (unsigned long k = 0; k < node->cullBoundsCount; k++) {
+      bounds->nodeIndex[bounds->count] = transforms->nodeIndex[t];
+      bounds->meshIndex[bounds->count] = k;
+      bounds->rejectPlane[bounds->count] = 0;
+      bounds->count++;
+    }
+
+    if (node->cullBoundsCount > 0) {
+      UpdateSceneNodeCullBounds(scene, node);
+    } else {
+      RemoveSceneBVHLeaf(scene, node);
+    }
+  }
+
+  PadSceneCullBounds(bounds);
+}
+
+// # Bounding Volume Hierarchy Functions
+// A dynamic AABB tree over the world bounds of all nodes with meshes, in the
+// style of Box2D's b2DynamicTree: leaves are inserted where they add the least
+// surface area, and every refit on the way back to the root applies tree
+// rotations to keep the tree balanced.
+#define SCENE_BVH_MARGIN 0.2f
+
+static BoundingBox CombineBoxes(BoundingBox a, BoundingBox b) {
+  return (BoundingBox){Vector3Min(a.min, b.min), Vector3Max(a.max, b.max)};
+}
+
+static long MaxLong(long a, long b) { return a > b ? a : b; }
+
+static float GetBoxSurfaceArea(BoundingBox box) {
+  Vector3 d = Vector3Subtract(box.max, box.min);
+  return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+static int BoxContainsBox(BoundingBox outer, BoundingBox inner) {
+  return outer.min.x <= inner.min.x && outer.min.y <= inner.min.y &&
+         outer.min.z <= inner.min.z && outer.max.x >= inner.max.x &&
+         outer.max.y >= inner.max.y && outer.max.z >= inner.max.z;
+}
+
+// union of the node's world space mesh bounds
+static BoundingBox GetSceneNodeWorldBounds(Scene *scene, SceneNode *node) {
+  SceneCullBounds *bounds = &scene->cullBounds;
+  BoundingBox box = {{INFINITY, INFINITY, INFINITY},
+                     {-INFINITY, -INFINITY, -INFINITY}};
+  for (unsigned long k = 0; k < node->cullBoundsCount; k++) {
+    unsigned long i = node->cullBoundsIndex + k;
+    Vector3 c = {bounds->centerX[i], bounds->centerY[i], bounds->centerZ[i]};
+    Vector3 e = {bounds->extentX[i], bounds->extentY[i], bounds->extentZ[i]};
+    box = CombineBoxes(box, (BoundingBox){Vector3Subtract(c, e),
+                                          Vector3Add(c, e)});
+  }
+
+  return box;
+}
+
+static long AllocSceneBVHNode(SceneBVH *bvh) {
+  if (bvh->freeList < 0) {
+    if (bvh->count >= bvh->capacity) {
+      bvh->capacity = bvh->capacity == 0 ? 16 : bvh->capacity * 2;
+      bvh->nodes =
+          ArrayRealloc(bvh->nodes, sizeof(SceneBVHNode) * bvh->capacity);
+    }
+    bvh->nodes[bvh->count].parent = -1;
+    bvh->freeList = bvh->count++;
+  }
+
+  long index = bvh->freeList;
+  bvh->freeList = bvh->nodes[index].parent;
+  bvh->nodes[index] = (SceneBVHNode){
+      .parent = -1, .child1 = -1, .child2 = -1, .height = 0};
+  return index;
+}
+
+static void FreeSceneBVHNode(SceneBVH *bvh, long index) {
+  bvh->nodes[index].parent = bvh->freeList;
+  bvh->nodes[index].height = -1;
+  bvh->freeList = index;
+}
+
+// AVL style rotation: if one child of iA is more than one level higher than
+// the other, the higher child is rotated up. Returns the new subtree root.
+static long BalanceSceneBVH(SceneBVH *bvh, long iA) {
+  SceneBVHNode *n = bvh->nodes;
+  if (n[iA].child1 < 0 || n[iA].height < 2) {
+    return iA;
+  }
+
+  long iB = n[iA].child1;
+  long iC = n[iA].child2;
+  long balance = n[iC].height - n[iB].height;
+
+  if (balance > 1) {
+    // rotate C up
+    long iF = n[iC].child1;
+    long iG = n[iC].child2;
+    n[iC].child1 = iA;
+    n[iC].parent = n[iA].parent;
+    n[iA].parent = iC;
+    if (n[iC].parent >= 0) {
+      if (n[n[iC].parent].child1 == iA) {
+        n[n[iC].parent].child1 = iC;
+      } else {
+        n[n[iC].parent].child2 = iC;
+      }
+    } else {
+      bvh->root = iC;
+    }
+
+    long iKeep = n[iF].height > n[iG].height ? iF : iG;
+    long iMove = iKeep == iF ? iG : iF;
+    n[iC].child2 = iKeep;
+    n[iA].child2 = iMove;
+    n[iMove].parent = iA;
+    n[iA].box = CombineBoxes(n[iB].box, n[iMove].box);
+    n[iC].box = CombineBoxes(n[iA].box, n[iKeep].box);
+    n[iA].height = 1 + MaxLong(n[iB].height, n[iMove].height);
+    n[iC].height = 1 + MaxLong(n[iA].height, n[iKeep].height);
+    return iC;
+  }
+
+  if (balance < -1) {
+    // rotate B up
+    long iD = n[iB].child1;
+    long iE = n[iB].child2;
+    n[iB].child1 = iA;
+    n[iB].parent = n[iA].parent;
+    n[iA].parent = iB;
+    if (n[iB].parent >= 0) {
+      if (n[n[iB].parent].child1 == iA) {
+        n[n[iB].parent].child1 = iB;
+      } else {
+        n[n[iB].parent].child2 = iB;
+      }
+    } else {
+      bvh->root = iB;
+    }
+
+    long iKeep = n[iD].height > n[iE].height ? iD : iE;
+    long iMove = iKeep == iD ? iE : iD;
+    n[iB].child2 = iKeep;
+    n[iA].child1 = iMove;
+    n[iMove].parent = iA;
+    n[iA].box = CombineBoxes(n[iC].box, n[iMove].box);
+    n[iB].box = CombineBoxes(n[iA].box, n[iKeep].box);
+    n[iA].height = 1 + MaxLong(n[iC].height, n[iMove].height);
+    n[iB].height = 1 + MaxLong(n[iA].height, n[iKeep].height);
+    return iB;
+  }
+
+  return iA;
+}
+
+// walks from index to the root, rebalancing and refitting every ancestor
+static void RefitSceneBVH(SceneBVH *bvh, long index) {
+  SceneBVHNode *n = bvh->nodes;
+  while (index >= 0) {
+    index = BalanceSceneBVH(bvh, index);
+    long child1 = n[index].child1;
+    long child2 = n[index].child2;
+    n[index].height = 1 + MaxLong(n[child1].height, n[child2].height);
+    n[index].box = CombineBoxes(n[child1].box, n[child2].box);
+    index = n[index].parent;
+  }
+}
+
+static void InsertSceneBVHLeaf(SceneBVH *bvh, long leaf) {
+  SceneBVHNode *n = bvh->nodes;
+  if (bvh->root < 0) {
+    bvh->root = leaf;
+    n[leaf].parent = -1;
+    return;
+  }
+
+  // descend towards the sibling with the lowest surface area cost
+  BoundingBox leafBox = n[leaf].box;
+  long index = bvh->root;
+  while (n[index].child1 >= 0) {
+    float area = GetBoxSurfaceArea(n[index].box);
+    float combinedArea = GetBoxSurfaceArea(CombineBoxes(n[index].box, leafBox));
+    // cost of making a new parent for this node and the leaf
+    float cost = 2.0f * combinedArea;
+    // minimum cost pushed down to the children
+    float inheritanceCost = 2.0f * (combinedArea - area);
+
+    float childCost[2];
+    long children[2] = {n[index].child1, n[index].child2};
+    for (int c = 0; c < 2; c++) {
+      SceneBVHNode *child = &n[children[c]];
+      float enlarged = GetBoxSurfaceArea(CombineBoxes(leafBox, child->box));
+      childCost[c] =
+          (child->child1 < 0 ? enlarged
+                             : enlarged - GetBoxSurfaceArea(child->box)) +
+          inheritanceCost;
+    }
+
+    if (cost < childCost[0] && cost < childCost[1]) {
+      break;
+    }
+
+    index = childCost[0] < childCost[1] ? children[0] : children[1];
+  }
+
+  long sibling = index;
+  long oldParent = n[sibling].parent;
+  long newParent = AllocSceneBVHNode(bvh);
+  n = bvh->nodes;
+  n[newParent].parent = oldParent;
+  n[newParent].box = CombineBoxes(leafBox, n[sibling].box);
+  n[newParent].height = n[sibling].height + 1;
+  n[newParent].child1 = sibling;
+  n[newParent].child2 = leaf;
+  n[sibling].parent = newParent;
+  n[leaf].parent = newParent;
+
+  if (oldParent >= 0) {
+    if (n[oldParent].child1 == sibling) {
+      n[oldParent].child1 = newParent;
+    } else {
+      n[oldParent].child2 = newParent;
+    }
+  } else {
+    bvh->root = newParent;
+  }
+
+  RefitSceneBVH(bvh, n[leaf].parent);
+}
+
+static void UnlinkSceneBVHLeaf(SceneBVH *bvh, long leaf) {
+  SceneBVHNode *n = bvh->nodes;
+  if (leaf == bvh->root) {
+    bvh->root = -1;
+    return;
+  }
+
+  long parent = n[leaf].parent;
+  long grandParent = n[parent].parent;
+  long sibling = n[parent].child1 == leaf ? n[parent].child2 : n[parent].child1;
+
+  if (grandParent >= 0) {
+    if (n[grandParent].child1 == parent) {
+      n[grandParent].child1 = sibling;
+    } else {
+      n[grandParent].child2 = sibling;
+    }
+    n[sibling].parent = grandParent;
+    FreeSceneBVHNode(bvh, parent);
+    RefitSceneBVH(bvh, grandParent);
+  } else {
+    bvh->root = sibling;
+    n[sibling].parent = -1;
+    FreeSceneBVHNode(bvh, parent);
+  }
+}
+
+static void RemoveSceneBVHLeaf(Scene *scene, SceneNode *node) {
+  if (node->bvhLeaf < 0) {
+    return;
+  }
+
+  UnlinkSceneBVHLeaf(&scene->bvh, node->bvhLeaf);
+  FreeSceneBVHNode(&scene->bvh, node->bvhLeaf);
+  node->bvhLeaf = -1;
+}
+
+// Inserts the node into the tree or updates its leaf after the node's mesh
+// bounds changed. As long as the bounds stay inside the enlarged leaf box the
+// tree is left untouched; otherwise the leaf is reinserted with a new margin.
+static void UpdateSceneBVHLeaf(Scene *scene, SceneNode *node) {
+  SceneBVH *bvh = &scene->bvh;
+  BoundingBox box = GetSceneNodeWorldBounds(scene, node);
+  if (node->bvhLeaf >= 0) {
+    if (BoxContainsBox(bvh->nodes[node->bvhLeaf].box, box)) {
+      return;
+    }
+    UnlinkSceneBVHLeaf(bvh, node->bvhLeaf);
+  } else {
+    node->bvhLeaf = AllocSceneBVHNode(bvh);
+    bvh->nodes[node->bvhLeaf].nodeIndex =
+        scene->transforms.nodeIndex[node->transformIndex];
+  }
+
+  Vector3 margin = {SCENE_BVH_MARGIN, SCENE_BVH_MARGIN, SCENE_BVH_MARGIN};
+  bvh->nodes[node->bvhLeaf].box = (BoundingBox){
+      Vector3Subtract(box.min, margin), Vector3Add(box.max, margin)};
+  InsertSceneBVHLeaf(bvh, node->bvhLeaf);
+}
+
+// Tests a box against the planes selected by planeMask. Returns -1 if the box
+// is outside, otherwise the mask of planes the box still straddles; planes the
+// box is fully inside of don't need to be tested for its children.
+static int ClassifyBoxFrustum(BoundingBox box, const Vector4 *planes,
+                              int planeMask) {
+  Vector3 c = Vector3Scale(Vector3Add(box.min, box.max), 0.5f);
+  Vector3 e = Vector3Scale(Vector3Subtract(box.max, box.min), 0.5f);
+  for (int p = 0; p < 6; p++) {
+    if (!(planeMask & (1 << p))) {
+      continue;
+    }
+
+    float d = planes[p].x * c.x + planes[p].y * c.y + planes[p].z * c.z;
+    float r = fabsf(planes[p].x) * e.x + fabsf(planes[p].y) * e.y +
+              fabsf(planes[p].z) * e.z;
+    if (d + r < planes[p].w) {
+      return -1;
+    }
+    if (d - r >= planes[p].w) {
+      planeMask &= ~(1 << p);
+    }
+  }
+
+  return planeMask;
+}
+
+// A depth first walk keeps at most one entry per level of the tree plus one.
+// The tree is balanced, so its height is logarithmic and this covers any
+// real scene; taller trees get their stack from the heap.
+#define SCENE_BVH_STACK_SIZE 256
+
+static long GetSceneBVHStackSize(const SceneBVH *bvh) {
+  return bvh->nodes[bvh->root].height + 2;
+}
+
+typedef struct SceneBVHStackEntry {
+  long index;
+  int planeMask;
+} SceneBVHStackEntry;
+
+// Walks the tree and calls visit for every leaf that is not outside the
+// frustum, with the planes the leaf still straddles (0 if fully inside).
+// Subtrees outside of a plane are rejected as a whole.
+static void WalkSceneBVHFrustum(Scene *scene, const Vector4 *planes,
+                                void (*visit)(Scene *, unsigned long, int,
+                                              void *),
+                                void *data) {
+  SceneBVH *bvh = &scene->bvh;
+  if (bvh->root < 0) {
+    return;
+  }
+
+  SceneBVHStackEntry fixedStack[SCENE_BVH_STACK_SIZE];
+  SceneBVHStackEntry *stack = fixedStack;
+  if (GetSceneBVHStackSize(bvh) > SCENE_BVH_STACK_SIZE) {
+    stack = MemAlloc(sizeof(*stack) * GetSceneBVHStackSize(bvh));
+  }
+
+  long stackCount = 0;
+  stack[stackCount++] = (SceneBVHStackEntry){bvh->root, 0x3f};
+  while (stackCount > 0) {
+    SceneBVHStackEntry entry = stack[--stackCount];
+    SceneBVHNode *node = &bvh->nodes[entry.index];
+    int planeMask = entry.planeMask;
+    if (planeMask) {
+      planeMask = ClassifyBoxFrustum(node->box, planes, planeMask);
+      if (planeMask < 0) {
+        continue;
+      }
+    }
+
+    if (node->child1 < 0) {
+      visit(scene, node->nodeIndex, planeMask, data);
+    } else {
+      stack[stackCount++] = (SceneBVHStackEntry){node->child1, planeMask};
+      stack[stackCount++] = (SceneBVHStackEntry){node->child2, planeMask};
+    }
+  }
+
+  if (stack != fixedStack) {
+    MemFree(stack);
+  }
+}
+
+static void AppendSceneDrawItems(Scene *scene, unsigned long nodeIndex,
+                                 int planeMask, void *data) {
+  SceneNode *node = GetSceneNodeAt(scene, nodeIndex);
+  unsigned long layerMask = *(unsigned long *)data;
+  if (!(node->layers & layerMask)) {
+    return;
+  }
+
+  if (planeMask == 0) {
+    // fully inside: every mesh of the node is visible
+    for (unsigned long k = 0; k < node->cullBoundsCount; k++) {
+      scene->drawItems[scene->drawItemsCount++] =
+          (SceneDrawItem){nodeIndex, k, 0, 0, 0};
+    }
+    return;
+  }
+
+  // straddling: queue the meshes for the batched kernel
+  SceneCullBounds *bounds = &scene->cullBounds;
+  SceneCullBounds *candidates = &scene->cullCandidates;
+  for (unsigned long k = 0; k < node->cullBoundsCount; k++) {
+    unsigned long from = node->cullBoundsIndex + k;
+    unsigned long to = candidates->count++;
+    candidates->nodeIndex[to] = bounds->nodeIndex[from];
+    candidates->meshIndex[to] = bounds->meshIndex[from];
+    candidates->centerX[to] = bounds->centerX[from];
+    candidates->centerY[to] = bounds->centerY[from];
+    candidates->centerZ[to] = bounds->centerZ[from];
+    candidates->extentX[to] = bounds->extentX[from];
+    candidates->extentY[to] = bounds->extentY[from];
+    candidates->extentZ[to] = bounds->extentZ[from];
+    candidates->radius[to] = bounds->radius[from];
+    candidates->rejectPlane[to] = bounds->rejectPlane[from];
+  }
+}
+
+static void ReserveSceneDrawItems(Scene *scene, unsigned long count) {
+  if (scene->drawItemsCapacity < count) {
+    scene->drawItemsCapacity = count;
+    scene->drawItems =
+        ArrayRealloc(scene->drawItems, sizeof(SceneDrawItem) * count);
+    scene->drawItemsScratch =
+        ArrayRealloc(scene->drawItemsScratch, sizeof(SceneDrawItem) * count);
+  }
+}
+
+// First half of culling the nodes in the layers of layerMask: fills
+// Scene.drawItems with the meshes of nodes fully inside the frustum and
+// Scene.cullCandidates with those of nodes that straddle it, for
+// CullSceneCandidates. When the mask selects all used layers, whole subtrees
+// are accepted or rejected in the BVH. Otherwise the members of the selected
+// layers are taken directly, so filtered nodes are never visited. Both lists
+// keep the meshes of a node together.
+static void GatherSceneCullCandidates(Scene *scene, const Vector4 *planes,
+                                      unsigned long layerMask) {
+  unsigned long meshCount = scene->cullBounds.count;
+  ReserveSceneDrawItems(scene, meshCount);
+  ReserveSceneCullBounds(&scene->cullCandidates, meshCount);
+
+  scene->drawItemsCount = 0;
+  scene->cullCandidates.count = 0;
+  if ((layerMask & scene->usedLayers) == scene->usedLayers) {
+    WalkSceneBVHFrustum(scene, planes, AppendSceneDrawItems, &layerMask);
+  } else {
+    for (int l = 0; l < SCENE_LAYER_COUNT; l++) {
+      unsigned long layer = 1ul << l;
+      if (!(layerMask & layer)) {
+        continue;
+      }
+
+      SceneLayer *members = &scene->layers[l];
+      for (unsigned long m = 0; m < members->count; m++) {
+        unsigned long nodeIndex = members->nodeIndices[m];
+        SceneNode *node = GetSceneNodeAt(scene, nodeIndex);
+        // nodes in several selected layers are taken from the first one
+        if (node->layers & layerMask & (layer - 1)) {
+          continue;
+        }
+        AppendSceneDrawItems(scene, nodeIndex, 0x3f, &layerMask);
+      }
+    }
+  }
+
+  PadSceneCullBounds(&scene->cullCandidates);
+}
+
+// Runs the SIMD kernel over the candidates in [first, last) and appends the
+// visible ones to items; the others leave the plane that rejected them in
+// Scene.cullBounds for the next frame. Every mesh is a candidate at most once,
+// so disjoint ranges can be culled concurrently. Returns the number of items
+// appended.
+static unsigned long CullSceneCandidates(Scene *scene, unsigned long first,
+                                         unsigned long last,
+                                         const Vector4 *planes,
+                                         SceneDrawItem *items) {
+  SceneCullBounds *candidates = &scene->cullCandidates;
+  CullSceneBounds(candidates, first, last, planes);
+  unsigned long count = 0;
+  for (unsigned long i = first; i < last; i++) {
+    if (candidates->visible[i]) {
+      items[count++] = (SceneDrawItem){candidates->nodeIndex[i],
+                                       candidates->meshIndex[i], 0, 0, 0};
+    } else {
+      SceneNode *node = GetSceneNodeAt(scene, candidates->nodeIndex[i]);
+      scene->cullBounds.rejectPlane[node->cullBoundsIndex +
+                                    candidates->meshIndex[i]] =
+          candidates->rejectPlane[i];
+    }
+  }
+
+  return count;
+}
+
+// refills the layer membership lists from the live nodes
+static void RebuildSceneLayers(Scene *scene) {
+  for (int l = 0; l < SCENE_LAYER_COUNT; l++) {
+    scene->layers[l].count = 0;
+  }
+  scene->usedLayers = 0;
+
+  SceneTransforms *transforms = &scene->transforms;
+  for (unsigned long t = 0; t < transforms->count; t++) {
+    unsigned long nodeIndex = transforms->nodeIndex[t];
+    unsigned long layers = GetSceneNodeAt(scene, nodeIndex)->layers;
+    for (int l = 0; l < SCENE_LAYER_COUNT; l++) {
+      if (layers & (1ul << l)) {
+        SceneLayer *layer = &scene->layers[l];
+        unsigned long *member =
+            ListAlloc((void **)&layer->nodeIndices, &layer->count,
+                      &layer->capacity, sizeof(unsigned long));
+        *member = nodeIndex;
+      }
+    }
+    scene->usedLayers |= layers;
+  }
+
+  scene->layersDirty = 0;
+}
+
+// makes transforms, mesh bounds, the BVH and the layer lists current
+static void PrepareSceneCulling(Scene *scene) {
+  UpdateTransforms(scene);
+  if (scene->cullBoundsDirty) {
+    RebuildSceneCullBounds(scene);
+  }
+  if (scene->layersDirty) {
+    RebuildSceneLayers(scene);
+  }
+}
+
+typedef struct SceneNodeQuery {
+  SceneId sceneId;
+  SceneNodeId *results;
+  int maxResults;
+  int count;
+  const Vector4 *planes;
+} SceneNodeQuery;
+
+static void AddSceneNodeQueryResult(Scene *scene, unsigned long nodeIndex,
+                                    SceneNodeQuery *query) {
+  if (query->count < query->maxResults) {
+    query->results[query->count] =
+        (SceneNodeId){query->sceneId, nodeIndex,
+                      GetSceneNodeAt(scene, nodeIndex)->generation};
+  }
+  query->count++;
+}
+
+int QuerySceneNodesInBox(SceneId sceneId, BoundingBox box,
+                         SceneNodeId *results, int maxResults) {
+  Scene *scene = GetScene(sceneId);
+  if (!scene) {
+    return 0;
+  }
+
+  PrepareSceneCulling(scene);
+  SceneBVH *bvh = &scene->bvh;
+  SceneNodeQuery query = {sceneId, results, maxResults, 0, 0};
+  if (bvh->root < 0) {
+    return 0;
+  }
+
+  long fixedStack[SCENE_BVH_STACK_SIZE];
+  long *stack = fixedStack;
+  if (GetSceneBVHStackSize(bvh) > SCENE_BVH_STACK_SIZE) {
+    stack = MemAlloc(sizeof(*stack) * GetSceneBVHStackSize(bvh));
+  }
+
+  long stackCount = 0;
+  stack[stackCount++] = bvh->root;
+  while (stackCount > 0) {
+    SceneBVHNode *node = &bvh->nodes[stack[--stackCount]];
+    if (!CheckCollisionBoxes(node->box, box)) {
+      continue;
+    }
+
+    if (node->child1 < 0) {
+      // leaf boxes are enlarged; test the exact node bounds
+      SceneNode *sceneNode = GetSceneNodeAt(scene, node->nodeIndex);
+      BoundingBox bounds = GetSceneNodeWorldBounds(scene, sceneNode);
+      if (CheckCollisionBoxes(bounds, box)) {
+        AddSceneNodeQueryResult(scene, node->nodeIndex, &query);
+      }
+    } else {
+      stack[stackCount++] = node->child1;
+      stack[stackCount++] = node->child2;
+    }
+  }
+
+  if (stack != fixedStack) {
+    MemFree(stack);
+  }
+  return query.count;
+}
+
+static void VisitSceneNodeQueryFrustum(Scene *scene, unsigned long nodeIndex,
+                                       int planeMask, void *data) {
+  SceneNodeQuery *query = data;
+  SceneNode *node = GetSceneNodeAt(scene, nodeIndex);
+  // leaf boxes are enlarged; test the exact node bounds
+  if (planeMask == 0 ||
+      ClassifyBoxFrustum(GetSceneNodeWorldBounds(scene, node),
+                         query->planes, planeMask) >= 0) {
+    AddSceneNodeQueryResult(scene, nodeIndex, query);
+  }
+}
+
+// same projection BeginMode3D sets up for the camera
+static Matrix GetCameraProjection(Camera3D camera) {
+  double aspect = (double)GetScreenWidth() / (double)GetScreenHeight();
+  double nearPlane = rlGetCullDistanceNear();
+  double farPlane = rlGetCullDistanceFar();
+  if (camera.projection == CAMERA_ORTHOGRAPHIC) {
+    double top = camera.fovy / 2.0;
+    double right = top * aspect;
+    return MatrixOrtho(-right, right, -top, top, nearPlane, farPlane);
+  }
+
+  double top = nearPlane * tan(camera.fovy * 0.5 * DEG2RAD);
+  double right = top * aspect;
+  return MatrixFrustum(-right, right, -top, top, nearPlane, farPlane);
+}
+
+int QuerySceneNodesInFrustum(SceneId sceneId, Camera3D camera,
+                             SceneNodeId *results, int maxResults) {
+  Scene *scene = GetScene(sceneId);
+  if (!scene) {
+    return 0;
+  }
+
+  PrepareSceneCulling(scene);
+  Vector4 planes[6];
+  Matrix view = MatrixLookAt(camera.position, camera.target, camera.up);
+  ExtractFrustumPlanes(MatrixMultiply(view, GetCameraProjection(camera)),
+                       planes);
+
+  SceneNodeQuery query = {sceneId, results, maxResults, 0, planes};
+  WalkSceneBVHFrustum(scene, planes, VisitSceneNodeQueryFrustum, &query);
+  return query.count;
+}
+
+// # Occlusion Functions
+// Occluders are rasterized into a coarse depth buffer that spans the whole
+// viewport, then the bounds of the frustum visible meshes are tested against
+// it. The buffer holds the window depth reversed, (1 - z/w) / 2: 1 on the near
+// plane and 0 on the far plane, where nothing was drawn. Unlike 1/w it works
+// for orthographic cameras too, whose w is always 1, and it is linear in
+// screen space for both projections. Rows are SCENE_CULL_BATCH pixels per
+// step, using the vector type of the culling kernel.
+#define SCENE_OCCLUSION_WIDTH 256
+#define SCENE_OCCLUSION_HEIGHT 144
+
+// A triangle in buffer space: x and y in pixels, z the reversed depth
+typedef struct SceneOcclusionTriangle {
+  Vector3 v[3];
+} SceneOcclusionTriangle;
+
+int AddSceneOccluder(SceneId sceneId, Mesh mesh, Matrix transform) {
+  Scene *scene = GetScene(sceneId);
+  if (!scene) {
+    return 0;
+  }
+  if (!mesh.vertices) {
+    TraceLog(LOG_WARNING, "AddSceneOccluder: mesh has no CPU vertex data");
+    return 0;
+  }
+
+  unsigned long count = 3ul * mesh.triangleCount;
+  if (scene->occluderVerticesCount + count > scene->occluderVerticesCapacity) {
+    unsigned long capacity = scene->occluderVerticesCapacity * 2;
+    if (capacity < scene->occluderVerticesCount + count) {
+      capacity = scene->occluderVerticesCount + count;
+    }
+    scene->occluderVertices =
+        ArrayRealloc(scene->occluderVertices, sizeof(Vector3) * capacity);
+    scene->occluderVerticesCapacity = capacity;
+  }
+
+  Vector3 *out = &scene->occluderVertices[scene->occluderVerticesCount];
+  for (unsigned long i = 0; i < count; i++) {
+    unsigned long v = mesh.indices ? mesh.indices[i] : i;
+    if (v >= (unsigned long)mesh.vertexCount) {
+      TraceLog(LOG_WARNING, "AddSceneOccluder: index out of range");
+      return 0;
+    }
+    Vector3 position = {mesh.vertices[v * 3], mesh.vertices[v * 3 + 1],
+                        mesh.vertices[v * 3 + 2]};
+    out[i] = Vector3Transform(position, transform);
+  }
+  scene->occluderVerticesCount += count;
+
+  return 1;
+}
+
+void ClearSceneOccluders(SceneId sceneId) {
+  Scene *scene = GetScene(sceneId);
+  if (scene) {
+    scene->occluderVerticesCount = 0;
+  }
+}
+
+static Vector4 TransformSceneClip(Vector3 p, Matrix m) {
+  return (Vector4){m.m0 * p.x + m.m4 * p.y + m.m8 * p.z + m.m12,
+                   m.m1 * p.x + m.m5 * p.y + m.m9 * p.z + m.m13,
+                   m.m2 * p.x + m.m6 * p.y + m.m10 * p.z + m.m14,
+                   m.m3 * p.x + m.m7 * p.y + m.m11 * p.z + m.m15};
+}
+
+// Distance of a clip space point in front of the near plane, z + w, which is
+// negative behind it for both projections
+static float GetSceneOcclusionNearDistance(Vector4 clip) {
+  return clip.z + clip.w;
+}
+
+static Vector3 GetSceneOcclusionPoint(Vector4 clip) {
+  float invW = 1.0f / clip.w;
+  return (Vector3){(clip.x * invW * 0.5f + 0.5f) * SCENE_OCCLUSION_WIDTH,
+                   (0.5f - clip.y * invW * 0.5f) * SCENE_OCCLUSION_HEIGHT,
+                   0.5f - clip.z * invW * 0.5f};
+}
+
+// Edge functions and the depth plane of a triangle, each as a*x + b*y + c
+typedef struct SceneOcclusionSetup {
+  float a[4], b[4], c[4]; // edges 0..2, depth in 3
+} SceneOcclusionSetup;
+
+static void RasterizeSceneOcclusionRow(float *row, int x0, int x1, float y,
+                                       const SceneOcclusionSetup *t) {
+#ifdef SCENE_CULL_SIMD
+  static const float laneOffsets[8] = {0.5f, 1.5f, 2.5f, 3.5f,
+                                       4.5f, 5.5f, 6.5f, 7.5f};
+  CullFloat zero = CullSet(0.0f);
+  CullFloat a[4], rowTerm[4];
+  for (int k = 0; k < 4; k++) {
+    a[k] = CullSet(t->a[k]);
+    rowTerm[k] = CullSet(t->b[k] * y + t->c[k]);
+  }
+
+  for (int x = x0 - x0 % SCENE_CULL_BATCH; x < x1; x += SCENE_CULL_BATCH) {
+    CullFloat px = CullAdd(CullSet((float)x), CullLoad(laneOffsets));
+    CullMask outside = CullLess(CullAdd(CullMul(a[0], px), rowTerm[0]), zero);
+    outside = CullOr(outside,
+                     CullLess(CullAdd(CullMul(a[1], px), rowTerm[1]), zero));
+    outside = CullOr(outside,
+                     CullLess(CullAdd(CullMul(a[2], px), rowTerm[2]), zero));
+    if (CullMaskBits(outside) == (1 << SCENE_CULL_BATCH) - 1) {
+      continue;
+    }
+
+    CullFloat depth = CullAdd(CullMul(a[3], px), rowTerm[3]);
+    CullFloat stored = CullLoad(&row[x]);
+    CullStore(&row[x],
+              CullMax(stored, CullSelect(outside, zero, depth)));
+  }
+#else
+  for (int x = x0; x < x1; x++) {
+    float px = x + 0.5f;
+    int inside = 1;
+    for (int k = 0; k < 3; k++) {
+      inside &= t->a[k] * px + t->b[k] * y + t->c[k] >= 0.0f;
+    }
+    float depth = t->a[3] * px + t->b[3] * y + t->c[3];
+    if (inside && depth > row[x]) {
+      row[x] = depth;
+    }
+  }
+#endif
+}
+
+static void RasterizeSceneOcclusionTriangle(float *buffer,
+                                            SceneOcclusionTriangle tri) {
+  Vector3 *v = tri.v;
+  float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) -
+               (v[1].y - v[0].y) * (v[2].x - v[0].x);
+  if (fabsf(area) < 1e-6f) {
+    return;
+  }
+  // both windings occlude; make the edge functions positive inside
+  if (area < 0) {
+    Vector3 swap = v[1];
+    v[1] = v[2];
+    v[2] = swap;
+    area = -area;
+  }
+
+  float minX = fminf(v[0].x, fminf(v[1].x, v[2].x));
+  float maxX = fmaxf(v[0].x, fmaxf(v[1].x, v[2].x));
+  float minY = fminf(v[0].y, fminf(v[1].y, v[2].y));
+  float maxY = fmaxf(v[0].y, fmaxf(v[1].y, v[2].y));
+  int x0 = (int)fmaxf(floorf(minX), 0.0f);
+  int x1 = (int)fminf(ceilf(maxX), SCENE_OCCLUSION_WIDTH);
+  int y0 = (int)fmaxf(floorf(minY), 0.0f);
+  int y1 = (int)fminf(ceilf(maxY), SCENE_OCCLUSION_HEIGHT);
+  if (x0 >= x1 || y0 >= y1) {
+    return;
+  }
+
+  SceneOcclusionSetup setup;
+  for (int k = 0; k < 3; k++) {
+    Vector3 from = v[k], to = v[(k + 1) % 3];
+    setup.a[k] = -(to.y - from.y);
+    setup.b[k] = to.x - from.x;
+    setup.c[k] = -(setup.a[k] * from.x + setup.b[k] * from.y);
+  }
+  float dx1 = v[1].x - v[0].x, dy1 = v[1].y - v[0].y;
+  float dx2 = v[2].x - v[0].x, dy2 = v[2].y - v[0].y;
+  float dz1 = v[1].z - v[0].z, dz2 = v[2].z - v[0].z;
+  setup.a[3] = (dz1 * dy2 - dz2 * dy1) / area;
+  setup.b[3] = (dz2 * dx1 - dz1 * dx2) / area;
+  setup.c[3] = v[0].z - setup.a[3] * v[0].x - setup.b[3] * v[0].y;
+
+  for (int y = y0; y < y1; y++) {
+    RasterizeSceneOcclusionRow(&buffer[y * SCENE_OCCLUSION_WIDTH], x0, x1,
+                               y + 0.5f, &setup);
+  }
+}
+
+// Clips the triangle against the near plane and rasterizes what is left
+static void RasterizeSceneOccluders(Scene *scene, Matrix viewProjection) {
+  if (!scene->occlusionDepth) {
+    scene->occlusionDepth = MemAlloc(sizeof(float) * SCENE_OCCLUSION_WIDTH *
+                                     SCENE_OCCLUSION_HEIGHT);
+  }
+
+  float *buffer = scene->occlusionDepth;
+  memset(buffer, 0,
+         sizeof(float) * SCENE_OCCLUSION_WIDTH * SCENE_OCCLUSION_HEIGHT);
+
+  for (unsigned long i = 0; i < scene->occluderVerticesCount; i += 3) {
+    Vector4 clip[3];
+    float distance[3];
+    int behind = 0;
+    for (int k = 0; k < 3; k++) {
+      clip[k] = TransformSceneClip(scene->occluderVertices[i + k],
+                                   viewProjection);
+      distance[k] = GetSceneOcclusionNearDistance(clip[k]);
+      behind += distance[k] < 0;
+    }
+    if (behind == 3) {
+      continue;
+    }
+
+    // polygon of the triangle in front of the near plane, at most 4 points
+    Vector4 polygon[4];
+    int count = 0;
+    for (int k = 0; k < 3; k++) {
+      Vector4 a = clip[k], b = clip[(k + 1) % 3];
+      float da = distance[k], db = distance[(k + 1) % 3];
+      if (da >= 0) {
+        polygon[count++] = a;
+      }
+      if ((da >= 0) != (db >= 0)) {
+        float t = da / (da - db);
+        polygon[count++] =
+            (Vector4){a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t,
+                      a.z + (b.z - a.z) * t, a.w + (b.w - a.w) * t};
+      }
+    }
+
+    Vector3 points[4];
+    for (int k = 0; k < count; k++) {
+      points[k] = GetSceneOcclusionPoint(polygon[k]);
+    }
+    for (int k = 2; k < count; k++) {
+      RasterizeSceneOcclusionTriangle(
+          buffer,
+          (SceneOcclusionTriangle){{points[0], points[k - 1], points[k]}});
+    }
+  }
+}
+
+// A box is occluded if every buffer pixel around its screen rectangle holds a
+// nearer occluder than the box's nearest corner. Occluders are written where
+// they cover a pixel center, so a pixel an occluder edge only partly covers
+// reads as covered. The rectangle is grown by half a pixel to take in the
+// centers around each of its points; past an edge, at least one of them is
+// uncovered. Boxes crossing the near plane are always visible.
+static int IsSceneBoxOccluded(const float *buffer, Vector3 center,
+                              Vector3 extent, Matrix viewProjection) {
+  float minX = INFINITY, maxX = -INFINITY, minY = INFINITY, maxY = -INFINITY;
+  float nearest = 0.0f;
+  for (int k = 0; k < 8; k++) {
+    Vector3 corner = {center.x + (k & 1 ? extent.x : -extent.x),
+                      center.y + (k & 2 ? extent.y : -extent.y),
+                      center.z + (k & 4 ? extent.z : -extent.z)};
+    Vector4 clip = TransformSceneClip(corner, viewProjection);
+    if (GetSceneOcclusionNearDistance(clip) < 0) {
+      return 0;
+    }
+    Vector3 point = GetSceneOcclusionPoint(clip);
+    minX = fminf(minX, point.x);
+    maxX = fmaxf(maxX, point.x);
+    minY = fminf(minY, point.y);
+    maxY = fmaxf(maxY, point.y);
+    nearest = fmaxf(nearest, point.z);
+  }
+
+  int x0 = (int)fmaxf(floorf(minX - 0.5f), 0.0f);
+  int x1 = (int)fminf(ceilf(maxX + 0.5f), SCENE_OCCLUSION_WIDTH);
+  int y0 = (int)fmaxf(floorf(minY - 0.5f), 0.0f);
+  int y1 = (int)fminf(ceilf(maxY + 0.5f), SCENE_OCCLUSION_HEIGHT);
+  if (x0 >= x1 || y0 >= y1) {
+    return 0;
+  }
+
+  for (int y = y0; y < y1; y++) {
+    const float *row = &buffer[y * SCENE_OCCLUSION_WIDTH];
+#ifdef SCENE_CULL_SIMD
+    // lanes outside of the rectangle read as fully occluded
+    static const float laneOffsets[8] = {0, 1, 2, 3, 4, 5, 6, 7};
+    CullFloat boxDepth = CullSet(nearest);
+    CullFloat covered = CullSet(INFINITY);
+    CullFloat first = CullSet((float)x0), last = CullSet((float)x1 - 1);
+    for (int x = x0 - x0 % SCENE_CULL_BATCH; x < x1; x += SCENE_CULL_BATCH) {
+      CullFloat px = CullAdd(CullSet((float)x), CullLoad(laneOffsets));
+      CullMask outside = CullOr(CullLess(px, first), CullLess(last, px));
+      CullFloat depth = CullSelect(outside, covered, CullLoad(&row[x]));
+      if (CullMaskBits(CullLess(boxDepth, depth)) !=
+          (1 << SCENE_CULL_BATCH) - 1) {
+        return 0;
+      }
+    }
+#else
+    for (int x = x0; x < x1; x++) {
+      if (!(row[x] > nearest)) {
+        return 0;
+      }
+    }
+#endif
+  }
+
+  return 1;
+}
+
+// Rasterizes the occluders with the view-projection the frustum was culled
+// with, so the buffer matches what is on screen even in a render texture or
+// under a custom projection. Returns 0 if the scene has none.
+static int PrepareSceneOcclusion(Scene *scene, Matrix viewProjection) {
+  if (scene->occluderVerticesCount == 0) {
+    return 0;
+  }
+
+  RasterizeSceneOccluders(scene, viewProjection);
+  return 1;
+}
+
+// Drops the draw items whose bounds are hidden behind the occluders and
+// returns how many are left. Only reads the scene, so disjoint item lists can
+// be tested concurrently.
+static unsigned long CullSceneOccludedItems(Scene *scene, SceneDrawItem *items,
+                                            unsigned long itemCount,
+                                            Matrix viewProjection) {
+  SceneCullBounds *bounds = &scene->cullBounds;
+  unsigned long count = 0;
+  for (unsigned long d = 0; d < itemCount; d++) {
+    SceneDrawItem item = items[d];
+    SceneNode *node = GetSceneNodeAt(scene, item.nodeIndex);
+    unsigned long b = node->cullBoundsIndex + item.meshIndex;
+    Vector3 center = {bounds->centerX[b], bounds->centerY[b],
+                      bounds->centerZ[b]};
+    Vector3 extent = {bounds->extentX[b], bounds->extentY[b],
+                      bounds->extentZ[b]};
+    if (!IsSceneBoxOccluded(scene->occlusionDepth, center, extent,
+                            viewProjection)) {
+      items[count++] = item;
+    }
+  }
+
+  return count;
+}
+
+#ifdef SCENE_CULL_VERIFY
+int CheckSceneOcclusion(void) {
+  // a 10 by 10 wall across the view, 10 units in front of the camera; its
+  // right edge runs through the middle of a pixel with the orthographic one
+  float wall[18] = {-5,  -3, 0, 5.1f, -3, 0, 5.1f, 7, 0,
+                    -5,  -3, 0, 5.1f, 7,  0, -5,   7, 0};
+  Mesh mesh = {.vertexCount = 6, .triangleCount = 2, .vertices = wall};
+  SceneId sceneId = LoadScene();
+  Scene *scene = GetScene(sceneId);
+  AddSceneOccluder(sceneId, mesh, MatrixIdentity());
+
+  // cameras: 1 perspective, 2 orthographic
+  struct {
+    const char *name;
+    Vector3 center, extent;
+    int occluded;
+    int cameras;
+  } boxes[] = {
+      {"behind the wall", {0, 2, -5}, {1, 1, 1}, 1, 3},
+      {"in front of the wall", {0, 2, 3}, {1, 1, 1}, 0, 3},
+      {"beside the wall", {12, 2, -5}, {1, 1, 1}, 0, 3},
+      {"through the wall", {0, 2, 0}, {1, 1, 1}, 0, 3},
+      {"behind the camera", {0, 2, 20}, {1, 1, 1}, 0, 3},
+      // past the edge by a fifth of a pixel, inside the edge's pixel
+      {"peeking past the wall", {4.86f, 2, -5}, {0.26f, 0.26f, 0.26f}, 0, 2}};
+
+  int failures = 0;
+  Matrix view = MatrixLookAt((Vector3){0, 2, 10}, (Vector3){0, 2, 0},
+                             (Vector3){0, 1, 0});
+  double nearPlane = rlGetCullDistanceNear();
+  double farPlane = rlGetCullDistanceFar();
+  for (int orthographic = 0; orthographic < 2; orthographic++) {
+    Matrix projection =
+        orthographic
+            ? MatrixOrtho(-16, 16, -9, 9, nearPlane, farPlane)
+            : MatrixPerspective(60 * DEG2RAD, 16.0 / 9.0, nearPlane, farPlane);
+    Matrix viewProjection = MatrixMultiply(view, projection);
+    RasterizeSceneOccluders(scene, viewProjection);
+    for (unsigned long b = 0; b < sizeof(boxes) / sizeof(boxes[0]); b++) {
+      if (!(boxes[b].cameras & (1 << orthographic))) {
+        continue;
+      }
+      int occluded = IsSceneBoxOccluded(scene->occlusionDepth, boxes[b].center,
+                                        boxes[b].extent, viewProjection);
+      if (occluded != boxes[b].occluded) {
+        TraceLog(LOG_WARNING, "CheckSceneOcclusion: %s camera, box %s is %s",
+                 orthographic ? "orthographic" : "perspective", boxes[b].name,
+                 occluded ? "occluded" : "visible");
+        failures++;
+      }
+    }
+  }
+
+  UnloadScene(sceneId);
+  return failures;
+}
+#endif
+
+// # Draw Queue Functions
+// runs of fewer instances of a mesh are drawn with plain DrawMesh calls
+#define SCENE_INSTANCING_MIN_COUNT 2
+
+// Sort keys are 64 bit, most significant first:
+//   view depth, the upper bits of the positive float, at most 24
+//   shader id, 8 bits
+//   material, the scene wide index SceneModel.firstMaterial + material index
+//   mesh, the scene wide index SceneModel.firstMesh + mesh index, times the
+//     SCENE_MAX_LOD_COUNT + 1 levels, plus the level
+// The material and mesh fields get as many bits as the scene's materials and
+// meshes need, so no two share a key, and the depth the bits left over.
+// Positive floats compare like their bit patterns, so the depth bits order
+// front to back; back to front inverts them. Within equal depth buckets draws
+// are grouped by state. The hierarchy order instead keys on the position of
+// the node in the parent-before-child transform order, then on the mesh index,
+// again in as many bits as the scene's meshes need.
+//
+// When instancing, the depth moves to the least significant bits so all
+// instances of a mesh end up next to each other, still front to back.
+#define SCENE_DRAW_KEY_DEPTH_BITS 24
+#define SCENE_DRAW_KEY_SHADER_BITS 8
+#define SCENE_DRAW_KEY_MATERIAL_MAX_BITS 24
+#define SCENE_DRAW_KEY_MESH_MAX_BITS 24
+
+// bits needed to tell count values apart, at most maxBits
+static int GetSceneDrawKeyBits(unsigned long count, int maxBits) {
+  int bits = 0;
+  while (bits < maxBits && (1ul << bits) < count) {
+    bits++;
+  }
+
+  return bits;
+}
+
+// scratch matrix array of the scene, valid until the next call
+static Matrix *ReserveSceneInstanceTransforms(Scene *scene,
+                                              unsigned long count) {
+  if (scene->instanceTransformsCapacity < count) {
+    scene->instanceTransformsCapacity = count;
+    scene->instanceTransforms =
+        ArrayRealloc(scene->instanceTransforms, sizeof(Matrix) * count);
+  }
+
+  return scene->instanceTransforms;
+}
+
+static void BuildSceneDrawKeys(Scene *scene, SceneDrawItem *items,
+                               unsigned long count, Camera3D camera,
+                               int sortMode, Shader shader, int instancing) {
+  SceneCullBounds *bounds = &scene->cullBounds;
+  Vector3 forward =
+      Vector3Normalize(Vector3Subtract(camera.target, camera.position));
+  int materialBits = GetSceneDrawKeyBits(scene->materialCount,
+                                         SCENE_DRAW_KEY_MATERIAL_MAX_BITS);
+  int meshBits =
+      GetSceneDrawKeyBits(scene->meshCount * (SCENE_MAX_LOD_COUNT + 1),
+                          SCENE_DRAW_KEY_MESH_MAX_BITS);
+  int stateBits = SCENE_DRAW_KEY_SHADER_BITS + materialBits + meshBits;
+  // no model has more meshes than the scene
+  int hierarchyMeshBits = GetSceneDrawKeyBits(scene->meshCount, 32);
+  int depthBits = 64 - stateBits < SCENE_DRAW_KEY_DEPTH_BITS
+                      ? 64 - stateBits
+                      : SCENE_DRAW_KEY_DEPTH_BITS;
+  for (unsigned long d = 0; d < count; d++) {
+    SceneDrawItem *item = &items[d];
+    SceneNode *node = GetSceneNodeAt(scene, item->nodeIndex);
+    if (sortMode == SCENE_DRAW_SORT_HIERARCHY) {
+      item->sortKey =
+          (unsigned long long)node->transformIndex << hierarchyMeshBits |
+          (unsigned long long)item->meshIndex;
+      continue;
+    }
+
+    unsigned long b = node->cullBoundsIndex + item->meshIndex;
+    Vector3 center = {bounds->centerX[b], bounds->centerY[b],
+                      bounds->centerZ[b]};
+    float depth = Vector3DotProduct(Vector3Subtract(center, camera.position),
+                                    forward);
+    unsigned int depthKey = 0;
+    if (depth > 0) {
+      memcpy(&depthKey, &depth, sizeof(depthKey));
+    }
+    depthKey >>= 32 - depthBits;
+    if (sortMode == SCENE_DRAW_SORT_BACK_TO_FRONT) {
+      depthKey = ~depthKey & ((1u << depthBits) - 1);
+    }
+
+    SceneModel *sceneModel = GetSceneModelAt(scene, node->model.id);
+    Model *model = &sceneModel->model;
+    int materialIndex = model->meshMaterial[item->meshIndex];
+    unsigned int shaderId =
+        shader.id > 0 ? shader.id : model->materials[materialIndex].shader.id;
+    unsigned long long material = sceneModel->firstMaterial + materialIndex;
+    material &= (1ull << materialBits) - 1;
+    unsigned long long mesh =
+        (sceneModel->firstMesh + item->meshIndex) * (SCENE_MAX_LOD_COUNT + 1) +
+        item->lod;
+    mesh &= (1ull << meshBits) - 1;
+    unsigned long long state =
+        ((unsigned long long)(shaderId & 0xff) << materialBits | material)
+            << meshBits |
+        mesh;
+    if (instancing) {
+      item->sortKey = state << depthBits | depthKey;
+    } else {
+      item->sortKey = (unsigned long long)depthKey << (64 - depthBits) | state;
+    }
+  }
+}
+
+// LSD radix sort of the draw queue by sort key, one byte per pass. Passes in
+// which all keys share the same byte are skipped, which makes the sparse
+// hierarchy keys cheap. The sort is stable.
+static void SortSceneDrawItems(Scene *scene) {
+  unsigned long count = scene->drawItemsCount;
+  unsigned long histograms[8][256] = {{0}};
+  for (unsigned long d = 0; d < count; d++) {
+    unsigned long long key = scene->drawItems[d].sortKey;
+    for (int pass = 0; pass < 8; pass++) {
+      histograms[pass][(key >> (pass * 8)) & 0xff]++;
+    }
+  }
+
+  for (int pass = 0; pass < 8; pass++) {
+    unsigned long *histogram = histograms[pass];
+    SceneDrawItem *from = scene->drawItems;
+    if (histogram[(from[0].sortKey >> (pass * 8)) & 0xff] == count) {
+      continue;
+    }
+
+    unsigned long offset = 0;
+    for (int digit = 0; digit < 256; digit++) {
+      unsigned long digitCount = histogram[digit];
+      histogram[digit] = offset;
+      offset += digitCount;
+    }
+
+    SceneDrawItem *to = scene->drawItemsScratch;
+    for (unsigned long d = 0; d < count; d++) {
+      to[histogram[(from[d].sortKey >> (pass * 8)) & 0xff]++] = from[d];
+    }
+    scene->drawItems = to;
+    scene->drawItemsScratch = from;
+  }
+}
+
+// # Level of Detail Functions
+// The level of a node is picked from the share of the viewport height its
+// model's bounding sphere covers, which works the same for perspective and
+// orthographic cameras. To leave its current level the size has to cross the
+// threshold by SCENE_LOD_HYSTERESIS of it, so nodes sitting right at a
+// threshold don't flip between two levels every frame.
+#define SCENE_LOD_HYSTERESIS 0.1f
+
+static float GetSceneNodeScreenSize(Scene *scene, SceneNode *node,
+                                    SceneModel *sceneModel, Camera3D camera) {
+  Matrix m = scene->transforms.localToWorld[node->transformIndex];
+  Vector4 sphere = sceneModel->boundingSphere;
+  Vector3 center =
+      Vector3Transform((Vector3){sphere.x, sphere.y, sphere.z}, m);
+  float radius = sphere.w * GetMatrixMaxScale(m);
+
+  float halfHeight = camera.fovy * 0.5f;
+  if (camera.projection != CAMERA_ORTHOGRAPHIC) {
+    float distance = Vector3Distance(center, camera.position);
+    if (distance <= radius) {
+      return INFINITY;
+    }
+    halfHeight = distance * tanf(halfHeight * DEG2RAD);
+  }
+
+  return radius / halfHeight;
+}
+
+static int SelectSceneModelLOD(SceneModel *sceneModel, float screenSize,
+                               int current) {
+  // the levels the size is clearly below and the ones it may be below
+  int finest = 0, coarsest = 0;
+  for (int l = 0; l < sceneModel->lodCount; l++) {
+    float threshold = sceneModel->lods[l].screenSize;
+    finest += screenSize < threshold * (1.0f - SCENE_LOD_HYSTERESIS);
+    coarsest += screenSize < threshold * (1.0f + SCENE_LOD_HYSTERESIS);
+  }
+
+  return current < finest ? finest : current > coarsest ? coarsest : current;
+}
+
+// Sets the level of every item from its node and returns the new item count.
+// With a crossfade time, nodes that just switched are queued a second time at
+// the level they left, so items needs room for twice the count: both are drawn
+// dithered, the new level with its share of the fade as a positive value and
+// the old one with the negated share, until the fade is through. Items of a
+// node must not be split between lists handled concurrently.
+static unsigned long SelectSceneDrawItemLODs(Scene *scene, SceneDrawItem *items,
+                                             unsigned long count,
+                                             Camera3D camera, double time,
+                                             float crossfadeTime) {
+  unsigned long itemCount = count;
+  unsigned long nodeIndex = (unsigned long)-1;
+  float fade = 0;
+  for (unsigned long d = 0; d < count; d++) {
+    SceneDrawItem *item = &items[d];
+    SceneNode *node = GetSceneNodeAt(scene, item->nodeIndex);
+    SceneModel *sceneModel = GetSceneModelAt(scene, node->model.id);
+    if (sceneModel->lodCount == 0) {
+      continue;
+    }
+
+    // a node's meshes are queued next to each other
+    if (item->nodeIndex != nodeIndex) {
+      nodeIndex = item->nodeIndex;
+      float size = GetSceneNodeScreenSize(scene, node, sceneModel, camera);
+      int lod = SelectSceneModelLOD(sceneModel, size, node->lod);
+      if (lod != node->lod) {
+        node->lodPrevious = node->lod;
+        node->lod = lod;
+        node->lodFadeStart = time;
+      }
+
+      fade = 0;
+      if (crossfadeTime > 0 && node->lodPrevious != node->lod) {
+        fade = (time - node->lodFadeStart) / crossfadeTime;
+        // both levels share the pixels from the first frame on
+        fade = fmaxf(fade, 1e-3f);
+      }
+      if (fade >= 1.0f || crossfadeTime <= 0) {
+        node->lodPrevious = node->lod;
+        fade = 0;
+      }
+    }
+
+    item->lod = node->lod;
+    item->fade = fade;
+    if (fade > 0) {
+      items[itemCount++] = (SceneDrawItem){item->nodeIndex, item->meshIndex, 0,
+                                           node->lodPrevious, -fade};
+    }
+  }
+
+  return itemCount;
+}
+
+static Mesh *GetSceneModelLODMeshes(SceneModel *sceneModel, int lod) {
+  return lod > 0 ? sceneModel->lods[lod - 1].meshes : sceneModel->model.meshes;
+}
+
+// # Material Functions
+// (Re)builds the variants of all scene materials for the table's shaders
+static void BuildSceneMaterialTable(Scene *scene, SceneMaterialTable *table) {
+  table->materials = ArrayRealloc(table->materials,
+                                  sizeof(Material) * 2 * scene->materialCount);
+  table->maps =
+      ArrayRealloc(table->maps, sizeof(MaterialMap) * SCENE_MATERIAL_MAP_COUNT *
+                                    scene->materialCount);
+  table->count = scene->materialCount;
+
+  for (unsigned long m = 0; m < scene->models.count; m++) {
+    SceneModel *sceneModel = GetSceneModelAt(scene, m);
+    Model *model = &sceneModel->model;
+    for (int i = 0; i < model->materialCount; i++) {
+      unsigned long index = sceneModel->firstMaterial + i;
+      MaterialMap *maps = &table->maps[index * SCENE_MATERIAL_MAP_COUNT];
+      memcpy(maps, model->materials[i].maps,
+             sizeof(MaterialMap) * SCENE_MATERIAL_MAP_COUNT);
+      maps[MATERIAL_MAP_DIFFUSE].color = WHITE;
+
+      Material material = model->materials[i];
+      material.maps = maps;
+      if (table->shader.id > 0) {
+        material.shader = table->shader;
+      }
+      table->materials[index * 2] = material;
+      material.shader = table->instancingShader;
+      table->materials[index * 2 + 1] = material;
+    }
+  }
+}
+
+// Returns the material variants for a pair of shader overrides. Tables are
+// built on first use and rebuilt when models were added since; a scene is
+// rarely drawn with more than a couple of shader pairs, so they are kept in a
+// list.
+static SceneMaterialTable *GetSceneMaterialTable(Scene *scene, Shader shader,
+                                                 Shader instancingShader) {
+  SceneMaterialTable *table = 0;
+  for (unsigned long t = 0; t < scene->materialTablesCount; t++) {
+    SceneMaterialTable *candidate = &scene->materialTables[t];
+    // a reloaded shader may get its old id back, but not its locations
+    if (candidate->shader.id == shader.id &&
+        candidate->shader.locs == shader.locs &&
+        candidate->instancingShader.id == instancingShader.id &&
+        candidate->instancingShader.locs == instancingShader.locs) {
+      table = candidate;
+      break;
+    }
+  }
+
+  if (!table) {
+    table = ListAlloc((void **)&scene->materialTables,
+                      &scene->materialTablesCount,
+                      &scene->materialTablesCapacity,
+                      sizeof(SceneMaterialTable));
+    table->shader = shader;
+    table->instancingShader = instancingShader;
+  }
+  if (table->count != scene->materialCount || !table->materials) {
+    BuildSceneMaterialTable(scene, table);
+  }
+
+  return table;
+}
+
+// # Draw Job Functions
+// DrawScene first gathers the meshes to test on the calling thread, with the
+// BVH or the layer lists like the serial path: those of nodes fully inside
+// the frustum, then the candidates that straddle it (see
+// GatherSceneCullCandidates). With more than one worker it cuts this sequence
+// into ranges that end at node boundaries and hands one job per range to the
+// worker pool. A job runs the kernel over its candidates, culls its meshes
+// against the occluders, picks the levels of detail and builds the sort keys
+// into a list of its own. The lists are concatenated in range order, so the
+// queue is the same as the serial path's no matter which thread ran which job,
+// and only sorting and submission are left to the calling thread.
+#define SCENE_DRAW_JOBS_PER_WORKER 4
+// smaller ranges aren't worth handing to another thread
+#define SCENE_DRAW_JOB_MIN_MESHES 256
+
+// what DrawScene builds its queue from, shared by all jobs
+typedef struct SceneDrawList {
+  Scene *scene;
+  const Vector4 *planes;
+  unsigned long layerMask;
+  // meshes of nodes fully inside the frustum, at the start of
+  // Scene.drawItems; the jobs' ranges continue into Scene.cullCandidates
+  unsigned long insideCount;
+  Camera3D camera;
+  // occlusion culling is requested, with the matrix the planes come from
+  char occlusion;
+  Matrix viewProjection;
+  double time;
+  float crossfadeTime;
+  // sort keys are only built if the queue is sorted
+  char buildKeys;
+  int sortMode;
+  Shader shader;
+  char instancing;
+} SceneDrawList;
+
+// node of the gathered mesh at index i, counting the meshes fully inside the
+// frustum first and the candidates after them
+static unsigned long GetSceneDrawJobNode(SceneDrawList *list,
+                                         unsigned long i) {
+  Scene *scene = list->scene;
+  return i < list->insideCount
+             ? scene->drawItems[i].nodeIndex
+             : scene->cullCandidates.nodeIndex[i - list->insideCount];
+}
+
+// Cuts the gathered meshes into job ranges. Returns the number of jobs, or 1
+// if there are too few to be worth splitting.
+static unsigned long SplitSceneDrawJobs(SceneDrawList *list, int workerCount) {
+  Scene *scene = list->scene;
+  unsigned long total = list->insideCount + scene->cullCandidates.count;
+  unsigned long jobCount = 1;
+  if (workerCount > 1) {
+    jobCount = (unsigned long)workerCount * SCENE_DRAW_JOBS_PER_WORKER;
+  }
+  if (jobCount > total / SCENE_DRAW_JOB_MIN_MESHES) {
+    jobCount = total / SCENE_DRAW_JOB_MIN_MESHES;
+  }
+  if (jobCount <= 1) {
+    return 1;
+  }
+
+  if (scene->drawJobsCapacity < jobCount) {
+    scene->drawJobs =
+        ArrayRealloc(scene->drawJobs, sizeof(SceneDrawJob) * jobCount);
+    memset(&scene->drawJobs[scene->drawJobsCapacity], 0,
+           sizeof(SceneDrawJob) * (jobCount - scene->drawJobsCapacity));
+    scene->drawJobsCapacity = jobCount;
+  }
+
+  // every range but the last is at least the target, so there are at most
+  // jobCount of them
+  unsigned long target = (total + jobCount - 1) / jobCount;
+  unsigned long j = 0;
+  for (unsigned long first = 0; first < total; j++) {
+    unsigned long last = first + target;
+    if (last >= total) {
+      last = total;
+    }
+    // the meshes of a node share its level of detail state
+    while (last < total && GetSceneDrawJobNode(list, last) ==
+                               GetSceneDrawJobNode(list, last - 1)) {
+      last++;
+    }
+
+    SceneDrawJob *job = &scene->drawJobs[j];
+    job->first = first;
+    job->last = last;
+    if (job->itemsCapacity < (last - first) * 2) {
+      job->itemsCapacity = (last - first) * 2;
+      job->items =
+          ArrayRealloc(job->items, sizeof(SceneDrawItem) * job->itemsCapacity);
+    }
+    first = last;
+  }
+
+  return j;
+}
+
+static void RunSceneDrawJob(void *data, unsigned long j) {
+  SceneDrawList *list = data;
+  Scene *scene = list->scene;
+  SceneDrawJob *job = &scene->drawJobs[j];
+  unsigned long inside = list->insideCount;
+  unsigned long count = 0;
+  if (job->first < inside) {
+    count = (job->last < inside ? job->last : inside) - job->first;
+    memcpy(job->items, scene->drawItems + job->first,
+           sizeof(SceneDrawItem) * count);
+  }
+  if (job->last > inside) {
+    unsigned long first = job->first > inside ? job->first - inside : 0;
+    count += CullSceneCandidates(scene, first, job->last - inside,
+                                 list->planes, job->items + count);
+  }
+  if (list->occlusion) {
+    count = CullSceneOccludedItems(scene, job->items, count,
+                                   list->viewProjection);
+  }
+
+  job->visibleCount = count;
+  job->itemsCount = SelectSceneDrawItemLODs(scene, job->items, count,
+                                            list->camera, list->time,
+                                            list->crossfadeTime);
+  if (list->buildKeys) {
+    BuildSceneDrawKeys(scene, job->items, job->itemsCount, list->camera,
+                       list->sortMode, list->shader, list->instancing);
+  }
+}
+
+// Concatenates the job lists into Scene.drawItems: the visible items of all
+// jobs in range order, then their crossfade duplicates. Returns the number of
+// visible items.
+static unsigned long MergeSceneDrawJobs(Scene *scene, unsigned long jobCount) {
+  unsigned long visibleCount = 0, count = 0;
+  for (unsigned long j = 0; j < jobCount; j++) {
+    visibleCount += scene->drawJobs[j].visibleCount;
+    count += scene->drawJobs[j].itemsCount;
+  }
+
+  ReserveSceneDrawItems(scene, count);
+  SceneDrawItem *visible = scene->drawItems;
+  SceneDrawItem *fading = scene->drawItems + visibleCount;
+  for (unsigned long j = 0; j < jobCount; j++) {
+    SceneDrawJob *job = &scene->drawJobs[j];
+    memcpy(visible, job->items, sizeof(SceneDrawItem) * job->visibleCount);
+    visible += job->visibleCount;
+    memcpy(fading, job->items + job->visibleCount,
+           sizeof(SceneDrawItem) * (job->itemsCount - job->visibleCount));
+    fading += job->itemsCount - job->visibleCount;
+  }
+
+  scene->drawItemsCount = count;
+  return visibleCount;
+}
+
+// Fills Scene.drawItems with the visible meshes at their level of detail and
+// with sort keys if requested, on workerCount threads if the scene is large
+// enough. Returns the number of meshes that passed culling.
+static unsigned long BuildSceneDrawItems(SceneDrawList *list,
+                                         int workerCount) {
+  Scene *scene = list->scene;
+  GatherSceneCullCandidates(scene, list->planes, list->layerMask);
+  list->insideCount = scene->drawItemsCount;
+  unsigned long jobCount = SplitSceneDrawJobs(list, workerCount);
+  if (jobCount > 1) {
+    list->occlusion =
+        list->occlusion && PrepareSceneOcclusion(scene, list->viewProjection);
+    RunSceneJobs(RunSceneDrawJob, list, jobCount, workerCount);
+#ifdef SCENE_CULL_VERIFY
+    VerifySceneCullBounds(&scene->cullCandidates, list->planes);
+#endif
+    return MergeSceneDrawJobs(scene, jobCount);
+  }
+
+  SceneCullBounds *candidates = &scene->cullCandidates;
+  scene->drawItemsCount +=
+      CullSceneCandidates(scene, 0, candidates->count, list->planes,
+                          scene->drawItems + scene->drawItemsCount);
+#ifdef SCENE_CULL_VERIFY
+  VerifySceneCullBounds(candidates, list->planes);
+#endif
+  if (list->occlusion && scene->drawItemsCount > 0 &&
+      PrepareSceneOcclusion(scene, list->viewProjection)) {
+    scene->drawItemsCount =
+        CullSceneOccludedItems(scene, scene->drawItems, scene->drawItemsCount,
+                               list->viewProjection);
+  }
+
+  unsigned long visibleCount = scene->drawItemsCount;
+  if (list->crossfadeTime > 0) {
+    ReserveSceneDrawItems(scene, visibleCount * 2);
+  }
+  scene->drawItemsCount =
+      SelectSceneDrawItemLODs(scene, scene->drawItems, visibleCount,
+                              list->camera, list->time, list->crossfadeTime);
+  if (list->buildKeys) {
+    BuildSceneDrawKeys(scene, scene->drawItems, scene->drawItemsCount,
+                       list->camera, list->sortMode, list->shader,
+                       list->instancing);
+  }
+
+  return visibleCount;
+}
+
+// # Component Functions
+static SceneComponentData *GetSceneNodeComponentPool(Scene *scene,
+                                                     unsigned long nodeIndex,
+                                                     int definitionId,
+                                                     unsigned long *entry) {
+  SceneComponentData *pool = &scene->sceneComponentData[definitionId];
+  if (nodeIndex >= pool->nodeEntriesCapacity ||
+      pool->nodeEntries[nodeIndex] == 0) {
+    return 0;
+  }
+
+  *entry = pool->nodeEntries[nodeIndex] - 1;
+  return pool;
+}
+
+// Calls onRemove, then fills the hole with the last entry of the pool
+static void RemoveSceneComponentEntry(Scene *scene, int definitionId,
+                                      unsigned long nodeIndex) {
+  SceneNodeComponentDefinition *definition =
+      &sceneNodeComponentDefinitions[definitionId];
+  unsigned long entry;
+  SceneComponentData *pool =
+      GetSceneNodeComponentPool(scene, nodeIndex, definitionId, &entry);
+  if (!pool) {
+    return;
+  }
+
+  if (definition->onRemove) {
+    unsigned long size = definition->componentDataSize;
+    SceneNodeId nodeId = pool->nodeIds[entry];
+    definition->onRemove(nodeId, pool->componentData + entry * size);
+    // the callback may have changed the pool; look the entry up again
+    scene = scenes[nodeId.sceneId.id];
+    pool = GetSceneNodeComponentPool(scene, nodeIndex, definitionId, &entry);
+    if (!pool) {
+      return;
+    }
+  }
+
+  unsigned long size = definition->componentDataSize;
+  unsigned long last = pool->count - 1;
+  if (entry != last) {
+    memcpy(pool->componentData + entry * size,
+           pool->componentData + last * size, size);
+    pool->nodeIds[entry] = pool->nodeIds[last];
+    pool->nodeEntries[pool->nodeIds[entry].id] = entry + 1;
+  }
+  pool->nodeEntries[nodeIndex] = 0;
+  pool->count--;
+}
+
+SceneNodeComponentId AddSceneNodeComponent(SceneNodeId sceneNodeId,
+                                           unsigned char definitionId) {
+  Scene *scene;
+  SceneNode *node = GetSceneNode(sceneNodeId, &scene);
+  SceneNodeComponentDefinition *definition =
+      &sceneNodeComponentDefinitions[definitionId];
+  if (!node) {
+    return (SceneNodeComponentId){0};
+  }
+  if (!definition->name) {
+    TraceLog(LOG_WARNING,
+             "AddSceneNodeComponent: no definition with id %d registered",
+             definitionId);
+    return (SceneNodeComponentId){0};
+  }
+
+  SceneComponentData *pool = &scene->sceneComponentData[definitionId];
+  unsigned long nodeIndex = sceneNodeId.id;
+  if (nodeIndex >= pool->nodeEntriesCapacity) {
+    unsigned long capacity = pool->nodeEntriesCapacity * 2;
+    if (capacity <= nodeIndex) {
+      capacity = scene->nodes.count > nodeIndex ? scene->nodes.count
+                                                : nodeIndex + 1;
+    }
+    pool->nodeEntries =
+        ArrayRealloc(pool->nodeEntries, sizeof(unsigned long) * capacity);
+    pool->nodeGenerations = ArrayRealloc(pool->nodeGenerations,
+                                         sizeof(unsigned short) * capacity);
+    for (unsigned long i = pool->nodeEntriesCapacity; i < capacity; i++) {
+      pool->nodeEntries[i] = 0;
+      pool->nodeGenerations[i] = 0;
+    }
+    pool->nodeEntriesCapacity = capacity;
+  }
+
+  if (pool->nodeEntries[nodeIndex]) {
+    TraceLog(LOG_WARNING,
+             "AddSceneNodeComponent: node already has a %s component",
+             definition->name);
+    return (SceneNodeComponentId){sceneNodeId.sceneId, nodeIndex,
+                                  pool->nodeGenerations[nodeIndex],
+                                  definitionId};
+  }
+
+  unsigned long size = definition->componentDataSize;
+  if (pool->count >= pool->capacity) {
+    pool->capacity = pool->capacity == 0 ? 16 : pool->capacity * 2;
+    pool->componentData = ArrayRealloc(pool->componentData,
+                                       (size ? size : 1) * pool->capacity);
+    pool->nodeIds =
+        ArrayRealloc(pool->nodeIds, sizeof(SceneNodeId) * pool->capacity);
+  }
+
+  unsigned long entry = pool->count++;
+  memset(pool->componentData + entry * size, 0, size);
+  pool->nodeIds[entry] = sceneNodeId;
+  pool->nodeEntries[nodeIndex] = entry + 1;
+  // 0 is never a valid generation
+  if (++pool->nodeGenerations[nodeIndex] == 0) {
+    pool->nodeGenerations[nodeIndex] = 1;
+  }
+
+  SceneNodeComponentId componentId = {sceneNodeId.sceneId, nodeIndex,
+                                      pool->nodeGenerations[nodeIndex],
+                                      definitionId};
+  if (definition->onAdd) {
+    definition->onAdd(sceneNodeId, pool->componentData + entry * size);
+  }
+
+  return componentId;
+}
+
+void *GetSceneNodeComponent(SceneNodeId sceneNodeId,
+                            unsigned char definitionId) {
+  Scene *scene;
+  unsigned long entry;
+  if (!GetSceneNode(sceneNodeId, &scene)) {
+    return 0;
+  }
+
+  SceneComponentData *pool =
+      GetSceneNodeComponentPool(scene, sceneNodeId.id, definitionId, &entry);
+  if (!pool) {
+    return 0;
+  }
+
+  return pool->componentData +
+         entry * sceneNodeComponentDefinitions[definitionId].componentDataSize;
+}
+
+void *GetSceneNodeComponentData(SceneNodeComponentId componentId) {
+  Scene *scene = GetScene(componentId.ownerSceneId);
+  unsigned long entry;
+  if (!scene) {
+    return 0;
+  }
+
+  SceneComponentData *pool = GetSceneNodeComponentPool(
+      scene, componentId.componentIndex, componentId.definitionId, &entry);
+  if (!pool ||
+      pool->nodeGenerations[componentId.componentIndex] !=
+          componentId.generation) {
+    return 0;
+  }
+
+  return pool->componentData +
+         entry * sceneNodeComponentDefinitions[componentId.definitionId]
+                     .componentDataSize;
+}
+
+int RemoveSceneNodeComponent(SceneNodeId sceneNodeId,
+                             unsigned char definitionId) {
+  Scene *scene;
+  unsigned long entry;
+  if (!GetSceneNode(sceneNodeId, &scene) ||
+      !GetSceneNodeComponentPool(scene, sceneNodeId.id, definitionId,
+                                 &entry)) {
+    return 0;
+  }
+
+  RemoveSceneComponentEntry(scene, definitionId, sceneNodeId.id);
+  return 1;
+}
+
+void RunSceneNodeComponentSystem(SceneId sceneId, unsigned char definitionId,
+                                 SceneNodeComponentSystem system,
+                                 void *data) {
+  Scene *scene = GetScene(sceneId);
+  if (!scene || !system) {
+    return;
+  }
+
+  SceneComponentData *pool = &scene->sceneComponentData[definitionId];
+  if (pool->count > 0) {
+    system(pool->componentData, pool->nodeIds, pool->count, data);
+  }
+}
+
+// Hands every component type with an onDraw callback its packed components
+// along with the world matrices of their nodes, one call per type
+static void DrawSceneNodeComponents(Scene *scene) {
+  for (int d = 0; d < 256; d++) {
+    SceneNodeComponentDefinition *definition =
+        &sceneNodeComponentDefinitions[d];
+    SceneComponentData *pool = &scene->sceneComponentData[d];
+    if (!definition->onDraw || pool->count == 0) {
+      continue;
+    }
+
+    Matrix *localToWorld = ReserveSceneInstanceTransforms(scene, pool->count);
+    for (unsigned long i = 0; i < pool->count; i++) {
+      SceneNode *node = GetSceneNodeAt(scene, pool->nodeIds[i].id);
+      localToWorld[i] = scene->transforms.localToWorld[node->transformIndex];
+    }
+    definition->onDraw(pool->componentData, pool->nodeIds, localToWorld,
+                       pool->count);
+  }
+}
+
+SceneDrawStats DrawScene(SceneId sceneId, SceneDrawConfig config) {
+  SceneDrawStats stats = {0};
+  if (!IsSceneValid(sceneId)) {
+    return stats;
+  }
+
+  Camera3D camera = config.camera;
+  Matrix transform = config.transform;
+  unsigned long layerMask = config.layerMask;
+  int sortMode = config.sortMode;
+  char drawBoundingBoxes = config.drawBoundingBoxes;
+  Shader shader = config.shader; // Add this line
+
+  Vector4 frustumPlanes[6];
+  Matrix viewProjection;
+  GetCameraFrustumPlanes(camera, frustumPlanes, &viewProjection);
+
+  if (config.drawCameraFrustum) {
+    DrawPlaneEq(frustumPlanes[0], GREEN);
+    DrawPlaneEq(frustumPlanes[1], GREEN);
+    DrawPlaneEq(frustumPlanes[2], GREEN);
+    DrawPlaneEq(frustumPlanes[3], GREEN);
+    DrawPlaneEq(frustumPlanes[4], GREEN);
+    DrawPlaneEq(frustumPlanes[5], GREEN);
+  }
+
+  Scene *scene = scenes[sceneId.id];
+  PrepareSceneCulling(scene);
+  // the fade goes through a uniform, so it needs the shader override
+  int fadeLocation = config.lodCrossfadeTime > 0 && shader.id > 0
+                         ? GetShaderLocation(shader, "lodFade")
+                         : -1;
+  // instanced draws lose the order between different meshes, which blended
+  // and hierarchy ordered draws depend on
+  int instancing = config.instancingShader.id > 0 &&
+                   sortMode != SCENE_DRAW_SORT_BACK_TO_FRONT &&
+                   sortMode != SCENE_DRAW_SORT_HIERARCHY;
+  SceneDrawList list = {
+      .scene = scene,
+      .planes = frustumPlanes,
+      .layerMask = layerMask,
+      .camera = camera,
+      .occlusion = config.occlusionCulling,
+      .viewProjection = viewProjection,
+      .time = GetTime(),
+      .crossfadeTime = fadeLocation >= 0 ? config.lodCrossfadeTime : 0,
+      .buildKeys = sortMode != SCENE_DRAW_SORT_NONE || instancing,
+      .sortMode = sortMode,
+      .shader = shader,
+      .instancing = instancing};
+  int workerCount =
+      config.workerCount < 0 ? GetSceneProcessorCount() : config.workerCount;
+  unsigned long visibleCount = BuildSceneDrawItems(&list, workerCount);
+  stats.culledMeshCount = scene->cullBounds.count - visibleCount;
+  if (list.buildKeys && scene->drawItemsCount > 1) {
+    SortSceneDrawItems(scene);
+  }
+
+  SceneMaterialTable *materials =
+      GetSceneMaterialTable(scene, shader, config.instancingShader);
+  SceneTransforms *transforms = &scene->transforms;
+  unsigned long d = 0;
+  while (d < scene->drawItemsCount) {
+    SceneDrawItem item = scene->drawItems[d];
+    SceneNode *node = GetSceneNodeAt(scene, item.nodeIndex);
+    SceneModel *sceneModel = GetSceneModelAt(scene, node->model.id);
+    int i = item.meshIndex;
+    Mesh mesh = GetSceneModelLODMeshes(sceneModel, item.lod)[i];
+
+    // the run of queued instances of the same mesh; fading ones are drawn
+    // one by one with their own fade
+    unsigned long runCount = 1;
+    while (instancing && item.fade == 0 &&
+           d + runCount < scene->drawItemsCount) {
+      SceneDrawItem next = scene->drawItems[d + runCount];
+      if (next.meshIndex != i || next.lod != item.lod || next.fade != 0 ||
+          GetSceneNodeAt(scene, next.nodeIndex)->model.id != node->model.id) {
+        break;
+      }
+      runCount++;
+    }
+
+    unsigned long materialIndex =
+        sceneModel->firstMaterial + sceneModel->model.meshMaterial[i];
+    Material *variants = &materials->materials[materialIndex * 2];
+    if (runCount >= SCENE_INSTANCING_MIN_COUNT) {
+      Matrix *instanceTransforms =
+          ReserveSceneInstanceTransforms(scene, runCount);
+      for (unsigned long r = 0; r < runCount; r++) {
+        SceneNode *instance =
+            GetSceneNodeAt(scene, scene->drawItems[d + r].nodeIndex);
+        instanceTransforms[r] =
+            transforms->localToWorld[instance->transformIndex];
+      }
+
+      DrawMeshInstanced(mesh, variants[1], instanceTransforms, runCount);
+    } else {
+      Matrix matrix = transforms->localToWorld[node->transformIndex];
+      if (item.fade != 0) {
+        SetShaderValue(shader, fadeLocation, &item.fade, SHADER_UNIFORM_FLOAT);
+      }
+      DrawMesh(mesh, variants[0], matrix);
+      if (item.fade != 0) {
+        float opaque = 0;
+        SetShaderValue(shader, fadeLocation, &opaque, SHADER_UNIFORM_FLOAT);
+      }
+    }
+
+    stats.drawCallCount++;
+    stats.meshDrawCount += runCount;
+    stats.trianglesDrawCount += runCount * mesh.triangleCount;
+    d += runCount;
+  }
+
+  DrawSceneNodeComponents(scene);
+
+  if (drawBoundingBoxes) {
+    for (unsigned long t = 0; t < transforms->count; t++) {
+      SceneNode *node = GetSceneNodeAt(scene, transforms->nodeIndex[t]);
+      SceneModel *sceneModel = GetSceneNodeSceneModel(scene, node);
+      if (!sceneModel || !(node->layers & layerMask)) {
+        continue;
+      }
+
+      Matrix matrix = transforms->localToWorld[t];
+      Model model = sceneModel->model;
+      rlPushMatrix();
+      rlMultMatrixf(MatrixToFloat(matrix));
+      for (int i = 0; i < model.meshCount; i++) {
+        BoundingBox box = sceneModel->meshBounds[i];
+        DrawBoundingBox(box, RED);
+      }
+      rlPopMatrix();
+    }
+  }
+
+  return stats;
+}
+
+SceneModelId AddModelToScene(SceneId sceneId, Model model, const char *name,
+                             int manageModel) {
+  if (!IsSceneValid(sceneId)) {
+    return (SceneModelId){0};
+  }
+
+  Scene *scene = scenes[sceneId.id];
+  SceneModel *sceneModel = PagedListAlloc(&scene->models, sizeof(SceneModel));
+  int index = scene->models.count - 1;
+  *sceneModel = (SceneModel){.generation = sceneModel->generation + 1,
+                             .model = model,
+                             .nameId = InternSceneName(&scene->names, name),
+                             .isManaged = manageModel,
+                             .firstMaterial = scene->materialCount,
+                             .firstMesh = scene->meshCount};
+  scene->materialCount += model.materialCount;
+  scene->meshCount += model.meshCount;
+
+  sceneModel->meshBounds = MemAlloc(sizeof(BoundingBox) * model.meshCount);
+  sceneModel->meshBoundingSpheres = MemAlloc(sizeof(Vector4) * model.meshCount);
+  for (int i = 0; i < model.meshCount; i++) {
+    BoundingBox box = GetMeshBoundingBox(model.meshes[i]);
+    sceneModel->meshBounds[i] = box;
+    Vector3 center = Vector3Scale(Vector3Add(box.min, box.max), 0.5f);
+    float radius = Vector3Distance(center, box.max);
+    sceneModel->meshBoundingSpheres[i] =
+        (Vector4){center.x, center.y, center.z, radius};
+  }
+
+  return (SceneModelId){sceneId, index, sceneModel->generation};
+}
+
+int AddModelLODToScene(SceneModelId modelId, const Mesh *meshes,
+                       float screenSize) {
+  Scene *scene = GetScene(modelId.ownerSceneId);
+  if (!scene || modelId.id >= scene->models.count) {
+    return 0;
+  }
+
+  SceneModel *sceneModel = GetSceneModelAt(scene, modelId.id);
+  if (sceneModel->generation != modelId.generation ||
+      sceneModel->lodCount >= SCENE_MAX_LOD_COUNT) {
+    TraceLog(LOG_WARNING, "AddModelLODToScene: invalid model or too many "
+                          "levels");
+    return 0;
+  }
+
+  // keep the levels ordered from the finest to the coarsest
+  int level = 0;
+  while (level < sceneModel->lodCount &&
+         sceneModel->lods[level].screenSize >= screenSize) {
+    level++;
+  }
+  int meshCount = sceneModel->model.meshCount;
+  sceneModel->lods = ArrayRealloc(
+      sceneModel->lods, sizeof(SceneModelLOD) * (sceneModel->lodCount + 1));
+  memmove(&sceneModel->lods[level + 1], &sceneModel->lods[level],
+          sizeof(SceneModelLOD) * (sceneModel->lodCount - level));
+  sceneModel->lodCount++;
+  SceneModelLOD *lod = &sceneModel->lods[level];
+  lod->screenSize = screenSize;
+  lod->meshes = MemAlloc(sizeof(Mesh) * (meshCount + 1));
+  memcpy(lod->meshes, meshes, sizeof(Mesh) * meshCount);
+
+  // the model's meshes may have dropped their CPU data, so use their bounds
+  BoundingBox bounds = {0};
+  for (int i = 0; i < meshCount; i++) {
+    BoundingBox box = sceneModel->meshBounds[i];
+    bounds = i == 0 ? box
+                    : (BoundingBox){Vector3Min(bounds.min, box.min),
+                                    Vector3Max(bounds.max, box.max)};
+  }
+  Vector3 center = Vector3Scale(Vector3Add(bounds.min, bounds.max), 0.5f);
+  sceneModel->boundingSphere = (Vector4){
+      center.x, center.y, center.z, Vector3Distance(center, bounds.max)};
+
+  return 1;
+}
+
+static Scene *GetScene(SceneId sceneId) {
+  if (!IsSceneValid(sceneId)) {
+    return 0;
+  }
+
+  return scenes[sceneId.id];
+}
+
+// Node rotations are applied by MatrixRotateXYZ, which is Rx * Ry * Rz,
+// while QuaternionToEuler decomposes into Rz * Ry * Rx. Decomposing the
+// inverse rotation and negating the angles gives the matching order.
+static Vector3 QuaternionToSceneEuler(Quaternion q) {
+  Quaternion inverse = {-q.x, -q.y, -q.z, q.w};
+  return Vector3Scale(QuaternionToEuler(QuaternionNormalize(inverse)),
+                      -RAD2DEG);
+}
+
+static void SetSceneNodeTRS(SceneNodeId nodeId, Vector3 translation,
+                            Quaternion rotation, Vector3 scale) {
+  SetSceneNodePositionV(nodeId, translation);
+  SetSceneNodeRotationV(nodeId, QuaternionToSceneEuler(rotation));
+  SetSceneNodeScaleV(nodeId, scale);
+}
+
+// Builds a model for one glTF mesh: the primitives are moved out of the
+// document and uploaded, materials get the shared textures of their images.
+static Model LoadGLTFSceneModel(Scene *scene, GLTFDocument *document,
+                                GLTFMesh *mesh, long *imageTextures) {
+  Model model = {.transform = MatrixIdentity(),
+                 .meshCount = mesh->primitiveCount,
+                 .materialCount = mesh->primitiveCount};
+  model.meshes = MemAlloc(sizeof(Mesh) * mesh->primitiveCount);
+  model.materials = MemAlloc(sizeof(Material) * mesh->primitiveCount);
+  model.meshMaterial = MemAlloc(sizeof(int) * mesh->primitiveCount);
+  for (int i = 0; i < mesh->primitiveCount; i++) {
+    model.meshes[i] = mesh->primitives[i];
+    mesh->primitives[i] = (Mesh){0};
+    UploadMesh(&model.meshes[i], false);
+
+    // one material per mesh, UnloadModel frees the maps of each
+    model.meshMaterial[i] = i;
+    model.materials[i] = LoadMaterialDefault();
+    int materialIndex = mesh->primitiveMaterials[i];
+    if (materialIndex < 0) {
+      continue;
+    }
+
+    GLTFMaterial *material = &document->materials[materialIndex];
+    model.materials[i].maps[MATERIAL_MAP_DIFFUSE].color = material->baseColor;
+    int image = material->baseColorImage;
+    if (image < 0 || !document->images[image].data) {
+      continue;
+    }
+
+    if (imageTextures[image] < 0) {
+      Texture2D *texture =
+          ListAlloc((void **)&scene->textures, &scene->texturesCount,
+                    &scene->texturesCapacity, sizeof(Texture2D));
+      *texture = LoadTextureFromImage(document->images[image]);
+      imageTextures[image] = scene->texturesCount - 1;
+    }
+    SetMaterialTexture(&model.materials[i], MATERIAL_MAP_DIFFUSE,
+                       scene->textures[imageTextures[image]]);
+  }
+
+  return model;
+}
+
+// Screen size below which the first generated level of detail is used; every
+// further level halves it
+#define SCENE_GLTF_LOD_SCREEN_SIZE 0.2f
+
+// Adds the levels generated next to the file. Each level file mirrors the
+// meshes and primitives of the original, meshes that don't match are skipped.
+static void LoadGLTFSceneLODs(const char *filename, GLTFDocument *document,
+                              const SceneModelId *models) {
+  const char *separator = strrchr(filename, '/');
+  const char *extension = strrchr(separator ? separator : filename, '.');
+  int baseLength = extension ? extension - filename : (int)strlen(filename);
+
+  for (int level = 1; level <= SCENE_MAX_LOD_COUNT; level++) {
+    char lodFilename[512];
+    snprintf(lodFilename, sizeof(lodFilename), "%.*s.lod%d.glb", baseLength,
+             filename, level);
+    GLTFDocument lod;
+    if (!FileExists(lodFilename) || !LoadGLTFDocument(lodFilename, &lod)) {
+      break;
+    }
+
+    int lodCount = 0;
+    float screenSize = SCENE_GLTF_LOD_SCREEN_SIZE / (1 << (level - 1));
+    for (int m = 0; m < document->meshCount && m < lod.meshCount; m++) {
+      GLTFMesh *mesh = &lod.meshes[m];
+      if (!models[m].generation || mesh->primitiveCount == 0 ||
+          mesh->primitiveCount != document->meshes[m].primitiveCount) {
+        continue;
+      }
+
+      for (int i = 0; i < mesh->primitiveCount; i++) {
+        UploadMesh(&mesh->primitives[i], false);
+      }
+      int added = AddModelLODToScene(models[m], mesh->primitives, screenSize);
+      for (int i = 0; i < mesh->primitiveCount; i++) {
+        if (!added) {
+          UnloadMesh(mesh->primitives[i]);
+        }
+        mesh->primitives[i] = (Mesh){0};
+      }
+      lodCount += added;
+    }
+
+    TraceLog(LOG_INFO, "AddGLTFScene: %s, level %d of %d meshes", lodFilename,
+             level, lodCount);
+    UnloadGLTFDocument(&lod);
+  }
+}
+
+SceneNodeId AddGLTFScene(SceneId sceneId, const char *filename,
+                         Matrix transform) {
+  Scene *scene = GetScene(sceneId);
+  if (!scene) {
+    return (SceneNodeId){0};
+  }
+
+  GLTFDocument document;
+  if (!LoadGLTFDocument(filename, &document)) {
+    TraceLog(LOG_WARNING, "AddGLTFScene: failed to load %s", filename);
+    return (SceneNodeId){0};
+  }
+
+  // every glTF mesh becomes one scene model, shared by all nodes using it
+  SceneModelId *models =
+      MemAlloc(sizeof(SceneModelId) * (document.meshCount + 1));
+  long *imageTextures = MemAlloc(sizeof(long) * (document.imageCount + 1));
+  for (int i = 0; i < document.imageCount; i++) {
+    imageTextures[i] = -1;
+  }
+  for (int m = 0; m < document.meshCount; m++) {
+    GLTFMesh *mesh = &document.meshes[m];
+    if (mesh->primitiveCount == 0) {
+      continue;
+    }
+
+    Model model = LoadGLTFSceneModel(scene, &document, mesh, imageTextures);
+    models[m] = AddModelToScene(sceneId, model, mesh->name, 1);
+  }
+  LoadGLTFSceneLODs(filename, &document, models);
+
+  // a root node carries the placement of the whole file
+  SceneNodeId rootId = AcquireSceneNode(sceneId);
+  Vector3 translation, scale;
+  Quaternion rotation;
+  MatrixDecompose(transform, &translation, &rotation, &scale);
+  SetSceneNodeTRS(rootId, translation, rotation, scale);
+  SetSceneNodeName(rootId, GetFileNameWithoutExt(filename));
+
+  // only nodes of the default scene are created; parents come first since
+  // every node is created before its children are linked
+  SceneNodeId *nodeIds =
+      MemAlloc(sizeof(SceneNodeId) * (document.nodeCount + 1));
+  char *inScene = MemAlloc(document.nodeCount + 1);
+  for (int r = 0; r < document.rootNodeCount; r++) {
+    inScene[document.rootNodes[r]] = 1;
+  }
+  for (int n = 0; n < document.nodeCount; n++) {
+    int root = n;
+    while (document.nodes[root].parent >= 0) {
+      root = document.nodes[root].parent;
+    }
+    if (!inScene[root]) {
+      continue;
+    }
+
+    GLTFNode *node = &document.nodes[n];
+    nodeIds[n] = AcquireSceneNode(sceneId);
+    SetSceneNodeTRS(nodeIds[n], node->translation, node->rotation, node->scale);
+    SetSceneNodeName(nodeIds[n], node->name);
+    if (node->mesh >= 0) {
+      SetSceneNodeModel(nodeIds[n], models[node->mesh]);
+    }
+  }
+  for (int n = 0; n < document.nodeCount; n++) {
+    int parent = document.nodes[n].parent;
+    if (nodeIds[n].generation) {
+      SetSceneNodeParent(nodeIds[n], parent >= 0 ? nodeIds[parent] : rootId);
+    }
+  }
+
+  TraceLog(LOG_INFO, "AddGLTFScene: %s, %d nodes, %d meshes, %d images",
+           filename, document.nodeCount, document.meshCount,
+           document.imageCount);
+  MemFree(inScene);
+  MemFree(nodeIds);
+  MemFree(imageTextures);
+  MemFree(models);
+  UnloadGLTFDocument(&document);
+  return rootId;
+}
+
+// # Transform Functions
+static void ReserveSceneTransforms(SceneTransforms *transforms,
+                                   unsigned long capacity) {
+  if (capacity <= transforms->capacity) {
+    return;
+  }
+
+  if (transforms->capacity == 0) {
+    transforms->nodeIndex = MemAlloc(sizeof(unsigned long) * capacity);
+    transforms->parent = MemAlloc(sizeof(long) * capacity);
+    transforms->dirty = MemAlloc(sizeof(unsigned char) * capacity);
+    transforms->position = MemAlloc(sizeof(Vector3) * capacity);
+    transforms->rotation = MemAlloc(sizeof(Vector3) * capacity);
+    transforms->scale = MemAlloc(sizeof(Vector3) * capacity);
+    transforms->localToWorld = MemAlloc(sizeof(Matrix) * capacity);
+  } else {
+    transforms->nodeIndex =
+        MemRealloc(transforms->nodeIndex, sizeof(unsigned long) * capacity);
+    transforms->parent =
+        MemRealloc(transforms->parent, sizeof(long) * capacity);
+    transforms->dirty =
+        MemRealloc(transforms->dirty, sizeof(unsigned char) * capacity);
+    transforms->position =
+        MemRealloc(transforms->position, sizeof(Vector3) * capacity);
+    transforms->rotation =
+        MemRealloc(transforms->rotation, sizeof(Vector3) * capacity);
+    transforms->scale =
+        MemRealloc(transforms->scale, sizeof(Vector3) * capacity);
+    transforms->localToWorld =
+        MemRealloc(transforms->localToWorld, sizeof(Matrix) * capacity);
+  }
+
+  transforms->capacity = capacity;
+}
+
+static void FreeSceneTransforms(SceneTransforms *transforms) {
+  if (transforms->capacity > 0) {
+    MemFree(transforms->nodeIndex);
+    MemFree(transforms->parent);
+    MemFree(transforms->dirty);
+    MemFree(transforms->position);
+    MemFree(transforms->rotation);
+    MemFree(transforms->scale);
+    MemFree(transforms->localToWorld);
+  }
+
+  *transforms = (SceneTransforms){0};
+}
+
+// appends a new root transform slot with identity TRS and returns its index
+static unsigned long AddSceneTransform(Scene *scene, unsigned long nodeIndex) {
+  SceneTransforms *transforms = &scene->transforms;
+  if (transforms->count >= transforms->capacity) {
+    ReserveSceneTransforms(transforms, transforms->capacity == 0
+                                           ? 8
+                                           : transforms->capacity * 2);
+  }
+
+  unsigned long index = transforms->count++;
+  transforms->nodeIndex[index] = nodeIndex;
+  transforms->parent[index] = -1;
+  transforms->dirty[index] = 0;
+  transforms->position[index] = (Vector3){0, 0, 0};
+  transforms->rotation[index] = (Vector3){0, 0, 0};
+  transforms->scale[index] = (Vector3){1, 1, 1};
+  transforms->localToWorld[index] = MatrixIdentity();
+  return index;
+}
+
+// Re-sorts the transform arrays into parent-before-child order and drops the
+// slots of released nodes. Only needed after reparenting against the current
+// order or releasing nodes, so the cost is paid once per structural change.
+static void RebuildSceneTransformOrder(Scene *scene) {
+  SceneTransforms *old = &scene->transforms;
+  SceneTransforms sorted = {0};
+  ReserveSceneTransforms(&sorted, old->count > 0 ? old->count : 8);
+
+  unsigned long *stack =
+      MemAlloc(sizeof(unsigned long) * (scene->nodes.count + 1));
+  for (unsigned long i = 0; i < scene->nodes.count; i++) {
+    SceneNode *root = GetSceneNodeAt(scene, i);
+    if (root->generation <= 0 || GetSceneNode(root->parent, 0)) {
+      continue;
+    }
+
+    unsigned long stackCount = 0;
+    stack[stackCount++] = i;
+    while (stackCount > 0) {
+      unsigned long nodeIndex = stack[--stackCount];
+      SceneNode *node = GetSceneNodeAt(scene, nodeIndex);
+      unsigned long from = node->transformIndex;
+      unsigned long to = sorted.count++;
+
+      sorted.nodeIndex[to] = nodeIndex;
+      sorted.parent[to] = -1;
+      sorted.dirty[to] = old->dirty[from];
+      sorted.position[to] = old->position[from];
+      sorted.rotation[to] = old->rotation[from];
+      sorted.scale[to] = old->scale[from];
+      sorted.localToWorld[to] = old->localToWorld[from];
+
+      SceneNode *parentNode = GetSceneNode(node->parent, 0);
+      if (parentNode) {
+        // the parent was emitted before us, so its index is already updated
+        sorted.parent[to] = parentNode->transformIndex;
+      }
+      node->transformIndex = to;
+
+      SceneNodeId childId = node->firstChildId;
+      SceneNode *child = GetSceneNode(childId, 0);
+      while (child) {
+        stack[stackCount++] = childId.id;
+        childId = child->nextSiblingId;
+        child = GetSceneNode(childId, 0);
+      }
+    }
+  }
+
+  MemFree(stack);
+  FreeSceneTransforms(old);
+  scene->transforms = sorted;
+  scene->transformOrderDirty = 0;
+  scene->transformSubtreesSplit = 0;
+}
+
+// T * R * S in raylib's row vector convention: scale, rotate, then translate
+static Matrix ComposeTRS(Vector3 position, Vector3 rotation, Vector3 scale) {
+  Matrix m = MatrixRotateXYZ((Vector3){DEG2RAD * rotation.x,
+                                       DEG2RAD * rotation.y,
+                                       DEG2RAD * rotation.z});
+  m.m0 *= scale.x;
+  m.m1 *= scale.x;
+  m.m2 *= scale.x;
+  m.m4 *= scale.y;
+  m.m5 *= scale.y;
+  m.m6 *= scale.y;
+  m.m8 *= scale.z;
+  m.m9 *= scale.z;
+  m.m10 *= scale.z;
+  m.m12 = position.x;
+  m.m13 = position.y;
+  m.m14 = position.z;
+  return m;
+}
+
+// Flags the node and all its descendants as dirty and queues them for the
+// next sweep. Subtrees that are already dirty are skipped, so every node is
+// queued at most once between two sweeps. Uses the sibling and parent links
+// for the walk, so no stack is needed.
+static void MarkSceneNodeSubtreeDirty(Scene *scene, SceneNodeId rootId,
+                                      SceneNode *root) {
+  SceneNodeId nodeId = rootId;
+  SceneNode *node = root;
+  while (node) {
+    SceneNode *next = 0;
+    unsigned char *dirty = &scene->transforms.dirty[node->transformIndex];
+    if (!*dirty) {
+      *dirty = 1;
+      unsigned long *entry =
+          ListAlloc((void **)&scene->dirtyNodes, &scene->dirtyNodesCount,
+                    &scene->dirtyNodesCapacity, sizeof(unsigned long));
+      *entry = nodeId.id;
+
+      next = GetSceneNode(node->firstChildId, 0);
+      if (next) {
+        nodeId = node->firstChildId;
+      }
+    }
+
+    // no (clean) children left: continue with the next sibling of the node or
+    // of its closest ancestor below the subtree root
+    while (!next && node != root) {
+      next = GetSceneNode(node->nextSiblingId, 0);
+      if (next) {
+        nodeId = node->nextSiblingId;
+      } else {
+        node = GetSceneNode(node->parent, 0);
+      }
+    }
+
+    node = next;
+  }
+}
+
+static int CompareTransformIndex(const void *a, const void *b) {
+  unsigned long ia = *(const unsigned long *)a;
+  unsigned long ib = *(const unsigned long *)b;
+  return (ia > ib) - (ia < ib);
+}
+
+// Resolves the world matrices of the queued dirty nodes. The queue is sorted
+// by transform index, which puts every parent before its children, so the
+// cost depends on the number of changed nodes, not on the scene size.
+static void UpdateTransforms(Scene *scene) {
+  if (scene->transformOrderDirty) {
+    RebuildSceneTransformOrder(scene);
+  }
+
+  if (scene->dirtyNodesCount == 0) {
+    return;
+  }
+
+  SceneTransforms *transforms = &scene->transforms;
+  unsigned long *queue = scene->dirtyNodes;
+  unsigned long queueCount = 0;
+  for (unsigned long i = 0; i < scene->dirtyNodesCount; i++) {
+    SceneNode *node = GetSceneNodeAt(scene, queue[i]);
+    if (node->generation > 0) {
+      queue[queueCount++] = node->transformIndex;
+    }
+  }
+
+  qsort(queue, queueCount, sizeof(unsigned long), CompareTransformIndex);
+
+  for (unsigned long q = 0; q < queueCount; q++) {
+    unsigned long i = queue[q];
+    if (!transforms->dirty[i]) {
+      // duplicate entry of a node that was released and acquired again
+      continue;
+    }
+
+    long parent = transforms->parent[i];
+    Matrix local = ComposeTRS(transforms->position[i], transforms->rotation[i],
+                              transforms->scale[i]);
+    transforms->localToWorld[i] =
+        parent >= 0 ? MatrixMultiply(local, transforms->localToWorld[parent])
+                    : local;
+    transforms->dirty[i] = 0;
+    UpdateSceneNodeCullBounds(scene,
+                              GetSceneNodeAt(scene, transforms->nodeIndex[i]));
+  }
+
+  scene->dirtyNodesCount = 0;
+}
+
+void UpdateSceneTransforms(SceneId sceneId) {
+  Scene *scene = GetScene(sceneId);
+  if (!scene) {
+    return;
+  }
+
+  UpdateTransforms(scene);
+}
+
+// # Binary Snapshot Functions
+// A snapshot is one block of flat arrays that references its parts by offsets
+// from the start of the file, so it can be mapped at any address and used in
+// place: loading relocates the offsets against the mapping, uploads the mesh
+// and texture payloads straight from it and copies the node data into the
+// scene. Nothing is parsed. The layout is native endian; the version is
+// bumped whenever it changes.
+#define SCENE_BINARY_MAGIC 0x4e435352u // "RSCN"
+#define SCENE_BINARY_VERSION 2u
+#define SCENE_BINARY_ALIGNMENT 16
+#define SCENE_BINARY_NONE 0xffffffffu
+
+typedef struct SceneBinaryHeader {
+  unsigned int magic;
+  unsigned int version;
+  unsigned long long fileSize;
+
+  // sections, as offsets from the start of the file
+  unsigned long long strings; // NUL terminated names
+  unsigned long long textures;
+  unsigned long long models;
+  unsigned long long meshes;
+  unsigned long long materials;
+  unsigned long long lods;
+  // node SoA in parent-before-child order
+  unsigned long long nodeParents;
+  unsigned long long nodePositions;
+  unsigned long long nodeRotations;
+  unsigned long long nodeScales;
+  unsigned long long nodeNames;
+  unsigned long long nodeModels;
+  unsigned long long nodeLayers;
+  unsigned long long nodeIdentifiers;
+
+  unsigned int stringsSize;
+  unsigned int textureCount;
+  unsigned int modelCount;
+  unsigned int meshCount;
+  unsigned int materialCount;
+  unsigned int lodCount;
+  unsigned int nodeCount;
+} SceneBinaryHeader;
+
+typedef struct SceneBinaryTexture {
+  unsigned long long data;
+  unsigned int dataSize;
+  int width, height, mipmaps, format;
+} SceneBinaryTexture;
+
+typedef struct SceneBinaryModel {
+  unsigned int name;
+  unsigned int firstMesh, meshCount;
+  unsigned int firstMaterial, materialCount;
+  unsigned int firstLOD, lodCount;
+} SceneBinaryModel;
+
+// a level of detail of a model, meshCount meshes of the model from firstMesh
+typedef struct SceneBinaryLOD {
+  float screenSize;
+  unsigned int firstMesh;
+} SceneBinaryLOD;
+
+// 0 for attributes the mesh doesn't have
+typedef struct SceneBinaryMesh {
+  unsigned long long vertices, texcoords, texcoords2, normals, tangents;
+  unsigned long long colors, indices;
+  int vertexCount, triangleCount;
+  unsigned int material; // index into the model's materials
+  BoundingBox bounds;
+  Vector4 boundingSphere;
+} SceneBinaryMesh;
+
+typedef struct SceneBinaryMaterial {
+  Color color;
+  int texture; // index into the snapshot's textures, -1 for none
+} SceneBinaryMaterial;
+
+typedef struct SceneBinaryWriter {
+  unsigned char *data;
+  unsigned long size;
+  unsigned long capacity;
+} SceneBinaryWriter;
+
+// appends an aligned copy of data (zeroes if data is null), returns its offset
+static unsigned long long WriteSceneBinary(SceneBinaryWriter *writer,
+                                           const void *data,
+                                           unsigned long size) {
+  unsigned long offset = (writer->size + SCENE_BINARY_ALIGNMENT - 1) &
+                         ~(unsigned long)(SCENE_BINARY_ALIGNMENT - 1);
+  if (offset + size > writer->capacity) {
+    while (offset + size > writer->capacity) {
+      writer->capacity = writer->capacity == 0 ? 4096 : writer->capacity * 2;
+    }
+    writer->data = ArrayRealloc(writer->data, writer->capacity);
+  }
+
+  memset(writer->data + writer->size, 0, offset - writer->size);
+  if (data) {
+    memcpy(writer->data + offset, data, size);
+  } else {
+    memset(writer->data + offset, 0, size);
+  }
+  writer->size = offset + size;
+  return offset;
+}
+
+static unsigned long long WriteSceneBinaryArray(SceneBinaryWriter *writer,
+                                                const void *data,
+                                                unsigned long size) {
+  return data ? WriteSceneBinary(writer, data, size) : 0;
+}
+
+static unsigned int WriteSceneBinaryString(SceneBinaryWriter *strings,
+                                           const char *str) {
+  if (!str) {
+    return SCENE_BINARY_NONE;
+  }
+
+  unsigned long length = strlen(str) + 1;
+  if (strings->size + length > strings->capacity) {
+    while (strings->size + length > strings->capacity) {
+      strings->capacity = strings->capacity == 0 ? 4096 : strings->capacity * 2;
+    }
+    strings->data = ArrayRealloc(strings->data, strings->capacity);
+  }
+  memcpy(strings->data + strings->size, str, length);
+  strings->size += length;
+  return strings->size - length;
+}
+
+static SceneBinaryMesh WriteSceneBinaryMesh(SceneBinaryWriter *writer,
+                                            const Mesh *mesh, int material,
+                                            BoundingBox bounds,
+                                            Vector4 boundingSphere) {
+  unsigned long vertexCount = mesh->vertexCount;
+  return (SceneBinaryMesh){
+      .vertices = WriteSceneBinaryArray(writer, mesh->vertices,
+                                        sizeof(float) * 3 * vertexCount),
+      .texcoords = WriteSceneBinaryArray(writer, mesh->texcoords,
+                                         sizeof(float) * 2 * vertexCount),
+      .texcoords2 = WriteSceneBinaryArray(writer, mesh->texcoords2,
+                                          sizeof(float) * 2 * vertexCount),
+      .normals = WriteSceneBinaryArray(writer, mesh->normals,
+                                       sizeof(float) * 3 * vertexCount),
+      .tangents = WriteSceneBinaryArray(writer, mesh->tangents,
+                                        sizeof(float) * 4 * vertexCount),
+      .colors = WriteSceneBinaryArray(writer, mesh->colors, 4 * vertexCount),
+      .indices = WriteSceneBinaryArray(
+          writer, mesh->indices,
+          sizeof(unsigned short) * 3 * mesh->triangleCount),
+      .vertexCount = mesh->vertexCount,
+      .triangleCount = mesh->triangleCount,
+      .material = material,
+      .bounds = bounds,
+      .boundingSphere = boundingSphere};
+}
+
+static int FindSceneTextureIndex(Scene *scene, Texture2D texture) {
+  for (unsigned long i = 0; i < scene->texturesCount; i++) {
+    if (scene->textures[i].id == texture.id) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+int SaveSceneBinary(SceneId sceneId, const char *fileName) {
+  Scene *scene = GetScene(sceneId);
+  if (!scene) {
+    return 0;
+  }
+
+  UpdateTransforms(scene);
+  SceneTransforms *transforms = &scene->transforms;
+  SceneBinaryWriter writer = {0};
+  SceneBinaryWriter strings = {0};
+  SceneBinaryHeader header = {.magic = SCENE_BINARY_MAGIC,
+                              .version = SCENE_BINARY_VERSION};
+  WriteSceneBinary(&writer, &header, sizeof(header));
+
+  // textures are read back from the GPU, they keep no CPU copy
+  SceneBinaryTexture *textures =
+      MemAlloc(sizeof(SceneBinaryTexture) * (scene->texturesCount + 1));
+  for (unsigned long i = 0; i < scene->texturesCount; i++) {
+    Image image = LoadImageFromTexture(scene->textures[i]);
+    int dataSize = GetPixelDataSize(image.width, image.height, image.format);
+    textures[i] = (SceneBinaryTexture){
+        .data = WriteSceneBinaryArray(&writer, image.data, dataSize),
+        .dataSize = image.data ? dataSize : 0,
+        .width = image.width,
+        .height = image.height,
+        .mipmaps = 1,
+        .format = image.format};
+    UnloadImage(image);
+  }
+
+  unsigned long meshCount = 0, materialCount = 0, lodCount = 0;
+  for (unsigned long m = 0; m < scene->models.count; m++) {
+    SceneModel *sceneModel = GetSceneModelAt(scene, m);
+    meshCount += sceneModel->model.meshCount * (sceneModel->lodCount + 1);
+    materialCount += sceneModel->model.materialCount;
+    lodCount += sceneModel->lodCount;
+  }
+
+  SceneBinaryModel *models =
+      MemAlloc(sizeof(SceneBinaryModel) * (scene->models.count + 1));
+  SceneBinaryMesh *meshes = MemAlloc(sizeof(SceneBinaryMesh) * (meshCount + 1));
+  SceneBinaryMaterial *materials =
+      MemAlloc(sizeof(SceneBinaryMaterial) * (materialCount + 1));
+  SceneBinaryLOD *lods = MemAlloc(sizeof(SceneBinaryLOD) * (lodCount + 1));
+  meshCount = materialCount = lodCount = 0;
+  for (unsigned long m = 0; m < scene->models.count; m++) {
+    SceneModel *sceneModel = GetSceneModelAt(scene, m);
+    Model *model = &sceneModel->model;
+    models[m] = (SceneBinaryModel){
+        .name = WriteSceneBinaryString(
+            &strings, GetSceneNameChars(&scene->names, sceneModel->nameId)),
+        .firstMesh = meshCount,
+        .meshCount = model->meshCount,
+        .firstMaterial = materialCount,
+        .materialCount = model->materialCount,
+        .firstLOD = lodCount,
+        .lodCount = sceneModel->lodCount};
+
+    // the levels of detail follow the model's own meshes and share their
+    // materials and bounds
+    for (int l = 0; l <= sceneModel->lodCount; l++) {
+      if (l > 0) {
+        lods[lodCount++] = (SceneBinaryLOD){
+            sceneModel->lods[l - 1].screenSize, meshCount};
+      }
+      Mesh *levelMeshes = GetSceneModelLODMeshes(sceneModel, l);
+      for (int i = 0; i < model->meshCount; i++) {
+        meshes[meshCount++] = WriteSceneBinaryMesh(
+            &writer, &levelMeshes[i],
+            model->meshMaterial ? model->meshMaterial[i] : 0,
+            sceneModel->meshBounds[i], sceneModel->meshBoundingSpheres[i]);
+      }
+    }
+
+    for (int i = 0; i < model->materialCount; i++) {
+      MaterialMap *diffuse = &model->materials[i].maps[MATERIAL_MAP_DIFFUSE];
+      materials[materialCount++] = (SceneBinaryMaterial){
+          diffuse->color, FindSceneTextureIndex(scene, diffuse->texture)};
+    }
+  }
+
+  // nodes in transform order, so parents are written before their children
+  unsigned long nodeCount = transforms->count;
+  int *nodeParents = MemAlloc(sizeof(int) * (nodeCount + 1));
+  unsigned int *nodeNames = MemAlloc(sizeof(unsigned int) * (nodeCount + 1));
+  int *nodeModels = MemAlloc(sizeof(int) * (nodeCount + 1));
+  unsigned long long *nodeLayers =
+      MemAlloc(sizeof(unsigned long long) * (nodeCount + 1));
+  int *nodeIdentifiers = MemAlloc(sizeof(int) * (nodeCount + 1));
+  for (unsigned long t = 0; t < nodeCount; t++) {
+    SceneNode *node = GetSceneNodeAt(scene, transforms->nodeIndex[t]);
+    nodeParents[t] = transforms->parent[t];
+    nodeNames[t] = WriteSceneBinaryString(
+        &strings, GetSceneNameChars(&scene->names, node->nameId));
+    nodeModels[t] = GetSceneNodeSceneModel(scene, node) ? (int)node->model.id
+                                                        : -1;
+    nodeLayers[t] = node->layers;
+    nodeIdentifiers[t] = node->userIdentifier;
+  }
+
+  header.textureCount = scene->texturesCount;
+  header.textures = WriteSceneBinary(
+      &writer, textures, sizeof(SceneBinaryTexture) * header.textureCount);
+  header.modelCount = scene->models.count;
+  header.models = WriteSceneBinary(
+      &writer, models, sizeof(SceneBinaryModel) * header.modelCount);
+  header.meshCount = meshCount;
+  header.meshes =
+      WriteSceneBinary(&writer, meshes, sizeof(SceneBinaryMesh) * meshCount);
+  header.materialCount = materialCount;
+  header.materials = WriteSceneBinary(
+      &writer, materials, sizeof(SceneBinaryMaterial) * materialCount);
+  header.lodCount = lodCount;
+  header.lods =
+      WriteSceneBinary(&writer, lods, sizeof(SceneBinaryLOD) * lodCount);
+  header.nodeCount = nodeCount;
+  header.nodeParents =
+      WriteSceneBinary(&writer, nodeParents, sizeof(int) * nodeCount);
+  header.nodePositions = WriteSceneBinary(&writer, transforms->position,
+                                          sizeof(Vector3) * nodeCount);
+  header.nodeRotations = WriteSceneBinary(&writer, transforms->rotation,
+                                          sizeof(Vector3) * nodeCount);
+  header.nodeScales = WriteSceneBinary(&writer, transforms->scale,
+                                       sizeof(Vector3) * nodeCount);
+  header.nodeNames =
+      WriteSceneBinary(&writer, nodeNames, sizeof(unsigned int) * nodeCount);
+  header.nodeModels =
+      WriteSceneBinary(&writer, nodeModels, sizeof(int) * nodeCount);
+  header.nodeLayers = WriteSceneBinary(&writer, nodeLayers,
+                                       sizeof(unsigned long long) * nodeCount);
+  header.nodeIdentifiers =
+      WriteSceneBinary(&writer, nodeIdentifiers, sizeof(int) * nodeCount);
+  // a terminating NUL keeps lookups of corrupt offsets inside the section
+  WriteSceneBinaryString(&strings, "");
+  header.stringsSize = strings.size;
+  header.strings = WriteSceneBinary(&writer, strings.data, strings.size);
+  header.fileSize = writer.size;
+  memcpy(writer.data, &header, sizeof(header));
+
+  int saved = SaveFileData(fileName, writer.data, writer.size);
+  TraceLog(LOG_INFO, "SaveSceneBinary: %s, %lu nodes, %lu meshes, %lu bytes",
+           fileName, nodeCount, meshCount, writer.size);
+
+  MemFree(nodeIdentifiers);
+  MemFree(nodeLayers);
+  MemFree(nodeModels);
+  MemFree(nodeNames);
+  MemFree(nodeParents);
+  MemFree(lods);
+  MemFree(materials);
+  MemFree(meshes);
+  MemFree(models);
+  MemFree(textures);
+  MemFree(strings.data);
+  MemFree(writer.data);
+  return saved;
+}
+
+// Maps the file read only; falls back to reading it where mmap isn't there
+static unsigned char *MapSceneBinary(const char *fileName,
+                                     unsigned long *size) {
+#if defined(_WIN32)
+  int dataSize = 0;
+  unsigned char *data = LoadFileData(fileName, &dataSize);
+  *size = dataSize;
+  return data;
+#else
+  int file = open(fileName, O_RDONLY);
+  if (file < 0) {
+    return 0;
+  }
+
+  struct stat info;
+  void *data = MAP_FAILED;
+  if (fstat(file, &info) == 0 && info.st_size > 0) {
+    *size = info.st_size;
+    data = mmap(0, *size, PROT_READ, MAP_PRIVATE, file, 0);
+  }
+  close(file);
+  return data == MAP_FAILED ? 0 : data;
+#endif
+}
+
+static void UnmapSceneBinary(unsigned char *data, unsigned long size) {
+#if defined(_WIN32)
+  (void)size;
+  UnloadFileData(data);
+#else
+  munmap(data, size);
+#endif
+}
+
+// Relocates a section offset against the mapping. Returns 0 if the range
+// isn't inside the file; empty sections relocate to the file start.
+static const void *GetSceneBinarySection(const unsigned char *data,
+                                         unsigned long size,
+                                         unsigned long long offset,
+                                         unsigned long long count,
+                                         unsigned long long elementSize) {
+  if (count == 0) {
+    return data;
+  }
+  if (offset == 0 || offset > size || count > (size - offset) / elementSize) {
+    return 0;
+  }
+  return data + offset;
+}
+
+static const char *GetSceneBinaryString(const char *strings,
+                                        unsigned int stringsSize,
+                                        unsigned int offset) {
+  return offset < stringsSize ? strings + offset : 0;
+}
+
+// A snapshot that was read and checked, see LoadSceneBinaryData. The section
+// pointers point into the mapping.
+struct SceneBinaryData {
+  unsigned char *data;
+  unsigned long size;
+  SceneBinaryHeader header;
+  const char *strings;
+  const SceneBinaryTexture *textures;
+  const SceneBinaryModel *models;
+  const SceneBinaryMesh *meshes;
+  const SceneBinaryMaterial *materials;
+  const SceneBinaryLOD *lods;
+  const int *nodeParents;
+  const Vector3 *nodePositions;
+  const Vector3 *nodeRotations;
+  const Vector3 *nodeScales;
+  const unsigned int *nodeNames;
+  const int *nodeModels;
+  const unsigned long long *nodeLayers;
+  const int *nodeIdentifiers;
+
+  // upload progress, see UploadSceneBinaryData
+  SceneId sceneId;
+  SceneModelId *modelIds;
+  SceneNodeId *nodeIds;
+  unsigned int uploadedTextures;
+  unsigned int uploadedModels;
+  unsigned int uploadedNodes;
+  int status; // 0 while uploading, 1 once the scene is done, -1 on failure
+};
+
+// Nodes linked per upload step; a step has to be short enough to check the
+// time budget often
+#define SCENE_BINARY_NODE_STEP 256
+// Stride used to touch the mapping's pages, a common page size
+#define SCENE_BINARY_PAGE_SIZE 4096
+
+// Resolves the attribute arrays of a mesh in the order of SceneBinaryMesh,
+// 0 for the ones it doesn't have. Returns 0 if one is outside the file or
+// the mesh has no positions.
+static int GetSceneBinaryMeshAttributes(const SceneBinaryData *binary,
+                                        const SceneBinaryMesh *source,
+                                        void *attributes[7]) {
+  unsigned long long vertexCount = source->vertexCount;
+  if (source->vertexCount <= 0 || source->triangleCount < 0) {
+    return 0;
+  }
+
+  const unsigned long long offsets[] = {
+      source->vertices, source->texcoords, source->texcoords2,
+      source->normals,  source->tangents,  source->colors,
+      source->indices};
+  const unsigned long long sizes[] = {
+      sizeof(float) * 3 * vertexCount, sizeof(float) * 2 * vertexCount,
+      sizeof(float) * 2 * vertexCount, sizeof(float) * 3 * vertexCount,
+      sizeof(float) * 4 * vertexCount, 4 * vertexCount,
+      sizeof(unsigned short) * 3 * (unsigned long long)source->triangleCount};
+  for (int i = 0; i < 7; i++) {
+    attributes[i] = 0;
+    if (offsets[i] == 0) {
+      continue;
+    }
+    attributes[i] = (void *)GetSceneBinarySection(
+        binary->data, binary->size, offsets[i], sizes[i], 1);
+    if (!attributes[i]) {
+      return 0;
+    }
+  }
+  return attributes[0] != 0;
+}
+
+static int ValidateSceneBinaryMesh(const SceneBinaryData *binary,
+                                   const SceneBinaryMesh *source) {
+  void *attributes[7];
+  if (!GetSceneBinaryMeshAttributes(binary, source, attributes)) {
+    return 0;
+  }
+
+  const unsigned short *indices = attributes[6];
+  unsigned long long indexCount = indices ? 3ull * source->triangleCount : 0;
+  for (unsigned long long i = 0; i < indexCount; i++) {
+    if (indices[i] >= (unsigned int)source->vertexCount) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static int ValidateSceneBinaryModel(const SceneBinaryData *binary,
+                                    const SceneBinaryModel *source) {
+  const SceneBinaryHeader *header = &binary->header;
+  if (source->meshCount > header->meshCount ||
+      source->firstMesh > header->meshCount - source->meshCount ||
+      source->materialCount == 0 ||
+      source->materialCount > header->materialCount ||
+      source->firstMaterial > header->materialCount - source->materialCount ||
+      source->lodCount > SCENE_MAX_LOD_COUNT ||
+      source->lodCount > header->lodCount ||
+      source->firstLOD > header->lodCount - source->lodCount) {
+    return 0;
+  }
+
+  for (unsigned int i = 0; i < source->meshCount; i++) {
+    if (binary->meshes[source->firstMesh + i].material >=
+        source->materialCount) {
+      return 0;
+    }
+  }
+  for (unsigned int l = 0; l < source->lodCount; l++) {
+    if (binary->lods[source->firstLOD + l].firstMesh >
+        header->meshCount - source->meshCount) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// Checks every range and index of the snapshot, so that uploading it can't
+// fail halfway
+static int ValidateSceneBinaryData(SceneBinaryData *binary) {
+  const unsigned char *data = binary->data;
+  unsigned long size = binary->size;
+  const SceneBinaryHeader *header = &binary->header;
+  unsigned long long nodeCount = header->nodeCount;
+  binary->textures =
+      GetSceneBinarySection(data, size, header->textures, header->textureCount,
+                            sizeof(SceneBinaryTexture));
+  binary->models =
+      GetSceneBinarySection(data, size, header->models, header->modelCount,
+                            sizeof(SceneBinaryModel));
+  binary->meshes = GetSceneBinarySection(
+      data, size, header->meshes, header->meshCount, sizeof(SceneBinaryMesh));
+  binary->materials =
+      GetSceneBinarySection(data, size, header->materials,
+                            header->materialCount, sizeof(SceneBinaryMaterial));
+  binary->lods = GetSceneBinarySection(
+      data, size, header->lods, header->lodCount, sizeof(SceneBinaryLOD));
+  binary->nodeParents = GetSceneBinarySection(data, size, header->nodeParents,
+                                              nodeCount, sizeof(int));
+  binary->nodePositions = GetSceneBinarySection(
+      data, size, header->nodePositions, nodeCount, sizeof(Vector3));
+  binary->nodeRotations = GetSceneBinarySection(
+      data, size, header->nodeRotations, nodeCount, sizeof(Vector3));
+  binary->nodeScales = GetSceneBinarySection(data, size, header->nodeScales,
+                                             nodeCount, sizeof(Vector3));
+  binary->nodeNames = GetSceneBinarySection(data, size, header->nodeNames,
+                                            nodeCount, sizeof(unsigned int));
+  binary->nodeModels = GetSceneBinarySection(data, size, header->nodeModels,
+                                             nodeCount, sizeof(int));
+  binary->nodeLayers = GetSceneBinarySection(
+      data, size, header->nodeLayers, nodeCount, sizeof(unsigned long long));
+  binary->nodeIdentifiers = GetSceneBinarySection(
+      data, size, header->nodeIdentifiers, nodeCount, sizeof(int));
+  if (!binary->textures || !binary->models || !binary->meshes ||
+      !binary->materials || !binary->lods || !binary->nodeParents ||
+      !binary->nodePositions || !binary->nodeRotations ||
+      !binary->nodeScales || !binary->nodeNames || !binary->nodeModels ||
+      !binary->nodeLayers || !binary->nodeIdentifiers) {
+    return 0;
+  }
+
+  for (unsigned int i = 0; i < header->textureCount; i++) {
+    const SceneBinaryTexture *source = &binary->textures[i];
+    if (source->width <= 0 || source->height <= 0 || source->dataSize == 0 ||
+        !GetSceneBinarySection(data, size, source->data, source->dataSize,
+                               1) ||
+        (unsigned int)GetPixelDataSize(source->width, source->height,
+                                       source->format) != source->dataSize) {
+      return 0;
+    }
+  }
+  for (unsigned int i = 0; i < header->meshCount; i++) {
+    if (!ValidateSceneBinaryMesh(binary, &binary->meshes[i])) {
+      return 0;
+    }
+  }
+  for (unsigned int m = 0; m < header->modelCount; m++) {
+    if (!ValidateSceneBinaryModel(binary, &binary->models[m])) {
+      return 0;
+    }
+  }
+  for (unsigned long long i = 0; i < nodeCount; i++) {
+    int model = binary->nodeModels[i];
+    if (binary->nodeParents[i] >= (long long)i ||
+        (model >= 0 && (unsigned int)model >= header->modelCount)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+SceneBinaryData *LoadSceneBinaryData(const char *fileName) {
+  unsigned long size = 0;
+  unsigned char *data = MapSceneBinary(fileName, &size);
+  if (!data) {
+    TraceLog(LOG_WARNING, "LoadSceneBinaryData: failed to open %s", fileName);
+    return 0;
+  }
+
+  SceneBinaryData *binary = MemAlloc(sizeof(SceneBinaryData));
+  binary->data = data;
+  binary->size = size;
+  if (size >= sizeof(binary->header)) {
+    memcpy(&binary->header, data, sizeof(binary->header));
+  }
+  const SceneBinaryHeader *header = &binary->header;
+  binary->strings = GetSceneBinarySection(data, size, header->strings,
+                                          header->stringsSize, 1);
+  if (header->magic != SCENE_BINARY_MAGIC ||
+      header->version != SCENE_BINARY_VERSION || header->fileSize != size ||
+      !binary->strings || header->stringsSize == 0 ||
+      binary->strings[header->stringsSize - 1] != '\0') {
+    TraceLog(LOG_WARNING,
+             "LoadSceneBinaryData: %s is not a version %u snapshot", fileName,
+             SCENE_BINARY_VERSION);
+    UnloadSceneBinaryData(binary);
+    return 0;
+  }
+
+  // The mapping is paged in lazily. Touch every page here, so the uploads on
+  // the GL thread never wait for the disk.
+  volatile unsigned char touched = 0;
+  for (unsigned long i = 0; i < size; i += SCENE_BINARY_PAGE_SIZE) {
+    touched ^= data[i];
+  }
+  (void)touched;
+
+  if (!ValidateSceneBinaryData(binary)) {
+    TraceLog(LOG_WARNING, "LoadSceneBinaryData: %s is corrupt", fileName);
+    UnloadSceneBinaryData(binary);
+    return 0;
+  }
+  return binary;
+}
+
+// Uploads a mesh straight from the mapping. The mesh keeps no CPU copy of
+// its attributes; its bounds come from the snapshot.
+static void UploadSceneBinaryMesh(const SceneBinaryData *binary,
+                                  const SceneBinaryMesh *source, Mesh *mesh) {
+  void *attributes[7];
+  GetSceneBinaryMeshAttributes(binary, source, attributes);
+
+  // UploadMesh only reads the attributes, the mapping is read only
+  *mesh = (Mesh){.vertexCount = source->vertexCount,
+                 .triangleCount = source->triangleCount,
+                 .vertices = attributes[0],
+                 .texcoords = attributes[1],
+                 .texcoords2 = attributes[2],
+                 .normals = attributes[3],
+                 .tangents = attributes[4],
+                 .colors = attributes[5],
+                 .indices = attributes[6]};
+  UploadMesh(mesh, false);
+  mesh->vertices = mesh->texcoords = mesh->texcoords2 = 0;
+  mesh->normals = mesh->tangents = 0;
+  mesh->colors = 0;
+  mesh->indices = 0;
+}
+
+static void UploadSceneBinaryTexture(SceneBinaryData *binary, Scene *scene,
+                                     unsigned int index) {
+  const SceneBinaryTexture *source = &binary->textures[index];
+  Image image = {.width = source->width,
+                 .height = source->height,
+                 .mipmaps = 1,
+                 .format = source->format};
+  image.data = (void *)GetSceneBinarySection(binary->data, binary->size,
+                                             source->data, source->dataSize, 1);
+  Texture2D *texture =
+      ListAlloc((void **)&scene->textures, &scene->texturesCount,
+                &scene->texturesCapacity, sizeof(Texture2D));
+  *texture = LoadTextureFromImage(image);
+}
+
+// Uploads the levels of detail of a model and adds them to its scene model
+static int UploadSceneBinaryLODs(const SceneBinaryData *binary,
+                                 const SceneBinaryModel *source,
+                                 SceneModelId modelId) {
+  Mesh *levelMeshes = MemAlloc(sizeof(Mesh) * (source->meshCount + 1));
+  int valid = 1;
+  for (unsigned int l = 0; l < source->lodCount && valid; l++) {
+    const SceneBinaryLOD *lod = &binary->lods[source->firstLOD + l];
+    for (unsigned int i = 0; i < source->meshCount; i++) {
+      UploadSceneBinaryMesh(binary, &binary->meshes[lod->firstMesh + i],
+                            &levelMeshes[i]);
+    }
+
+    valid = AddModelLODToScene(modelId, levelMeshes, lod->screenSize);
+    for (unsigned int i = 0; !valid && i < source->meshCount; i++) {
+      UnloadMesh(levelMeshes[i]);
+    }
+  }
+
+  MemFree(levelMeshes);
+  return valid;
+}
+
+static int UploadSceneBinaryModel(SceneBinaryData *binary, Scene *scene,
+                                  unsigned int index) {
+  const SceneBinaryModel *source = &binary->models[index];
+  Model model = {.transform = MatrixIdentity(),
+                 .meshCount = source->meshCount,
+                 .materialCount = source->materialCount};
+  model.meshes = MemAlloc(sizeof(Mesh) * (source->meshCount + 1));
+  model.materials = MemAlloc(sizeof(Material) * source->materialCount);
+  model.meshMaterial = MemAlloc(sizeof(int) * (source->meshCount + 1));
+  for (unsigned int i = 0; i < source->materialCount; i++) {
+    const SceneBinaryMaterial *material =
+        &binary->materials[source->firstMaterial + i];
+    model.materials[i] = LoadMaterialDefault();
+    model.materials[i].maps[MATERIAL_MAP_DIFFUSE].color = material->color;
+    if (material->texture >= 0 &&
+        (unsigned long)material->texture < scene->texturesCount) {
+      SetMaterialTexture(&model.materials[i], MATERIAL_MAP_DIFFUSE,
+                         scene->textures[material->texture]);
+    }
+  }
+
+  const SceneBinaryMesh *meshes = &binary->meshes[source->firstMesh];
+  for (unsigned int i = 0; i < source->meshCount; i++) {
+    UploadSceneBinaryMesh(binary, &meshes[i], &model.meshes[i]);
+    model.meshMaterial[i] = (int)meshes[i].material;
+  }
+
+  SceneModelId modelId = AddModelToScene(
+      binary->sceneId, model,
+      GetSceneBinaryString(binary->strings, binary->header.stringsSize,
+                           source->name),
+      1);
+  binary->modelIds[index] = modelId;
+  SceneModel *sceneModel = GetSceneModelAt(scene, modelId.id);
+  for (unsigned int i = 0; i < source->meshCount; i++) {
+    sceneModel->meshBounds[i] = meshes[i].bounds;
+    sceneModel->meshBoundingSpheres[i] = meshes[i].boundingSphere;
+  }
+  return UploadSceneBinaryLODs(binary, source, modelId);
+}
+
+static void UploadSceneBinaryNode(SceneBinaryData *binary, unsigned int i) {
+  // parents come first, so linking keeps the transform order intact
+  SceneNodeId nodeId = AcquireSceneNode(binary->sceneId);
+  binary->nodeIds[i] = nodeId;
+  SetSceneNodePositionV(nodeId, binary->nodePositions[i]);
+  SetSceneNodeRotationV(nodeId, binary->nodeRotations[i]);
+  SetSceneNodeScaleV(nodeId, binary->nodeScales[i]);
+  if (binary->nodeParents[i] >= 0) {
+    SetSceneNodeParent(nodeId, binary->nodeIds[binary->nodeParents[i]]);
+  }
+  SetSceneNodeName(nodeId,
+                   GetSceneBinaryString(binary->strings,
+                                        binary->header.stringsSize,
+                                        binary->nodeNames[i]));
+  if (binary->nodeModels[i] >= 0) {
+    SetSceneNodeModel(nodeId, binary->modelIds[binary->nodeModels[i]]);
+  }
+  SetSceneNodeLayer(nodeId, binary->nodeLayers[i]);
+  SetSceneNodeIdentifier(nodeId, binary->nodeIdentifiers[i]);
+}
+
+// Runs one step of the upload: a texture, a model with its levels of detail
+// or a run of nodes. Returns 0 if the scene went away or a level of detail
+// was refused.
+static int UploadSceneBinaryStep(SceneBinaryData *binary) {
+  Scene *scene = GetScene(binary->sceneId);
+  const SceneBinaryHeader *header = &binary->header;
+  if (!scene) {
+    return 0;
+  }
+
+  if (binary->uploadedTextures < header->textureCount) {
+    UploadSceneBinaryTexture(binary, scene, binary->uploadedTextures++);
+  } else if (binary->uploadedModels < header->modelCount) {
+    return UploadSceneBinaryModel(binary, scene, binary->uploadedModels++);
+  } else if (binary->uploadedNodes < header->nodeCount) {
+    unsigned int last = binary->uploadedNodes + SCENE_BINARY_NODE_STEP;
+    if (last > header->nodeCount) {
+      last = header->nodeCount;
+    }
+    while (binary->uploadedNodes < last) {
+      UploadSceneBinaryNode(binary, binary->uploadedNodes++);
+    }
+  } else {
+    binary->status = 1;
+  }
+  return 1;
+}
+
+int UploadSceneBinaryData(SceneBinaryData *binary, double timeBudget,
+                          SceneId *sceneId) {
+  if (!binary || binary->status != 0) {
+    if (binary && binary->status == 1 && sceneId) {
+      *sceneId = binary->sceneId;
+    }
+    return binary ? binary->status : -1;
+  }
+
+  if (!binary->modelIds) {
+    binary->sceneId = LoadScene();
+    binary->modelIds =
+        MemAlloc(sizeof(SceneModelId) * (binary->header.modelCount + 1));
+    binary->nodeIds =
+        MemAlloc(sizeof(SceneNodeId) * (binary->header.nodeCount + 1));
+  }
+
+  // every call makes at least one step, so any budget finishes eventually
+  double deadline = GetTime() + timeBudget;
+  do {
+    if (!UploadSceneBinaryStep(binary)) {
+      TraceLog(LOG_WARNING, "UploadSceneBinaryData: upload failed");
+      UnloadScene(binary->sceneId);
+      binary->status = -1;
+    }
+  } while (binary->status == 0 && (timeBudget <= 0 || GetTime() < deadline));
+
+  if (binary->status != 0) {
+    MemFree(binary->modelIds);
+    MemFree(binary->nodeIds);
+    binary->modelIds = 0;
+    binary->nodeIds = 0;
+  }
+  if (binary->status == 1 && sceneId) {
+    *sceneId = binary->sceneId;
+  }
+  return binary->status;
+}
+
+void UnloadSceneBinaryData(SceneBinaryData *binary) {
+  if (!binary) {
+    return;
+  }
+
+  // a scene that isn't finished yet still belongs to the snapshot
+  if (binary->status == 0 && binary->modelIds) {
+    UnloadScene(binary->sceneId);
+  }
+  MemFree(binary->modelIds);
+  MemFree(binary->nodeIds);
+  UnmapSceneBinary(binary->data, binary->size);
+  MemFree(binary);
+}
+
+SceneId LoadSceneBinary(const char *fileName) {
+  SceneBinaryData *binary = LoadSceneBinaryData(fileName);
+  SceneId sceneId = {0};
+  if (binary && UploadSceneBinaryData(binary, 0, &sceneId) == 1) {
+    TraceLog(LOG_INFO, "LoadSceneBinary: %s, %u nodes, %u meshes", fileName,
+             binary->header.nodeCount, binary->header.meshCount);
+  }
+  UnloadSceneBinaryData(binary);
+  return sceneId;
+}
+
+// # Traversal Functions
+static SceneNodeId GetSceneNodeIdAt(SceneId sceneId, Scene *scene,
+                                    unsigned long nodeIndex) {
+  return (SceneNodeId){sceneId, nodeIndex,
+                       GetSceneNodeAt(scene, nodeIndex)->generation};
+}
+
+// Brings the transforms into depth first order (see
+// RebuildSceneTransformOrder) and resolves them. Every subtree is then a
+// contiguous range, so walking the transforms front to back is a depth first
+// traversal that needs neither recursion nor a stack.
+static void PrepareSceneTraversal(Scene *scene) {
+  if (scene->transformSubtreesSplit) {
+    scene->transformOrderDirty = 1;
+  }
+  UpdateTransforms(scene);
+}
+
+void TraverseSceneNodes(SceneId sceneId, SceneNodeVisitor visitor,
+                        void *data) {
+  Scene *scene = GetScene(sceneId);
+  if (!scene || !visitor) {
+    return;
+  }
+
+  PrepareSceneTraversal(scene);
+  SceneTransforms *transforms = &scene->transforms;
+  for (unsigned long i = 0; i < transforms->count; i++) {
+    visitor(GetSceneNodeIdAt(sceneId, scene, transforms->nodeIndex[i]),
+            transforms->localToWorld[i], data);
+  }
+}
+
+void TraverseSceneNodesBreadthFirst(SceneId sceneId, SceneNodeVisitor visitor,
+                                    void *data) {
+  Scene *scene = GetScene(sceneId);
+  if (!scene || !visitor) {
+    return;
+  }
+
+  UpdateTransforms(scene);
+  SceneTransforms *transforms = &scene->transforms;
+  if (transforms->count == 0) {
+    return;
+  }
+
+  // every node is queued exactly once
+  unsigned long *queue = MemAlloc(sizeof(unsigned long) * transforms->count);
+  unsigned long head = 0, tail = 0;
+  for (unsigned long i = 0; i < transforms->count; i++) {
+    if (transforms->parent[i] < 0) {
+      queue[tail++] = transforms->nodeIndex[i];
+    }
+  }
+
+  while (head < tail) {
+    unsigned long nodeIndex = queue[head++];
+    SceneNode *node = GetSceneNodeAt(scene, nodeIndex);
+    visitor(GetSceneNodeIdAt(sceneId, scene, nodeIndex),
+            transforms->localToWorld[node->transformIndex], data);
+
+    SceneNodeId childId = node->firstChildId;
+    SceneNode *child = GetSceneNode(childId, 0);
+    while (child) {
+      queue[tail++] = childId.id;
+      childId = child->nextSiblingId;
+      child = GetSceneNode(childId, 0);
+    }
+  }
+
+  MemFree(queue);
+}
+
+// Subtrees handed out per worker; more than one so a deep subtree on one
+// worker doesn't leave the others idle
+#define SCENE_TRAVERSAL_TASKS_PER_WORKER 4
+
+// a subtree as a range of transform indices
+typedef struct SceneTraversalTask {
+  unsigned long first, last;
+} SceneTraversalTask;
+
+typedef struct SceneTraversal {
+  SceneId sceneId;
+  Scene *scene;
+  SceneNodeVisitor visitor;
+  void *data;
+  SceneTraversalTask *tasks;
+  unsigned long taskCount;
+} SceneTraversal;
+
+static void RunSceneTraversalTask(void *data, unsigned long t) {
+  SceneTraversal *traversal = data;
+  SceneTransforms *transforms = &traversal->scene->transforms;
+  SceneTraversalTask task = traversal->tasks[t];
+  for (unsigned long i = task.first; i < task.last; i++) {
+    traversal->visitor(GetSceneNodeIdAt(traversal->sceneId, traversal->scene,
+                                        transforms->nodeIndex[i]),
+                       transforms->localToWorld[i], traversal->data);
+  }
+}
+
+void TraverseSceneNodesParallel(SceneId sceneId, SceneNodeVisitor visitor,
+                                void *data, int workerCount) {
+  Scene *scene = GetScene(sceneId);
+  if (!scene || !visitor) {
+    return;
+  }
+
+  PrepareSceneTraversal(scene);
+  SceneTransforms *transforms = &scene->transforms;
+  unsigned long count = transforms->count;
+  if (workerCount <= 1 || count < (unsigned long)workerCount) {
+    TraverseSceneNodes(sceneId, visitor, data);
+    return;
+  }
+
+  // subtree sizes in one backward sweep, children come after their parent
+  unsigned long *subtreeSize = MemAlloc(sizeof(unsigned long) * count);
+  for (unsigned long i = 0; i < count; i++) {
+    subtreeSize[i] = 1;
+  }
+  for (unsigned long i = count; i-- > 0;) {
+    if (transforms->parent[i] >= 0) {
+      subtreeSize[transforms->parent[i]] += subtreeSize[i];
+    }
+  }
+
+  // Cut the order into subtrees no larger than the target. The roots of
+  // larger subtrees are visited here, before any worker starts, so every
+  // parent is still visited before its children.
+  unsigned long taskTarget =
+      count / ((unsigned long)workerCount * SCENE_TRAVERSAL_TASKS_PER_WORKER) +
+      1;
+  SceneTraversal traversal = {.sceneId = sceneId,
+                              .scene = scene,
+                              .visitor = visitor,
+                              .data = data};
+  traversal.tasks = MemAlloc(sizeof(SceneTraversalTask) * count);
+  for (unsigned long i = 0; i < count;) {
+    if (subtreeSize[i] <= taskTarget) {
+      SceneTraversalTask *task = &traversal.tasks[traversal.taskCount++];
+      task->first = i;
+      task->last = i + subtreeSize[i];
+      i = task->last;
+    } else {
+      visitor(GetSceneNodeIdAt(sceneId, scene, transforms->nodeIndex[i]),
+              transforms->localToWorld[i], data);
+      i++;
+    }
+  }
+  MemFree(subtreeSize);
+
+  RunSceneJobs(RunSceneTraversalTask, &traversal, traversal.taskCount,
+               workerCount);
+  MemFree(traversal.tasks);
+}
+
+// # Scene Node Functions
+SceneNodeId AcquireSceneNode(SceneId sceneId) {
+  Scene *scene = GetScene(sceneId);
+  if (!scene) {
+    return (SceneNodeId){0};
+  }
+
+  // the free list stores the negated generations of released nodes
+  SceneNode *node = GetSceneNode(scene->firstFree, 0);
+  int index;
+  if (!node) {
+    node = PagedListAlloc(&scene->nodes, sizeof(SceneNode));
+    node->generation = scene->nodeGenerationFloor;
+    index = scene->nodes.count - 1;
+  } else {
+    index = scene->firstFree.id;
+    scene->firstFree = node->nextSiblingId;
+  }
+
+  long generation = node->generation < 0 ? -node->generation : node->generation;
+  *node = (SceneNode){.generation = generation + 1,
+                      .nameId = 0,
+                      .previousNamed = -1,
+                      .nextNamed = -1,
+                      .userIdentifier = 0,
+                      .bvhLeaf = -1,
+                      .layers = SCENE_LAYER_DEFAULT,
+                      .parent = (SceneNodeId){0},
+                      .model = (SceneModelId){0}};
+  node->transformIndex = AddSceneTransform(scene, index);
+  scene->layersDirty = 1;
+
+  return (SceneNodeId){sceneId, index, node->generation};
+}
+
+static SceneNode *GetSceneNode(SceneNodeId sceneNodeId, Scene **sceneOut) {
+  Scene *scene = GetScene(sceneNodeId.sceneId);
+  if (!scene) {
+    return 0;
+  }
+
+  if (sceneNodeId.id >= scene->nodes.count ||
+      GetSceneNodeAt(scene, sceneNodeId.id)->generation !=
+          sceneNodeId.generation) {
+    return 0;
+  }
+
+  if (sceneOut)
+    *sceneOut = scene;
+
+  return GetSceneNodeAt(scene, sceneNodeId.id);
+}
+
+int IsSceneNodeValid(SceneNodeId sceneNodeId) {
+  Scene *scene;
+  return GetSceneNode(sceneNodeId, &scene) != 0;
+}
+
+// removes the node from its parent's child list
+static void DetachSceneNode(SceneNodeId sceneNodeId, SceneNode *node) {
+  SceneNode *parentNode = GetSceneNode(node->parent, 0);
+  if (parentNode) {
+    SceneNodeId siblingId = parentNode->firstChildId;
     if (siblingId.id == sceneNodeId.id) {
       parentNode->firstChildId = node->nextSiblingId;
     } else {
@@ -587,16 +4829,83 @@ void ReleaseSceneNode(SceneNodeId sceneNodeId) {
         siblingId = sibling->nextSiblingId;
         sibling = GetSceneNode(siblingId, 0);
       }
-      sibling->nextSiblingId = node->nextSiblingId;
+      if (sibling) {
+        sibling->nextSiblingId = node->nextSiblingId;
+      }
+    }
+  }
+
+  node->parent = (SceneNodeId){0};
+  node->nextSiblingId = (SceneNodeId){0};
+}
+
+void SetSceneNodeParent(SceneNodeId sceneNodeId,
+                        SceneNodeId parentSceneNodeId) {
+  if (parentSceneNodeId.sceneId.id != sceneNodeId.sceneId.id) {
+    TraceLog(
+        LOG_WARNING,
+        "SetSceneNodeParent: scene node and parent must be in the same scene");
+    return;
+  }
+
+  Scene *scene;
+  SceneNode *node = GetSceneNode(sceneNodeId, &scene);
+  if (!node) {
+    return;
+  }
+
+  SceneNode *parentNode = GetSceneNode(parentSceneNodeId, 0);
+  if (!parentNode) {
+    return;
+  }
+
+  for (SceneNode *ancestor = parentNode; ancestor;
+       ancestor = GetSceneNode(ancestor->parent, 0)) {
+    if (ancestor == node) {
+      TraceLog(LOG_WARNING,
+               "SetSceneNodeParent: node can't be parented to its descendant");
+      return;
     }
   }
 
-  node->generation++;
-  if (node->name) {
-    MemFree(node->name);
-    node->name = 0;
+  DetachSceneNode(sceneNodeId, node);
+  node->parent = parentSceneNodeId;
+  node->nextSiblingId = parentNode->firstChildId;
+  parentNode->firstChildId = sceneNodeId;
+
+  scene->transforms.parent[node->transformIndex] = parentNode->transformIndex;
+  if (parentNode->transformIndex > node->transformIndex) {
+    scene->transformOrderDirty = 1;
+  } else {
+    scene->transformSubtreesSplit = 1;
+  }
+  MarkSceneNodeSubtreeDirty(scene, sceneNodeId, node);
+}
+
+// releases a scene node (destroy) and all its children
+void ReleaseSceneNode(SceneNodeId sceneNodeId) {
+  Scene *scene;
+  SceneNode *node = GetSceneNode(sceneNodeId, &scene);
+  if (!node) {
+    return;
+  }
+
+  // while the node is still valid for the onRemove callbacks
+  for (int d = 0; d < 256; d++) {
+    RemoveSceneComponentEntry(scene, d, sceneNodeId.id);
+  }
+  node = GetSceneNode(sceneNodeId, &scene);
+  if (!node) {
+    return;
   }
 
+  DetachSceneNode(sceneNodeId, node);
+  UnlinkSceneNodeName(scene, sceneNodeId.id);
+
+  // negative generation marks the node as free; handles to it become invalid
+  node->generation = -node->generation;
+  sceneNodeId.generation = node->generation;
+
   // release children
   SceneNodeId childId = node->firstChildId;
   SceneNode *child = GetSceneNode(childId, 0);
@@ -606,42 +4915,105 @@ void ReleaseSceneNode(SceneNodeId sceneNodeId) {
     child = GetSceneNode(nextChildId, 0);
     childId = nextChildId;
   }
+  node->firstChildId = (SceneNodeId){0};
+
+  // the transform slot is dropped by the next order rebuild
+  scene->transforms.nodeIndex[node->transformIndex] = scene->nodes.count;
+  scene->transformOrderDirty = 1;
+  if (node->cullBoundsCount > 0) {
+    scene->cullBoundsDirty = 1;
+  }
+  RemoveSceneBVHLeaf(scene, node);
+  scene->layersDirty = 1;
 
   // add to free list
-  node->parent = (SceneNodeId){0};
   node->nextSiblingId = scene->firstFree;
   scene->firstFree = sceneNodeId;
 }
 
+void DefragmentScene(SceneId sceneId) {
+  Scene *scene = GetScene(sceneId);
+  if (!scene) {
+    return;
+  }
+
+  // repacks the transforms in hierarchy order and flushes the dirty queue,
+  // which may still hold released nodes
+  scene->transformOrderDirty = 1;
+  UpdateTransforms(scene);
+
+  // drop the free slots at the end of the storage and the pages they used
+  while (scene->nodes.count > 0) {
+    SceneNode *last = GetSceneNodeAt(scene, scene->nodes.count - 1);
+    if (last->generation > 0) {
+      break;
+    }
+    if (-last->generation > scene->nodeGenerationFloor) {
+      scene->nodeGenerationFloor = -last->generation;
+    }
+    scene->nodes.count--;
+  }
+  TrimPagedList(&scene->nodes);
+
+  // relink the free list in ascending order, so new nodes fill the lowest
+  // holes first and live nodes gather in the first pages
+  scene->firstFree = (SceneNodeId){0};
+  for (unsigned long i = scene->nodes.count; i-- > 0;) {
+    SceneNode *node = GetSceneNodeAt(scene, i);
+    if (node->generation < 0) {
+      node->nextSiblingId = scene->firstFree;
+      scene->firstFree = (SceneNodeId){sceneId, i, node->generation};
+    }
+  }
+
+  // repack the culling data in the new transform order
+  scene->cullBoundsDirty = 1;
+  scene->layersDirty = 1;
+  PrepareSceneCulling(scene);
+}
+
+// resolves the node and queues its subtree for the next transform sweep
+static SceneNode *GetSceneNodeForTRSUpdate(SceneNodeId sceneNodeId,
+                                           Scene **sceneOut) {
+  SceneNode *node = GetSceneNode(sceneNodeId, sceneOut);
+  if (!node) {
+    return 0;
+  }
+
+  MarkSceneNodeSubtreeDirty(*sceneOut, sceneNodeId, node);
+  return node;
+}
+
 void SetSceneNodePosition(SceneNodeId sceneNodeId, float x, float y, float z) {
-  SceneNode *node = GetSceneNode(sceneNodeId, 0);
+  Scene *scene;
+  SceneNode *node = GetSceneNodeForTRSUpdate(sceneNodeId, &scene);
   if (!node) {
     return;
   }
 
-  node->position = (Vector3){x, y, z};
-  node->modTRSGeneration += 1;
+  scene->transforms.position[node->transformIndex] = (Vector3){x, y, z};
 }
 
 void SetSceneNodeRotation(SceneNodeId sceneNodeId, float eulerXDeg,
                           float eulerYDeg, float eulerZDeg) {
-  SceneNode *node = GetSceneNode(sceneNodeId, 0);
+  Scene *scene;
+  SceneNode *node = GetSceneNodeForTRSUpdate(sceneNodeId, &scene);
   if (!node) {
     return;
   }
 
-  node->rotation = (Vector3){eulerXDeg, eulerYDeg, eulerZDeg};
-  node->modTRSGeneration += 1;
+  scene->transforms.rotation[node->transformIndex] =
+      (Vector3){eulerXDeg, eulerYDeg, eulerZDeg};
 }
 
 void SetSceneNodeScale(SceneNodeId sceneNodeId, float x, float y, float z) {
-  SceneNode *node = GetSceneNode(sceneNodeId, 0);
+  Scene *scene;
+  SceneNode *node = GetSceneNodeForTRSUpdate(sceneNodeId, &scene);
   if (!node) {
     return;
   }
 
-  node->scale = (Vector3){x, y, z};
-  node->modTRSGeneration += 1;
+  scene->transforms.scale[node->transformIndex] = (Vector3){x, y, z};
 }
 
 void SetSceneNodePositionV(SceneNodeId sceneNodeId, Vector3 position) {
@@ -657,70 +5029,47 @@ void SetSceneNodeScaleV(SceneNodeId sceneNodeId, Vector3 scale) {
 }
 
 Vector3 GetSceneNodeLocalPosition(SceneNodeId sceneNodeId) {
-  SceneNode *node = GetSceneNode(sceneNodeId, 0);
+  Scene *scene;
+  SceneNode *node = GetSceneNode(sceneNodeId, &scene);
   if (!node) {
     return (Vector3){0, 0, 0};
   }
 
-  return node->position;
+  return scene->transforms.position[node->transformIndex];
 }
 
 Vector3 GetSceneNodeLocalRotation(SceneNodeId sceneNodeId) {
-  SceneNode *node = GetSceneNode(sceneNodeId, 0);
+  Scene *scene;
+  SceneNode *node = GetSceneNode(sceneNodeId, &scene);
   if (!node) {
     return (Vector3){0, 0, 0};
   }
 
-  return node->rotation;
+  return scene->transforms.rotation[node->transformIndex];
 }
 
 Vector3 GetSceneNodeLocalScale(SceneNodeId sceneNodeId) {
-  SceneNode *node = GetSceneNode(sceneNodeId, 0);
+  Scene *scene;
+  SceneNode *node = GetSceneNode(sceneNodeId, &scene);
   if (!node) {
     return (Vector3){1, 1, 1};
   }
 
-  return node->scale;
-}
-
-static SceneNode *UpdateSceneNodeTRS(SceneNodeId sceneNodeId) {
-  SceneNode *node = IsSceneNodeTRSDirty(sceneNodeId);
-  if (!node) {
-    return GetSceneNode(sceneNodeId, 0);
-  }
-
-  SceneNode *parentNode = GetSceneNode(node->parent, 0);
-  node->localToWorld = MatrixIdentity();
-  node->localToWorld =
-      MatrixMultiply(node->localToWorld,
-                     MatrixScale(node->scale.x, node->scale.y, node->scale.z));
-  node->localToWorld =
-      MatrixMultiply(node->localToWorld,
-                     MatrixRotateXYZ((Vector3){DEG2RAD * node->rotation.x,
-                                               DEG2RAD * node->rotation.y,
-                                               DEG2RAD * node->rotation.z}));
-  node->localToWorld = MatrixMultiply(
-      node->localToWorld,
-      MatrixTranslate(node->position.x, node->position.y, node->position.z));
-  if (parentNode) {
-    UpdateSceneNodeTRS(node->parent);
-    node->localToWorld =
-        MatrixMultiply(node->localToWorld, parentNode->localToWorld);
-  }
-
-  unsigned long generationSum = GetSceneNodeGenerationSum(node);
-  node->modTRSMarker = generationSum;
-
-  return node;
+  return scene->transforms.scale[node->transformIndex];
 }
 
 Matrix GetSceneNodeLocalTransform(SceneNodeId sceneNodeId) {
-  SceneNode *node = UpdateSceneNodeTRS(sceneNodeId);
+  Scene *scene;
+  SceneNode *node = GetSceneNode(sceneNodeId, &scene);
   if (!node) {
     return MatrixIdentity();
   }
 
-  return node->localToWorld;
+  // clean nodes are read directly, even if other nodes are pending
+  if (scene->transforms.dirty[node->transformIndex]) {
+    UpdateTransforms(scene);
+  }
+  return scene->transforms.localToWorld[node->transformIndex];
 }
 
 Vector3 GetSceneNodeWorldPosition(SceneNodeId sceneNodeId) {
@@ -743,38 +5092,315 @@ Vector3 GetSceneNodeWorldRight(SceneNodeId sceneNodeId) {
   return (Vector3){localToWorld.m0, localToWorld.m1, localToWorld.m2};
 }
 
-static char *StringDup(const char *str) {
+// # Name Functions
+// FNV-1a
+static unsigned long HashSceneName(const char *str, unsigned long length) {
+  unsigned long hash = 2166136261u;
+  for (unsigned long i = 0; i < length; i++) {
+    hash = (hash ^ (unsigned char)str[i]) * 16777619u;
+  }
+  return hash;
+}
+
+// returns the id of the interned string or 0
+static unsigned long FindSceneName(SceneNames *names, const char *str,
+                                   unsigned long length, unsigned long hash) {
+  if (names->slotsCapacity == 0) {
+    return 0;
+  }
+
+  unsigned long mask = names->slotsCapacity - 1;
+  for (unsigned long i = hash & mask;; i = (i + 1) & mask) {
+    unsigned long id = names->slots[i];
+    if (id == 0) {
+      return 0;
+    }
+
+    SceneName *entry = &names->entries[id - 1];
+    if (entry->hash == hash && entry->length == length &&
+        memcmp(entry->chars, str, length) == 0) {
+      return id;
+    }
+  }
+}
+
+static void InsertSceneNameSlot(SceneNames *names, unsigned long id) {
+  unsigned long mask = names->slotsCapacity - 1;
+  unsigned long i = names->entries[id - 1].hash & mask;
+  while (names->slots[i] != 0) {
+    i = (i + 1) & mask;
+  }
+  names->slots[i] = id;
+}
+
+// takes the id out of the table, shifting the entries after it in its probe
+// run back so lookups don't stop at the hole
+static void RemoveSceneNameSlot(SceneNames *names, unsigned long id) {
+  unsigned long mask = names->slotsCapacity - 1;
+  unsigned long i = names->entries[id - 1].hash & mask;
+  while (names->slots[i] != id) {
+    i = (i + 1) & mask;
+  }
+
+  for (unsigned long j = (i + 1) & mask; names->slots[j] != 0;
+       j = (j + 1) & mask) {
+    // an entry may fill the hole unless its home slot lies between the two
+    unsigned long home = names->entries[names->slots[j] - 1].hash & mask;
+    if (((j - home) & mask) >= ((j - i) & mask)) {
+      names->slots[i] = names->slots[j];
+      i = j;
+    }
+  }
+  names->slots[i] = 0;
+}
+
+static char *AllocSceneNameChars(SceneNames *names, unsigned long size) {
+  if (names->blocksCount == 0 || names->blockUsed + size > names->blockSize) {
+    if (names->blocksCount >= names->blocksCapacity) {
+      names->blocksCapacity =
+          names->blocksCapacity == 0 ? 8 : names->blocksCapacity * 2;
+      names->blocks =
+          ArrayRealloc(names->blocks, sizeof(char *) * names->blocksCapacity);
+    }
+    // names longer than a block get a block of their own
+    names->blockSize =
+        size > SCENE_NAME_BLOCK_SIZE ? size : SCENE_NAME_BLOCK_SIZE;
+    names->blocks[names->blocksCount++] = MemAlloc(names->blockSize);
+    names->blockUsed = 0;
+  }
+
+  char *chars = names->blocks[names->blocksCount - 1] + names->blockUsed;
+  names->blockUsed += size;
+  names->usedChars += size;
+  return chars;
+}
+
+// copies the live names into new blocks and frees the old ones
+static void CompactSceneNames(SceneNames *names) {
+  char **blocks = names->blocks;
+  unsigned long blocksCount = names->blocksCount;
+  names->blocks = 0;
+  names->blocksCount = names->blocksCapacity = 0;
+  names->blockUsed = names->blockSize = 0;
+  names->usedChars = names->freeChars = 0;
+  for (unsigned long i = 0; i < names->count; i++) {
+    SceneName *entry = &names->entries[i];
+    if (entry->chars) {
+      char *chars = AllocSceneNameChars(names, entry->length + 1);
+      memcpy(chars, entry->chars, entry->length + 1);
+      entry->chars = chars;
+    }
+  }
+
+  for (unsigned long i = 0; i < blocksCount; i++) {
+    MemFree(blocks[i]);
+  }
+  if (blocks) {
+    MemFree(blocks);
+  }
+}
+
+// Returns the id of str and adds a reference to it, interning it if it wasn't
+// yet. Every reference is given back with ReleaseSceneName.
+static unsigned long InternSceneName(SceneNames *names, const char *str) {
   if (!str) {
     return 0;
   }
 
-  unsigned long len = strlen(str);
-  char *dup = MemAlloc(len + 1);
-  strcpy(dup, str);
-  return dup;
+  unsigned long length = strlen(str);
+  unsigned long hash = HashSceneName(str, length);
+  unsigned long id = FindSceneName(names, str, length, hash);
+  if (id) {
+    names->entries[id - 1].references++;
+    return id;
+  }
+
+  if ((names->count + 1) * 2 > names->slotsCapacity) {
+    MemFree(names->slots);
+    names->slotsCapacity =
+        names->slotsCapacity == 0 ? 64 : names->slotsCapacity * 2;
+    names->slots = MemAlloc(sizeof(unsigned long) * names->slotsCapacity);
+    memset(names->slots, 0, sizeof(unsigned long) * names->slotsCapacity);
+    for (unsigned long i = 0; i < names->count; i++) {
+      if (names->entries[i].chars) {
+        InsertSceneNameSlot(names, i + 1);
+      }
+    }
+  }
+
+  char *chars = AllocSceneNameChars(names, length + 1);
+  memcpy(chars, str, length + 1);
+  if (names->freeIdsCount > 0) {
+    id = names->freeIds[--names->freeIdsCount];
+  } else {
+    ListAlloc((void **)&names->entries, &names->count, &names->capacity,
+              sizeof(SceneName));
+    id = names->count;
+  }
+  names->entries[id - 1] = (SceneName){chars, length, hash, 1, -1};
+  InsertSceneNameSlot(names, id);
+
+  return id;
+}
+
+// Drops a reference taken by InternSceneName. The last one drops the name,
+// which may move the characters of the other names.
+static void ReleaseSceneName(SceneNames *names, unsigned long id) {
+  if (id == 0 || --names->entries[id - 1].references > 0) {
+    return;
+  }
+
+  SceneName *entry = &names->entries[id - 1];
+  RemoveSceneNameSlot(names, id);
+  names->freeChars += entry->length + 1;
+  entry->chars = 0;
+  unsigned long *freeId =
+      ListAlloc((void **)&names->freeIds, &names->freeIdsCount,
+                &names->freeIdsCapacity, sizeof(unsigned long));
+  *freeId = id;
+
+  if (names->freeChars > SCENE_NAME_BLOCK_SIZE &&
+      names->freeChars * 2 > names->usedChars) {
+    CompactSceneNames(names);
+  }
+}
+
+static const char *GetSceneNameChars(SceneNames *names, unsigned long id) {
+  return id ? names->entries[id - 1].chars : 0;
+}
+
+static void FreeSceneNames(SceneNames *names) {
+  for (unsigned long i = 0; i < names->blocksCount; i++) {
+    MemFree(names->blocks[i]);
+  }
+  if (names->blocks) {
+    MemFree(names->blocks);
+  }
+  if (names->entries) {
+    MemFree(names->entries);
+  }
+  if (names->slots) {
+    MemFree(names->slots);
+  }
+  if (names->freeIds) {
+    MemFree(names->freeIds);
+  }
+  *names = (SceneNames){0};
+}
+
+static void UnlinkSceneNodeName(Scene *scene, unsigned long nodeIndex) {
+  SceneNode *node = GetSceneNodeAt(scene, nodeIndex);
+  if (node->nameId == 0) {
+    return;
+  }
+
+  if (node->previousNamed >= 0) {
+    GetSceneNodeAt(scene, node->previousNamed)->nextNamed = node->nextNamed;
+  } else {
+    scene->names.entries[node->nameId - 1].firstNode = node->nextNamed;
+  }
+  if (node->nextNamed >= 0) {
+    GetSceneNodeAt(scene, node->nextNamed)->previousNamed = node->previousNamed;
+  }
+
+  ReleaseSceneName(&scene->names, node->nameId);
+  node->nameId = 0;
+  node->previousNamed = -1;
+  node->nextNamed = -1;
 }
 
 int SetSceneNodeName(SceneNodeId sceneNodeId, const char *name) {
-  SceneNode *node = GetSceneNode(sceneNodeId, 0);
+  Scene *scene;
+  SceneNode *node = GetSceneNode(sceneNodeId, &scene);
   if (!node) {
     return 0;
   }
 
-  if (node->name) {
-    MemFree(node->name);
+  // interned first, so renaming a node to its own name keeps the entry
+  unsigned long nameId = InternSceneName(&scene->names, name);
+  UnlinkSceneNodeName(scene, sceneNodeId.id);
+  node->nameId = nameId;
+  if (node->nameId) {
+    SceneName *entry = &scene->names.entries[node->nameId - 1];
+    node->nextNamed = entry->firstNode;
+    if (entry->firstNode >= 0) {
+      GetSceneNodeAt(scene, entry->firstNode)->previousNamed = sceneNodeId.id;
+    }
+    entry->firstNode = sceneNodeId.id;
   }
-  node->name = StringDup(name);
 
   return 1;
 }
 
 const char *GetSceneNodeName(SceneNodeId sceneNodeId) {
-  SceneNode *node = GetSceneNode(sceneNodeId, 0);
+  Scene *scene;
+  SceneNode *node = GetSceneNode(sceneNodeId, &scene);
   if (!node) {
     return 0;
   }
 
-  return node->name;
+  return GetSceneNameChars(&scene->names, node->nameId);
+}
+
+// appends the nodes named by the entry, returns the updated total count
+static int CollectSceneNamedNodes(SceneId sceneId, Scene *scene,
+                                  SceneName *entry, SceneNodeId *results,
+                                  int maxResults, int count) {
+  for (long i = entry->firstNode; i >= 0;
+       i = GetSceneNodeAt(scene, i)->nextNamed) {
+    if (count < maxResults) {
+      results[count] = (SceneNodeId){sceneId, (unsigned long)i,
+                                     GetSceneNodeAt(scene, i)->generation};
+    }
+    count++;
+  }
+  return count;
+}
+
+SceneNodeId FindSceneNodeByName(SceneId sceneId, const char *name) {
+  SceneNodeId result = {0};
+  FindSceneNodesByName(sceneId, name, &result, 1);
+  return result;
+}
+
+int FindSceneNodesByName(SceneId sceneId, const char *name,
+                         SceneNodeId *results, int maxResults) {
+  Scene *scene = GetScene(sceneId);
+  if (!scene || !name) {
+    return 0;
+  }
+
+  unsigned long length = strlen(name);
+  unsigned long id = FindSceneName(&scene->names, name, length,
+                                   HashSceneName(name, length));
+  if (!id) {
+    return 0;
+  }
+
+  return CollectSceneNamedNodes(sceneId, scene, &scene->names.entries[id - 1],
+                                results, maxResults, 0);
+}
+
+int FindSceneNodesByNamePrefix(SceneId sceneId, const char *prefix,
+                               SceneNodeId *results, int maxResults) {
+  Scene *scene = GetScene(sceneId);
+  if (!scene || !prefix) {
+    return 0;
+  }
+
+  // one compare per distinct name, not per node
+  unsigned long length = strlen(prefix);
+  int count = 0;
+  for (unsigned long i = 0; i < scene->names.count; i++) {
+    SceneName *entry = &scene->names.entries[i];
+    if (entry->firstNode >= 0 && entry->length >= length &&
+        memcmp(entry->chars, prefix, length) == 0) {
+      count = CollectSceneNamedNodes(sceneId, scene, entry, results,
+                                     maxResults, count);
+    }
+  }
+
+  return count;
 }
 
 int GetSceneNodeIdentifier(SceneNodeId sceneNodeId) {
@@ -797,10 +5423,46 @@ int SetSceneNodeIdentifier(SceneNodeId sceneNodeId, int identifier) {
 }
 
 void SetSceneNodeModel(SceneNodeId sceneNodeId, SceneModelId model) {
-  SceneNode *node = GetSceneNode(sceneNodeId, 0);
+  Scene *scene;
+  SceneNode *node = GetSceneNode(sceneNodeId, &scene);
   if (!node) {
     return;
   }
 
   node->model = model;
+  node->lod = node->lodPrevious = 0;
+  scene->cullBoundsDirty = 1;
+}
+
+void SetSceneNodeLayer(SceneNodeId sceneNodeId, unsigned long layers) {
+  Scene *scene;
+  SceneNode *node = GetSceneNode(sceneNodeId, &scene);
+  if (!node) {
+    return;
+  }
+
+  // bits past the last layer are no layer at all; no mask would match them
+  unsigned long validLayers =
+      ~0ul >> (sizeof(unsigned long) * 8 - SCENE_LAYER_COUNT);
+  if (layers & ~validLayers) {
+    TraceLog(LOG_WARNING,
+             "SetSceneNodeLayer: layers 0x%lx past the %d layers ignored",
+             layers & ~validLayers, SCENE_LAYER_COUNT);
+    layers &= validLayers;
+  }
+  if (node->layers == layers) {
+    return;
+  }
+
+  node->layers = layers;
+  scene->layersDirty = 1;
+}
+
+unsigned long GetSceneNodeLayer(SceneNodeId sceneNodeId) {
+  SceneNode *node = GetSceneNode(sceneNodeId, 0);
+  if (!node) {
+    return 0;
+  }
+
+  return node->layers;
 }
\ No newline at end of file
@@ -22,11 +22,28 @@ Secondary goals:
 - Draw order sorting and filtering
 */
 
+// Draw order of the visible meshes. Front to back reduces overdraw of opaque
+// meshes, back to front is required for blended ones, hierarchy draws parents
+// before their children.
 #define SCENE_DRAW_SORT_NONE 0
 #define SCENE_DRAW_SORT_FRONT_TO_BACK 1
 #define SCENE_DRAW_SORT_BACK_TO_FRONT 2
 #define SCENE_DRAW_SORT_HIERARCHY 3
 
+// Nodes belong to a set of layers, stored as a bitmask. New nodes are in the
+// default layer; SceneDrawConfig.layerMask selects the layers that are drawn.
+#define SCENE_LAYER_COUNT 32
+#define SCENE_LAYER_DEFAULT 1ul
+
+// Maximum number of coarser levels of detail per model, see
+// AddModelLODToScene
+#define SCENE_MAX_LOD_COUNT 8
+
+// Maps raylib allocates per material (MAX_MATERIAL_MAPS in its config.h,
+// which isn't installed with the library). Copies of a material's maps must
+// hold this many, since DrawMesh walks all of them.
+#define SCENE_MATERIAL_MAP_COUNT 12
+
 typedef struct SceneId {
   unsigned long id;
   long generation;
@@ -68,9 +85,19 @@ typedef struct SceneNodeComponentDefinition {
   const char *name;
   void (*onAdd)(SceneNodeId nodeId, void *data);
   void (*onRemove)(SceneNodeId nodeId, void *data);
-  void (*onDraw)(SceneNodeId nodeId, Matrix localToWorld, void *data);
+  // called once per scene draw with all components of this type; components
+  // holds count packed entries of componentDataSize bytes, entry i belongs to
+  // nodeIds[i] and localToWorld[i]
+  void (*onDraw)(void *components, const SceneNodeId *nodeIds,
+                 const Matrix *localToWorld, unsigned long count);
 } SceneNodeComponentDefinition;
 
+// A system processes all components of one type in a single call, see
+// SceneNodeComponentDefinition.onDraw for the layout
+typedef void (*SceneNodeComponentSystem)(void *components,
+                                         const SceneNodeId *nodeIds,
+                                         unsigned long count, void *data);
+
 typedef struct SceneDrawConfig {
   Camera3D camera;
   Matrix transform;
@@ -78,30 +105,117 @@ typedef struct SceneDrawConfig {
   unsigned char sortMode;
   unsigned char drawBoundingBoxes : 1;
   unsigned char drawCameraFrustum : 1;
+  // skips meshes hidden behind the scene's occluders, see AddSceneOccluder
+  unsigned char occlusionCulling : 1;
   Shader shader;  // Add this line
+  // when set, visible instances of the same mesh are drawn with a single
+  // DrawMeshInstanced call using this shader; it must read the model matrix
+  // from the per-instance attribute bound to SHADER_LOC_MATRIX_MODEL
+  Shader instancingShader;
+  // seconds over which nodes crossfade with a dither pattern when they switch
+  // their level of detail; 0 switches at once. Needs the shader override to
+  // have a float lodFade uniform, see assets/shaders/lighting.fs.
+  float lodCrossfadeTime;
+  // threads culling, level selection and draw list building run on,
+  // including the calling one; 0 and 1 keep them on the calling thread and
+  // negative values use one per processor. The BVH and layer selection run on
+  // the calling thread and only the meshes they keep are split between the
+  // threads. Draws are always submitted from the calling thread.
+  int workerCount;
 } SceneDrawConfig;
 
 typedef struct SceneDrawStats {
   unsigned long culledMeshCount;
   unsigned long meshDrawCount;
+  unsigned long drawCallCount;
   unsigned long trianglesDrawCount;
 } SceneDrawStats;
 
 void RegisterSceneNodeComponent(SceneNodeComponentDefinition definition);
 
+// Components of each registered type are stored packed per scene. A node has
+// at most one component per type; new component data is zeroed before onAdd.
+// Removing a component moves the last one of its type into its place, so
+// component pointers are only valid until the next add or remove.
+SceneNodeComponentId AddSceneNodeComponent(SceneNodeId sceneNodeId,
+                                           unsigned char definitionId);
+void *GetSceneNodeComponent(SceneNodeId sceneNodeId,
+                            unsigned char definitionId);
+void *GetSceneNodeComponentData(SceneNodeComponentId componentId);
+int RemoveSceneNodeComponent(SceneNodeId sceneNodeId,
+                             unsigned char definitionId);
+// runs the system once over all components of the type in the scene
+void RunSceneNodeComponentSystem(SceneId sceneId, unsigned char definitionId,
+                                 SceneNodeComponentSystem system, void *data);
+
 // creates a new empty scene
 SceneId LoadScene();
 void UnloadScene(SceneId sceneId);
 int IsSceneValid(SceneId sceneId);
 SceneDrawStats DrawScene(SceneId sceneId, SceneDrawConfig config);
+// DrawScene draws with copies of the model's materials, made when the scene
+// is first drawn after models were added; later changes to the materials
+// themselves don't show up.
 SceneModelId AddModelToScene(SceneId sceneId, Model model, const char *name,
                              int manageModel);
-void TraverseSceneNodes(SceneId sceneId, void (*callback)(SceneNodeId, void *),
+// Adds a coarser level of detail to a model. meshes holds one mesh per mesh of
+// the model; the array is copied. DrawScene uses the level wherever the
+// model's bounding sphere covers less than screenSize of the viewport height,
+// picking the coarsest such level of the chain. A managed model unloads its
+// levels with it.
+int AddModelLODToScene(SceneModelId modelId, const Mesh *meshes,
+                       float screenSize);
+// resolves all pending world matrix updates of the scene in one sweep; called
+// by DrawScene, call it earlier to read world transforms in bulk
+void UpdateSceneTransforms(SceneId sceneId);
+
+// Called once per node by the traversals below with the node's resolved world
+// matrix. Visitors may change node properties such as transforms, but must not
+// acquire, release or reparent nodes.
+typedef void (*SceneNodeVisitor)(SceneNodeId nodeId, Matrix localToWorld,
+                                 void *data);
+// depth first, every node is visited after its parent
+void TraverseSceneNodes(SceneId sceneId, SceneNodeVisitor visitor,
                         void *data);
+// level order: all roots first, then their children and so on
+void TraverseSceneNodesBreadthFirst(SceneId sceneId, SceneNodeVisitor visitor,
+                                    void *data);
+// Splits the hierarchy into independent subtrees and visits them on
+// workerCount threads, including the calling one. Parents are still visited
+// before their children, but siblings run concurrently, so the visitor must be
+// thread safe and must not call functions that change the scene; collect the
+// changes and apply them after the traversal returns. The threads are shared
+// with DrawScene.
+void TraverseSceneNodesParallel(SceneId sceneId, SceneNodeVisitor visitor,
+                                void *data, int workerCount);
 
+// Occluders are world space triangles, usually simplified walls and other
+// large static geometry. The mesh needs its CPU side vertex data and is copied
+// in, transformed by transform. With SceneDrawConfig.occlusionCulling set,
+// DrawScene rasterizes them into a coarse depth buffer on the CPU and skips
+// meshes whose bounds are fully behind them; those count as culled.
+int AddSceneOccluder(SceneId sceneId, Mesh mesh, Matrix transform);
+void ClearSceneOccluders(SceneId sceneId);
+
+// Spatial queries over the scene's bounding volume hierarchy. Both write up to
+// maxResults ids of nodes whose world bounds overlap the volume and return
+// the total number of overlapping nodes, which may exceed maxResults.
+int QuerySceneNodesInBox(SceneId sceneId, BoundingBox box,
+                         SceneNodeId *results, int maxResults);
+int QuerySceneNodesInFrustum(SceneId sceneId, Camera3D camera,
+                             SceneNodeId *results, int maxResults);
+
+// Nodes live in fixed size pages and never move, so acquiring nodes doesn't
+// copy the existing ones. Released slots are reused by later acquires.
 SceneNodeId AcquireSceneNode(SceneId sceneId);
 void ReleaseSceneNode(SceneNodeId sceneNodeId);
 int IsSceneNodeValid(SceneNodeId sceneNodeId);
+// Compacts the scene storage without invalidating handles: frees the pages
+// past the last live node, makes new nodes fill the lowest free slots first
+// and repacks the per node transform and culling data in hierarchy order.
+// Costs a pass over all nodes; meant for loading screens or after despawning
+// many nodes.
+void DefragmentScene(SceneId sceneId);
 
 void SetSceneNodeParent(SceneNodeId sceneNodeId, SceneNodeId parentSceneNodeId);
 SceneNodeId GetSceneNodeFirstRoot(SceneNodeId sceneNodeId);
@@ -127,14 +241,76 @@ Vector3 GetSceneNodeWorldForward(SceneNodeId sceneNodeId);
 Vector3 GetSceneNodeWorldUp(SceneNodeId sceneNodeId);
 Vector3 GetSceneNodeWorldRight(SceneNodeId sceneNodeId);
 
+// Names are interned per scene. The returned string stays valid until a node
+// of the scene is renamed or released, which may drop a name and move the
+// others.
 int SetSceneNodeName(SceneNodeId sceneNodeId, const char *name);
 const char *GetSceneNodeName(SceneNodeId sceneNodeId);
+// Name lookups go through a hash index. FindSceneNodeByName returns one of the
+// nodes with the name, or an invalid id if there is none. The other two write
+// up to maxResults ids and return the total number of matching nodes.
+SceneNodeId FindSceneNodeByName(SceneId sceneId, const char *name);
+int FindSceneNodesByName(SceneId sceneId, const char *name,
+                         SceneNodeId *results, int maxResults);
+int FindSceneNodesByNamePrefix(SceneId sceneId, const char *prefix,
+                               SceneNodeId *results, int maxResults);
 
 int GetSceneNodeIdentifier(SceneNodeId sceneNodeId);
 int SetSceneNodeIdentifier(SceneNodeId sceneNodeId, int identifier);
 
 void SetSceneNodeModel(SceneNodeId sceneNodeId, SceneModelId model);
 
-void AddGLTFScene(SceneId sceneId, const char *filename, Matrix transform);
+// Bits past SCENE_LAYER_COUNT are dropped with a warning.
+void SetSceneNodeLayer(SceneNodeId sceneNodeId, unsigned long layers);
+unsigned long GetSceneNodeLayer(SceneNodeId sceneNodeId);
+
+// Loads a glTF file into the scene, keeping its node hierarchy, names and
+// TRS. The file's root nodes are parented to a new node placed at transform,
+// which is returned. Each glTF mesh is uploaded once and shared as one scene
+// model by all nodes that reference it. Levels of detail written by
+// tools/lodgen next to the file (name.lod1.glb, name.lod2.glb, ...) are added
+// to the models they were generated from.
+SceneNodeId AddGLTFScene(SceneId sceneId, const char *filename,
+                         Matrix transform);
+
+// Writes the scene to a binary snapshot: the node hierarchy with TRS, names,
+// layers and identifiers, the models with their mesh data, baked bounds and
+// base color materials, and the scene's textures. Components are not saved.
+// Returns 0 if the file couldn't be written.
+int SaveSceneBinary(SceneId sceneId, const char *fileName);
+// Creates a new scene from a snapshot. The file is memory mapped and its
+// payloads are uploaded in place without parsing; meshes keep no CPU copy of
+// their vertex data. Returns an invalid id if the file is missing, from
+// another version or corrupt.
+SceneId LoadSceneBinary(const char *fileName);
+
+// LoadSceneBinary in two stages, for streaming scenes in without stalls.
+// LoadSceneBinaryData maps the file, pages it in and checks all of it; it
+// touches no scene or GL state, so it may run on any thread. Returns 0 if
+// the file is missing, from another version or corrupt.
+typedef struct SceneBinaryData SceneBinaryData;
+SceneBinaryData *LoadSceneBinaryData(const char *fileName);
+// Creates the scene and uploads the snapshot into it on the GL thread, in
+// steps of one texture, one model or a run of nodes, until timeBudget seconds
+// have passed; 0 or less uploads all of it. Returns 0 while there is work
+// left, 1 once the scene is complete and stored in sceneId, and -1 if the
+// upload failed.
+int UploadSceneBinaryData(SceneBinaryData *binary, double timeBudget,
+                          SceneId *sceneId);
+// Unmaps the snapshot. A complete scene stays loaded; an unfinished one is
+// unloaded with it.
+void UnloadSceneBinaryData(SceneBinaryData *binary);
+
+#ifdef SCENE_CULL_VERIFY
+// Culls count random boxes against random frusta with both the culling kernel
+// and its scalar reference, 64 rounds of them, many with boxes exactly on or
+// touching the planes. Returns the number of boxes the two disagreed on,
+// which must be 0.
+int CheckSceneCullKernel(unsigned long count, unsigned int seed);
+// Rasterizes a wall as occluder and tests boxes around it with a perspective
+// and an orthographic camera. Returns the number of boxes that came out
+// occluded when they are visible or the other way around, which must be 0.
+int CheckSceneOcclusion(void);
+#endif
 
 #endif
\ No newline at end of file
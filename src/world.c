@@ -0,0 +1,393 @@
+#include "world.h"
+#include <math.h>
+#include <pthread.h>
+#include <raylib.h>
+#include <raymath.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Loads in flight at once. Few enough that the nearest cells are picked
+// again every frame instead of waiting behind stale requests.
+#define WORLD_MAX_LOADS 4
+
+typedef struct world_load_t {
+  int cell;
+  unsigned int generation;
+  const char *fileName; // the cell's, cells don't move after world_init
+  SceneBinaryData *data;
+} world_load_t;
+
+// The loader thread reads snapshots off the queue and hands them back on the
+// done list. The main thread owns inFlight, the rest is guarded by lock.
+struct world_loader_t {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  world_load_t queued[WORLD_MAX_LOADS];
+  int queuedCount;
+  world_load_t done[WORLD_MAX_LOADS];
+  int doneCount;
+  bool stopping;
+  int inFlight; // queued, being read or done but not collected yet
+};
+
+static void *world_loader_run(void *data) {
+  world_loader_t *loader = data;
+  pthread_mutex_lock(&loader->lock);
+  while (true) {
+    while (!loader->stopping && loader->queuedCount == 0) {
+      pthread_cond_wait(&loader->wake, &loader->lock);
+    }
+    if (loader->stopping) {
+      break;
+    }
+
+    world_load_t load = loader->queued[0];
+    loader->queuedCount--;
+    memmove(&loader->queued[0], &loader->queued[1],
+            sizeof(world_load_t) * loader->queuedCount);
+    pthread_mutex_unlock(&loader->lock);
+
+    load.data = LoadSceneBinaryData(load.fileName);
+
+    pthread_mutex_lock(&loader->lock);
+    loader->done[loader->doneCount++] = load;
+  }
+  pthread_mutex_unlock(&loader->lock);
+  return 0;
+}
+
+static void world_queue_load(world_t *world, int index) {
+  world_loader_t *loader = world->loader;
+  world_cell_t *cell = &world->cells[index];
+  cell->state = WORLD_CELL_LOADING;
+  world->memoryUsed += cell->size;
+  loader->inFlight++;
+
+  pthread_mutex_lock(&loader->lock);
+  loader->queued[loader->queuedCount++] =
+      (world_load_t){.cell = index,
+                     .generation = cell->generation,
+                     .fileName = cell->fileName};
+  pthread_cond_signal(&loader->wake);
+  pthread_mutex_unlock(&loader->lock);
+}
+
+// Takes the finished loads off the loader. Loads of cells that were dropped
+// in the meantime are thrown away.
+static void world_collect_loads(world_t *world) {
+  world_loader_t *loader = world->loader;
+  world_load_t done[WORLD_MAX_LOADS];
+  pthread_mutex_lock(&loader->lock);
+  int doneCount = loader->doneCount;
+  memcpy(done, loader->done, sizeof(world_load_t) * doneCount);
+  loader->doneCount = 0;
+  pthread_mutex_unlock(&loader->lock);
+
+  loader->inFlight -= doneCount;
+  for (int i = 0; i < doneCount; i++) {
+    world_cell_t *cell = &world->cells[done[i].cell];
+    if (cell->state != WORLD_CELL_LOADING ||
+        cell->generation != done[i].generation) {
+      UnloadSceneBinaryData(done[i].data);
+    } else if (!done[i].data) {
+      cell->state = WORLD_CELL_FAILED;
+      world->memoryUsed -= cell->size;
+    } else {
+      cell->state = WORLD_CELL_UPLOADING;
+      cell->data = done[i].data;
+    }
+  }
+}
+
+static void world_unload_cell(world_t *world, world_cell_t *cell) {
+  if (cell->state == WORLD_CELL_RESIDENT) {
+    UnloadScene(cell->sceneId);
+    cell->sceneId = (SceneId){0};
+  } else if (cell->state == WORLD_CELL_UPLOADING) {
+    UnloadSceneBinaryData(cell->data);
+    cell->data = 0;
+  } else if (cell->state == WORLD_CELL_LOADING) {
+    // the loader still finishes it, world_collect_loads drops the result
+    cell->generation++;
+  } else {
+    return;
+  }
+
+  world->memoryUsed -= cell->size;
+  cell->state = WORLD_CELL_UNLOADED;
+}
+
+static void world_make_resident(world_t *world, world_cell_t *cell,
+                                SceneId sceneId) {
+  UnloadSceneBinaryData(cell->data);
+  cell->data = 0;
+  cell->sceneId = sceneId;
+  cell->state = WORLD_CELL_RESIDENT;
+  if (world->onCellLoaded) {
+    world->onCellLoaded(cell, world->onCellLoadedData);
+  }
+}
+
+static void world_fail_cell(world_t *world, world_cell_t *cell) {
+  UnloadSceneBinaryData(cell->data);
+  cell->data = 0;
+  cell->state = WORLD_CELL_FAILED;
+  world->memoryUsed -= cell->size;
+}
+
+static void world_update_distances(world_t *world, Vector3 position,
+                                   Camera camera) {
+  Vector3 forward =
+      Vector3Normalize(Vector3Subtract(camera.target, camera.position));
+  for (int i = 0; i < world->cellCount; i++) {
+    world_cell_t *cell = &world->cells[i];
+    float dx = fmaxf(fmaxf(cell->bounds.min.x - position.x, 0.0f),
+                     position.x - cell->bounds.max.x);
+    float dz = fmaxf(fmaxf(cell->bounds.min.z - position.z, 0.0f),
+                     position.z - cell->bounds.max.z);
+    cell->distance = sqrtf(dx * dx + dz * dz);
+
+    // cells behind the camera come last among those at the same distance
+    Vector3 center = Vector3Scale(
+        Vector3Add(cell->bounds.min, cell->bounds.max), 0.5f);
+    center.y = camera.position.y;
+    Vector3 toCell = Vector3Subtract(center, camera.position);
+    bool behind = Vector3DotProduct(toCell, forward) < 0.0f &&
+                  cell->distance > 0.0f;
+    cell->priority = cell->distance + (behind ? world->cellSize : 0.0f);
+  }
+}
+
+// Makes room for size more bytes by dropping resident cells that matter less
+// than priority, the least important first. Returns false if they don't
+// free enough.
+static bool world_make_room(world_t *world, unsigned long size,
+                            float priority) {
+  while (world->memoryUsed + size > world->memoryBudget) {
+    world_cell_t *victim = 0;
+    for (int i = 0; i < world->cellCount; i++) {
+      world_cell_t *cell = &world->cells[i];
+      if (cell->state == WORLD_CELL_RESIDENT && cell->priority > priority &&
+          (!victim || cell->priority > victim->priority)) {
+        victim = cell;
+      }
+    }
+    if (!victim) {
+      return false;
+    }
+    world_unload_cell(world, victim);
+  }
+  return true;
+}
+
+// The unloaded cell in range that matters most, or -1
+static int world_next_cell(const world_t *world) {
+  int next = -1;
+  for (int i = 0; i < world->cellCount; i++) {
+    const world_cell_t *cell = &world->cells[i];
+    if (cell->state == WORLD_CELL_UNLOADED &&
+        cell->distance <= world->loadRadius &&
+        (next < 0 || cell->priority < world->cells[next].priority)) {
+      next = i;
+    }
+  }
+  return next;
+}
+
+// Uploads the read cells nearest first until the frame's budget is spent
+static void world_upload_cells(world_t *world) {
+  double start = GetTime();
+  while (true) {
+    world_cell_t *cell = 0;
+    for (int i = 0; i < world->cellCount; i++) {
+      world_cell_t *candidate = &world->cells[i];
+      if (candidate->state == WORLD_CELL_UPLOADING &&
+          (!cell || candidate->priority < cell->priority)) {
+        cell = candidate;
+      }
+    }
+    double remaining = world->uploadBudget - (GetTime() - start);
+    if (!cell || remaining <= 0.0) {
+      return;
+    }
+
+    SceneId sceneId = {0};
+    int status = UploadSceneBinaryData(cell->data, remaining, &sceneId);
+    if (status == 1) {
+      world_make_resident(world, cell, sceneId);
+    } else if (status < 0) {
+      world_fail_cell(world, cell);
+    }
+  }
+}
+
+static int world_compare_cells(const void *a, const void *b) {
+  const world_cell_t *cellA = a, *cellB = b;
+  if (cellA->z != cellB->z) {
+    return cellA->z < cellB->z ? -1 : 1;
+  }
+  return cellA->x < cellB->x ? -1 : cellA->x > cellB->x;
+}
+
+void world_init(world_t *world, const char *directory) {
+  *world = (world_t){.cellSize = WORLD_CELL_SIZE,
+                     .loadRadius = WORLD_LOAD_RADIUS,
+                     .unloadRadius = WORLD_UNLOAD_RADIUS,
+                     .memoryBudget = WORLD_MEMORY_BUDGET,
+                     .uploadBudget = WORLD_UPLOAD_BUDGET};
+
+  FilePathList files = {0};
+  if (DirectoryExists(directory)) {
+    files = LoadDirectoryFiles(directory);
+  }
+  world->cells = MemAlloc(sizeof(world_cell_t) * (files.count + 1));
+  for (unsigned int i = 0; i < files.count; i++) {
+    const char *name = GetFileName(files.paths[i]);
+    int x, z, end = 0;
+    if (sscanf(name, "cell_%d_%d.scene%n", &x, &z, &end) != 2 ||
+        end != (int)strlen(name) ||
+        strlen(files.paths[i]) >= sizeof(world->cells[0].fileName)) {
+      continue;
+    }
+
+    world_cell_t *cell = &world->cells[world->cellCount++];
+    cell->x = x;
+    cell->z = z;
+    strcpy(cell->fileName, files.paths[i]);
+    cell->size = GetFileLength(files.paths[i]);
+  }
+  UnloadDirectoryFiles(files);
+
+  qsort(world->cells, world->cellCount, sizeof(world_cell_t),
+        world_compare_cells);
+  for (int i = 0; i < world->cellCount; i++) {
+    world_cell_t *cell = &world->cells[i];
+    float size = world->cellSize;
+    cell->bounds = (BoundingBox){{cell->x * size, -size, cell->z * size},
+                                 {(cell->x + 1) * size, size,
+                                  (cell->z + 1) * size}};
+  }
+  TraceLog(LOG_INFO, "World: %d cells in %s", world->cellCount, directory);
+
+  world->loader = MemAlloc(sizeof(world_loader_t));
+  pthread_mutex_init(&world->loader->lock, 0);
+  pthread_cond_init(&world->loader->wake, 0);
+  if (pthread_create(&world->loader->thread, 0, world_loader_run,
+                     world->loader) != 0) {
+    TraceLog(LOG_ERROR, "World: failed to start the loader thread");
+    pthread_cond_destroy(&world->loader->wake);
+    pthread_mutex_destroy(&world->loader->lock);
+    MemFree(world->loader);
+    world->loader = 0;
+  }
+}
+
+void world_prime(world_t *world, Vector3 position) {
+  Camera camera = {.position = position,
+                   .target = Vector3Add(position, (Vector3){0, 0, 1})};
+  world_update_distances(world, position, camera);
+
+  int next;
+  while ((next = world_next_cell(world)) >= 0) {
+    world_cell_t *cell = &world->cells[next];
+    if (!world_make_room(world, cell->size, cell->priority)) {
+      break;
+    }
+
+    world->memoryUsed += cell->size;
+    cell->state = WORLD_CELL_UPLOADING;
+    cell->data = LoadSceneBinaryData(cell->fileName);
+    SceneId sceneId = {0};
+    if (cell->data && UploadSceneBinaryData(cell->data, 0, &sceneId) == 1) {
+      world_make_resident(world, cell, sceneId);
+    } else {
+      world_fail_cell(world, cell);
+    }
+  }
+}
+
+void world_update(world_t *world, Vector3 position, Camera camera) {
+  if (!world->loader) {
+    return;
+  }
+
+  world_collect_loads(world);
+  world_update_distances(world, position, camera);
+
+  // drop one cell out of range per frame, unloading is not free either
+  for (int i = 0; i < world->cellCount; i++) {
+    world_cell_t *cell = &world->cells[i];
+    if (cell->state == WORLD_CELL_LOADING &&
+        cell->distance > world->unloadRadius) {
+      world_unload_cell(world, cell);
+    } else if ((cell->state == WORLD_CELL_RESIDENT ||
+                cell->state == WORLD_CELL_UPLOADING) &&
+               cell->distance > world->unloadRadius) {
+      world_unload_cell(world, cell);
+      break;
+    }
+  }
+
+  // a budget lowered since the last frame drops the least important cells
+  world_make_room(world, 0, -1.0f);
+
+  int next;
+  while (world->loader->inFlight < WORLD_MAX_LOADS &&
+         (next = world_next_cell(world)) >= 0) {
+    world_cell_t *cell = &world->cells[next];
+    if (!world_make_room(world, cell->size, cell->priority)) {
+      break;
+    }
+    world_queue_load(world, next);
+  }
+
+  world_upload_cells(world);
+}
+
+SceneDrawStats world_draw(world_t *world, SceneDrawConfig config) {
+  SceneDrawStats total = {0};
+  for (int i = 0; i < world->cellCount; i++) {
+    if (world->cells[i].state != WORLD_CELL_RESIDENT) {
+      continue;
+    }
+
+    SceneDrawStats stats = DrawScene(world->cells[i].sceneId, config);
+    total.culledMeshCount += stats.culledMeshCount;
+    total.meshDrawCount += stats.meshDrawCount;
+    total.drawCallCount += stats.drawCallCount;
+    total.trianglesDrawCount += stats.trianglesDrawCount;
+  }
+  return total;
+}
+
+bool world_cell_contains(const world_cell_t *cell, Vector3 position) {
+  return position.x >= cell->bounds.min.x && position.x < cell->bounds.max.x &&
+         position.z >= cell->bounds.min.z && position.z < cell->bounds.max.z;
+}
+
+void world_cleanup(world_t *world) {
+  world_loader_t *loader = world->loader;
+  if (loader) {
+    pthread_mutex_lock(&loader->lock);
+    loader->stopping = true;
+    pthread_cond_signal(&loader->wake);
+    pthread_mutex_unlock(&loader->lock);
+    pthread_join(loader->thread, 0);
+
+    // the queue is dropped, a load that was running ends up on done
+    world_collect_loads(world);
+    pthread_cond_destroy(&loader->wake);
+    pthread_mutex_destroy(&loader->lock);
+    MemFree(loader);
+    world->loader = 0;
+  }
+
+  for (int i = 0; i < world->cellCount; i++) {
+    world_unload_cell(world, &world->cells[i]);
+  }
+  MemFree(world->cells);
+  world->cells = 0;
+  world->cellCount = 0;
+}
@@ -0,0 +1,44 @@
+#ifndef WORLD_H
+#define WORLD_H
+
+#include "game_types.h"
+#include "scene.h"
+#include <raylib.h>
+
+/*
+World partition streaming.
+
+The world is a grid of square cells, each a scene snapshot of its own named
+cell_<x>_<z>.scene after its grid coordinates. A loader thread maps and checks
+the snapshots of the cells near the player, nearest and in view first, and the
+main thread uploads them a time slice per frame, so crossing into a new cell
+never waits for the disk or a whole cell's worth of uploads. Cells that fall
+out of range or don't fit the memory budget are unloaded again.
+*/
+
+#define WORLD_CELL_SIZE 64.0f
+#define WORLD_LOAD_RADIUS 64.0f
+#define WORLD_UNLOAD_RADIUS 96.0f
+#define WORLD_MEMORY_BUDGET (256ul * 1024 * 1024)
+#define WORLD_UPLOAD_BUDGET 0.002 // seconds per frame
+
+// Finds the cells in directory and starts the loader thread. The radii and
+// budgets are set to the defaults above and may be changed afterwards.
+void world_init(world_t *world, const char *directory);
+
+// Loads the cells around position right away, before the first frame
+void world_prime(world_t *world, Vector3 position);
+
+// Streams cells in and out around position, once per frame
+void world_update(world_t *world, Vector3 position, Camera camera);
+
+// Draws the scenes of all resident cells
+SceneDrawStats world_draw(world_t *world, SceneDrawConfig config);
+
+// Checks if position lies in the cell on the XZ plane
+bool world_cell_contains(const world_cell_t *cell, Vector3 position);
+
+// Stops the loader thread and unloads every cell
+void world_cleanup(world_t *world);
+
+#endif // WORLD_H
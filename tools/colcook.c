@@ -0,0 +1,61 @@
+/*
+Offline cooker for collision meshes.
+
+  colcook file.glb [x y z]
+
+Loads the meshes of every node of the file like collision_init_gltf: welds
+their vertices, bakes them into world space placed at x y z (the origin by
+default) and builds their BVHs, then writes the result next to the file as
+file.colbin. collision_init maps that file and uses it as it is, so the game
+starts without parsing the model or building anything; it falls back to the
+model when the cooked file is missing or older.
+*/
+
+#include "../src/collision.h"
+#include <raylib.h>
+#include <raymath.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int main(int argc, char **argv) {
+  if (argc != 2 && argc != 5) {
+    printf("usage: %s file.glb [x y z]\n", argv[0]);
+    return 1;
+  }
+
+  Vector3 position = {0};
+  if (argc == 5) {
+    position = (Vector3){(float)atof(argv[2]), (float)atof(argv[3]),
+                         (float)atof(argv[4])};
+  }
+
+  CollisionSystem collisionSystem = {0};
+  if (!collision_init_gltf(&collisionSystem, argv[1],
+                           MatrixTranslate(position.x, position.y,
+                                           position.z))) {
+    printf("colcook: failed to load %s\n", argv[1]);
+    return 1;
+  }
+
+  const char *fileName = argv[1];
+  const char *separator = strrchr(fileName, '/');
+  const char *extension = strrchr(separator ? separator : fileName, '.');
+  int baseLength = extension ? extension - fileName : (int)strlen(fileName);
+  char cookedName[512];
+  snprintf(cookedName, sizeof(cookedName), "%.*s.colbin", baseLength,
+           fileName);
+
+  int triangleCount = 0, nodeCount = 0;
+  for (int i = 0; i < collisionSystem.meshCount; i++) {
+    triangleCount += collisionSystem.meshes[i].triangleCount;
+    nodeCount += collisionSystem.meshes[i].bvhNodeCount;
+  }
+  bool saved = collision_save(&collisionSystem, cookedName);
+  printf("colcook: %s, %d meshes, %d triangles, %d BVH nodes%s\n", cookedName,
+         collisionSystem.meshCount, triangleCount, nodeCount,
+         saved ? "" : ", failed to save");
+
+  collision_cleanup(&collisionSystem);
+  return !saved;
+}
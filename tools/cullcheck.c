@@ -0,0 +1,30 @@
+/*
+Checks the culling kernels.
+
+  cullcheck [count] [seed]
+
+Culls count random boxes (1000 by default) against random frusta with both the
+SIMD kernel and its scalar reference and prints how many they disagreed on,
+then tests boxes around an occluding wall with a perspective and an
+orthographic camera. Built with SCENE_CULL_VERIFY and the same flags as the
+game, so it tests the kernels the game uses; exits with 1 on any failure.
+*/
+
+#include "../src/scene.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(int argc, char **argv) {
+  if (argc > 3) {
+    printf("usage: %s [count] [seed]\n", argv[0]);
+    return 1;
+  }
+
+  unsigned long count = argc > 1 ? strtoul(argv[1], 0, 10) : 1000;
+  unsigned int seed = argc > 2 ? (unsigned int)strtoul(argv[2], 0, 10) : 1;
+  int mismatches = CheckSceneCullKernel(count, seed);
+  printf("cullcheck: %d of %lu boxes differ\n", mismatches, count * 64);
+  int occlusionFailures = CheckSceneOcclusion();
+  printf("cullcheck: %d occlusion tests failed\n", occlusionFailures);
+  return mismatches != 0 || occlusionFailures != 0;
+}
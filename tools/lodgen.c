@@ -0,0 +1,781 @@
+/*
+Offline level of detail generator for glTF scenes.
+
+  lodgen file.glb [ratio ...]
+
+Simplifies every primitive of the file to the given ratios of its triangle
+count (0.5 0.2 0.05 by default) and writes one file per level next to it,
+file.lod1.glb, file.lod2.glb and so on. Each level keeps the node hierarchy,
+the meshes and the primitives of the original in the same order, so
+AddGLTFScene can pair them up; it only carries geometry, materials and images
+stay in the original file.
+
+Simplification collapses edges in order of their quadric error (Garland and
+Heckbert), up to an error bound. Vertices are welded by position first, so
+flat shaded and UV seamed meshes collapse as one surface; a collapsed corner
+takes over the attributes of the vertex at the target position that matches
+its normal and texture coordinates best. Open edges get a perpendicular plane
+in their quadrics to keep the outline, and collapses that flip a triangle are
+skipped.
+*/
+
+#include "../src/gltf.h"
+#include <raylib.h>
+#include <raymath.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LODGEN_MAX_LEVELS 8
+// weight of the planes that hold open edges in place, relative to the planes
+// of the triangles
+#define LODGEN_BOUNDARY_WEIGHT 10.0
+// Collapses stop before moving the surface further than this share of the
+// mesh's bounding box diagonal, even if the target isn't reached. The bound
+// doubles with every level, like the screen size AddGLTFScene uses a level
+// at halves, so the error stays about the same on screen.
+#define LODGEN_MAX_ERROR 0.05
+// collapses that turn a triangle's normal by more than this are rejected
+#define LODGEN_MIN_NORMAL_DOT 0.2f
+
+// # Quadric Functions
+// Symmetric 4x4 matrix of the summed squared plane distances:
+// a2 ab ac ad b2 bc bd c2 cd d2
+typedef struct Quadric {
+  double q[10];
+} Quadric;
+
+static void AddPlaneQuadric(Quadric *quadric, Vector3 normal, double d,
+                            double weight) {
+  double a = normal.x, b = normal.y, c = normal.z;
+  double plane[10] = {a * a, a * b, a * c, a * d, b * b,
+                      b * c, b * d, c * c, c * d, d * d};
+  for (int i = 0; i < 10; i++) {
+    quadric->q[i] += plane[i] * weight;
+  }
+}
+
+static double GetQuadricError(const Quadric *quadric, Vector3 p) {
+  const double *q = quadric->q;
+  double x = p.x, y = p.y, z = p.z;
+  return q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x +
+         q[4] * y * y + 2 * q[5] * y * z + 2 * q[6] * y + q[7] * z * z +
+         2 * q[8] * z + q[9];
+}
+
+// # Simplifier Functions
+typedef struct Simplifier {
+  const Mesh *mesh;
+  // welded positions; every vertex maps to one point
+  int pointCount;
+  Vector3 *points;
+  int *vertexPoints;
+  // vertices of each point, pointVertices[pointFirstVertex[p]..[p + 1]]
+  int *pointFirstVertex;
+  int *pointVertices;
+  Quadric *quadrics;
+  // corners as vertex indices; removed triangles are flagged
+  int triangleCount;
+  int *corners;
+  char *removed;
+  int liveCount;
+  // live triangles of each point, rebuilt every pass
+  int *pointFirstTriangle;
+  int *pointTriangles;
+  // squared error bound, see LODGEN_MAX_ERROR
+  double maxCost;
+} Simplifier;
+
+typedef struct SimplifierEdge {
+  int from, to;
+  double cost;
+  int triangle; // a triangle of the edge, while looking for open edges
+} SimplifierEdge;
+
+static Vector3 GetMeshVertex(const Mesh *mesh, int v) {
+  return (Vector3){mesh->vertices[v * 3], mesh->vertices[v * 3 + 1],
+                   mesh->vertices[v * 3 + 2]};
+}
+
+static const Mesh *sortMesh;
+
+static int CompareVertexPositions(const void *a, const void *b) {
+  const float *pa = &sortMesh->vertices[*(const int *)a * 3];
+  const float *pb = &sortMesh->vertices[*(const int *)b * 3];
+  for (int c = 0; c < 3; c++) {
+    if (pa[c] != pb[c]) {
+      return pa[c] < pb[c] ? -1 : 1;
+    }
+  }
+  return 0;
+}
+
+static int CompareEdges(const void *a, const void *b) {
+  const SimplifierEdge *ea = a, *eb = b;
+  if (ea->from != eb->from) {
+    return ea->from - eb->from;
+  }
+  return ea->to - eb->to;
+}
+
+static int CompareEdgeCosts(const void *a, const void *b) {
+  double ca = ((const SimplifierEdge *)a)->cost;
+  double cb = ((const SimplifierEdge *)b)->cost;
+  return ca < cb ? -1 : ca > cb ? 1 : 0;
+}
+
+static int GetCornerPoint(const Simplifier *s, int triangle, int corner) {
+  return s->vertexPoints[s->corners[triangle * 3 + corner]];
+}
+
+static Vector3 GetTriangleNormal(Vector3 a, Vector3 b, Vector3 c) {
+  return Vector3CrossProduct(Vector3Subtract(b, a), Vector3Subtract(c, a));
+}
+
+static void WeldSimplifierPoints(Simplifier *s) {
+  const Mesh *mesh = s->mesh;
+  int *order = MemAlloc(sizeof(int) * mesh->vertexCount);
+  for (int v = 0; v < mesh->vertexCount; v++) {
+    order[v] = v;
+  }
+  sortMesh = mesh;
+  qsort(order, mesh->vertexCount, sizeof(int), CompareVertexPositions);
+
+  s->points = MemAlloc(sizeof(Vector3) * mesh->vertexCount);
+  s->vertexPoints = MemAlloc(sizeof(int) * mesh->vertexCount);
+  s->pointFirstVertex = MemAlloc(sizeof(int) * (mesh->vertexCount + 1));
+  s->pointVertices = order;
+  for (int i = 0; i < mesh->vertexCount; i++) {
+    if (i == 0 || CompareVertexPositions(&order[i - 1], &order[i]) != 0) {
+      s->pointFirstVertex[s->pointCount] = i;
+      s->points[s->pointCount++] = GetMeshVertex(mesh, order[i]);
+    }
+    s->vertexPoints[order[i]] = s->pointCount - 1;
+  }
+  s->pointFirstVertex[s->pointCount] = mesh->vertexCount;
+}
+
+// Sums the planes of the triangles into the quadrics of their points, plus a
+// plane along each open edge, perpendicular to its triangle
+static void BuildSimplifierQuadrics(Simplifier *s) {
+  s->quadrics = MemAlloc(sizeof(Quadric) * s->pointCount);
+  SimplifierEdge *edges =
+      MemAlloc(sizeof(SimplifierEdge) * s->triangleCount * 3);
+  int edgeCount = 0;
+  for (int t = 0; t < s->triangleCount; t++) {
+    int p[3] = {GetCornerPoint(s, t, 0), GetCornerPoint(s, t, 1),
+                GetCornerPoint(s, t, 2)};
+    Vector3 normal =
+        GetTriangleNormal(s->points[p[0]], s->points[p[1]], s->points[p[2]]);
+    float area = Vector3Length(normal);
+    if (area <= 0) {
+      continue;
+    }
+    normal = Vector3Scale(normal, 1.0f / area);
+    double d = -Vector3DotProduct(normal, s->points[p[0]]);
+    for (int k = 0; k < 3; k++) {
+      AddPlaneQuadric(&s->quadrics[p[k]], normal, d, 1.0);
+      int a = p[k], b = p[(k + 1) % 3];
+      edges[edgeCount++] =
+          (SimplifierEdge){a < b ? a : b, a < b ? b : a, 0, t};
+    }
+  }
+
+  // edges used by a single triangle are open
+  qsort(edges, edgeCount, sizeof(SimplifierEdge), CompareEdges);
+  for (int i = 0; i < edgeCount;) {
+    int j = i + 1;
+    while (j < edgeCount && edges[j].from == edges[i].from &&
+           edges[j].to == edges[i].to) {
+      j++;
+    }
+    if (j - i == 1) {
+      int t = edges[i].triangle;
+      Vector3 a = s->points[edges[i].from], b = s->points[edges[i].to];
+      Vector3 normal = Vector3Normalize(
+          GetTriangleNormal(s->points[GetCornerPoint(s, t, 0)],
+                            s->points[GetCornerPoint(s, t, 1)],
+                            s->points[GetCornerPoint(s, t, 2)]));
+      Vector3 edge = Vector3Subtract(b, a);
+      Vector3 side = Vector3Normalize(Vector3CrossProduct(edge, normal));
+      double d = -Vector3DotProduct(side, a);
+      AddPlaneQuadric(&s->quadrics[edges[i].from], side, d,
+                      LODGEN_BOUNDARY_WEIGHT);
+      AddPlaneQuadric(&s->quadrics[edges[i].to], side, d,
+                      LODGEN_BOUNDARY_WEIGHT);
+    }
+    i = j;
+  }
+  MemFree(edges);
+}
+
+static void BuildSimplifierAdjacency(Simplifier *s) {
+  int *counts = s->pointFirstTriangle;
+  memset(counts, 0, sizeof(int) * (s->pointCount + 1));
+  for (int t = 0; t < s->triangleCount; t++) {
+    for (int k = 0; k < 3 && !s->removed[t]; k++) {
+      counts[GetCornerPoint(s, t, k) + 1]++;
+    }
+  }
+  for (int p = 0; p < s->pointCount; p++) {
+    counts[p + 1] += counts[p];
+  }
+  int *fill = MemAlloc(sizeof(int) * (s->pointCount + 1));
+  memcpy(fill, counts, sizeof(int) * (s->pointCount + 1));
+  for (int t = 0; t < s->triangleCount; t++) {
+    for (int k = 0; k < 3 && !s->removed[t]; k++) {
+      s->pointTriangles[fill[GetCornerPoint(s, t, k)]++] = t;
+    }
+  }
+  MemFree(fill);
+}
+
+// the vertex at point p whose attributes are closest to vertex v
+static int FindMatchingVertex(const Simplifier *s, int v, int p) {
+  const Mesh *mesh = s->mesh;
+  int best = -1;
+  float bestScore = 0;
+  for (int i = s->pointFirstVertex[p]; i < s->pointFirstVertex[p + 1]; i++) {
+    int w = s->pointVertices[i];
+    float score = 0;
+    if (mesh->normals) {
+      Vector3 nv = {mesh->normals[v * 3], mesh->normals[v * 3 + 1],
+                    mesh->normals[v * 3 + 2]};
+      Vector3 nw = {mesh->normals[w * 3], mesh->normals[w * 3 + 1],
+                    mesh->normals[w * 3 + 2]};
+      score += 1.0f - Vector3DotProduct(nv, nw);
+    }
+    if (mesh->texcoords) {
+      float du = mesh->texcoords[v * 2] - mesh->texcoords[w * 2];
+      float dv = mesh->texcoords[v * 2 + 1] - mesh->texcoords[w * 2 + 1];
+      score += du * du + dv * dv;
+    }
+    if (best < 0 || score < bestScore) {
+      best = w;
+      bestScore = score;
+    }
+  }
+  return best;
+}
+
+// Checks that moving point from onto point to flips none of the triangles
+// around from that survive the collapse, and that some triangles survive
+static int CanCollapse(const Simplifier *s, int from, int to) {
+  int removedCount = 0;
+  for (int i = s->pointFirstTriangle[from]; i < s->pointFirstTriangle[from + 1];
+       i++) {
+    int t = s->pointTriangles[i];
+    Vector3 before[3], after[3];
+    int hasTo = 0;
+    for (int k = 0; k < 3; k++) {
+      int p = GetCornerPoint(s, t, k);
+      hasTo |= p == to;
+      before[k] = s->points[p];
+      after[k] = p == from ? s->points[to] : before[k];
+    }
+    if (hasTo) {
+      removedCount++;
+      continue;
+    }
+
+    Vector3 n0 = GetTriangleNormal(before[0], before[1], before[2]);
+    Vector3 n1 = GetTriangleNormal(after[0], after[1], after[2]);
+    float l0 = Vector3Length(n0), l1 = Vector3Length(n1);
+    if (l1 <= 1e-12f ||
+        Vector3DotProduct(n0, n1) < LODGEN_MIN_NORMAL_DOT * l0 * l1) {
+      return 0;
+    }
+  }
+  return removedCount < s->liveCount;
+}
+
+static void MarkTouched(const Simplifier *s, int p, char *touched) {
+  for (int i = s->pointFirstTriangle[p]; i < s->pointFirstTriangle[p + 1];
+       i++) {
+    for (int k = 0; k < 3; k++) {
+      touched[GetCornerPoint(s, s->pointTriangles[i], k)] = 1;
+    }
+  }
+}
+
+static void Collapse(Simplifier *s, int from, int to) {
+  for (int i = s->pointFirstTriangle[from]; i < s->pointFirstTriangle[from + 1];
+       i++) {
+    int t = s->pointTriangles[i];
+    int hasTo = 0;
+    for (int k = 0; k < 3; k++) {
+      hasTo |= GetCornerPoint(s, t, k) == to;
+    }
+    // a triangle with a repeated corner is listed once per corner
+    if (hasTo && !s->removed[t]) {
+      s->removed[t] = 1;
+      s->liveCount--;
+    }
+    if (hasTo) {
+      continue;
+    }
+    for (int k = 0; k < 3; k++) {
+      if (GetCornerPoint(s, t, k) == from) {
+        s->corners[t * 3 + k] =
+            FindMatchingVertex(s, s->corners[t * 3 + k], to);
+      }
+    }
+  }
+
+  for (int i = 0; i < 10; i++) {
+    s->quadrics[to].q[i] += s->quadrics[from].q[i];
+  }
+}
+
+// One round of collapses, cheapest first. Collapses don't share triangles
+// within a round, which keeps the adjacency valid; returns the collapse count.
+static int RunSimplifierPass(Simplifier *s, int targetCount) {
+  BuildSimplifierAdjacency(s);
+  SimplifierEdge *edges =
+      MemAlloc(sizeof(SimplifierEdge) * (s->liveCount * 3 + 1));
+  int edgeCount = 0;
+  for (int t = 0; t < s->triangleCount; t++) {
+    for (int k = 0; k < 3 && !s->removed[t]; k++) {
+      int a = GetCornerPoint(s, t, k), b = GetCornerPoint(s, t, (k + 1) % 3);
+      edges[edgeCount++] =
+          (SimplifierEdge){a < b ? a : b, a < b ? b : a, 0, t};
+    }
+  }
+  qsort(edges, edgeCount, sizeof(SimplifierEdge), CompareEdges);
+
+  // unique edges, collapsing towards the cheaper end
+  int uniqueCount = 0;
+  for (int i = 0; i < edgeCount; i++) {
+    if (i > 0 && CompareEdges(&edges[i - 1], &edges[i]) == 0) {
+      continue;
+    }
+    int a = edges[i].from, b = edges[i].to;
+    Quadric q = s->quadrics[a];
+    for (int c = 0; c < 10; c++) {
+      q.q[c] += s->quadrics[b].q[c];
+    }
+    double toB = GetQuadricError(&q, s->points[b]);
+    double toA = GetQuadricError(&q, s->points[a]);
+    edges[uniqueCount++] = toB <= toA ? (SimplifierEdge){a, b, toB, 0}
+                                      : (SimplifierEdge){b, a, toA, 0};
+  }
+  qsort(edges, uniqueCount, sizeof(SimplifierEdge), CompareEdgeCosts);
+
+  char *touched = MemAlloc(s->pointCount);
+  int collapses = 0;
+  for (int i = 0; i < uniqueCount && s->liveCount > targetCount &&
+                  edges[i].cost <= s->maxCost;
+       i++) {
+    int from = edges[i].from, to = edges[i].to;
+    if (touched[from] || touched[to] || !CanCollapse(s, from, to)) {
+      continue;
+    }
+
+    MarkTouched(s, from, touched);
+    MarkTouched(s, to, touched);
+    Collapse(s, from, to);
+    collapses++;
+  }
+
+  MemFree(touched);
+  MemFree(edges);
+  return collapses;
+}
+
+// Builds a mesh of the remaining triangles and the vertices they use. It is
+// indexed unless the vertices don't fit 16 bit indices.
+static Mesh BuildSimplifiedMesh(const Simplifier *s) {
+  const Mesh *source = s->mesh;
+  int *remap = MemAlloc(sizeof(int) * source->vertexCount);
+  int vertexCount = 0;
+  for (int t = 0; t < s->triangleCount; t++) {
+    for (int k = 0; k < 3 && !s->removed[t]; k++) {
+      int v = s->corners[t * 3 + k];
+      if (remap[v] == 0) {
+        remap[v] = ++vertexCount;
+      }
+    }
+  }
+
+  // the source vertex of every vertex of the new mesh
+  int indexed = vertexCount <= 65535;
+  if (!indexed) {
+    vertexCount = s->liveCount * 3;
+  }
+  int *sources = MemAlloc(sizeof(int) * (vertexCount + 1));
+  int corner = 0;
+  for (int v = 0; v < source->vertexCount && indexed; v++) {
+    if (remap[v] > 0) {
+      sources[remap[v] - 1] = v;
+    }
+  }
+  for (int t = 0; t < s->triangleCount && !indexed; t++) {
+    for (int k = 0; k < 3 && !s->removed[t]; k++) {
+      sources[corner++] = s->corners[t * 3 + k];
+    }
+  }
+
+  Mesh mesh = {.vertexCount = vertexCount, .triangleCount = s->liveCount};
+  mesh.vertices = MemAlloc(sizeof(float) * 3 * vertexCount);
+  mesh.normals =
+      source->normals ? MemAlloc(sizeof(float) * 3 * vertexCount) : 0;
+  mesh.texcoords =
+      source->texcoords ? MemAlloc(sizeof(float) * 2 * vertexCount) : 0;
+  mesh.colors = source->colors ? MemAlloc(4 * vertexCount) : 0;
+  for (int to = 0; to < vertexCount; to++) {
+    int v = sources[to];
+    memcpy(&mesh.vertices[to * 3], &source->vertices[v * 3], sizeof(float) * 3);
+    if (mesh.normals) {
+      memcpy(&mesh.normals[to * 3], &source->normals[v * 3], sizeof(float) * 3);
+    }
+    if (mesh.texcoords) {
+      memcpy(&mesh.texcoords[to * 2], &source->texcoords[v * 2],
+             sizeof(float) * 2);
+    }
+    if (mesh.colors) {
+      memcpy(&mesh.colors[to * 4], &source->colors[v * 4], 4);
+    }
+  }
+
+  if (indexed) {
+    mesh.indices = MemAlloc(sizeof(unsigned short) * 3 * s->liveCount);
+    for (int t = 0; t < s->triangleCount; t++) {
+      for (int k = 0; k < 3 && !s->removed[t]; k++) {
+        mesh.indices[corner++] = remap[s->corners[t * 3 + k]] - 1;
+      }
+    }
+  }
+
+  MemFree(sources);
+  MemFree(remap);
+  return mesh;
+}
+
+// Returns a new mesh with about targetCount triangles, or more if getting
+// there would move the surface by more than maxError of the mesh's size
+static Mesh SimplifyMesh(const Mesh *mesh, int targetCount,
+                         double maxError) {
+  Simplifier s = {.mesh = mesh, .triangleCount = mesh->triangleCount};
+  s.corners = MemAlloc(sizeof(int) * 3 * s.triangleCount);
+  for (int i = 0; i < 3 * s.triangleCount; i++) {
+    s.corners[i] = mesh->indices ? mesh->indices[i] : i;
+  }
+  s.removed = MemAlloc(s.triangleCount);
+  s.liveCount = s.triangleCount;
+  WeldSimplifierPoints(&s);
+  // triangles that are already degenerate would only get in the way
+  for (int t = 0; t < s.triangleCount; t++) {
+    int p0 = GetCornerPoint(&s, t, 0), p1 = GetCornerPoint(&s, t, 1);
+    int p2 = GetCornerPoint(&s, t, 2);
+    if (p0 == p1 || p1 == p2 || p2 == p0) {
+      s.removed[t] = 1;
+      s.liveCount--;
+    }
+  }
+  // keep a fully degenerate mesh as it is, every level needs the primitive
+  if (s.liveCount == 0) {
+    memset(s.removed, 0, s.triangleCount);
+    s.liveCount = targetCount = s.triangleCount;
+  }
+  BuildSimplifierQuadrics(&s);
+  BoundingBox bounds = GetMeshBoundingBox(*mesh);
+  maxError *= Vector3Distance(bounds.min, bounds.max);
+  s.maxCost = maxError * maxError;
+  s.pointFirstTriangle = MemAlloc(sizeof(int) * (s.pointCount + 1));
+  s.pointTriangles = MemAlloc(sizeof(int) * 3 * s.triangleCount);
+
+  if (targetCount < 1) {
+    targetCount = 1;
+  }
+  while (s.liveCount > targetCount && RunSimplifierPass(&s, targetCount) > 0) {
+  }
+  Mesh simplified = BuildSimplifiedMesh(&s);
+
+  MemFree(s.pointTriangles);
+  MemFree(s.pointFirstTriangle);
+  MemFree(s.quadrics);
+  MemFree(s.pointFirstVertex);
+  MemFree(s.pointVertices);
+  MemFree(s.vertexPoints);
+  MemFree(s.points);
+  MemFree(s.removed);
+  MemFree(s.corners);
+  return simplified;
+}
+
+// # GLB Writer Functions
+typedef struct Buffer {
+  char *data;
+  int size;
+  int capacity;
+} Buffer;
+
+static void *AppendBuffer(Buffer *buffer, const void *data, int size) {
+  if (size <= 0) {
+    return buffer->data;
+  }
+  if (buffer->size + size > buffer->capacity) {
+    while (buffer->size + size > buffer->capacity) {
+      buffer->capacity = buffer->capacity == 0 ? 4096 : buffer->capacity * 2;
+    }
+    buffer->data = realloc(buffer->data, buffer->capacity);
+  }
+  void *at = buffer->data + buffer->size;
+  if (data) {
+    memcpy(at, data, size);
+  } else {
+    memset(at, 0, size);
+  }
+  buffer->size += size;
+  return at;
+}
+
+static void AppendJson(Buffer *json, const char *text) {
+  AppendBuffer(json, text, strlen(text));
+}
+
+static void AppendJsonString(Buffer *json, const char *str) {
+  AppendJson(json, "\"");
+  for (const char *c = str ? str : ""; *c; c++) {
+    if (*c == '"' || *c == '\\') {
+      AppendJson(json, "\\");
+    }
+    if ((unsigned char)*c < 0x20) {
+      AppendJson(json, TextFormat("\\u%04x", *c));
+    } else {
+      AppendBuffer(json, c, 1);
+    }
+  }
+  AppendJson(json, "\"");
+}
+
+typedef struct GlbWriter {
+  Buffer json;     // the accessors and buffer views, joined at the end
+  Buffer views;
+  Buffer binary;
+  int accessorCount;
+} GlbWriter;
+
+// Appends data as a buffer view with one accessor over it, returns the
+// accessor index. min and max are written for positions.
+static int WriteGlbAccessor(GlbWriter *writer, const void *data, int count,
+                            int componentType, const char *type,
+                            int elementSize, int normalized,
+                            const float *bounds) {
+  while (writer->binary.size % 4) {
+    AppendBuffer(&writer->binary, 0, 1);
+  }
+  int viewIndex = writer->accessorCount;
+  AppendJson(&writer->views, viewIndex > 0 ? "," : "");
+  AppendJson(&writer->views,
+             TextFormat("{\"buffer\":0,\"byteOffset\":%d,\"byteLength\":%d}",
+                        writer->binary.size, count * elementSize));
+  AppendBuffer(&writer->binary, data, count * elementSize);
+
+  AppendJson(&writer->json, viewIndex > 0 ? "," : "");
+  AppendJson(&writer->json,
+             TextFormat("{\"bufferView\":%d,\"componentType\":%d,"
+                        "\"count\":%d,\"type\":\"%s\"%s",
+                        viewIndex, componentType, count, type,
+                        normalized ? ",\"normalized\":true" : ""));
+  if (bounds) {
+    AppendJson(&writer->json,
+               TextFormat(",\"min\":[%.9g,%.9g,%.9g],\"max\":[%.9g,%.9g,%.9g]",
+                          bounds[0], bounds[1], bounds[2], bounds[3],
+                          bounds[4], bounds[5]));
+  }
+  AppendJson(&writer->json, "}");
+  return writer->accessorCount++;
+}
+
+static void WriteGlbPrimitive(GlbWriter *writer, Buffer *meshes,
+                              const Mesh *mesh) {
+  BoundingBox box = GetMeshBoundingBox(*mesh);
+  float bounds[6] = {box.min.x, box.min.y, box.min.z,
+                     box.max.x, box.max.y, box.max.z};
+  int position = WriteGlbAccessor(writer, mesh->vertices, mesh->vertexCount,
+                                  5126, "VEC3", 12, 0, bounds);
+  AppendJson(meshes, TextFormat("{\"attributes\":{\"POSITION\":%d", position));
+  if (mesh->normals) {
+    int normal = WriteGlbAccessor(writer, mesh->normals, mesh->vertexCount,
+                                  5126, "VEC3", 12, 0, 0);
+    AppendJson(meshes, TextFormat(",\"NORMAL\":%d", normal));
+  }
+  if (mesh->texcoords) {
+    int texcoord = WriteGlbAccessor(writer, mesh->texcoords, mesh->vertexCount,
+                                    5126, "VEC2", 8, 0, 0);
+    AppendJson(meshes, TextFormat(",\"TEXCOORD_0\":%d", texcoord));
+  }
+  if (mesh->colors) {
+    int color = WriteGlbAccessor(writer, mesh->colors, mesh->vertexCount, 5121,
+                                 "VEC4", 4, 1, 0);
+    AppendJson(meshes, TextFormat(",\"COLOR_0\":%d", color));
+  }
+  AppendJson(meshes, "}");
+  if (mesh->indices) {
+    int indices = WriteGlbAccessor(writer, mesh->indices,
+                                   mesh->triangleCount * 3, 5123, "SCALAR", 2,
+                                   0, 0);
+    AppendJson(meshes, TextFormat(",\"indices\":%d", indices));
+  }
+  AppendJson(meshes, "}");
+}
+
+static void WriteGlbNodes(Buffer *json, const GLTFDocument *document) {
+  AppendJson(json, ",\"nodes\":[");
+  for (int n = 0; n < document->nodeCount; n++) {
+    const GLTFNode *node = &document->nodes[n];
+    AppendJson(json, n > 0 ? ",{\"name\":" : "{\"name\":");
+    AppendJsonString(json, node->name);
+    if (node->mesh >= 0) {
+      AppendJson(json, TextFormat(",\"mesh\":%d", node->mesh));
+    }
+    AppendJson(json,
+               TextFormat(",\"translation\":[%.9g,%.9g,%.9g]"
+                          ",\"rotation\":[%.9g,%.9g,%.9g,%.9g]",
+                          node->translation.x, node->translation.y,
+                          node->translation.z, node->rotation.x,
+                          node->rotation.y, node->rotation.z,
+                          node->rotation.w));
+    AppendJson(json, TextFormat(",\"scale\":[%.9g,%.9g,%.9g]", node->scale.x,
+                                node->scale.y, node->scale.z));
+    int childCount = 0;
+    for (int c = 0; c < document->nodeCount; c++) {
+      if (document->nodes[c].parent == n) {
+        AppendJson(json, childCount++ > 0 ? "," : ",\"children\":[");
+        AppendJson(json, TextFormat("%d", c));
+      }
+    }
+    AppendJson(json, childCount > 0 ? "]}" : "}");
+  }
+  AppendJson(json, "],\"scene\":0,\"scenes\":[{\"nodes\":[");
+  for (int r = 0; r < document->rootNodeCount; r++) {
+    AppendJson(json, TextFormat(r > 0 ? ",%d" : "%d", document->rootNodes[r]));
+  }
+  AppendJson(json, "]}]");
+}
+
+// Writes the document's hierarchy with the given primitives, one array per
+// mesh in document order
+static int SaveGlb(const char *fileName, const GLTFDocument *document,
+                   Mesh **primitives) {
+  GlbWriter writer = {0};
+  Buffer meshes = {0};
+  for (int m = 0; m < document->meshCount; m++) {
+    AppendJson(&meshes, m > 0 ? ",{\"name\":" : "{\"name\":");
+    AppendJsonString(&meshes, document->meshes[m].name);
+    AppendJson(&meshes, ",\"primitives\":[");
+    for (int i = 0; i < document->meshes[m].primitiveCount; i++) {
+      AppendJson(&meshes, i > 0 ? "," : "");
+      WriteGlbPrimitive(&writer, &meshes, &primitives[m][i]);
+    }
+    AppendJson(&meshes, "]}");
+  }
+
+  Buffer json = {0};
+  AppendJson(&json,
+             "{\"asset\":{\"version\":\"2.0\",\"generator\":\"lodgen\"}");
+  WriteGlbNodes(&json, document);
+  AppendJson(&json, ",\"meshes\":[");
+  AppendBuffer(&json, meshes.data, meshes.size);
+  AppendJson(&json, "],\"accessors\":[");
+  AppendBuffer(&json, writer.json.data, writer.json.size);
+  AppendJson(&json, "],\"bufferViews\":[");
+  AppendBuffer(&json, writer.views.data, writer.views.size);
+  AppendJson(&json, TextFormat("],\"buffers\":[{\"byteLength\":%d}]}",
+                               writer.binary.size));
+  while (json.size % 4) {
+    AppendJson(&json, " ");
+  }
+  while (writer.binary.size % 4) {
+    AppendBuffer(&writer.binary, 0, 1);
+  }
+
+  // header, JSON chunk, binary chunk; all little endian
+  unsigned int header[5] = {0x46546c67, 2,
+                            12 + 8 + json.size + 8 + writer.binary.size,
+                            json.size, 0x4e4f534a};
+  unsigned int binaryHeader[2] = {writer.binary.size, 0x004e4942};
+  Buffer file = {0};
+  AppendBuffer(&file, header, sizeof(header));
+  AppendBuffer(&file, json.data, json.size);
+  AppendBuffer(&file, binaryHeader, sizeof(binaryHeader));
+  AppendBuffer(&file, writer.binary.data, writer.binary.size);
+  int saved = SaveFileData(fileName, file.data, file.size);
+
+  free(file.data);
+  free(json.data);
+  free(meshes.data);
+  free(writer.json.data);
+  free(writer.views.data);
+  free(writer.binary.data);
+  return saved;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    printf("usage: %s file.glb [ratio ...]\n", argv[0]);
+    return 1;
+  }
+
+  float ratios[LODGEN_MAX_LEVELS] = {0.5f, 0.2f, 0.05f};
+  int levelCount = 3;
+  if (argc > 2) {
+    levelCount = 0;
+    for (int i = 2; i < argc && levelCount < LODGEN_MAX_LEVELS; i++) {
+      ratios[levelCount++] = (float)atof(argv[i]);
+    }
+  }
+
+  GLTFDocument document;
+  if (!LoadGLTFDocument(argv[1], &document)) {
+    printf("lodgen: failed to load %s\n", argv[1]);
+    return 1;
+  }
+
+  const char *fileName = argv[1];
+  const char *separator = strrchr(fileName, '/');
+  const char *extension = strrchr(separator ? separator : fileName, '.');
+  int baseLength = extension ? extension - fileName : (int)strlen(fileName);
+  Mesh **primitives = MemAlloc(sizeof(Mesh *) * (document.meshCount + 1));
+  int failed = 0;
+  for (int level = 0; level < levelCount; level++) {
+    long sourceCount = 0, simplifiedCount = 0;
+    for (int m = 0; m < document.meshCount; m++) {
+      GLTFMesh *mesh = &document.meshes[m];
+      primitives[m] = MemAlloc(sizeof(Mesh) * (mesh->primitiveCount + 1));
+      for (int i = 0; i < mesh->primitiveCount; i++) {
+        Mesh *source = &mesh->primitives[i];
+        primitives[m][i] =
+            SimplifyMesh(source, (int)(source->triangleCount * ratios[level]),
+                         LODGEN_MAX_ERROR * (1 << level));
+        sourceCount += source->triangleCount;
+        simplifiedCount += primitives[m][i].triangleCount;
+      }
+    }
+
+    char lodName[512];
+    snprintf(lodName, sizeof(lodName), "%.*s.lod%d.glb", baseLength, fileName,
+             level + 1);
+    int saved = SaveGlb(lodName, &document, primitives);
+    failed |= !saved;
+    printf("lodgen: %s, %ld of %ld triangles%s\n", lodName, simplifiedCount,
+           sourceCount, saved ? "" : ", failed to save");
+
+    for (int m = 0; m < document.meshCount; m++) {
+      for (int i = 0; i < document.meshes[m].primitiveCount; i++) {
+        Mesh *mesh = &primitives[m][i];
+        MemFree(mesh->vertices);
+        MemFree(mesh->normals);
+        MemFree(mesh->texcoords);
+        MemFree(mesh->colors);
+        MemFree(mesh->indices);
+      }
+      MemFree(primitives[m]);
+    }
+  }
+
+  MemFree(primitives);
+  UnloadGLTFDocument(&document);
+  return failed;
+}
@@ -0,0 +1,115 @@
+/*
+Checks ray packets against single rays.
+
+  raycheck [file.glb] [count] [seed]
+
+Loads the collision meshes of the file (assets/colliders.glb by default) like
+collision_init_gltf and casts count random packets (1000 by default) of
+nearby rays aimed into the meshes, each with collision_raycast_packet and ray
+by ray with collision_check_mesh_raycast. Packets hold a random number of
+rays, so the padding lanes are exercised as well. Prints how many rays
+disagreed on whether or where they hit; exits with 1 if any did.
+*/
+
+#include "../src/collision.h"
+#include <math.h>
+#include <raylib.h>
+#include <raymath.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static float GetCheckRandom(unsigned int *state, float min, float max) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return min + (max - min) * (float)(*state >> 8) / (float)(1 << 24);
+}
+
+static Vector3 GetCheckRandomPoint(unsigned int *state, BoundingBox box) {
+  return (Vector3){GetCheckRandom(state, box.min.x, box.max.x),
+                   GetCheckRandom(state, box.min.y, box.max.y),
+                   GetCheckRandom(state, box.min.z, box.max.z)};
+}
+
+// Both casts walk the same triangles with the same arithmetic, so a hit
+// should only differ in the last bits of its distance
+static bool AreHitsEqual(RayCollision a, RayCollision b) {
+  if (a.hit != b.hit) {
+    return false;
+  }
+  return !a.hit ||
+         fabsf(a.distance - b.distance) <= 1e-5f * fmaxf(1.0f, a.distance);
+}
+
+int main(int argc, char **argv) {
+  if (argc > 4) {
+    printf("usage: %s [file.glb] [count] [seed]\n", argv[0]);
+    return 1;
+  }
+
+  const char *fileName = argc > 1 ? argv[1] : "./assets/colliders.glb";
+  unsigned long count = argc > 2 ? strtoul(argv[2], 0, 10) : 1000;
+  unsigned int state = argc > 3 ? (unsigned int)strtoul(argv[3], 0, 10) : 1;
+  state = state ? state : 1;
+
+  CollisionSystem collisionSystem = {0};
+  if (!collision_init_gltf(&collisionSystem, fileName, MatrixIdentity()) ||
+      collisionSystem.meshCount == 0) {
+    printf("raycheck: failed to load %s\n", fileName);
+    return 1;
+  }
+
+  // Origins come from around all meshes, targets from within one of them
+  BoundingBox bounds = collisionSystem.meshes[0].bbox;
+  for (int i = 1; i < collisionSystem.meshCount; i++) {
+    bounds.min = Vector3Min(bounds.min, collisionSystem.meshes[i].bbox.min);
+    bounds.max = Vector3Max(bounds.max, collisionSystem.meshes[i].bbox.max);
+  }
+  Vector3 margin = {2.0f, 2.0f, 2.0f};
+  bounds.min = Vector3Subtract(bounds.min, margin);
+  bounds.max = Vector3Add(bounds.max, margin);
+  float diagonal = Vector3Distance(bounds.min, bounds.max);
+
+  unsigned long rayTotal = 0, hitTotal = 0, mismatches = 0;
+  for (unsigned long p = 0; p < count; p++) {
+    int rayCount = 1 + (int)GetCheckRandom(&state, 0, COLLISION_PACKET_SIZE);
+    int meshIndex =
+        (int)GetCheckRandom(&state, 0, (float)collisionSystem.meshCount);
+    Vector3 origin = GetCheckRandomPoint(&state, bounds);
+    Vector3 target =
+        GetCheckRandomPoint(&state, collisionSystem.meshes[meshIndex].bbox);
+    Vector3 direction = Vector3Normalize(Vector3Subtract(target, origin));
+    float distance = GetCheckRandom(&state, 0.1f, diagonal);
+
+    Ray rays[COLLISION_PACKET_SIZE];
+    for (int i = 0; i < rayCount; i++) {
+      Vector3 offset = {GetCheckRandom(&state, -0.5f, 0.5f),
+                        GetCheckRandom(&state, -0.5f, 0.5f),
+                        GetCheckRandom(&state, -0.5f, 0.5f)};
+      Vector3 spread = {GetCheckRandom(&state, -0.1f, 0.1f),
+                        GetCheckRandom(&state, -0.1f, 0.1f),
+                        GetCheckRandom(&state, -0.1f, 0.1f)};
+      rays[i] = (Ray){Vector3Add(origin, offset),
+                      Vector3Normalize(Vector3Add(direction, spread))};
+    }
+
+    RayCollision hits[COLLISION_PACKET_SIZE];
+    collision_raycast_packet(&collisionSystem, rays, rayCount, distance,
+                             hits);
+    for (int i = 0; i < rayCount; i++) {
+      RayCollision expected;
+      collision_check_mesh_raycast(&collisionSystem, rays[i].position,
+                                   rays[i].direction, distance, &expected);
+      hitTotal += expected.hit;
+      if (!AreHitsEqual(hits[i], expected)) {
+        mismatches++;
+      }
+    }
+    rayTotal += rayCount;
+  }
+
+  printf("raycheck: %lu of %lu rays differ, %lu rays hit\n", mismatches,
+         rayTotal, hitTotal);
+  collision_cleanup(&collisionSystem);
+  return mismatches != 0;
+}